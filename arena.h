@@ -0,0 +1,230 @@
+//symbolic constants used by arenas
+//
+//an arena hands out memory from a list of chunks by bumping an offset, and
+//takes it all back at once.  nothing drawn from an arena is freed on its
+//own:  rewinding to a mark returns everything drawn since the mark and
+//resetting returns everything, both in constant time, keeping the chunks
+//for whatever is drawn next.  arenas given back with arena_give wait in a
+//pool shared by every thread until arena_take hands them out again, so
+//building and freeing the same things over and over allocates nothing once
+//the pool holds enough chunks
+//
+//arenas do not lock, an arena is only used by one thread at a time
+
+//bytes of the smallest chunk
+#define ARENA_CHUNK_SIZE 4096
+
+//alignment of everything drawn from an arena
+#define ARENA_ALIGN 16
+
+//most arenas kept in the pool, further ones given back are freed
+#define ARENA_POOL_MAX 64
+
+//a chunk of an arena
+//
+//the size bytes handed out follow the chunk header, which is padded to
+//ARENA_ALIGN bytes
+typedef struct _arena_chunk{
+   struct _arena_chunk *next; //the chunk drawn from after this one
+   gsize size;                //bytes after the header
+} arena_chunk;
+
+//an arena
+//
+//chunks is the first chunk and chunk the one being drawn from, used bytes
+//of it being handed out already.  the chunks before chunk are full, the
+//ones after it are waiting to be drawn from again.  next links the arenas
+//in the pool
+//
+//arenas must be freed with arena_free or given back with arena_give
+typedef struct _arena{
+   arena_chunk *chunks; //the first chunk, NULL until anything is drawn
+   arena_chunk *chunk;  //the chunk being drawn from
+   gsize used;          //bytes of chunk handed out
+   gsize chunk_size;    //bytes of the smallest chunk
+   struct _arena *next; //the next arena in the pool
+} arena;
+
+//a point of an arena to rewind to
+typedef struct _arena_mark{
+   arena_chunk *chunk; //the chunk being drawn from
+   gsize used;         //bytes of chunk handed out
+} arena_mark;
+
+//the arenas given back, their number and the lock guarding both
+//global for convinience purposes
+arena *arena_pool = NULL;
+guint arena_pool_length = 0;
+GMutex arena_pool_lock;
+
+
+/****
+ *arena functions
+ ****/
+
+//returns an empty arena drawing chunks of at least chunk_size bytes
+arena *arena_new(gsize chunk_size);
+
+//frees a and all of its chunks, and with them everything drawn from a
+void arena_free(arena *a);
+
+//returns size bytes drawn from a, aligned to ARENA_ALIGN
+//a new chunk is only allocated when none of the chunks left has room
+gpointer arena_alloc(arena *a, gsize size);
+
+//same as arena_alloc but the bytes are zeroed
+gpointer arena_alloc0(arena *a, gsize size);
+
+//returns the point of a everything drawn next follows
+arena_mark arena_get_mark(arena *a);
+
+//returns everything drawn from a since mark
+void arena_rewind(arena *a, arena_mark mark);
+
+//returns everything drawn from a
+void arena_reset(arena *a);
+
+//returns an arena from the pool, reset, or a new one if the pool is empty.
+//chunk_size is only used for new arenas
+arena *arena_take(gsize chunk_size);
+
+//resets a and puts it in the pool, or frees it if the pool is full
+void arena_give(arena *a);
+
+//returns the bytes taken by the header of a chunk
+gsize arena_chunk_header(void);
+
+/********/
+
+arena *arena_new(gsize chunk_size){
+   arena *new_arena = g_new(arena, 1);
+
+   new_arena->chunks = NULL;
+   new_arena->chunk = NULL;
+   new_arena->used = 0;
+   new_arena->chunk_size = MAX(chunk_size, ARENA_ALIGN);
+   new_arena->next = NULL;
+
+   return(new_arena);
+}
+
+void arena_free(arena *a){
+   arena_chunk *chunk = a->chunks;
+
+   while(chunk != NULL){
+      arena_chunk *next = chunk->next;
+
+      g_free(chunk);
+
+      chunk = next;
+   }
+
+   g_free(a);
+}
+
+gpointer arena_alloc(arena *a, gsize size){
+   size = (size + ARENA_ALIGN - 1) & ~((gsize) ARENA_ALIGN - 1);
+
+   if(a->chunk != NULL && a->used + size <= a->chunk->size){
+      gpointer block = (guint8 *) a->chunk + arena_chunk_header() + a->used;
+
+      a->used += size;
+
+      return(block);
+   }
+
+   //the chunks after the current one are empty, the next one is reused if
+   //it has room and a new one goes in front of it otherwise
+   arena_chunk *next = a->chunk != NULL?a->chunk->next:a->chunks;
+
+   if(next == NULL || next->size < size){
+      arena_chunk *chunk = g_malloc(arena_chunk_header() +
+         MAX(size, a->chunk_size));
+
+      chunk->size = MAX(size, a->chunk_size);
+      chunk->next = next;
+
+      if(a->chunk != NULL){
+         a->chunk->next = chunk;
+      }else{
+         a->chunks = chunk;
+      }
+
+      next = chunk;
+   }
+
+   a->chunk = next;
+   a->used = size;
+
+   return((guint8 *) next + arena_chunk_header());
+}
+
+gpointer arena_alloc0(arena *a, gsize size){
+   gpointer block = arena_alloc(a, size);
+
+   memset(block, 0, size);
+
+   return(block);
+}
+
+arena_mark arena_get_mark(arena *a){
+   arena_mark mark = {a->chunk, a->used};
+
+   return(mark);
+}
+
+void arena_rewind(arena *a, arena_mark mark){
+   a->chunk = mark.chunk;
+   a->used = mark.used;
+}
+
+void arena_reset(arena *a){
+   a->chunk = NULL;
+   a->used = 0;
+}
+
+arena *arena_take(gsize chunk_size){
+   g_mutex_lock(&arena_pool_lock);
+
+   arena *taken = arena_pool;
+
+   if(taken != NULL){
+      arena_pool = taken->next;
+      arena_pool_length--;
+   }
+
+   g_mutex_unlock(&arena_pool_lock);
+
+   if(taken == NULL){
+      return(arena_new(chunk_size));
+   }
+
+   taken->next = NULL;
+
+   return(taken);
+}
+
+void arena_give(arena *a){
+   arena_reset(a);
+
+   g_mutex_lock(&arena_pool_lock);
+
+   if(arena_pool_length < ARENA_POOL_MAX){
+      a->next = arena_pool;
+      arena_pool = a;
+      arena_pool_length++;
+
+      a = NULL;
+   }
+
+   g_mutex_unlock(&arena_pool_lock);
+
+   if(a != NULL){
+      arena_free(a);
+   }
+}
+
+gsize arena_chunk_header(void){
+   return((sizeof(arena_chunk) + ARENA_ALIGN - 1) &
+      ~((gsize) ARENA_ALIGN - 1));
+}
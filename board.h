@@ -1,5 +1,13 @@
 //symbolic constants used with board and board_cell
 
+//when SNAFU_HEADLESS is defined boards are built against glib alone:  
+//widgets are opaque, nothing is drawn and the drawing functions only 
+//forget the changed cells
+#ifdef SNAFU_HEADLESS
+typedef struct _GtkWidget GtkWidget;
+typedef struct _cairo_surface cairo_surface_t;
+#endif
+
 //masks used to isolate the individual components of a board_cell
 #define BOARD_CELL_FLAGS_MASK 0xff000000
 #define BOARD_CELL_RED_MASK 0x00ff0000
@@ -10,6 +18,98 @@
 //coordinate is out of bounds on a board
 #define BOARD_CELL_OUT_OF_BOUNDS 0xffffffff
 
+//the flags of the board_cells of static walls, see board_walls_add
+#define BOARD_WALL_FLAGS 0x80
+
+//the character marking a wall cell in level files
+#define BOARD_WALL_CHAR '#'
+
+//the seed the zobrist keys of every board are drawn from, so the keys of 
+//cell i are the same on every board and hashes of boards alike are equal
+#define BOARD_ZOBRIST_SEED G_GUINT64_CONSTANT(0x5eed5a7f0b0a4d11)
+
+//storage formats for the grid of a board
+//BOARD_STORAGE_DENSE stores every board_cell as is in brd->cells
+//BOARD_STORAGE_PALETTE8 and BOARD_STORAGE_PALETTE16 store every cell as an
+//index into brd->palette, which holds each distinct board_cell on the board
+#define BOARD_STORAGE_DENSE 0
+#define BOARD_STORAGE_PALETTE8 1
+#define BOARD_STORAGE_PALETTE16 2
+//BOARD_STORAGE_TILED splits the grid into square tiles of board_cells which 
+//are only allocated once a cell in them is set to something other than the
+//background_color, so memory and clearing scale with the occupied area
+#define BOARD_STORAGE_TILED 3
+
+//tiles of BOARD_STORAGE_TILED are BOARD_TILE_SIZE cells on a side
+#define BOARD_TILE_SHIFT 6
+#define BOARD_TILE_SIZE (1 << BOARD_TILE_SHIFT)
+#define BOARD_TILE_MASK (BOARD_TILE_SIZE - 1)
+
+//the finest level of the occupancy summary counts the occupied cells of
+//square blocks of BOARD_SUMMARY_SIZE cells on a side
+#define BOARD_SUMMARY_SHIFT 3
+#define BOARD_SUMMARY_SIZE (1 << BOARD_SUMMARY_SHIFT)
+
+//shapes of boards which have kernels of their own
+//BOARD_SHAPE_POW2 boards are a power of two cells wide and split cell 
+//indices into coordinates with a shift and a mask, BOARD_SHAPE_DEFAULT 
+//boards are BOARD_SHAPE_DEFAULT_WIDTH cells wide, the size of the default 
+//game, and divide by a constant.  BOARD_SHAPE_GENERIC boards divide by 
+//their width
+#define BOARD_SHAPE_GENERIC 0
+#define BOARD_SHAPE_POW2 1
+#define BOARD_SHAPE_DEFAULT 2
+#define BOARD_SHAPE_DEFAULT_WIDTH 45
+
+//the index of cell (x, y) in the grid, wide enough for boards of more than 
+//G_MAXINT cells
+#define BOARD_INDEX(brd, x, y) (((gint64)(brd)->width * (y)) + (x))
+
+//the column and row of cell i of brd for each shape
+#define BOARD_X_GENERIC(brd, i) ((i) % (brd)->width)
+#define BOARD_Y_GENERIC(brd, i) ((i) / (brd)->width)
+#define BOARD_X_POW2(brd, i) ((i) & ((brd)->width - 1))
+#define BOARD_Y_POW2(brd, i) ((i) >> (brd)->width_shift)
+#define BOARD_X_DEFAULT(brd, i) ((i) % BOARD_SHAPE_DEFAULT_WIDTH)
+#define BOARD_Y_DEFAULT(brd, i) ((i) / BOARD_SHAPE_DEFAULT_WIDTH)
+
+//the column and row of cell i of brd whatever its shape
+#define BOARD_X(brd, i) ((brd)->shape == BOARD_SHAPE_POW2?BOARD_X_POW2(brd, i):\
+   (brd)->shape == BOARD_SHAPE_DEFAULT?BOARD_X_DEFAULT(brd, i):\
+   BOARD_X_GENERIC(brd, i))
+#define BOARD_Y(brd, i) ((brd)->shape == BOARD_SHAPE_POW2?BOARD_Y_POW2(brd, i):\
+   (brd)->shape == BOARD_SHAPE_DEFAULT?BOARD_Y_DEFAULT(brd, i):\
+   BOARD_Y_GENERIC(brd, i))
+
+//expands kernel(shape, X, Y) once for every shape, with the name of the 
+//shape and the macros splitting its cell indices, to declare or define a
+//variant of a kernel per shape
+#define BOARD_KERNELS(kernel) \
+   kernel(generic, BOARD_X_GENERIC, BOARD_Y_GENERIC) \
+   kernel(pow2, BOARD_X_POW2, BOARD_Y_POW2) \
+   kernel(default, BOARD_X_DEFAULT, BOARD_Y_DEFAULT)
+
+//calls the variant of kernel for the shape of brd with the parenthesized 
+//arguments
+#define BOARD_KERNEL_CALL(brd, kernel, arguments) \
+   ((brd)->shape == BOARD_SHAPE_POW2?kernel##_pow2 arguments:\
+   (brd)->shape == BOARD_SHAPE_DEFAULT?kernel##_default arguments:\
+   kernel##_generic arguments)
+
+//limits of the zoom of a board's view
+//cells are never drawn larger than BOARD_VIEW_CELL_MAX pixels and never more
+//than 1 << BOARD_VIEW_LOD_MAX cells on a side share a pixel
+#define BOARD_VIEW_CELL_MAX 64
+#define BOARD_VIEW_LOD_MAX 16
+
+//masks used to isolate the components of a palette cell
+//the occupied bit is set when the board_cell at the palette index has flags, 
+//so occupancy never needs to look at the palette
+#define BOARD_PALETTE8_OCCUPIED_MASK 0x80
+#define BOARD_PALETTE8_INDEX_MASK 0x7f
+#define BOARD_PALETTE16_OCCUPIED_MASK 0x8000
+#define BOARD_PALETTE16_INDEX_MASK 0x7fff
+
 ////////////
 //typedefs//
 ////////////
@@ -42,27 +142,128 @@ typedef guint32 board_cell;
 //width and height
 //boards can be drawn using various functions.  drawing occurs on 
 //widget.  when a cell is cleared it is drawn with background_color
-//to facilitate faster drawing, changed_cells is a colon-delimited 
-//gchar* of indices to cells, which are redrawn selectively by an 
-//incremental drawing function
+//to facilitate faster drawing, changed_cells is a GArray of the gint64 
+//indices ((width * y) + x) of changed cells, which are redrawn selectively 
+//by an incremental drawing function.  it is also the change set of the board
+//for anything else which follows the board, such as network clients
+//a board without a widget is never drawn
+//
+//storage is one of the BOARD_STORAGE_* formats.  only the grid for the 
+//current storage is allocated, the others are NULL.  palette holds 
+//palette_length distinct board_cells, palette[0] always being the 
+//background_color.  palettes are never shrunk except by board_set_storage.
+//palette_indices maps every board_cell of palette to its index plus 1, so
+//writes find their index without searching the palette
+//
+//the view is the part of the board drawn on widget:  view_width by 
+//view_height pixels with cell (view_x, view_y) in the top left corner.  
+//cell_width and cell_height are the zoom of the view.  once cells are 
+//zoomed out to a single pixel, lod_shift counts further zoom out steps, 
+//every pixel then standing for a square of 1 << lod_shift cells on a side
+//which is drawn from the occupancy summary instead of the cells.  zoom
+//counts the steps zoomed in from base_cell_width by base_cell_height
+//pixels, the size of the cells the board was made with, negative when
+//zoomed out, so zooming back always returns to that size
+//
+//summary is a pyramid of summary_levels occupancy levels, level k being 
+//summary_across[k] by summary_down[k] guint8s for blocks of 
+//BOARD_SUMMARY_SIZE << k cells on a side.  level 0 counts the occupied 
+//cells of its blocks, higher levels count the non-empty blocks of the level 
+//below.  the summary is kept up to date by every write to the grid
+//
+//rays hold a bit for every cell of every row and then of every column, set
+//for occupied cells, row_words and column_words guint64s to a line.  
+//rays_summary holds a bit for every guint64 of rays which is not zero, 
+//row_summary_words and column_summary_words to a line, so the nearest 
+//occupied cell along a line is found a word at a time.  rays are only kept
+//once board_rays_alloc is called and are NULL otherwise
+//
+//walls holds a bit for every cell of the static layer loaded from a level, 
+//and wall_cells the gint64 indices of those cells.  wall cells hold 
+//wall_color in the grid like any occupied cell and are written back by 
+//board_clear, so they never cost more than an empty board to check.  
+//walls_surface is the background_color and the walls rendered once, a 
+//pixel to a cell, painted by board_draw before the cells which differ from 
+//it.  walls is NULL on boards without walls and walls_surface until drawn
 //
-//changed_cells is an alocated string and must be freed with g_free
-//boards must be freed with board_free.  board_free also frees changed_cells
+//zobrist holds a random guint64 key for every cell and hash is the xor of
+//the keys of the occupied cells, updated by every write which fills or 
+//empties a cell, so positions are told apart without looking at the grid.
+//the hash is only kept once board_hash_alloc is called and zobrist is NULL
+//otherwise
+//
+//shape is the BOARD_SHAPE_* picking the kernels of the board and 
+//width_shift the log2 of a BOARD_SHAPE_POW2 width.  shape may be set to 
+//BOARD_SHAPE_GENERIC to use the kernels which divide on any board
+//
+//tiles is an array of tiles_across * tiles_down tiles for 
+//BOARD_STORAGE_TILED, a NULL tile reads as the background_color.  
+//tiles_used holds the gint numbers of the allocated tiles and tile_pool 
+//keeps the tiles released by board_clear for reuse
+//
+//boards must be freed with board_free.  board_free also frees changed_cells,
+//the grids and the palette
 typedef struct _board {
    gint height;  //height of grid
    gint width;   //width of grid
+   gint shape;       //the BOARD_SHAPE_* of the grid
+   gint width_shift; //log2 of width for BOARD_SHAPE_POW2
    
    gint cell_height; //height in pixels of an individual cell
    gint cell_width;  //width in pixels of an individual cell
+
+   gint view_x;      //the leftmost cell drawn
+   gint view_y;      //the topmost cell drawn
+   gint view_width;  //width in pixels of the view
+   gint view_height; //height in pixels of the view
+   gint lod_shift;   //how far the view is zoomed out past one pixel per cell
+   gint zoom;        //steps zoomed in from the base cell size
+   gint base_cell_width;  //width in pixels of a cell at zoom 0
+   gint base_cell_height; //height in pixels of a cell at zoom 0
+
+   guint8 **summary;     //the occupancy summary levels
+   gint *summary_across; //width of each summary level
+   gint *summary_down;   //height of each summary level
+   gint summary_levels;  //number of summary levels
+
+   guint64 *rays;          //occupancy bits of the rows and columns
+   guint64 *rays_summary;  //bits of the words of rays which are not zero
+   gint row_words;         //words of rays to a row
+   gint column_words;      //words of rays to a column
+   gint row_summary_words;    //words of rays_summary to a row
+   gint column_summary_words; //words of rays_summary to a column
+
+   guint64 *walls;         //a bit for every wall cell
+   GArray *wall_cells;     //indices of the wall cells
+   board_cell wall_color;  //the board_cell of wall cells
+   cairo_surface_t *walls_surface; //the background and walls as drawn
+
+   guint64 *zobrist; //the key of every cell
+   guint64 hash;     //xor of the keys of the occupied cells
    
    GtkWidget *widget; //the widget to use to draw on
  
+   gint storage; //the BOARD_STORAGE_* format of the grid
+
    board_cell *cells; //the grid of cells
+   guint8 *cells8;    //the grid of palette indices for BOARD_STORAGE_PALETTE8
+   guint16 *cells16;  //the grid of palette indices for BOARD_STORAGE_PALETTE16
+
+   board_cell *palette;    //the board_cells indexed by cells8 and cells16
+   guint palette_length;   //number of board_cells in palette
+   guint palette_capacity; //number of board_cells allocated for palette
+   GHashTable *palette_indices; //index plus 1 of every board_cell of palette
+
+   board_cell **tiles;   //the grid of tiles for BOARD_STORAGE_TILED
+   gint tiles_across;    //number of tiles in a row of the grid
+   gint tiles_down;      //number of tiles in a column of the grid
+   GArray *tiles_used;   //numbers of the allocated tiles
+   GPtrArray *tile_pool; //released tiles waiting to be reused
 
    board_cell background_color; //the color to set cleared cells to
 
-   gchar *changed_cells; //a colon delimited list of cells 
-                         //to facilitate faster drawing
+   GArray *changed_cells; //indices of the cells changed since the last draw
+                          //to facilitate faster drawing
 } board;
 
 
@@ -100,10 +301,168 @@ void board_cell_get_rgb(board_cell cell, gfloat *r, gfloat *g, gfloat *b);
 //accepts x and y coordinates and returns true if the coordinates are 
 //within the bounds of brd
 gboolean board_check_coords_in_bounds(board *brd, gint x, gint y);
+
+//returns the index into brd->palette of value, adding value to the palette
+//if it is not yet there
+guint board_palette_lookup(board *brd, board_cell value);
+
+//returns a copy of the board_cell at index i of the grid, whatever the storage
+//i is BOARD_INDEX(brd, x, y) and is not bounds checked
+board_cell board_read_cell(board *brd, gint64 i);
+
+//returns only the flags of the board_cell at index i of the grid
+//for palette storage, empty cells are answered without touching the palette
+board_cell board_read_cell_flags(board *brd, gint64 i);
+
+//same as board_read_cell and board_read_cell_flags with the coordinates 
+//(x, y) of cell i already known, so tiled storage divides nothing
+board_cell board_read_cell_xy(board *brd, gint64 i, gint x, gint y);
+board_cell board_read_cell_flags_xy(board *brd, gint64 i, gint x, gint y);
+
+//writes value to index i of the grid, whatever the storage
+//if the palette of a palette storage runs out of indices, the board is 
+//converted to the next larger storage first
+//i is not bounds checked and the cell is not marked changed
+void board_write_cell(board *brd, gint64 i, board_cell value);
+
+//same as board_write_cell with the coordinates (x, y) of cell i already 
+//known, so nothing is divided
+void board_write_cell_xy(board *brd, gint64 i, gint x, gint y, 
+   board_cell value);
+
+//the variants of board_write_cell for every shape
+#define BOARD_DECLARE_WRITE_CELL(shape, X, Y) \
+   void board_write_cell_##shape(board *brd, gint64 i, board_cell value);
+BOARD_KERNELS(BOARD_DECLARE_WRITE_CELL)
+
+//returns the BOARD_SHAPE_* of boards width cells wide, setting shift to the
+//log2 of width for BOARD_SHAPE_POW2
+gint board_shape_of(gint width, gint *shift);
+
+//same as board_write_cell_xy however the summary is not updated
+void board_write_cell_storage(board *brd, gint64 i, gint x, gint y, 
+   board_cell value);
+
+//converts the grid of brd to storage, keeping every board_cell
+//returns FALSE and leaves brd untouched if the board holds too many 
+//distinct board_cells for the palette of storage
+//the conversion goes through a temporary dense copy of the grid
+gboolean board_set_storage(board *brd, gint storage);
+
+//allocates the grid of brd for brd->storage
+//the contents of the grid are undefined until the board is cleared
+void board_alloc_grid(board *brd);
+
+//frees the grid of brd, whatever the storage, including pooled tiles
+void board_free_grid(board *brd);
+
+//returns the tile of BOARD_STORAGE_TILED holding cell (x, y), allocating 
+//it filled with the background_color if it is not yet allocated
+board_cell *board_tile_get(board *brd, gint x, gint y);
+
+//returns the board_cell (x, y) of BOARD_STORAGE_TILED, the background_color
+//if its tile is not allocated
+board_cell board_tile_read(board *brd, gint x, gint y);
+
+//allocates the occupancy summary of brd for its width and height
+void board_summary_alloc(board *brd);
+
+//frees the occupancy summary of brd
+void board_summary_free(board *brd);
+
+//zeroes every level of the summary blocks overlapping the square of size 
+//cells on a side with its top left corner at cell (x, y)
+void board_summary_zero(board *brd, gint x, gint y, gint size);
+
+//records that cell (x, y) became occupied if occupied is TRUE or empty 
+//otherwise, updating each summary level the change reaches
+void board_summary_update(board *brd, gint x, gint y, gboolean occupied);
+
+//returns how occupied the aligned square of 1 << shift cells on a side 
+//containing cell (x, y) is, from 0 for empty to 255 for full
+//squares of BOARD_SUMMARY_SIZE cells or larger are answered from the summary
+guint8 board_summary_density(board *brd, gint x, gint y, gint shift);
+
+//returns the color used to draw a square with density as returned by 
+//board_summary_density, blending the background_color towards white
+board_cell board_summary_color(board *brd, guint8 density);
+
+//starts keeping the rays of brd, filled in from the grid.  every write to 
+//the grid keeps them up to date from then on
+void board_rays_alloc(board *brd);
+
+//stops keeping the rays of brd, freeing them
+void board_rays_free(board *brd);
+
+//empties every row and column of the rays of brd
+void board_rays_zero(board *brd);
+
+//records that cell (x, y) became occupied if occupied is TRUE or empty 
+//otherwise in the row and the column of the cell
+void board_rays_update(board *brd, gint x, gint y, gboolean occupied);
+
+//starts keeping the zobrist hash of brd, drawing the keys and hashing the 
+//occupied cells of the grid.  every write to the grid keeps it up to date 
+//from then on
+void board_hash_alloc(board *brd);
+
+//stops keeping the zobrist hash of brd, freeing the keys
+void board_hash_free(board *brd);
+
+//returns the zobrist key of cell i, brd must keep its hash
+guint64 board_hash_key(board *brd, gint64 i);
+
+//sets bit i of the line at bits, and the bit of its word in summary, for 
+//occupied
+void board_rays_set(guint64 *bits, guint64 *summary, gint i, 
+   gboolean occupied);
+
+//returns the first set bit after bit i of the line of length bits at bits,
+//or length if there is none
+gint board_rays_next(const guint64 *bits, const guint64 *summary, 
+   gint length, gint i);
+
+//returns the last set bit before bit i of the line at bits, or -1 if there 
+//is none
+gint board_rays_previous(const guint64 *bits, const guint64 *summary, gint i);
+
+//returns how many steps of (dx, dy) it takes from cell (x, y) to reach an 
+//occupied cell, cells off the board counting as occupied, so 1 means the 
+//next cell is occupied.  one of dx and dy is 0 and the other 1 or -1
+//answered from the rays if brd keeps them, cell by cell otherwise
+gint board_ray_distance(board *brd, gint x, gint y, gint dx, gint dy);
+
+//makes cell i a static wall of brd holding brd->wall_color, which needs 
+//flags.  walls stay for the life of brd, surviving board_clear
+void board_walls_add(board *brd, gint64 i);
+
+//adds the walls of the level file at path to brd.  every line of the file 
+//is a row of cells, BOARD_WALL_CHAR marking a wall, and whatever falls off 
+//brd is ignored.  returns FALSE and sets error if path cannot be read
+gboolean board_walls_load(board *brd, const gchar *path, GError **error);
+
+//returns whether cell i is a wall of brd
+gboolean board_walls_test(board *brd, gint64 i);
+
+//writes brd->wall_color back to every wall cell without marking them 
+//changed, after the grid was cleared
+void board_walls_restore(board *brd);
+
+//frees the walls of brd and walls_surface, leaving the cells as they are
+void board_walls_free(board *brd);
+
+#ifndef SNAFU_HEADLESS
+//renders the background_color and walls of brd to brd->walls_surface
+void board_walls_render(board *brd);
+#endif
+
 //appends the cell coordinates (x, y) to brd->changed_cells, marking the
 //cells for redrawing
 void board_mark_cell_changed(board *brd, gint x, gint y);
 
+//empties brd->changed_cells without drawing anything
+void board_forget_changes(board *brd);
+
 //changes board_cell (x, y) to value
 void board_set_cell(board *brd, gint x, gint y, board_cell value);
 
@@ -126,6 +485,8 @@ void board_clear_cell_leave_color_dont_mark_changed(board *brd, gint x, gint y);
 
 //returns a pointer to board_cell (x, y)
 //remember to call board_mark_cell_changed(brd,x,y) if you modify this pointer!
+//only BOARD_STORAGE_DENSE has board_cells to point to, NULL is returned 
+//for other storage
 board_cell *board_get_cell(board *brd, gint x, gint y);
 
 //returns a copy of board_cell (x, y)
@@ -136,8 +497,30 @@ board_cell board_get_cell_flags(board *brd, gint x, gint y);
 //returns only the color of board_cell (x, y)
 board_cell board_get_cell_color(board *brd, gint x, gint y);
 
+//sets the size in pixels of the view of brd, keeping its top left cell
+void board_view_resize(board *brd, gint width, gint height);
+
+//stores in x and y the cell drawn at pixel (px, py) of the view
+void board_view_cell_at(board *brd, gint px, gint py, gint *x, gint *y);
+
+//moves the view so that cell (x, y) is drawn at pixel (px, py), as far as
+//the edges of the board allow
+void board_view_place(board *brd, gint x, gint y, gint px, gint py);
+
+//zooms the view in by steps, or out if steps is negative, halving or 
+//doubling the cells per pixel each step and keeping the cell at pixel 
+//(px, py) in place.  cells grow to BOARD_VIEW_CELL_MAX pixels at most
+void board_view_zoom(board *brd, gint steps, gint px, gint py);
+
+//returns the number of columns or rows of cells in the view
+gint board_view_columns(board *brd);
+gint board_view_rows(board *brd);
+
+#ifndef SNAFU_HEADLESS
 //accepts a cairo_t as its first parameter and uses it to draw 
 //board_cell (x, y) to brd
+//cells outside the view are not drawn.  when the view is zoomed out past 
+//one pixel per cell, the pixel holding (x, y) is drawn from the summary
 void board_draw_cell_with_cairo_t(board *brd, cairo_t *cr, gint x, gint y);
 
 //same as board_draw_cell_with_cairo_t except it does not accept a 
@@ -146,6 +529,38 @@ void board_draw_cell_with_cairo_t(board *brd, cairo_t *cr, gint x, gint y);
 //this function is not recomended for repetative draws
 void board_draw_cell(board *brd, gint x, gint y);
 
+//returns an allocated image surface width by height pixels, pixel (px, py)
+//showing the density of the aligned square of 1 << shift cells on a side 
+//containing cell (x + (px << shift), y + (py << shift))
+//used for both zoomed out views and minimaps
+//the surface must be freed with cairo_surface_destroy
+cairo_surface_t *board_summary_surface(board *brd, gint x, gint y, 
+   gint width, gint height, gint shift);
+
+//draws the whole board scaled down to width by height pixels with cr, 
+//from the summary, and outlines the view on it
+void board_draw_minimap(board *brd, cairo_t *cr, gint width, gint height);
+
+//callback for expose events
+void board_expose(board *brd, GtkWidget *drawing_area);
+#endif
+
+#ifndef SNAFU_HEADLESS
+//the variants for every shape drawing the cells in brd->changed_cells with
+//cr, without forgetting them
+#define BOARD_DECLARE_DRAW_CHANGED(shape, X, Y) \
+   void board_draw_changed_##shape(board *brd, cairo_t *cr);
+BOARD_KERNELS(BOARD_DECLARE_DRAW_CHANGED)
+
+//draws the cells in brd->changed_cells with cr, without forgetting them
+//used to draw boards without a widget, such as to image surfaces
+void board_draw_changed(board *brd, cairo_t *cr);
+
+//same as board_draw except it draws the view with cr and does not forget
+//the changed cells
+void board_draw_with_cairo_t(board *brd, cairo_t *cr);
+#endif
+
 //draws only the cells marked changed in brd->changed_cells
 //allows for the board to be incrementally redrawn as opposed 
 //to redrawn from scratch
@@ -159,6 +574,7 @@ void board_incremental_draw(board *brd);
 //recomended for use when every cell in the board needs to be drawn, 
 //such as on expose
 //not recomended for frequent draws, such as animation
+//only the view is drawn, in one pass over the summary when zoomed out
 void board_draw(board *brd);
 
 //clears an entire board, also redrawing it if draw_after is set to TRUE
@@ -169,11 +585,9 @@ void board_clear_leave_color(board *brd, gboolean draw_after);
 //debug function
 void board_dump(board *brd);
 
-//callback for expose events
-void board_expose(board *brd, GtkWidget *drawing_area);
-
 //returns a pointer to an allocated board
-//accepts a widget which will be used to draw the board on
+//accepts a widget which will be used to draw the board on, or NULL for a 
+//board which is never drawn
 //width and height of the board
 //width and heigh in pixels of individual cells
 //the background color to apply to cleared cells
@@ -181,6 +595,17 @@ void board_expose(board *brd, GtkWidget *drawing_area);
 board *board_new(GtkWidget *widget, gint width, gint height, gint cell_height, 
    gint cell_width, board_cell background_color);
 
+//same as board_new however the grid is stored in the format storage
+//palette storage uses a quarter or half of the memory of BOARD_STORAGE_DENSE
+//as long as the board holds few distinct board_cells
+//BOARD_STORAGE_TILED suits very large boards which stay mostly empty
+board *board_new_with_storage(GtkWidget *widget, gint width, gint height, 
+   gint cell_height, gint cell_width, board_cell background_color, 
+   gint storage);
+
+//returns the BOARD_STORAGE_* named by name, BOARD_STORAGE_DENSE if unknown
+gint board_storage_parse(const gchar *name);
+
 //frees the allocated board
 void board_free(board *brd);
 
@@ -227,12 +652,840 @@ gboolean board_check_coords_in_bounds(board *brd, gint x, gint y){
    return(TRUE);
 }
 
+guint board_palette_lookup(board *brd, board_cell value){
+   guint index = GPOINTER_TO_UINT(g_hash_table_lookup(brd->palette_indices, 
+      GUINT_TO_POINTER(value)));
+
+   if(index){
+      return(index - 1);
+   }
+
+   if(brd->palette_length == brd->palette_capacity){
+      brd->palette_capacity *= 2;
+      brd->palette = g_renew(board_cell, brd->palette, brd->palette_capacity);
+   }
+
+   *(brd->palette + brd->palette_length) = value;
+
+   g_hash_table_insert(brd->palette_indices, GUINT_TO_POINTER(value), 
+      GUINT_TO_POINTER(brd->palette_length + 1));
+
+   return(brd->palette_length++);
+}
+
+board_cell board_read_cell(board *brd, gint64 i){
+   switch(brd->storage){
+      case(BOARD_STORAGE_PALETTE8):{
+         return(*(brd->palette + 
+            (*(brd->cells8 + i) & BOARD_PALETTE8_INDEX_MASK)));
+      }
+      case(BOARD_STORAGE_PALETTE16):{
+         return(*(brd->palette + 
+            (*(brd->cells16 + i) & BOARD_PALETTE16_INDEX_MASK)));
+      }
+      case(BOARD_STORAGE_TILED):{
+         return(board_tile_read(brd, BOARD_X(brd, i), BOARD_Y(brd, i)));
+      }
+      default:{
+         return(*(brd->cells + i));
+      }
+   }
+}
+
+board_cell board_read_cell_flags(board *brd, gint64 i){
+   switch(brd->storage){
+      case(BOARD_STORAGE_PALETTE8):{
+         if(!(*(brd->cells8 + i) & BOARD_PALETTE8_OCCUPIED_MASK)){
+            return(0);
+         }
+
+         break;
+      }
+      case(BOARD_STORAGE_PALETTE16):{
+         if(!(*(brd->cells16 + i) & BOARD_PALETTE16_OCCUPIED_MASK)){
+            return(0);
+         }
+
+         break;
+      }
+   }
+
+   return(board_read_cell(brd, i) & BOARD_CELL_FLAGS_MASK);
+}
+
+board_cell board_read_cell_xy(board *brd, gint64 i, gint x, gint y){
+   if(brd->storage == BOARD_STORAGE_TILED){
+      return(board_tile_read(brd, x, y));
+   }
+
+   return(board_read_cell(brd, i));
+}
+
+board_cell board_read_cell_flags_xy(board *brd, gint64 i, gint x, gint y){
+   if(brd->storage == BOARD_STORAGE_TILED){
+      return(board_tile_read(brd, x, y) & BOARD_CELL_FLAGS_MASK);
+   }
+
+   return(board_read_cell_flags(brd, i));
+}
+
+void board_write_cell(board *brd, gint64 i, board_cell value){
+   BOARD_KERNEL_CALL(brd, board_write_cell, (brd, i, value));
+}
+
+void board_write_cell_xy(board *brd, gint64 i, gint x, gint y, 
+   board_cell value){
+   gboolean was_occupied = (board_read_cell_flags_xy(brd, i, x, y) != 0);
+
+   board_write_cell_storage(brd, i, x, y, value);
+
+   if(was_occupied != ((value & BOARD_CELL_FLAGS_MASK) != 0)){
+      board_summary_update(brd, x, y, !was_occupied);
+
+      if(brd->rays != NULL){
+         board_rays_update(brd, x, y, !was_occupied);
+      }
+
+      if(brd->zobrist != NULL){
+         brd->hash ^= *(brd->zobrist + i);
+      }
+   }
+}
+
+#define BOARD_DEFINE_WRITE_CELL(shape, X, Y) \
+void board_write_cell_##shape(board *brd, gint64 i, board_cell value){ \
+   board_write_cell_xy(brd, i, X(brd, i), Y(brd, i), value); \
+}
+BOARD_KERNELS(BOARD_DEFINE_WRITE_CELL)
+
+gint board_shape_of(gint width, gint *shift){
+   *shift = 0;
+
+   if(width > 0 && !(width & (width - 1))){
+      while((1 << *shift) < width){
+         (*shift)++;
+      }
+
+      return(BOARD_SHAPE_POW2);
+   }
+
+   return(width == BOARD_SHAPE_DEFAULT_WIDTH?BOARD_SHAPE_DEFAULT:
+      BOARD_SHAPE_GENERIC);
+}
+
+void board_write_cell_storage(board *brd, gint64 i, gint x, gint y, 
+   board_cell value){
+   switch(brd->storage){
+      case(BOARD_STORAGE_PALETTE8):{
+         guint index = board_palette_lookup(brd, value);
+
+         if(index > BOARD_PALETTE8_INDEX_MASK){
+            board_set_storage(brd, BOARD_STORAGE_PALETTE16);
+            board_write_cell_storage(brd, i, x, y, value);
+            return;
+         }
+
+         *(brd->cells8 + i) = index | 
+            ((value & BOARD_CELL_FLAGS_MASK)?BOARD_PALETTE8_OCCUPIED_MASK:0);
+         return;
+      }
+      case(BOARD_STORAGE_PALETTE16):{
+         guint index = board_palette_lookup(brd, value);
+
+         if(index > BOARD_PALETTE16_INDEX_MASK){
+            board_set_storage(brd, BOARD_STORAGE_DENSE);
+            board_write_cell_storage(brd, i, x, y, value);
+            return;
+         }
+
+         *(brd->cells16 + i) = index | 
+            ((value & BOARD_CELL_FLAGS_MASK)?BOARD_PALETTE16_OCCUPIED_MASK:0);
+         return;
+      }
+      case(BOARD_STORAGE_TILED):{
+         if(*(brd->tiles + ((y >> BOARD_TILE_SHIFT) * brd->tiles_across) + 
+            (x >> BOARD_TILE_SHIFT)) == NULL && 
+            value == brd->background_color){
+            return;
+         }
+
+         *(board_tile_get(brd, x, y) + ((y & BOARD_TILE_MASK) << 
+            BOARD_TILE_SHIFT) + (x & BOARD_TILE_MASK)) = value;
+         return;
+      }
+      default:{
+         *(brd->cells + i) = value;
+      }
+   }
+}
+
+gboolean board_set_storage(board *brd, gint storage){
+   gint64 cell_count = (gint64)brd->width * brd->height;
+
+   //the palette of brd may hold board_cells no longer on the board, and a 
+   //dense board has none, so the distinct board_cells are counted
+   if(storage == BOARD_STORAGE_PALETTE8 || 
+      storage == BOARD_STORAGE_PALETTE16){
+      guint limit = (storage == BOARD_STORAGE_PALETTE8?
+         BOARD_PALETTE8_INDEX_MASK:BOARD_PALETTE16_INDEX_MASK) + 1;
+      GHashTable *distinct = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+      g_hash_table_insert(distinct, GUINT_TO_POINTER(brd->background_color),
+         NULL);
+
+      for(gint64 i = 0; i < cell_count && 
+         g_hash_table_size(distinct) <= limit; i++){
+         g_hash_table_insert(distinct, 
+            GUINT_TO_POINTER(board_read_cell(brd, i)), NULL);
+      }
+
+      gboolean fits = g_hash_table_size(distinct) <= limit;
+
+      g_hash_table_destroy(distinct);
+
+      if(!fits){
+         return(FALSE);
+      }
+   }
+
+   //keep a dense copy of the old grid to transcode from
+   board_cell *old_cells = brd->cells;
+
+   if(brd->storage != BOARD_STORAGE_DENSE){
+      old_cells = g_new(board_cell, cell_count);
+
+      for(gint64 i = 0; i < cell_count; i++){
+         *(old_cells + i) = board_read_cell(brd, i);
+      }
+   }else{
+      brd->cells = NULL;
+   }
+
+   board_free_grid(brd);
+
+   //the new grid starts out as all palette[0], and the board_cells counted
+   //above fit the new palette
+   brd->palette_length = 1;
+   *brd->palette = brd->background_color;
+
+   g_hash_table_remove_all(brd->palette_indices);
+   g_hash_table_insert(brd->palette_indices, 
+      GUINT_TO_POINTER(brd->background_color), GUINT_TO_POINTER(1));
+
+   brd->storage = storage;
+
+   board_alloc_grid(brd);
+
+   board_clear(brd, FALSE);
+
+   for(gint64 i = 0; i < cell_count; i++){
+      board_write_cell(brd, i, *(old_cells + i));
+   }
+
+   g_free(old_cells);
+
+   return(TRUE);
+}
+
+void board_alloc_grid(board *brd){
+   gint64 cell_count = (gint64)brd->width * brd->height;
+
+   switch(brd->storage){
+      case(BOARD_STORAGE_PALETTE8):{
+         brd->cells8 = g_new(guint8, cell_count);
+         break;
+      }
+      case(BOARD_STORAGE_PALETTE16):{
+         brd->cells16 = g_new(guint16, cell_count);
+         break;
+      }
+      case(BOARD_STORAGE_TILED):{
+         brd->tiles_across = (brd->width + BOARD_TILE_MASK) >> 
+            BOARD_TILE_SHIFT;
+         brd->tiles_down = (brd->height + BOARD_TILE_MASK) >> 
+            BOARD_TILE_SHIFT;
+
+         brd->tiles = g_new0(board_cell *, 
+            brd->tiles_across * brd->tiles_down);
+
+         brd->tiles_used = g_array_new(FALSE, FALSE, sizeof(gint));
+         brd->tile_pool = g_ptr_array_new();
+         break;
+      }
+      default:{
+         brd->cells = g_new(board_cell, cell_count);
+      }
+   }
+}
+
+void board_free_grid(board *brd){
+   g_free(brd->cells);
+   g_free(brd->cells8);
+   g_free(brd->cells16);
+
+   brd->cells = NULL;
+   brd->cells8 = NULL;
+   brd->cells16 = NULL;
+
+   if(brd->tiles != NULL){
+      for(guint i = 0; i < brd->tiles_used->len; i++){
+         g_free(*(brd->tiles + g_array_index(brd->tiles_used, gint, i)));
+      }
+
+      for(guint i = 0; i < brd->tile_pool->len; i++){
+         g_free(g_ptr_array_index(brd->tile_pool, i));
+      }
+
+      g_free(brd->tiles);
+      g_array_free(brd->tiles_used, TRUE);
+      g_ptr_array_free(brd->tile_pool, TRUE);
+
+      brd->tiles = NULL;
+      brd->tiles_used = NULL;
+      brd->tile_pool = NULL;
+   }
+}
+
+board_cell *board_tile_get(board *brd, gint x, gint y){
+   gint tile_number = ((y >> BOARD_TILE_SHIFT) * brd->tiles_across) + 
+      (x >> BOARD_TILE_SHIFT);
+
+   board_cell *tile = *(brd->tiles + tile_number);
+
+   if(tile != NULL){
+      return(tile);
+   }
+
+   if(brd->tile_pool->len){
+      tile = g_ptr_array_index(brd->tile_pool, brd->tile_pool->len - 1);
+      g_ptr_array_remove_index_fast(brd->tile_pool, brd->tile_pool->len - 1);
+   }else{
+      tile = g_new(board_cell, BOARD_TILE_SIZE * BOARD_TILE_SIZE);
+   }
+
+   for(gint j = 0; j < BOARD_TILE_SIZE * BOARD_TILE_SIZE; j++){
+      *(tile + j) = brd->background_color;
+   }
+
+   *(brd->tiles + tile_number) = tile;
+
+   g_array_append_val(brd->tiles_used, tile_number);
+
+   return(tile);
+}
+
+board_cell board_tile_read(board *brd, gint x, gint y){
+   board_cell *tile = *(brd->tiles + 
+      ((y >> BOARD_TILE_SHIFT) * brd->tiles_across) + (x >> BOARD_TILE_SHIFT));
+
+   if(tile == NULL){
+      return(brd->background_color);
+   }
+
+   return(*(tile + ((y & BOARD_TILE_MASK) << BOARD_TILE_SHIFT) + 
+      (x & BOARD_TILE_MASK)));
+}
+
+void board_summary_alloc(board *brd){
+   brd->summary_levels = 1;
+
+   while(((brd->width - 1) >> (BOARD_SUMMARY_SHIFT + brd->summary_levels - 1)) 
+      || ((brd->height - 1) >> 
+      (BOARD_SUMMARY_SHIFT + brd->summary_levels - 1))){
+      brd->summary_levels++;
+   }
+
+   brd->summary = g_new(guint8 *, brd->summary_levels);
+   brd->summary_across = g_new(gint, brd->summary_levels);
+   brd->summary_down = g_new(gint, brd->summary_levels);
+
+   for(gint k = 0; k < brd->summary_levels; k++){
+      gint shift = BOARD_SUMMARY_SHIFT + k;
+
+      *(brd->summary_across + k) = ((brd->width - 1) >> shift) + 1;
+      *(brd->summary_down + k) = ((brd->height - 1) >> shift) + 1;
+
+      *(brd->summary + k) = g_new0(guint8, 
+         *(brd->summary_across + k) * *(brd->summary_down + k));
+   }
+}
+
+void board_summary_free(board *brd){
+   for(gint k = 0; k < brd->summary_levels; k++){
+      g_free(*(brd->summary + k));
+   }
+
+   g_free(brd->summary);
+   g_free(brd->summary_across);
+   g_free(brd->summary_down);
+}
+
+void board_summary_zero(board *brd, gint x, gint y, gint size){
+   for(gint k = 0; k < brd->summary_levels; k++){
+      gint shift = BOARD_SUMMARY_SHIFT + k;
+      gint across = *(brd->summary_across + k);
+      gint down = *(brd->summary_down + k);
+
+      for(gint j = y >> shift; j <= (y + size - 1) >> shift && j < down; j++){
+         for(gint i = x >> shift; i <= (x + size - 1) >> shift && i < across; 
+            i++){
+            *(*(brd->summary + k) + (j * across) + i) = 0;
+         }
+      }
+   }
+}
+
+void board_summary_update(board *brd, gint x, gint y, gboolean occupied){
+   for(gint k = 0; k < brd->summary_levels; k++){
+      gint shift = BOARD_SUMMARY_SHIFT + k;
+      guint8 *count = *(brd->summary + k) + 
+         ((y >> shift) * *(brd->summary_across + k)) + (x >> shift);
+
+      //a level above only changes when a block turns empty or non-empty
+      if(occupied){
+         if((*count)++){
+            return;
+         }
+      }else{
+         if(--(*count)){
+            return;
+         }
+      }
+   }
+}
+
+guint8 board_summary_density(board *brd, gint x, gint y, gint shift){
+   if(shift < BOARD_SUMMARY_SHIFT){
+      gint size = 1 << shift, occupied = 0;
+
+      x &= ~(size - 1);
+      y &= ~(size - 1);
+
+      for(gint j = y; j < y + size && j < brd->height; j++){
+         for(gint i = x; i < x + size && i < brd->width; i++){
+            if(board_read_cell_flags_xy(brd, BOARD_INDEX(brd, i, j), i, j)){
+               occupied++;
+            }
+         }
+      }
+
+      return((occupied * 255) >> (shift * 2));
+   }
+
+   gint k = shift - BOARD_SUMMARY_SHIFT;
+
+   if(k >= brd->summary_levels){
+      k = brd->summary_levels - 1;
+   }
+
+   shift = BOARD_SUMMARY_SHIFT + k;
+
+   guint count = *(*(brd->summary + k) + 
+      ((y >> shift) * *(brd->summary_across + k)) + (x >> shift));
+
+   //level 0 counts cells, the levels above count their four children
+   return(k?((count * 255) / 4):((count * 255) >> (BOARD_SUMMARY_SHIFT * 2)));
+}
+
+void board_rays_alloc(board *brd){
+   if(brd->rays != NULL){
+      return;
+   }
+
+   brd->row_words = (brd->width + 63) >> 6;
+   brd->column_words = (brd->height + 63) >> 6;
+   brd->row_summary_words = (brd->row_words + 63) >> 6;
+   brd->column_summary_words = (brd->column_words + 63) >> 6;
+
+   brd->rays = g_new0(guint64, (brd->height * brd->row_words) + 
+      (brd->width * brd->column_words));
+   brd->rays_summary = g_new0(guint64, 
+      (brd->height * brd->row_summary_words) + 
+      (brd->width * brd->column_summary_words));
+
+   for(gint y = 0, i = 0; y < brd->height; y++){
+      for(gint x = 0; x < brd->width; x++, i++){
+         if(board_read_cell_flags(brd, i)){
+            board_rays_update(brd, x, y, TRUE);
+         }
+      }
+   }
+}
+
+void board_rays_free(board *brd){
+   g_free(brd->rays);
+   g_free(brd->rays_summary);
+
+   brd->rays = NULL;
+   brd->rays_summary = NULL;
+}
+
+void board_rays_zero(board *brd){
+   memset(brd->rays, 0, sizeof(guint64) * ((brd->height * brd->row_words) +
+      (brd->width * brd->column_words)));
+   memset(brd->rays_summary, 0, sizeof(guint64) * 
+      ((brd->height * brd->row_summary_words) + 
+      (brd->width * brd->column_summary_words)));
+}
+
+void board_rays_update(board *brd, gint x, gint y, gboolean occupied){
+   //the columns follow the rows
+   gint columns = brd->height * brd->row_words;
+   gint columns_summary = brd->height * brd->row_summary_words;
+
+   board_rays_set(brd->rays + (y * brd->row_words), 
+      brd->rays_summary + (y * brd->row_summary_words), x, occupied);
+   board_rays_set(brd->rays + columns + (x * brd->column_words), 
+      brd->rays_summary + columns_summary + (x * brd->column_summary_words),
+      y, occupied);
+}
+
+void board_hash_alloc(board *brd){
+   if(brd->zobrist != NULL){
+      return;
+   }
+
+   guint64 state = BOARD_ZOBRIST_SEED;
+
+   brd->zobrist = g_new(guint64, (gint64)brd->width * brd->height);
+   brd->hash = 0;
+
+   //splitmix64, so the keys need no generator of their own
+   for(gint64 i = 0; i < ((gint64)brd->width * brd->height); i++){
+      guint64 key = (state += G_GUINT64_CONSTANT(0x9e3779b97f4a7c15));
+
+      key = (key ^ (key >> 30)) * G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+      key = (key ^ (key >> 27)) * G_GUINT64_CONSTANT(0x94d049bb133111eb);
+
+      *(brd->zobrist + i) = key ^ (key >> 31);
+
+      if(board_read_cell_flags(brd, i)){
+         brd->hash ^= *(brd->zobrist + i);
+      }
+   }
+}
+
+void board_hash_free(board *brd){
+   g_free(brd->zobrist);
+
+   brd->zobrist = NULL;
+   brd->hash = 0;
+}
+
+guint64 board_hash_key(board *brd, gint64 i){
+   return(*(brd->zobrist + i));
+}
+
+void board_rays_set(guint64 *bits, guint64 *summary, gint i, 
+   gboolean occupied){
+   gint word = i >> 6;
+
+   if(occupied){
+      *(bits + word) |= G_GUINT64_CONSTANT(1) << (i & 63);
+      *(summary + (word >> 6)) |= G_GUINT64_CONSTANT(1) << (word & 63);
+   }else{
+      *(bits + word) &= ~(G_GUINT64_CONSTANT(1) << (i & 63));
+
+      if(!*(bits + word)){
+         *(summary + (word >> 6)) &= ~(G_GUINT64_CONSTANT(1) << (word & 63));
+      }
+   }
+}
+
+gint board_rays_next(const guint64 *bits, const guint64 *summary, 
+   gint length, gint i){
+   if(++i >= length){
+      return(length);
+   }
+
+   gint word = i >> 6;
+   guint64 found = *(bits + word) & (~G_GUINT64_CONSTANT(0) << (i & 63));
+
+   if(found){
+      return((word << 6) + __builtin_ctzll(found));
+   }
+
+   //the next word which is not zero, from the summary
+   gint words = (length + 63) >> 6;
+
+   if(++word >= words){
+      return(length);
+   }
+
+   gint summary_word = word >> 6;
+   gint summary_words = (words + 63) >> 6;
+
+   found = *(summary + summary_word) & 
+      (~G_GUINT64_CONSTANT(0) << (word & 63));
+
+   while(!found){
+      if(++summary_word >= summary_words){
+         return(length);
+      }
+
+      found = *(summary + summary_word);
+   }
+
+   word = (summary_word << 6) + __builtin_ctzll(found);
+
+   return((word << 6) + __builtin_ctzll(*(bits + word)));
+}
+
+gint board_rays_previous(const guint64 *bits, const guint64 *summary, gint i){
+   if(--i < 0){
+      return(-1);
+   }
+
+   gint word = i >> 6;
+   guint64 found = *(bits + word) & (~G_GUINT64_CONSTANT(0) >> (63 - (i & 63)));
+
+   if(found){
+      return((word << 6) + 63 - __builtin_clzll(found));
+   }
+
+   //the previous word which is not zero, from the summary
+   if(--word < 0){
+      return(-1);
+   }
+
+   gint summary_word = word >> 6;
+
+   found = *(summary + summary_word) & 
+      (~G_GUINT64_CONSTANT(0) >> (63 - (word & 63)));
+
+   while(!found){
+      if(--summary_word < 0){
+         return(-1);
+      }
+
+      found = *(summary + summary_word);
+   }
+
+   word = (summary_word << 6) + 63 - __builtin_clzll(found);
+
+   return((word << 6) + 63 - __builtin_clzll(*(bits + word)));
+}
+
+gint board_ray_distance(board *brd, gint x, gint y, gint dx, gint dy){
+   if(brd->rays == NULL){
+      gint distance = 1;
+
+      while(board_check_coords_in_bounds(brd, x + (distance * dx), 
+         y + (distance * dy)) && !board_read_cell_flags_xy(brd, 
+         BOARD_INDEX(brd, x + (distance * dx), y + (distance * dy)), 
+         x + (distance * dx), y + (distance * dy))){
+         distance++;
+      }
+
+      return(distance);
+   }
+
+   if(dy == 0){
+      const guint64 *bits = brd->rays + (y * brd->row_words);
+      const guint64 *summary = brd->rays_summary + 
+         (y * brd->row_summary_words);
+
+      return(dx > 0?board_rays_next(bits, summary, brd->width, x) - x:
+         x - board_rays_previous(bits, summary, x));
+   }
+
+   const guint64 *bits = brd->rays + (brd->height * brd->row_words) + 
+      (x * brd->column_words);
+   const guint64 *summary = brd->rays_summary + 
+      (brd->height * brd->row_summary_words) + (x * brd->column_summary_words);
+
+   return(dy > 0?board_rays_next(bits, summary, brd->height, y) - y:
+      y - board_rays_previous(bits, summary, y));
+}
+
+board_cell board_summary_color(board *brd, guint8 density){
+   board_cell color = 0;
+
+   for(gint shift = 0; shift < 24; shift += 8){
+      guint component = (brd->background_color >> shift) & 0xff;
+
+      component += ((0xff - component) * density) / 0xff;
+
+      color |= component << shift;
+   }
+
+   return(color);
+}
+
+void board_view_resize(board *brd, gint width, gint height){
+   brd->view_width = width;
+   brd->view_height = height;
+
+   board_view_place(brd, brd->view_x, brd->view_y, 0, 0);
+}
+
+void board_view_cell_at(board *brd, gint px, gint py, gint *x, gint *y){
+   if(brd->lod_shift){
+      *x = brd->view_x + (px << brd->lod_shift);
+      *y = brd->view_y + (py << brd->lod_shift);
+   }else{
+      *x = brd->view_x + (px / brd->cell_width);
+      *y = brd->view_y + (py / brd->cell_height);
+   }
+}
+
+void board_view_place(board *brd, gint x, gint y, gint px, gint py){
+   if(brd->lod_shift){
+      x -= px << brd->lod_shift;
+      y -= py << brd->lod_shift;
+
+      //keep whole summary blocks under each pixel
+      x &= ~((1 << brd->lod_shift) - 1);
+      y &= ~((1 << brd->lod_shift) - 1);
+   }else{
+      x -= px / brd->cell_width;
+      y -= py / brd->cell_height;
+   }
+
+   brd->view_x = 0;
+   brd->view_y = 0;
+
+   gint max_x = brd->width - board_view_columns(brd);
+   gint max_y = brd->height - board_view_rows(brd);
+
+   brd->view_x = CLAMP(x, 0, MAX(max_x, 0));
+   brd->view_y = CLAMP(y, 0, MAX(max_y, 0));
+}
+
+void board_view_zoom(board *brd, gint steps, gint px, gint py){
+   gint x, y;
+   gint base = MAX(brd->base_cell_width, brd->base_cell_height);
+   gint zoom_in = 0, to_pixel = g_bit_storage(base) - 1;
+
+   board_view_cell_at(brd, px, py, &x, &y);
+
+   //the steps doubling the base size up to BOARD_VIEW_CELL_MAX pixels, and
+   //those halving it down to a pixel before summarizing cells
+   while((base << (zoom_in + 1)) <= BOARD_VIEW_CELL_MAX){
+      zoom_in++;
+   }
+
+   brd->zoom = CLAMP(brd->zoom + steps, -(to_pixel + BOARD_VIEW_LOD_MAX), 
+      zoom_in);
+
+   if(brd->zoom >= 0){
+      brd->cell_width = brd->base_cell_width << brd->zoom;
+      brd->cell_height = brd->base_cell_height << brd->zoom;
+      brd->lod_shift = 0;
+   }else{
+      brd->cell_width = MAX(brd->base_cell_width >> -brd->zoom, 1);
+      brd->cell_height = MAX(brd->base_cell_height >> -brd->zoom, 1);
+      brd->lod_shift = MAX(-brd->zoom - to_pixel, 0);
+   }
+
+   board_view_place(brd, x, y, px, py);
+}
+
+gint board_view_columns(board *brd){
+   gint columns = brd->lod_shift?(brd->view_width << brd->lod_shift):
+      ((brd->view_width + brd->cell_width - 1) / brd->cell_width);
+
+   return(MIN(columns, brd->width - brd->view_x));
+}
+
+gint board_view_rows(board *brd){
+   gint rows = brd->lod_shift?(brd->view_height << brd->lod_shift):
+      ((brd->view_height + brd->cell_height - 1) / brd->cell_height);
+
+   return(MIN(rows, brd->height - brd->view_y));
+}
+
+void board_walls_add(board *brd, gint64 i){
+   if(brd->walls == NULL){
+      brd->walls = g_new0(guint64, 
+         (((gint64)brd->width * brd->height) + 63) >> 6);
+      brd->wall_cells = g_array_new(FALSE, FALSE, sizeof(gint64));
+   }
+
+   if(board_walls_test(brd, i)){
+      return;
+   }
+
+   *(brd->walls + (i >> 6)) |= G_GUINT64_CONSTANT(1) << (i & 63);
+   g_array_append_val(brd->wall_cells, i);
+
+   board_write_cell(brd, i, brd->wall_color);
+   board_mark_cell_changed(brd, BOARD_X(brd, i), BOARD_Y(brd, i));
+
+#ifndef SNAFU_HEADLESS
+   //rendered again by the next board_draw
+   if(brd->walls_surface != NULL){
+      cairo_surface_destroy(brd->walls_surface);
+      brd->walls_surface = NULL;
+   }
+#endif
+}
+
+gboolean board_walls_load(board *brd, const gchar *path, GError **error){
+   gchar *contents;
+
+   if(!g_file_get_contents(path, &contents, NULL, error)){
+      return(FALSE);
+   }
+
+   gchar **lines = g_strsplit(contents, "\n", -1);
+
+   for(gint y = 0; y < brd->height && *(lines + y) != NULL; y++){
+      gchar *line = *(lines + y);
+
+      for(gint x = 0; x < brd->width && *(line + x) != '\0'; x++){
+         if(*(line + x) == BOARD_WALL_CHAR){
+            board_walls_add(brd, BOARD_INDEX(brd, x, y));
+         }
+      }
+   }
+
+   g_strfreev(lines);
+   g_free(contents);
+
+   return(TRUE);
+}
+
+gboolean board_walls_test(board *brd, gint64 i){
+   if(brd->walls == NULL){
+      return(FALSE);
+   }
+
+   return((*(brd->walls + (i >> 6)) >> (i & 63)) & 1);
+}
+
+void board_walls_restore(board *brd){
+   for(guint j = 0; j < brd->wall_cells->len; j++){
+      board_write_cell(brd, g_array_index(brd->wall_cells, gint64, j), 
+         brd->wall_color);
+   }
+}
+
+void board_walls_free(board *brd){
+   if(brd->walls != NULL){
+      g_free(brd->walls);
+      g_array_free(brd->wall_cells, TRUE);
+
+      brd->walls = NULL;
+      brd->wall_cells = NULL;
+   }
+
+#ifndef SNAFU_HEADLESS
+   if(brd->walls_surface != NULL){
+      cairo_surface_destroy(brd->walls_surface);
+      brd->walls_surface = NULL;
+   }
+#endif
+}
+
 void board_mark_cell_changed(board *brd, gint x, gint y){
-   gchar *cell_string = g_strdup_printf(":%d", (brd->width * y) + x);
+   gint64 cell_number = BOARD_INDEX(brd, x, y);
 
-   brd->changed_cells = g_strconcat(brd->changed_cells, cell_string, NULL);
+   g_array_append_val(brd->changed_cells, cell_number);
+}
 
-   g_free(cell_string);
+void board_forget_changes(board *brd){
+   g_array_set_size(brd->changed_cells, 0);
 }
 
 void board_set_cell(board *brd, gint x, gint y, board_cell value){
@@ -240,7 +1493,7 @@ void board_set_cell(board *brd, gint x, gint y, board_cell value){
       return;
    }
 
-   *(brd->cells + ((brd->width * y) + x)) = value;
+   board_write_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y, value);
 
    board_mark_cell_changed(brd, x, y);
 }
@@ -250,8 +1503,8 @@ void board_clear_cell(board *brd, gint x, gint y){
       return;
    }
 
-   *(brd->cells + ((brd->width * y) + x)) = 
-      (brd->background_color & (~BOARD_CELL_FLAGS_MASK));
+   board_write_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y, 
+      brd->background_color);
 
    board_mark_cell_changed(brd, x, y);
 }
@@ -261,7 +1514,9 @@ void board_clear_cell_leave_color(board *brd, gint x, gint y){
       return;
    }
 
-   *(brd->cells + ((brd->width * y) + x)) &= (~BOARD_CELL_FLAGS_MASK);
+   board_write_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y, 
+      board_read_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y) & 
+         (~BOARD_CELL_FLAGS_MASK));
 
    board_mark_cell_changed(brd, x, y);
 }
@@ -272,7 +1527,7 @@ void board_set_cell_dont_mark_changed(board *brd, gint x, gint y,
       return;
    }
 
-   *(brd->cells + ((brd->width * y) + x)) = value;
+   board_write_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y, value);
 }
 
 void board_clear_cell_dont_mark_changed(board *brd, gint x, gint y){
@@ -280,8 +1535,8 @@ void board_clear_cell_dont_mark_changed(board *brd, gint x, gint y){
       return;
    }
 
-   *(brd->cells + ((brd->width * y) + x)) = 
-      (brd->background_color & (~BOARD_CELL_FLAGS_MASK));
+   board_write_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y, 
+      brd->background_color);
 }
 
 void board_clear_cell_leave_color_dont_mark_changed(board *brd, gint x, gint y){
@@ -289,7 +1544,9 @@ void board_clear_cell_leave_color_dont_mark_changed(board *brd, gint x, gint y){
       return;
    }
 
-   *(brd->cells + ((brd->width * y) + x)) &= (~BOARD_CELL_FLAGS_MASK);
+   board_write_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y, 
+      board_read_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y) & 
+         (~BOARD_CELL_FLAGS_MASK));
 }
 
 board_cell *board_get_cell(board *brd, gint x, gint y){
@@ -297,7 +1554,11 @@ board_cell *board_get_cell(board *brd, gint x, gint y){
       return(NULL);
    }
 
-   return(brd->cells + ((brd->width * y) + x));
+   if(brd->storage != BOARD_STORAGE_DENSE){
+      return(NULL);
+   }
+
+   return(brd->cells + (BOARD_INDEX(brd, x, y)));
 }
 
 board_cell board_get_cell_copy(board *brd, gint x, gint y){
@@ -305,7 +1566,7 @@ board_cell board_get_cell_copy(board *brd, gint x, gint y){
       return(BOARD_CELL_OUT_OF_BOUNDS);
    }
 
-   return(*(brd->cells + ((brd->width * y) + x)));
+   return(board_read_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y));
 }
 
 board_cell board_get_cell_flags(board *brd, gint x, gint y){
@@ -313,7 +1574,7 @@ board_cell board_get_cell_flags(board *brd, gint x, gint y){
       return(BOARD_CELL_OUT_OF_BOUNDS);
    }
 
-   return(*(brd->cells + ((brd->width * y) + x)) & BOARD_CELL_FLAGS_MASK);
+   return(board_read_cell_flags_xy(brd, BOARD_INDEX(brd, x, y), x, y));
 }
 
 board_cell board_get_cell_color(board *brd, gint x, gint y){
@@ -321,17 +1582,41 @@ board_cell board_get_cell_color(board *brd, gint x, gint y){
       return(BOARD_CELL_OUT_OF_BOUNDS);
    }
 
-   return(*(brd->cells + ((brd->width * y) + x)) & (~BOARD_CELL_FLAGS_MASK));
+   return(board_read_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y) & 
+      (~BOARD_CELL_FLAGS_MASK));
 }
 
+#ifndef SNAFU_HEADLESS
 void board_draw_cell_with_cairo_t(board *brd, cairo_t *cr, gint x, gint y){
+   if(x < brd->view_x || y < brd->view_y || 
+      x >= brd->view_x + board_view_columns(brd) || 
+      y >= brd->view_y + board_view_rows(brd)){
+      return;
+   }
+
    gfloat r, g, b;
-   board_cell_get_rgb(*(brd->cells + ((brd->width * y) + x)), &r, &g, &b);   
+
+   if(brd->lod_shift){
+      board_cell_get_rgb(board_summary_color(brd, 
+         board_summary_density(brd, x, y, brd->lod_shift)), &r, &g, &b);
+
+      cairo_set_source_rgb(cr, r, g, b);
+
+      cairo_rectangle(cr, (x - brd->view_x) >> brd->lod_shift, 
+         (y - brd->view_y) >> brd->lod_shift, 1, 1);
+
+      cairo_fill(cr);
+
+      return;
+   }
+
+   board_cell_get_rgb(board_read_cell_xy(brd, BOARD_INDEX(brd, x, y), x, y), 
+      &r, &g, &b);
 
    cairo_set_source_rgb(cr, r, g, b);
 
-   cairo_rectangle(cr, x * brd->cell_width, y * brd->cell_height, 
-      brd->cell_width, brd->cell_height);
+   cairo_rectangle(cr, (x - brd->view_x) * brd->cell_width, 
+      (y - brd->view_y) * brd->cell_height, brd->cell_width, brd->cell_height);
 
    cairo_fill(cr);
 }
@@ -348,44 +1633,242 @@ void board_draw_cell(board *brd, gint x, gint y){
    cairo_destroy(cr);
 }
 
-void board_incremental_draw(board *brd){
-   cairo_t *cr = gdk_cairo_create(brd->widget->window);
+cairo_surface_t *board_summary_surface(board *brd, gint x, gint y, 
+   gint width, gint height, gint shift){
+   cairo_surface_t *surface = cairo_image_surface_create(
+      CAIRO_FORMAT_RGB24, width, height);
+
+   guint8 *data = cairo_image_surface_get_data(surface);
+   gint stride = cairo_image_surface_get_stride(surface);
 
-   gchar **changed_cells = g_strsplit(brd->changed_cells, ":", 0);
+   for(gint py = 0; py < height; py++){
+      guint32 *row = (guint32 *) (data + (py * stride));
 
-   for(gint i = 1; *(changed_cells + i) != NULL; i++){
-      gint cell_number = g_ascii_strtoll(*(changed_cells + i), NULL, 10);
+      for(gint px = 0; px < width; px++){
+         gint cell_x = x + (px << shift), cell_y = y + (py << shift);
 
-      board_draw_cell_with_cairo_t(brd, cr, cell_number % brd->width, 
-         cell_number / brd->width);
+         *(row + px) = (cell_x < brd->width && cell_y < brd->height)?
+            board_summary_color(brd, 
+            board_summary_density(brd, cell_x, cell_y, shift)):0;
+      }
    }
 
-   cairo_destroy(cr);
+   cairo_surface_mark_dirty(surface);
+
+   return(surface);
+}
+
+void board_draw_minimap(board *brd, cairo_t *cr, gint width, gint height){
+   //the smallest power of two square of cells which fits a pixel
+   gint shift = 0;
+
+   while(((brd->width - 1) >> shift) >= width || 
+      ((brd->height - 1) >> shift) >= height){
+      shift++;
+   }
+
+   cairo_surface_t *surface = board_summary_surface(brd, 0, 0, 
+      ((brd->width - 1) >> shift) + 1, ((brd->height - 1) >> shift) + 1, 
+      shift);
+
+   gdouble scale = MIN((gdouble) width / brd->width, 
+      (gdouble) height / brd->height);
+
+   cairo_save(cr);
+
+   cairo_scale(cr, scale * (1 << shift), scale * (1 << shift));
+   cairo_set_source_surface(cr, surface, 0, 0);
+   cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+   cairo_paint(cr);
+
+   cairo_restore(cr);
+
+   cairo_surface_destroy(surface);
 
-   g_strfreev(changed_cells);
+   cairo_set_source_rgb(cr, 1, 1, 0);
+   cairo_set_line_width(cr, 1);
 
-   g_free(brd->changed_cells);
+   cairo_rectangle(cr, brd->view_x * scale + 0.5, brd->view_y * scale + 0.5,
+      board_view_columns(brd) * scale, board_view_rows(brd) * scale);
 
-   brd->changed_cells = g_strdup("");
+   cairo_stroke(cr);
 }
 
-void board_draw(board *brd){
-   cairo_t *cr = gdk_cairo_create(brd->widget->window);
+void board_walls_render(board *brd){
+   brd->walls_surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 
+      brd->width, brd->height);
+
+   guint8 *data = cairo_image_surface_get_data(brd->walls_surface);
+   gint stride = cairo_image_surface_get_stride(brd->walls_surface);
+
+   //RGB24 pixels hold the color in the same low 24 bits as board_cells
+   for(gint y = 0; y < brd->height; y++){
+      guint32 *row = (guint32 *) (data + (y * stride));
 
-   for(gint i = 0; i < (brd->width * brd->height); i++){
-      board_draw_cell_with_cairo_t(brd, cr, i % brd->width, i / brd->width);
+      for(gint x = 0; x < brd->width; x++){
+         *(row + x) = brd->background_color & (~BOARD_CELL_FLAGS_MASK);
+      }
    }
 
-   cairo_destroy(cr);
+   for(guint j = 0; j < brd->wall_cells->len; j++){
+      gint64 i = g_array_index(brd->wall_cells, gint64, j);
+
+      *((guint32 *) (data + (BOARD_Y(brd, i) * stride)) + BOARD_X(brd, i)) =
+         brd->wall_color & (~BOARD_CELL_FLAGS_MASK);
+   }
 
-   g_free(brd->changed_cells);
+   cairo_surface_mark_dirty(brd->walls_surface);
+}
+
+void board_expose(board *brd, GtkWidget *drawing_area){
+   if(drawing_area->allocation.width != brd->view_width || 
+      drawing_area->allocation.height != brd->view_height){
+      board_view_resize(brd, drawing_area->allocation.width, 
+         drawing_area->allocation.height);
+   }
 
-   brd->changed_cells = g_strdup("");
+   board_draw(brd);
+}
+#endif
+
+#ifndef SNAFU_HEADLESS
+#define BOARD_DEFINE_DRAW_CHANGED(shape, X, Y) \
+void board_draw_changed_##shape(board *brd, cairo_t *cr){ \
+   for(guint j = 0; j < brd->changed_cells->len; j++){ \
+      gint64 i = g_array_index(brd->changed_cells, gint64, j); \
+\
+      board_draw_cell_with_cairo_t(brd, cr, X(brd, i), Y(brd, i)); \
+   } \
+}
+BOARD_KERNELS(BOARD_DEFINE_DRAW_CHANGED)
+
+void board_draw_changed(board *brd, cairo_t *cr){
+   BOARD_KERNEL_CALL(brd, board_draw_changed, (brd, cr));
+}
+
+void board_draw_with_cairo_t(board *brd, cairo_t *cr){
+   if(brd->lod_shift){
+      cairo_surface_t *surface = board_summary_surface(brd, brd->view_x, 
+         brd->view_y, brd->view_width, brd->view_height, brd->lod_shift);
+
+      cairo_set_source_surface(cr, surface, 0, 0);
+      cairo_paint(cr);
+
+      cairo_surface_destroy(surface);
+   }else if(brd->walls != NULL){
+      gint columns = board_view_columns(brd), rows = board_view_rows(brd);
+
+      if(brd->walls_surface == NULL){
+         board_walls_render(brd);
+      }
+
+      //one paint for the background and walls, cells only for the trails
+      cairo_save(cr);
+
+      cairo_rectangle(cr, 0, 0, columns * brd->cell_width, 
+         rows * brd->cell_height);
+      cairo_clip(cr);
+      cairo_scale(cr, brd->cell_width, brd->cell_height);
+      cairo_set_source_surface(cr, brd->walls_surface, -brd->view_x, 
+         -brd->view_y);
+      cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+      cairo_paint(cr);
+
+      cairo_restore(cr);
+
+      //only walls hold the wall_color, and they are on walls_surface
+      for(gint y = brd->view_y; y < brd->view_y + rows; y++){
+         for(gint x = brd->view_x; x < brd->view_x + columns; x++){
+            board_cell value = board_read_cell_xy(brd, BOARD_INDEX(brd, x, y),
+               x, y);
+
+            if(value != brd->background_color && value != brd->wall_color){
+               board_draw_cell_with_cairo_t(brd, cr, x, y);
+            }
+         }
+      }
+   }else{
+      gint columns = board_view_columns(brd), rows = board_view_rows(brd);
+
+      for(gint y = brd->view_y; y < brd->view_y + rows; y++){
+         for(gint x = brd->view_x; x < brd->view_x + columns; x++){
+            board_draw_cell_with_cairo_t(brd, cr, x, y);
+         }
+      }
+   }
+}
+#endif
+
+void board_incremental_draw(board *brd){
+#ifndef SNAFU_HEADLESS
+   if(brd->widget != NULL){
+      cairo_t *cr = gdk_cairo_create(brd->widget->window);
+
+      board_draw_changed(brd, cr);
+
+      cairo_destroy(cr);
+   }
+#endif
+
+   board_forget_changes(brd);
+}
+
+void board_draw(board *brd){
+#ifndef SNAFU_HEADLESS
+   if(brd->widget != NULL){
+      cairo_t *cr = gdk_cairo_create(brd->widget->window);
+
+      board_draw_with_cairo_t(brd, cr);
+
+      cairo_destroy(cr);
+   }
+#endif
+
+   board_forget_changes(brd);
 }
 
 void board_clear(board *brd, gboolean draw_after){
-   for(gint i = 0; i < (brd->width * brd->height); i++){
-      board_clear_cell_dont_mark_changed(brd, i % brd->width, i / brd->width);
+   //palette[0] is always the background_color without flags
+   if(brd->storage == BOARD_STORAGE_PALETTE8){
+      memset(brd->cells8, 0, sizeof(guint8) * brd->width * brd->height);
+   }else if(brd->storage == BOARD_STORAGE_PALETTE16){
+      memset(brd->cells16, 0, sizeof(guint16) * brd->width * brd->height);
+   }else if(brd->storage == BOARD_STORAGE_TILED){
+      //untouched tiles are already clear, only the used ones go to the pool
+      for(guint i = 0; i < brd->tiles_used->len; i++){
+         gint tile_number = g_array_index(brd->tiles_used, gint, i);
+
+         board_summary_zero(brd, 
+            (tile_number % brd->tiles_across) << BOARD_TILE_SHIFT, 
+            (tile_number / brd->tiles_across) << BOARD_TILE_SHIFT, 
+            BOARD_TILE_SIZE);
+
+         g_ptr_array_add(brd->tile_pool, *(brd->tiles + tile_number));
+
+         *(brd->tiles + tile_number) = NULL;
+      }
+
+      g_array_set_size(brd->tiles_used, 0);
+   }else{
+      //the summary and rays are zeroed below, so the cells are only filled
+      for(gint64 i = 0; i < ((gint64)brd->width * brd->height); i++){
+         *(brd->cells + i) = brd->background_color;
+      }
+   }
+
+   if(brd->storage != BOARD_STORAGE_TILED){
+      board_summary_zero(brd, 0, 0, MAX(brd->width, brd->height));
+   }
+
+   if(brd->rays != NULL){
+      board_rays_zero(brd);
+   }
+
+   //nothing is occupied until the walls are written back
+   brd->hash = 0;
+
+   if(brd->walls != NULL){
+      board_walls_restore(brd);
    }
 
    if(draw_after){
@@ -394,9 +1877,47 @@ void board_clear(board *brd, gboolean draw_after){
 }
 
 void board_clear_leave_color(board *brd, gboolean draw_after){
-   for(gint i = 0; i < (brd->width * brd->height); i++){
-      board_clear_cell_leave_color_dont_mark_changed(brd, i / brd->width, 
-         i % brd->width);
+   if(brd->storage == BOARD_STORAGE_TILED){
+      //the background_color has no flags, so only used tiles need clearing
+      for(guint i = 0; i < brd->tiles_used->len; i++){
+         gint tile_number = g_array_index(brd->tiles_used, gint, i);
+         board_cell *tile = *(brd->tiles + tile_number);
+
+         board_summary_zero(brd, 
+            (tile_number % brd->tiles_across) << BOARD_TILE_SHIFT, 
+            (tile_number / brd->tiles_across) << BOARD_TILE_SHIFT, 
+            BOARD_TILE_SIZE);
+
+         for(gint j = 0; j < BOARD_TILE_SIZE * BOARD_TILE_SIZE; j++){
+            *(tile + j) &= (~BOARD_CELL_FLAGS_MASK);
+         }
+      }
+
+      if(brd->rays != NULL){
+         board_rays_zero(brd);
+      }
+   }else{
+      //no cell is left occupied, so the summary and rays are zeroed whole
+      for(gint y = 0; y < brd->height; y++){
+         for(gint x = 0; x < brd->width; x++){
+            gint64 i = BOARD_INDEX(brd, x, y);
+
+            board_write_cell_storage(brd, i, x, y, 
+               board_read_cell(brd, i) & (~BOARD_CELL_FLAGS_MASK));
+         }
+      }
+
+      board_summary_zero(brd, 0, 0, MAX(brd->width, brd->height));
+
+      if(brd->rays != NULL){
+         board_rays_zero(brd);
+      }
+   }
+
+   brd->hash = 0;
+
+   if(brd->walls != NULL){
+      board_walls_restore(brd);
    }
 
    if(draw_after){
@@ -409,40 +1930,112 @@ void board_dump(board *brd){
         brd->height, brd->width, brd->cell_height, brd->cell_width);*/
 }
 
-void board_expose(board *brd, GtkWidget *drawing_area){
-   board_draw(brd);
-}
-
 board *board_new(GtkWidget *widget, gint width, gint height, gint cell_height, 
    gint cell_width, board_cell background_color){
+   return(board_new_with_storage(widget, width, height, cell_height, 
+      cell_width, background_color, BOARD_STORAGE_DENSE));
+}
+
+board *board_new_with_storage(GtkWidget *widget, gint width, gint height, 
+   gint cell_height, gint cell_width, board_cell background_color, 
+   gint storage){
    board *new_board = g_new(board, 1);
 
    new_board->widget = widget;
 
    new_board->height = height;
    new_board->width = width;
+   new_board->shape = board_shape_of(width, &new_board->width_shift);
 
    new_board->cell_height = cell_height;
    new_board->cell_width = cell_width;
 
-   new_board->cells = g_new(board_cell, height * width);
+   new_board->view_x = 0;
+   new_board->view_y = 0;
+   new_board->view_width = width * cell_width;
+   new_board->view_height = height * cell_height;
+   new_board->lod_shift = 0;
+   new_board->zoom = 0;
+   new_board->base_cell_width = cell_width;
+   new_board->base_cell_height = cell_height;
+
+   board_summary_alloc(new_board);
+
+   new_board->rays = NULL;
+   new_board->rays_summary = NULL;
+
+   new_board->walls = NULL;
+   new_board->wall_cells = NULL;
+   new_board->wall_color = board_cell_new_with_flags(BOARD_WALL_FLAGS, 
+      64, 64, 64);
+   new_board->walls_surface = NULL;
+
+   new_board->zobrist = NULL;
+   new_board->hash = 0;
 
    new_board->background_color = background_color & (~BOARD_CELL_FLAGS_MASK);
 
+   new_board->storage = storage;
+
+   new_board->cells = NULL;
+   new_board->cells8 = NULL;
+   new_board->cells16 = NULL;
+   new_board->tiles = NULL;
+
+   board_alloc_grid(new_board);
+
+   new_board->palette_capacity = 16;
+   new_board->palette = g_new(board_cell, new_board->palette_capacity);
+   new_board->palette_length = 1;
+   *new_board->palette = new_board->background_color;
+   new_board->palette_indices = g_hash_table_new(g_direct_hash, 
+      g_direct_equal);
+
+   g_hash_table_insert(new_board->palette_indices, 
+      GUINT_TO_POINTER(new_board->background_color), GUINT_TO_POINTER(1));
+
    board_clear(new_board, FALSE);
 
-   new_board->changed_cells = g_strdup("");
+   new_board->changed_cells = g_array_new(FALSE, FALSE, sizeof(gint64));
 
-   g_signal_connect_swapped(widget, "expose-event", G_CALLBACK(board_expose), 
-      new_board);
+#ifndef SNAFU_HEADLESS
+   if(widget != NULL){
+      g_signal_connect_swapped(widget, "expose-event", 
+         G_CALLBACK(board_expose), new_board);
+   }
+#endif
 
    return(new_board);   
 }
 
+gint board_storage_parse(const gchar *name){
+   if(!g_strcmp0(name, "palette8")){
+      return(BOARD_STORAGE_PALETTE8);
+   }
+
+   if(!g_strcmp0(name, "palette16")){
+      return(BOARD_STORAGE_PALETTE16);
+   }
+
+   if(!g_strcmp0(name, "tiled")){
+      return(BOARD_STORAGE_TILED);
+   }
+
+   return(BOARD_STORAGE_DENSE);
+}
+
 void board_free(board *brd){
-   g_free(brd->cells);
+   board_free_grid(brd);
+
+   board_summary_free(brd);
+   board_rays_free(brd);
+   board_hash_free(brd);
+   board_walls_free(brd);
+
+   g_free(brd->palette);
+   g_hash_table_destroy(brd->palette_indices);
 
-   g_free(brd->changed_cells);
+   g_array_free(brd->changed_cells, TRUE);
 
    g_free(brd);
 }
@@ -0,0 +1,289 @@
+/******************************************************************************
+Title         : New SNAFU Board Benchmark
+Description   : Measures the board kernels which turn cell indices into
+                coordinates on boards of several shapes:  the default 45
+                cells wide board, boards a power of two wide and boards of
+                any other width.  Every kernel runs once with the shape of
+                the board and once with the board forced to
+                BOARD_SHAPE_GENERIC, which divides by the width, and the
+                speedup of the shape's own kernel is printed.  Clearing is
+                measured against clearing cell by cell, as boards were
+                cleared before, and drawing the cells changed by a step
+                to an image surface against drawing the whole board.
+Usage         : board-bench [--seconds S]
+Build with    : gcc -o board-bench -std=c99 -Wall -O2 board_bench.c \
+   `pkg-config --cflags --libs gtk+-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <gtk/gtk.h>
+#include <cairo.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+
+#define NUMBER_INDICES 65536
+#define FILL_PERCENT 30
+#define BENCH_ROUNDS 5
+#define DRAW_CHANGED 64
+
+//the shapes measured
+static const gint shapes[][2] = {
+   {45, 30}, {64, 64}, {1024, 1024}, {100, 100}, {1000, 1000}
+};
+
+//command line options
+static gdouble bench_seconds = 0.2;
+
+static GOptionEntry options[] = {
+   {"seconds", 0, 0, G_OPTION_ARG_DOUBLE, &bench_seconds,
+      "Time spent on every kernel and shape", "S"},
+   {NULL}
+};
+
+//random cell indices of the board being measured
+//global for convinience purposes
+static gint indices[NUMBER_INDICES];
+
+//draws to an image surface the size of the view of the board being measured
+//global for convinience purposes
+static cairo_t *draw_cr;
+
+//returns the nanoseconds one call of kernel on brd takes, over bench_seconds
+//kernel returns the number of operations it ran
+gdouble bench_time(board *brd, guint (*kernel)(board *brd));
+
+//writes an occupied cell and then the background_color to every index
+guint kernel_write(board *brd);
+
+//reads every index
+guint kernel_read(board *brd);
+
+//fills FILL_PERCENT of the indices and clears the board
+guint kernel_clear(board *brd);
+
+//fills FILL_PERCENT of the indices and clears the board cell by cell,
+//turning every index into coordinates
+guint kernel_clear_cells(board *brd);
+
+//fills FILL_PERCENT of the indices and clears the flags of the board
+guint kernel_clear_leave_color(board *brd);
+
+//draws the whole board with draw_cr, returning 1 for the frame
+guint kernel_draw(board *brd);
+
+//marks DRAW_CHANGED of the indices changed and draws only them with 
+//draw_cr, returning 1 for the frame
+guint kernel_draw_changed(board *brd);
+
+//prints the times of kernel on brd with the shape of brd and with
+//BOARD_SHAPE_GENERIC, or with baseline if it is not NULL
+void bench_kernel(board *brd, const gchar *name,
+   guint (*kernel)(board *brd), guint (*baseline)(board *brd));
+
+//returns the name of shape
+const gchar *shape_name(gint shape);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "- measure the board kernels of every shape");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   GRand *rand = g_rand_new_with_seed(1);
+
+   printf("%-10s %8s %-14s %12s %12s %8s\n", "board", "shape", "kernel",
+      "divide ns", "shape ns", "speedup");
+
+   for(guint k = 0; k < sizeof(shapes) / sizeof(shapes[0]); k++){
+      gint width = shapes[k][0], height = shapes[k][1];
+      board *dense = board_new(NULL, width, height, 1, 1,
+         board_cell_new_with_color(128, 128, 128));
+      board *tiled = board_new_with_storage(NULL, width, height, 1, 1,
+         board_cell_new_with_color(128, 128, 128), BOARD_STORAGE_TILED);
+
+      board_rays_alloc(dense);
+
+      cairo_surface_t *surface = cairo_image_surface_create(
+         CAIRO_FORMAT_ARGB32, dense->view_width, dense->view_height);
+
+      draw_cr = cairo_create(surface);
+
+      for(gint i = 0; i < NUMBER_INDICES; i++){
+         indices[i] = g_rand_int_range(rand, 0, width * height);
+      }
+
+      bench_kernel(dense, "write", kernel_write, NULL);
+      bench_kernel(tiled, "write tiled", kernel_write, NULL);
+      bench_kernel(tiled, "read tiled", kernel_read, NULL);
+      bench_kernel(dense, "clear", kernel_clear, kernel_clear_cells);
+      bench_kernel(dense, "clear color", kernel_clear_leave_color,
+         kernel_clear_cells);
+      bench_kernel(dense, "draw changed", kernel_draw_changed, NULL);
+      bench_kernel(dense, "draw", kernel_draw_changed, kernel_draw);
+
+      cairo_destroy(draw_cr);
+      cairo_surface_destroy(surface);
+
+      board_free(dense);
+      board_free(tiled);
+   }
+
+   g_rand_free(rand);
+
+   return(0);
+}
+
+gdouble bench_time(board *brd, guint (*kernel)(board *brd)){
+   gdouble best = G_MAXDOUBLE;
+
+   //once untimed, so the cells and caches start out alike
+   kernel(brd);
+
+   //the best of BENCH_ROUNDS rounds, the others having been interrupted
+   for(gint round = 0; round < BENCH_ROUNDS; round++){
+      guint64 operations = 0;
+      gint64 start = g_get_monotonic_time();
+      gdouble seconds;
+
+      do{
+         operations += kernel(brd);
+      }while((seconds = (g_get_monotonic_time() - start) / 1e6) <
+         bench_seconds / BENCH_ROUNDS);
+
+      best = MIN(best, seconds * 1e9 / operations);
+   }
+
+   return(best);
+}
+
+guint kernel_write(board *brd){
+   for(gint j = 0; j < NUMBER_INDICES; j++){
+      board_write_cell(brd, indices[j], 0x01ff0000);
+   }
+
+   for(gint j = 0; j < NUMBER_INDICES; j++){
+      board_write_cell(brd, indices[j], brd->background_color);
+   }
+
+   return(2 * NUMBER_INDICES);
+}
+
+guint kernel_read(board *brd){
+   board_cell seen = 0;
+
+   for(gint j = 0; j < NUMBER_INDICES; j++){
+      seen ^= board_read_cell(brd, indices[j]);
+   }
+
+   //keeps the reads from being optimized away
+   if(seen == BOARD_CELL_OUT_OF_BOUNDS){
+      printf("\n");
+   }
+
+   return(NUMBER_INDICES);
+}
+
+guint kernel_clear(board *brd){
+   gint cells = brd->width * brd->height;
+
+   for(gint j = 0; j < (cells * FILL_PERCENT) / 100; j++){
+      board_write_cell(brd, indices[j % NUMBER_INDICES], 0x01ff0000);
+   }
+
+   board_clear(brd, FALSE);
+
+   return(cells);
+}
+
+guint kernel_clear_cells(board *brd){
+   gint cells = brd->width * brd->height;
+
+   for(gint j = 0; j < (cells * FILL_PERCENT) / 100; j++){
+      board_write_cell(brd, indices[j % NUMBER_INDICES], 0x01ff0000);
+   }
+
+   for(gint i = 0; i < cells; i++){
+      board_clear_cell_dont_mark_changed(brd, i % brd->width, i / brd->width);
+   }
+
+   return(cells);
+}
+
+guint kernel_clear_leave_color(board *brd){
+   gint cells = brd->width * brd->height;
+
+   for(gint j = 0; j < (cells * FILL_PERCENT) / 100; j++){
+      board_write_cell(brd, indices[j % NUMBER_INDICES], 0x01ff0000);
+   }
+
+   board_clear_leave_color(brd, FALSE);
+
+   return(cells);
+}
+
+guint kernel_draw(board *brd){
+   board_draw_with_cairo_t(brd, draw_cr);
+
+   return(1);
+}
+
+guint kernel_draw_changed(board *brd){
+   for(gint j = 0; j < DRAW_CHANGED; j++){
+      board_mark_cell_changed(brd, BOARD_X(brd, indices[j]), 
+         BOARD_Y(brd, indices[j]));
+   }
+
+   board_draw_changed(brd, draw_cr);
+   board_forget_changes(brd);
+
+   return(1);
+}
+
+void bench_kernel(board *brd, const gchar *name,
+   guint (*kernel)(board *brd), guint (*baseline)(board *brd)){
+   gint shape = brd->shape;
+   gdouble divided, shaped;
+
+   if(baseline != NULL){
+      divided = bench_time(brd, baseline);
+   }else{
+      brd->shape = BOARD_SHAPE_GENERIC;
+      divided = bench_time(brd, kernel);
+      brd->shape = shape;
+   }
+
+   shaped = bench_time(brd, kernel);
+
+   gchar size[32];
+
+   g_snprintf(size, sizeof(size), "%dx%d", brd->width, brd->height);
+
+   printf("%-10s %8s %-14s %12.2f %12.2f %7.2fx\n", size, shape_name(shape),
+      name, divided, shaped, divided / shaped);
+}
+
+const gchar *shape_name(gint shape){
+   switch(shape){
+      case(BOARD_SHAPE_POW2):{
+         return("pow2");
+      }
+      case(BOARD_SHAPE_DEFAULT):{
+         return("default");
+      }
+      default:{
+         return("generic");
+      }
+   }
+}
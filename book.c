@@ -0,0 +1,471 @@
+/******************************************************************************
+Title         : New SNAFU Opening Book
+Description   : Works out the openings of games from the cells the players
+                always start on and writes them to an opening book, see
+                book.h.  Positions are explored a tick at a time from the
+                start, up to --depth ticks and --positions positions a
+                tick.  Every position is followed by all players playing
+                their book moves, and by each player alone playing another
+                move instead:  any other first move at the start and
+                straight on later, as the ai built into snafu does.  Each
+                move of each player in a position is rated by --rollouts
+                games played out from it, every player steering for space,
+                and the move the player lasts longest with on average goes
+                in the book.  Every tick of positions is rated on --threads
+                workers, and the book is the same whatever their number.
+Usage         : book [--output PATH] [--depth TICKS] [--positions N]
+                   [--rollouts N] [--threads N] [--seed S]
+                   [--max-ticks TICKS] [--players N] [--width CELLS]
+                   [--height CELLS]
+Build with    : gcc -o book -std=c99 -Wall -O2 -DSNAFU_HEADLESS book.c \
+   `pkg-config --cflags --libs glib-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "regions.h"
+#include "arena.h"
+#include "snafu.h"
+#include "book.h"
+
+#define NUMBER_PLAYERS 4
+#define DEPTH 12
+#define DEPTH_MAX 64
+#define POSITIONS 512
+#define ROLLOUTS 16
+#define MAX_TICKS 1000
+
+//one in ROLLOUT_NOISE moves of a rollout is random, so the rollouts of a
+//move differ
+#define ROLLOUT_NOISE 8
+
+//typedefs
+
+//a position of the opening
+//
+//moves holds the direction of every player for each of the ticks played
+//from the start.  best holds the book move of every player, SNAFU_RANDOM
+//for players which are dead or have no way on, and straight the direction
+//each player moved in last
+typedef struct _position{
+   snafu_player_direction moves[DEPTH_MAX][NUMBER_PLAYERS]; //the moves played
+   gint ticks;      //ticks played from the start
+   snafu_player_direction best[NUMBER_PLAYERS]; //the book moves
+   snafu_player_direction straight[NUMBER_PLAYERS]; //the last moves
+   gboolean alive[NUMBER_PLAYERS]; //players alive in the position
+   guint64 keys[NUMBER_PLAYERS];   //book keys of the players
+} position;
+
+//a worker rating positions on its own game
+typedef struct _worker{
+   snafu *game;     //the game positions are played on
+   GThread *thread; //the thread
+} worker;
+
+//command line options
+static gchar *output_path = "snafu.book";
+static gint depth = DEPTH;
+static gint number_positions = POSITIONS;
+static gint number_rollouts = ROLLOUTS;
+static gint number_threads = 0;
+static gint base_seed = 0;
+static gint max_ticks = MAX_TICKS;
+static gint number_players = NUMBER_PLAYERS;
+static gint board_width = SNAFU_BOARD_WIDTH;
+static gint board_height = SNAFU_BOARD_HEIGHT;
+
+static GOptionEntry options[] = {
+   {"output", 0, 0, G_OPTION_ARG_FILENAME, &output_path,
+      "Write the book to PATH", "PATH"},
+   {"depth", 0, 0, G_OPTION_ARG_INT, &depth,
+      "Ticks from the start the book goes", "TICKS"},
+   {"positions", 0, 0, G_OPTION_ARG_INT, &number_positions,
+      "Most positions to work out a tick", "N"},
+   {"rollouts", 0, 0, G_OPTION_ARG_INT, &number_rollouts,
+      "Games played out for every move", "N"},
+   {"threads", 0, 0, G_OPTION_ARG_INT, &number_threads,
+      "Threads rating positions, 0 for one per processor", "N"},
+   {"seed", 0, 0, G_OPTION_ARG_INT, &base_seed,
+      "Seed of the rollouts", "S"},
+   {"max-ticks", 0, 0, G_OPTION_ARG_INT, &max_ticks,
+      "Iterations after which a rollout ends", "TICKS"},
+   {"players", 0, 0, G_OPTION_ARG_INT, &number_players,
+      "Players in every game, 2 to 4", "N"},
+   {"width", 0, 0, G_OPTION_ARG_INT, &board_width,
+      "Width of the board in cells", "CELLS"},
+   {"height", 0, 0, G_OPTION_ARG_INT, &board_height,
+      "Height of the board in cells", "CELLS"},
+   {NULL}
+};
+
+//the positions being rated and the next one to be rated
+//global for convinience purposes
+static GArray *level;
+static volatile gint next_position;
+
+//rates every position of level left, claiming them one at a time
+gpointer worker_run(worker *work);
+
+//plays the moves of pos on game from the start, the players left steered
+//as humans
+void position_play(snafu *game, position *pos);
+
+//works out the book moves of every player of pos on game
+void position_rate(snafu *game, position *pos);
+
+//returns the ticks player seat lasts on average over number_rollouts games
+//from pos in which it moves in direction first, max_ticks more for every
+//game it outlasts the others in
+gdouble rollout_value(snafu *game, position *pos, gint seat,
+   snafu_player_direction direction);
+
+//sets the direction of every living player of game for the next
+//iteration, towards the neighbouring cell in the largest region
+void rollout_steer(snafu *game);
+
+//appends to next the positions following pos which are not in seen yet,
+//stopping once next holds number_positions
+void position_expand(position *pos, GArray *next, GHashTable *seen);
+
+//returns the direction opposite direction
+snafu_player_direction direction_reverse(snafu_player_direction direction);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "- work out an opening book");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   depth = CLAMP(depth, 1, DEPTH_MAX);
+   number_positions = MAX(number_positions, 1);
+   number_rollouts = MAX(number_rollouts, 1);
+   number_players = CLAMP(number_players, 2, NUMBER_PLAYERS);
+
+   //the players start at fixed cells of the default board
+   board_width = MAX(board_width, SNAFU_BOARD_WIDTH);
+   board_height = MAX(board_height, SNAFU_BOARD_HEIGHT);
+
+   //every position holds a key for each player, at most half the table full
+   guint table_bits = 1;
+
+   while((1u << table_bits) < 2 * (guint) (depth * number_positions *
+      number_players)){
+      table_bits++;
+   }
+
+   guint64 *table = g_new0(guint64, 1 << table_bits);
+   guint entries = 0;
+
+   guint number_workers = CLAMP(number_threads?number_threads:
+      g_get_num_processors(), 1, number_positions);
+   worker *workers = g_new(worker, number_workers);
+
+   for(guint i = 0; i < number_workers; i++){
+      board *play_area = board_new(NULL, board_width, board_height, 1, 1,
+         board_cell_new_with_color(128, 128, 128));
+
+      //the rollouts ask for the rays and regions every iteration, the keys
+      //for the hash
+      board_rays_alloc(play_area);
+      board_hash_alloc(play_area);
+
+      (workers + i)->game = snafu_new(play_area, number_players, 0);
+
+      snafu_set_track_regions((workers + i)->game, TRUE);
+   }
+
+   GHashTable *seen = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+      g_free, NULL);
+   position start;
+   gint64 begin = g_get_monotonic_time();
+
+   memset(&start, 0, sizeof(position));
+
+   level = g_array_new(FALSE, FALSE, sizeof(position));
+   g_array_append_val(level, start);
+
+   //a level of positions a tick, every level rated before the next is known
+   for(gint tick = 0; tick < depth && level->len; tick++){
+      GArray *next = g_array_new(FALSE, FALSE, sizeof(position));
+
+      next_position = 0;
+
+      for(guint i = 0; i < number_workers; i++){
+         (workers + i)->thread = g_thread_new("book",
+            (GThreadFunc) worker_run, workers + i);
+      }
+
+      for(guint i = 0; i < number_workers; i++){
+         g_thread_join((workers + i)->thread);
+      }
+
+      //in the order of the level, so the book does not depend on the threads
+      for(guint i = 0; i < level->len; i++){
+         position *pos = &g_array_index(level, position, i);
+
+         for(gint seat = 0; seat < number_players; seat++){
+            if(pos->best[seat] == SNAFU_RANDOM){
+               continue;
+            }
+
+            entries += book_insert(table, table_bits, pos->keys[seat],
+               g_bit_nth_lsf(pos->best[seat], -1));
+         }
+
+         position_expand(pos, next, seen);
+      }
+
+      printf("tick %d: %u positions, %u in the book, %.3f seconds\n", tick,
+         level->len, entries, (g_get_monotonic_time() - begin) / 1e6);
+
+      g_array_free(level, TRUE);
+      level = next;
+   }
+
+   g_array_free(level, TRUE);
+   g_hash_table_destroy(seen);
+
+   if(!book_save(output_path, board_width, board_height, number_players,
+      table, table_bits, entries, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   printf("%u moves written to %s\n", entries, output_path);
+
+   for(guint i = 0; i < number_workers; i++){
+      board *play_area = (workers + i)->game->play_area;
+
+      snafu_free((workers + i)->game);
+      board_free(play_area);
+   }
+
+   g_free(workers);
+   g_free(table);
+
+   return(0);
+}
+
+gpointer worker_run(worker *work){
+   gint i;
+
+   while((i = g_atomic_int_add(&next_position, 1)) < (gint) level->len){
+      position_rate(work->game, &g_array_index(level, position, i));
+   }
+
+   return(NULL);
+}
+
+void position_play(snafu *game, position *pos){
+   snafu_end(game);
+   snafu_begin(game);
+
+   for(gint seat = 0; seat < number_players; seat++){
+      (game->players + seat)->human = TRUE;
+   }
+
+   for(gint tick = 0; tick < pos->ticks; tick++){
+      for(gint seat = 0; seat < number_players; seat++){
+         (game->players + seat)->direction = pos->moves[tick][seat];
+      }
+
+      snafu_step(game);
+
+      board_forget_changes(game->play_area);
+   }
+}
+
+void position_rate(snafu *game, position *pos){
+   position_play(game, pos);
+
+   for(gint seat = 0; seat < number_players; seat++){
+      snafu_player *player = game->players + seat;
+
+      pos->alive[seat] = player->alive;
+      pos->best[seat] = SNAFU_RANDOM;
+      pos->keys[seat] = player->alive?book_key(game, player):0;
+   }
+
+   for(gint seat = 0; seat < number_players; seat++){
+      gdouble best_value = 0;
+
+      if(!pos->alive[seat]){
+         continue;
+      }
+
+      for(snafu_player_direction direction = SNAFU_UP;
+         direction <= SNAFU_RIGHT; direction <<= 1){
+         //going back is always into the trail, and blocked ways lose
+         if((pos->ticks && direction == direction_reverse(
+            pos->straight[seat])) || !snafu_player_reach(game,
+            game->players + seat, direction)){
+            continue;
+         }
+
+         gdouble value = rollout_value(game, pos, seat, direction);
+
+         if(pos->best[seat] == SNAFU_RANDOM || value > best_value){
+            pos->best[seat] = direction;
+            best_value = value;
+         }
+
+         //the rollouts left the game elsewhere
+         position_play(game, pos);
+      }
+   }
+}
+
+gdouble rollout_value(snafu *game, position *pos, gint seat,
+   snafu_player_direction direction){
+   gdouble total = 0;
+
+   for(gint rollout = 0; rollout < number_rollouts; rollout++){
+      position_play(game, pos);
+
+      //the same seeds for every move, so the moves are told apart rather
+      //than the luck of their rollouts
+      snafu_set_seed(game, base_seed + rollout);
+
+      rollout_steer(game);
+      (game->players + seat)->direction = direction;
+
+      guint start = game->tick, outlasted = 0;
+
+      while(game->active && game->tick - start < (guint) max_ticks &&
+         (game->players + seat)->alive){
+         snafu_step(game);
+
+         board_forget_changes(game->play_area);
+
+         rollout_steer(game);
+      }
+
+      //the ticks the player lasted, and whether it outlasted the others
+      for(gint other = 0; other < number_players; other++){
+         outlasted += other != seat && (game->players + other)->alive;
+      }
+
+      total += (game->tick - start) + ((game->players + seat)->alive &&
+         !outlasted?max_ticks:0);
+   }
+
+   return(total / number_rollouts);
+}
+
+void rollout_steer(snafu *game){
+   for(gint seat = 0; seat < number_players; seat++){
+      snafu_player *player = game->players + seat;
+      snafu_player_direction best = player->direction;
+      guint best_space = 0, best_reach = 0;
+
+      if(!player->alive){
+         continue;
+      }
+
+      if(!g_rand_int_range(game->rand, 0, ROLLOUT_NOISE)){
+         player->direction = snafu_player_direction_new(game->rand,
+            SNAFU_RANDOM);
+
+         if(snafu_player_reach(game, player, player->direction)){
+            continue;
+         }
+      }
+
+      for(snafu_player_direction direction = SNAFU_UP;
+         direction <= SNAFU_RIGHT; direction <<= 1){
+         gint x = (gint) player->x + (direction == SNAFU_RIGHT) -
+            (direction == SNAFU_LEFT);
+         gint y = (gint) player->y + (direction == SNAFU_DOWN) -
+            (direction == SNAFU_UP);
+         guint space = regions_size(game->regions,
+            regions_label(game->regions, x, y));
+         guint reach = snafu_player_reach(game, player, direction);
+
+         if(space > best_space || (space && space == best_space &&
+            reach > best_reach)){
+            best = direction;
+            best_space = space;
+            best_reach = reach;
+         }
+      }
+
+      player->direction = best;
+   }
+}
+
+void position_expand(position *pos, GArray *next, GHashTable *seen){
+   //every player plays its book move, or one player plays another move:
+   //any other at the start and straight on later
+   for(gint seat = -1; seat < number_players; seat++){
+      for(gint other = 1; other < (pos->ticks?2:4); other++){
+         position child = *pos;
+         guint64 *key;
+
+         if(next->len >= (guint) number_positions){
+            return;
+         }
+
+         if(seat >= 0 && (!pos->alive[seat] ||
+            pos->best[seat] == SNAFU_RANDOM)){
+            break;
+         }
+
+         key = g_new(guint64, 1);
+         *key = 0;
+
+         for(gint i = 0; i < number_players; i++){
+            snafu_player_direction direction = pos->best[i];
+
+            if(i == seat){
+               direction = pos->ticks?pos->straight[i]:SNAFU_UP <<
+                  ((g_bit_nth_lsf(direction, -1) + other) % 4);
+            }
+
+            //dead and stuck players keep moving on into whatever is there
+            if(direction == SNAFU_RANDOM){
+               direction = pos->straight[i]?pos->straight[i]:SNAFU_UP;
+            }
+
+            child.moves[pos->ticks][i] = direction;
+            child.straight[i] = direction;
+
+            *key = (*key * 31) + (pos->keys[i] ^ direction);
+         }
+
+         child.ticks = pos->ticks + 1;
+
+         //the same moves from the same position are only played once, and
+         //going straight on may be the book move already
+         if(g_hash_table_lookup_extended(seen, key, NULL, NULL)){
+            g_free(key);
+         }else{
+            g_hash_table_insert(seen, key, NULL);
+            g_array_append_val(next, child);
+         }
+
+         if(seat < 0){
+            break;
+         }
+      }
+   }
+}
+
+snafu_player_direction direction_reverse(snafu_player_direction direction){
+   return(direction == SNAFU_UP?SNAFU_DOWN:direction == SNAFU_DOWN?SNAFU_UP:
+      direction == SNAFU_LEFT?SNAFU_RIGHT:SNAFU_LEFT);
+}
@@ -0,0 +1,284 @@
+//symbolic constants used by opening books
+//
+//the players always start on the same cells, so the first moves of every
+//game go through the same positions.  an opening book holds the best move
+//of a player in each of those positions, worked out ahead of time by the
+//book program, and is looked up instead of thinking while a game is young
+//
+//a book file starts with a book_header, followed by a table of
+//1 << table_bits little endian guint64 entries, and is mapped read only.
+//the table is open addressed:  a key starts at the entry indexed by its
+//top table_bits bits and goes on to the next entry until it is found or an
+//empty entry, which is 0, is reached, looking at every entry at most
+//once.  an entry holds the key in its top 61 bits, BOOK_ENTRY_USED and
+//the index of the move, SNAFU_UP << index being the direction
+//
+//the key of a player in a position is the zobrist hash of the board, which
+//the board keeps, mixed with the heads of the living players and the seat
+//of the player.  books only hold boards the size they were made for
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+//"SNAFBOOK" in the first bytes of the file
+#define BOOK_MAGIC "SNAFBOOK"
+
+//changes whenever the layout of the file does
+#define BOOK_VERSION 1
+
+//the bits of an entry holding BOOK_ENTRY_USED and the move
+#define BOOK_ENTRY_MASK 7
+#define BOOK_ENTRY_USED 4
+
+//odd constant mixing the seat of the player into the key
+#define BOOK_SEAT_KEY G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)
+
+//the header of a book file, little endian
+typedef struct _book_header{
+   gchar magic[8];        //BOOK_MAGIC
+   guint32 version;       //BOOK_VERSION
+   guint32 width;         //width of the boards of the book
+   guint32 height;        //height of the boards of the book
+   guint32 number_players; //players of the games of the book
+   guint32 table_bits;    //log2 of the entries of the table
+   guint32 entries;       //entries in use
+} book_header;
+
+//an opening book mapped from a file
+//
+//map is the mapping of length bytes and table points into it, past the
+//header.  the other fields are read from the header
+//
+//books must be closed with book_close
+typedef struct _book{
+   gpointer map;          //the mapping of the file
+   gsize length;          //bytes mapped
+   const guint64 *table;  //the entries
+   guint table_bits;      //log2 of the entries of the table
+   gint width;            //width of the boards of the book
+   gint height;           //height of the boards of the book
+   guint number_players;  //players of the games of the book
+   guint entries;         //entries in use
+} book;
+
+
+/****
+ *book functions
+ ****/
+
+//maps the book file at path, returns NULL and sets error if it cannot be
+//read or is not a book
+book *book_open(const gchar *path, GError **error);
+
+//unmaps bk and frees it
+void book_close(book *bk);
+
+//returns the key of player in the current position of game.  the board of
+//game must keep its hash
+guint64 book_key(snafu *game, snafu_player *player);
+
+//returns the direction bk holds for player in the current position of
+//game, or SNAFU_RANDOM if the position is not in the book.
+//game->play_area keeps its hash from the first call on
+snafu_player_direction book_lookup(book *bk, snafu *game,
+   snafu_player *player);
+
+//returns the entry of key in the table of 1 << table_bits entries, or the
+//empty entry it would go in, NULL if key is not in the table and it is full
+const guint64 *book_find(const guint64 *table, guint table_bits,
+   guint64 key);
+
+//puts the move with index move under key in table, replacing any move it
+//held.  returns TRUE if key was not in table yet, FALSE if it was or there
+//was no empty entry left for it
+gboolean book_insert(guint64 *table, guint table_bits, guint64 key,
+   guint move);
+
+//writes the book of table for width by height boards and number_players
+//players to path, returning FALSE and setting error if it cannot be written
+gboolean book_save(const gchar *path, gint width, gint height,
+   guint number_players, const guint64 *table, guint table_bits,
+   guint entries, GError **error);
+
+/********/
+
+book *book_open(const gchar *path, GError **error){
+   gint fd = open(path, O_RDONLY);
+   struct stat status;
+
+   if(fd < 0 || fstat(fd, &status) < 0){
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+         "cannot open %s: %s", path, g_strerror(errno));
+
+      if(fd >= 0){
+         close(fd);
+      }
+
+      return(NULL);
+   }
+
+   if(status.st_size < sizeof(book_header)){
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+         "%s is not a book", path);
+      close(fd);
+
+      return(NULL);
+   }
+
+   gpointer map = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+   //the mapping stays once the file is closed
+   close(fd);
+
+   if(map == MAP_FAILED){
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+         "cannot map %s: %s", path, g_strerror(errno));
+
+      return(NULL);
+   }
+
+   const book_header *header = map;
+   guint table_bits = GUINT32_FROM_LE(header->table_bits);
+
+   if(memcmp(header->magic, BOOK_MAGIC, sizeof(header->magic)) ||
+      GUINT32_FROM_LE(header->version) != BOOK_VERSION || table_bits < 1 ||
+      table_bits > 32 || status.st_size != sizeof(book_header) +
+      (sizeof(guint64) << table_bits) || GUINT32_FROM_LE(header->entries) >=
+      (G_GUINT64_CONSTANT(1) << table_bits)){
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+         "%s is not a book of this version", path);
+      munmap(map, status.st_size);
+
+      return(NULL);
+   }
+
+   book *new_book = g_new(book, 1);
+
+   new_book->map = map;
+   new_book->length = status.st_size;
+   new_book->table = (const guint64 *) ((const guint8 *) map +
+      sizeof(book_header));
+   new_book->table_bits = table_bits;
+   new_book->width = GUINT32_FROM_LE(header->width);
+   new_book->height = GUINT32_FROM_LE(header->height);
+   new_book->number_players = GUINT32_FROM_LE(header->number_players);
+   new_book->entries = GUINT32_FROM_LE(header->entries);
+
+   return(new_book);
+}
+
+void book_close(book *bk){
+   munmap(bk->map, bk->length);
+
+   g_free(bk);
+}
+
+guint64 book_key(snafu *game, snafu_player *player){
+   board *brd = game->play_area;
+   guint64 key = brd->hash ^ (BOOK_SEAT_KEY * ((player - game->players) + 1));
+
+   //every seat turns the key of its head by a different amount
+   for(guint i = 0; i < game->number_players; i++){
+      snafu_player *seat = game->players + i;
+      guint64 head;
+      gint turn = 8 * (i + 1);
+
+      if(!seat->alive){
+         continue;
+      }
+
+      head = board_hash_key(brd, (brd->width * seat->y) + seat->x);
+      key ^= (head << turn) | (head >> (64 - turn));
+   }
+
+   return(key);
+}
+
+snafu_player_direction book_lookup(book *bk, snafu *game,
+   snafu_player *player){
+   board *brd = game->play_area;
+
+   if(brd->width != bk->width || brd->height != bk->height ||
+      game->number_players != bk->number_players){
+      return(SNAFU_RANDOM);
+   }
+
+   if(brd->zobrist == NULL){
+      board_hash_alloc(brd);
+   }
+
+   const guint64 *found = book_find(bk->table, bk->table_bits,
+      book_key(game, player));
+
+   if(found == NULL || !*found){
+      return(SNAFU_RANDOM);
+   }
+
+   guint64 entry = GUINT64_FROM_LE(*found);
+
+   return(SNAFU_UP << (entry & (BOOK_ENTRY_USED - 1)));
+}
+
+const guint64 *book_find(const guint64 *table, guint table_bits,
+   guint64 key){
+   guint64 mask = (G_GUINT64_CONSTANT(1) << table_bits) - 1;
+   guint64 i = key >> (64 - table_bits);
+
+   //entries are stored little endian, which keeps 0 as 0.  a corrupt or
+   //full table has no empty entry to stop at
+   for(guint64 probes = 0; probes <= mask; probes++){
+      if(!*(table + i) || (GUINT64_FROM_LE(*(table + i)) &
+         (~(guint64) BOOK_ENTRY_MASK)) == 
+         (key & (~(guint64) BOOK_ENTRY_MASK))){
+         return(table + i);
+      }
+
+      i = (i + 1) & mask;
+   }
+
+   return(NULL);
+}
+
+gboolean book_insert(guint64 *table, guint table_bits, guint64 key,
+   guint move){
+   guint64 *entry = (guint64 *) book_find(table, table_bits, key);
+
+   if(entry == NULL){
+      return(FALSE);
+   }
+
+   gboolean added = !*entry;
+
+   *entry = GUINT64_TO_LE((key & (~(guint64) BOOK_ENTRY_MASK)) |
+      BOOK_ENTRY_USED | move);
+
+   return(added);
+}
+
+gboolean book_save(const gchar *path, gint width, gint height,
+   guint number_players, const guint64 *table, guint table_bits,
+   guint entries, GError **error){
+   gsize length = sizeof(book_header) + (sizeof(guint64) << table_bits);
+   gchar *contents = g_malloc0(length);
+   book_header *header = (book_header *) contents;
+
+   memcpy(header->magic, BOOK_MAGIC, sizeof(header->magic));
+   header->version = GUINT32_TO_LE(BOOK_VERSION);
+   header->width = GUINT32_TO_LE(width);
+   header->height = GUINT32_TO_LE(height);
+   header->number_players = GUINT32_TO_LE(number_players);
+   header->table_bits = GUINT32_TO_LE(table_bits);
+   header->entries = GUINT32_TO_LE(entries);
+
+   memcpy(contents + sizeof(book_header), table,
+      sizeof(guint64) << table_bits);
+
+   gboolean saved = g_file_set_contents(path, contents, length, error);
+
+   g_free(contents);
+
+   return(saved);
+}
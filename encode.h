@@ -0,0 +1,475 @@
+//symbolic constants used by the observation encoder
+//
+//an encoder turns the board of a snafu into ENCODE_PLANES guint8 feature
+//planes from the point of view of one snafu_player, each cell of a plane
+//being 0 or 1:
+//   ENCODE_PLANE_OCCUPIED  cells with any flag set
+//   ENCODE_PLANE_OWN       cells holding the player's cell_value
+//   ENCODE_PLANE_OTHERS    cells holding another player's cell_value
+//   ENCODE_PLANE_HEADS     the heads of the living players
+//planes are stored one after the other, each row after row
+//
+//the board can be encoded whole, or as an egocentric crop of the square of
+//cells within radius of the player's head, optionally rotated so that the
+//player heads towards the top row.  cells of a crop off the board read as
+//occupied and nothing else, like the walls they stand for
+//
+//the cells are compared with simd kernels, SSE2 or AVX2 when the processor
+//has them, which must match the scalar kernel exactly
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ENCODE_SIMD
+#endif
+
+#define ENCODE_PLANES 4
+
+#define ENCODE_PLANE_OCCUPIED 0
+#define ENCODE_PLANE_OWN 1
+#define ENCODE_PLANE_OTHERS 2
+#define ENCODE_PLANE_HEADS 3
+
+//kernels comparing runs of cells
+#define ENCODE_KERNEL_SCALAR 0
+#define ENCODE_KERNEL_SSE2 1
+#define ENCODE_KERNEL_AVX2 2
+
+//the most players told apart, the others are only occupied
+#define ENCODE_PLAYERS_MAX 16
+
+//the encoder of a board
+//
+//kernel is the ENCODE_KERNEL_* in use.  cells holds a row of the board for
+//storage other than BOARD_STORAGE_DENSE, which is read through
+//board_read_cell a row at a time, and window the unrotated square of a
+//rotated crop
+//
+//encoders must be freed with encoder_free
+typedef struct _encoder{
+   gint kernel;        //the ENCODE_KERNEL_* in use
+   board_cell *cells;  //a row of cells read from a board which is not dense
+   gint cells_length;  //cells allocated for cells
+   guint8 *window;     //the unrotated planes of a rotated crop
+   gint window_length; //bytes allocated for window
+} encoder;
+
+
+/****
+ *encoder functions
+ ****/
+
+//returns an encoder using the fastest kernel the processor supports
+encoder *encoder_new(void);
+
+//frees enc
+void encoder_free(encoder *enc);
+
+//sets the ENCODE_KERNEL_* enc uses
+//returns FALSE and leaves the kernel alone if the processor lacks it
+gboolean encoder_set_kernel(encoder *enc, gint kernel);
+
+//returns the name of kernel
+const gchar *encoder_kernel_name(gint kernel);
+
+//writes the planes of the whole board of game from the point of view of
+//player to planes, ENCODE_PLANES * width * height guint8s
+void encoder_encode(encoder *enc, snafu *game, guint player, guint8 *planes);
+
+//writes the planes of the square of cells within radius of the head of
+//player to planes, ENCODE_PLANES * side * side guint8s where side is
+//(2 * radius) + 1.  if rotate is TRUE the square is turned so that the
+//direction of player is towards the top row
+void encoder_encode_crop(encoder *enc, snafu *game, guint player,
+   gint radius, gboolean rotate, guint8 *planes);
+
+//writes the planes of the width by height rectangle of the board of game
+//with its top left corner at cell (x, y) to planes, rows of stride bytes
+//and planes of plane_stride bytes.  the rectangle may reach off the board
+void encoder_encode_rect(encoder *enc, snafu *game, guint player, gint x,
+   gint y, gint width, gint height, guint8 *planes, gint stride,
+   gint plane_stride);
+
+//returns the length cells of row y of brd starting at column x, which must
+//be on the board, pointing into the board if it is dense and into
+//enc->cells otherwise
+const board_cell *encoder_row(encoder *enc, board *brd, gint x, gint y,
+   gint length);
+
+//writes the occupied, own and others planes of length cells with the
+//kernel of enc.  own is the cell_value of the player and others the
+//number_others cell_values of the other players
+void encoder_span(encoder *enc, const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane);
+
+//the kernels of encoder_span
+void encoder_span_scalar(const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane);
+
+#ifdef ENCODE_SIMD
+void encoder_span_sse2(const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane);
+
+void encoder_span_avx2(const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane);
+#endif
+
+/********/
+
+encoder *encoder_new(void){
+   encoder *new_encoder = g_new(encoder, 1);
+
+   new_encoder->kernel = ENCODE_KERNEL_SCALAR;
+   new_encoder->cells = NULL;
+   new_encoder->cells_length = 0;
+   new_encoder->window = NULL;
+   new_encoder->window_length = 0;
+
+   if(!encoder_set_kernel(new_encoder, ENCODE_KERNEL_AVX2)){
+      encoder_set_kernel(new_encoder, ENCODE_KERNEL_SSE2);
+   }
+
+   return(new_encoder);
+}
+
+void encoder_free(encoder *enc){
+   g_free(enc->cells);
+   g_free(enc->window);
+
+   g_free(enc);
+}
+
+gboolean encoder_set_kernel(encoder *enc, gint kernel){
+   switch(kernel){
+      case(ENCODE_KERNEL_SCALAR):{
+         break;
+      }
+#ifdef ENCODE_SIMD
+      case(ENCODE_KERNEL_SSE2):{
+         break;
+      }
+      case(ENCODE_KERNEL_AVX2):{
+         if(!__builtin_cpu_supports("avx2")){
+            return(FALSE);
+         }
+
+         break;
+      }
+#endif
+      default:{
+         return(FALSE);
+      }
+   }
+
+   enc->kernel = kernel;
+
+   return(TRUE);
+}
+
+const gchar *encoder_kernel_name(gint kernel){
+   switch(kernel){
+      case(ENCODE_KERNEL_SSE2):{
+         return("sse2");
+      }
+      case(ENCODE_KERNEL_AVX2):{
+         return("avx2");
+      }
+      default:{
+         return("scalar");
+      }
+   }
+}
+
+void encoder_encode(encoder *enc, snafu *game, guint player, guint8 *planes){
+   board *brd = game->play_area;
+
+   encoder_encode_rect(enc, game, player, 0, 0, brd->width, brd->height,
+      planes, brd->width, brd->width * brd->height);
+}
+
+void encoder_encode_crop(encoder *enc, snafu *game, guint player,
+   gint radius, gboolean rotate, guint8 *planes){
+   snafu_player *centre = game->players + player;
+   gint side = (2 * radius) + 1;
+   gint area = side * side;
+
+   if(!rotate || centre->direction == SNAFU_UP){
+      encoder_encode_rect(enc, game, player, centre->x - radius,
+         centre->y - radius, side, side, planes, side, area);
+      return;
+   }
+
+   if(enc->window_length < ENCODE_PLANES * area){
+      enc->window_length = ENCODE_PLANES * area;
+      enc->window = g_renew(guint8, enc->window, enc->window_length);
+   }
+
+   encoder_encode_rect(enc, game, player, centre->x - radius,
+      centre->y - radius, side, side, enc->window, side, area);
+
+   //(dx, dy) from the centre of the output is (wx, wy) from the centre of
+   //the window, the direction of the player ending up towards -dy
+   for(gint k = 0; k < ENCODE_PLANES; k++){
+      const guint8 *window = enc->window + (k * area);
+      guint8 *plane = planes + (k * area);
+
+      for(gint dy = -radius; dy <= radius; dy++){
+         for(gint dx = -radius; dx <= radius; dx++){
+            gint wx = centre->direction == SNAFU_DOWN?-dx:
+               centre->direction == SNAFU_LEFT?dy:-dy;
+            gint wy = centre->direction == SNAFU_DOWN?-dy:
+               centre->direction == SNAFU_LEFT?-dx:dx;
+
+            *(plane + (side * (dy + radius)) + dx + radius) =
+               *(window + (side * (wy + radius)) + wx + radius);
+         }
+      }
+   }
+}
+
+void encoder_encode_rect(encoder *enc, snafu *game, guint player, gint x,
+   gint y, gint width, gint height, guint8 *planes, gint stride,
+   gint plane_stride){
+   board *brd = game->play_area;
+   board_cell own = (game->players + player)->cell_value;
+   board_cell others[ENCODE_PLAYERS_MAX];
+   guint number_others = 0;
+
+   for(guint i = 0; i < game->number_players &&
+      number_others < ENCODE_PLAYERS_MAX; i++){
+      if(i != player){
+         others[number_others++] = (game->players + i)->cell_value;
+      }
+   }
+
+   guint8 *occupied = planes + (ENCODE_PLANE_OCCUPIED * plane_stride);
+   guint8 *own_plane = planes + (ENCODE_PLANE_OWN * plane_stride);
+   guint8 *others_plane = planes + (ENCODE_PLANE_OTHERS * plane_stride);
+   guint8 *heads = planes + (ENCODE_PLANE_HEADS * plane_stride);
+
+   //the part of the rectangle on the board
+   gint start_x = MAX(x, 0), end_x = MIN(x + width, brd->width);
+
+   for(gint row = 0; row < height; row++){
+      gint offset = stride * row;
+      gint board_y = y + row;
+
+      memset(heads + offset, 0, width);
+
+      if(board_y < 0 || board_y >= brd->height || start_x >= end_x){
+         memset(occupied + offset, 1, width);
+         memset(own_plane + offset, 0, width);
+         memset(others_plane + offset, 0, width);
+         continue;
+      }
+
+      //off the board to the left and right
+      memset(occupied + offset, 1, start_x - x);
+      memset(own_plane + offset, 0, start_x - x);
+      memset(others_plane + offset, 0, start_x - x);
+
+      memset(occupied + offset + (end_x - x), 1, x + width - end_x);
+      memset(own_plane + offset + (end_x - x), 0, x + width - end_x);
+      memset(others_plane + offset + (end_x - x), 0, x + width - end_x);
+
+      offset += start_x - x;
+
+      encoder_span(enc, encoder_row(enc, brd, start_x, board_y,
+         end_x - start_x), end_x - start_x, own, others, number_others,
+         occupied + offset, own_plane + offset, others_plane + offset);
+   }
+
+   for(guint i = 0; i < game->number_players; i++){
+      snafu_player *head = game->players + i;
+      gint head_x = (gint) head->x - x, head_y = (gint) head->y - y;
+
+      if(head->alive && head_x >= 0 && head_x < width && head_y >= 0 &&
+         head_y < height){
+         *(heads + (stride * head_y) + head_x) = 1;
+      }
+   }
+}
+
+const board_cell *encoder_row(encoder *enc, board *brd, gint x, gint y,
+   gint length){
+   if(brd->storage == BOARD_STORAGE_DENSE){
+      return(brd->cells + (brd->width * y) + x);
+   }
+
+   if(enc->cells_length < length){
+      enc->cells_length = length;
+      enc->cells = g_renew(board_cell, enc->cells, length);
+   }
+
+   for(gint i = 0; i < length; i++){
+      *(enc->cells + i) = board_read_cell(brd, (brd->width * y) + x + i);
+   }
+
+   return(enc->cells);
+}
+
+void encoder_span(encoder *enc, const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane){
+   switch(enc->kernel){
+#ifdef ENCODE_SIMD
+      case(ENCODE_KERNEL_SSE2):{
+         encoder_span_sse2(cells, length, own, others, number_others,
+            occupied, own_plane, others_plane);
+         break;
+      }
+      case(ENCODE_KERNEL_AVX2):{
+         encoder_span_avx2(cells, length, own, others, number_others,
+            occupied, own_plane, others_plane);
+         break;
+      }
+#endif
+      default:{
+         encoder_span_scalar(cells, length, own, others, number_others,
+            occupied, own_plane, others_plane);
+      }
+   }
+}
+
+void encoder_span_scalar(const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane){
+   for(gint i = 0; i < length; i++){
+      board_cell cell = *(cells + i);
+      guint8 other = 0;
+
+      for(guint j = 0; j < number_others; j++){
+         other |= (cell == *(others + j));
+      }
+
+      *(occupied + i) = (cell & BOARD_CELL_FLAGS_MASK) != 0;
+      *(own_plane + i) = (cell == own);
+      *(others_plane + i) = other;
+   }
+}
+
+#ifdef ENCODE_SIMD
+
+//16 cells at a time:  every comparison leaves 0 or all ones in each 32 bit
+//lane, which saturating packs narrow to a byte per cell without mixing up
+//the order
+void encoder_span_sse2(const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane){
+   __m128i flags_mask = _mm_set1_epi32(BOARD_CELL_FLAGS_MASK);
+   __m128i zero = _mm_setzero_si128();
+   __m128i ones = _mm_set1_epi8(1);
+   __m128i own_value = _mm_set1_epi32(own);
+   __m128i other_values[ENCODE_PLAYERS_MAX];
+   gint i = 0;
+
+   for(guint j = 0; j < number_others; j++){
+      other_values[j] = _mm_set1_epi32(*(others + j));
+   }
+
+   for(; i + 16 <= length; i += 16){
+      __m128i empty[4], mine[4], theirs[4];
+
+      for(gint k = 0; k < 4; k++){
+         __m128i cell = _mm_loadu_si128((const __m128i *) (cells + i +
+            (4 * k)));
+
+         empty[k] = _mm_cmpeq_epi32(_mm_and_si128(cell, flags_mask), zero);
+         mine[k] = _mm_cmpeq_epi32(cell, own_value);
+         theirs[k] = zero;
+
+         for(guint j = 0; j < number_others; j++){
+            theirs[k] = _mm_or_si128(theirs[k],
+               _mm_cmpeq_epi32(cell, other_values[j]));
+         }
+      }
+
+      __m128i empty_bytes = _mm_packs_epi16(
+         _mm_packs_epi32(empty[0], empty[1]),
+         _mm_packs_epi32(empty[2], empty[3]));
+      __m128i mine_bytes = _mm_packs_epi16(
+         _mm_packs_epi32(mine[0], mine[1]),
+         _mm_packs_epi32(mine[2], mine[3]));
+      __m128i theirs_bytes = _mm_packs_epi16(
+         _mm_packs_epi32(theirs[0], theirs[1]),
+         _mm_packs_epi32(theirs[2], theirs[3]));
+
+      _mm_storeu_si128((__m128i *) (occupied + i),
+         _mm_andnot_si128(empty_bytes, ones));
+      _mm_storeu_si128((__m128i *) (own_plane + i),
+         _mm_and_si128(mine_bytes, ones));
+      _mm_storeu_si128((__m128i *) (others_plane + i),
+         _mm_and_si128(theirs_bytes, ones));
+   }
+
+   encoder_span_scalar(cells + i, length - i, own, others, number_others,
+      occupied + i, own_plane + i, others_plane + i);
+}
+
+//32 cells at a time, as encoder_span_sse2.  the packs of AVX2 work within
+//each 128 bit half, so the groups of four cells are put back in order with
+//a permute afterwards.  each pair of comparisons is packed to 16 bits as
+//soon as it is made, so no more registers are live than AVX2 has
+__attribute__((target("avx2")))
+void encoder_span_avx2(const board_cell *cells, gint length,
+   board_cell own, const board_cell *others, guint number_others,
+   guint8 *occupied, guint8 *own_plane, guint8 *others_plane){
+   __m256i flags_mask = _mm256_set1_epi32(BOARD_CELL_FLAGS_MASK);
+   __m256i zero = _mm256_setzero_si256();
+   __m256i ones = _mm256_set1_epi8(1);
+   __m256i own_value = _mm256_set1_epi32(own);
+   __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+   __m256i other_values[ENCODE_PLAYERS_MAX];
+   gint i = 0;
+
+   for(guint j = 0; j < number_others; j++){
+      other_values[j] = _mm256_set1_epi32(*(others + j));
+   }
+
+   for(; i + 32 <= length; i += 32){
+      __m256i empty[2], mine[2], theirs[2];
+
+      for(gint k = 0; k < 2; k++){
+         __m256i low = _mm256_loadu_si256((const __m256i *) (cells + i +
+            (16 * k)));
+         __m256i high = _mm256_loadu_si256((const __m256i *) (cells + i +
+            (16 * k) + 8));
+         __m256i theirs_low = zero, theirs_high = zero;
+
+         for(guint j = 0; j < number_others; j++){
+            theirs_low = _mm256_or_si256(theirs_low,
+               _mm256_cmpeq_epi32(low, other_values[j]));
+            theirs_high = _mm256_or_si256(theirs_high,
+               _mm256_cmpeq_epi32(high, other_values[j]));
+         }
+
+         empty[k] = _mm256_packs_epi32(
+            _mm256_cmpeq_epi32(_mm256_and_si256(low, flags_mask), zero),
+            _mm256_cmpeq_epi32(_mm256_and_si256(high, flags_mask), zero));
+         mine[k] = _mm256_packs_epi32(_mm256_cmpeq_epi32(low, own_value),
+            _mm256_cmpeq_epi32(high, own_value));
+         theirs[k] = _mm256_packs_epi32(theirs_low, theirs_high);
+      }
+
+      __m256i empty_bytes = _mm256_permutevar8x32_epi32(
+         _mm256_packs_epi16(empty[0], empty[1]), order);
+      __m256i mine_bytes = _mm256_permutevar8x32_epi32(
+         _mm256_packs_epi16(mine[0], mine[1]), order);
+      __m256i theirs_bytes = _mm256_permutevar8x32_epi32(
+         _mm256_packs_epi16(theirs[0], theirs[1]), order);
+
+      _mm256_storeu_si256((__m256i *) (occupied + i),
+         _mm256_andnot_si256(empty_bytes, ones));
+      _mm256_storeu_si256((__m256i *) (own_plane + i),
+         _mm256_and_si256(mine_bytes, ones));
+      _mm256_storeu_si256((__m256i *) (others_plane + i),
+         _mm256_and_si256(theirs_bytes, ones));
+   }
+
+   encoder_span_sse2(cells + i, length - i, own, others, number_others,
+      occupied + i, own_plane + i, others_plane + i);
+}
+
+#endif
@@ -0,0 +1,311 @@
+/******************************************************************************
+Title         : New SNAFU Encoder Benchmark
+Description   : Checks that every observation encoder kernel the processor
+                supports writes exactly the planes of the scalar kernel, for
+                random runs of cells and for whole boards and crops of games
+                played in every board storage, then measures how fast each
+                kernel encodes a large dense board.  Bandwidth counts the
+                board_cells read and the plane bytes written.
+Usage         : encode-bench [--width W] [--height H] [--players N]
+                   [--radius R] [--seconds S]
+Build with    : gcc -o encode-bench -std=c99 -Wall -O2 -DSNAFU_HEADLESS \
+   encode_bench.c `pkg-config --cflags --libs glib-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "regions.h"
+#include "arena.h"
+#include "snafu.h"
+#include "encode.h"
+
+#define CHECK_WIDTH 77
+#define CHECK_HEIGHT 53
+#define CHECK_GAMES 2
+#define CHECK_SPANS 100000
+#define BENCH_WIDTH 1024
+#define BENCH_HEIGHT 1024
+
+//command line options
+static gint bench_width = BENCH_WIDTH;
+static gint bench_height = BENCH_HEIGHT;
+static gint number_players = 4;
+static gint crop_radius = 15;
+static gdouble bench_seconds = 1.0;
+
+static GOptionEntry options[] = {
+   {"width", 0, 0, G_OPTION_ARG_INT, &bench_width,
+      "Width of the benchmarked board", "W"},
+   {"height", 0, 0, G_OPTION_ARG_INT, &bench_height,
+      "Height of the benchmarked board", "H"},
+   {"players", 0, 0, G_OPTION_ARG_INT, &number_players,
+      "Players in every game, 2 to 4", "N"},
+   {"radius", 0, 0, G_OPTION_ARG_INT, &crop_radius,
+      "Radius of the checked crops", "R"},
+   {"seconds", 0, 0, G_OPTION_ARG_DOUBLE, &bench_seconds,
+      "Time spent benchmarking every kernel", "S"},
+   {NULL}
+};
+
+//returns the number of kernels which disagreed with the scalar kernel on
+//random runs of cells
+gint check_spans(void);
+
+//returns the number of kernels which disagreed with the scalar kernel on
+//games played on a board stored as storage
+gint check_games(gint storage);
+
+//returns the number of kernels which disagreed with the scalar kernel on
+//the whole board of game and on crops around every player
+gint check_game(snafu *game, encoder *reference, encoder *enc);
+
+//encodes a large board with every kernel for bench_seconds each, printing
+//the cells per second and the bandwidth
+void bench_kernels(void);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "- check and measure the observation encoder");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   number_players = CLAMP(number_players, 2, 4);
+   crop_radius = MAX(crop_radius, 0);
+
+   gint failures = check_spans();
+
+   failures += check_games(BOARD_STORAGE_DENSE);
+   failures += check_games(BOARD_STORAGE_PALETTE8);
+   failures += check_games(BOARD_STORAGE_PALETTE16);
+   failures += check_games(BOARD_STORAGE_TILED);
+
+   if(failures){
+      printf("%d mismatches against the scalar kernel\n", failures);
+      return(1);
+   }
+
+   printf("all kernels match the scalar kernel\n");
+
+   bench_kernels();
+
+   return(0);
+}
+
+gint check_spans(void){
+   encoder *enc = encoder_new();
+   GRand *rand = g_rand_new_with_seed(1);
+   board_cell own = 0x01ff0000;
+   board_cell others[ENCODE_PLAYERS_MAX];
+   board_cell cells[256 + 8];
+   guint8 expected[3][256], actual[3][256];
+   gint failures = 0;
+
+   for(guint j = 0; j < ENCODE_PLAYERS_MAX; j++){
+      others[j] = 0x01000000 | (j + 1);
+   }
+
+   for(gint span = 0; span < CHECK_SPANS; span++){
+      gint length = g_rand_int_range(rand, 0, 256);
+      gint offset = g_rand_int_range(rand, 0, 8);
+      guint number_others = g_rand_int_range(rand, 0, ENCODE_PLAYERS_MAX + 1);
+
+      //mostly cells the players left, with some unknown and empty ones
+      for(gint i = 0; i < length; i++){
+         guint32 roll = g_rand_int(rand);
+
+         switch(roll & 7){
+            case(0):{
+               cells[offset + i] = own;
+               break;
+            }
+            case(1):{
+               cells[offset + i] = roll;
+               break;
+            }
+            case(2):{
+               cells[offset + i] = roll & ~BOARD_CELL_FLAGS_MASK;
+               break;
+            }
+            default:{
+               cells[offset + i] = others[(roll >> 8) % ENCODE_PLAYERS_MAX];
+            }
+         }
+      }
+
+      encoder_span_scalar(cells + offset, length, own, others, number_others,
+         expected[0], expected[1], expected[2]);
+
+      for(gint kernel = ENCODE_KERNEL_SSE2; kernel <= ENCODE_KERNEL_AVX2;
+         kernel++){
+         if(!encoder_set_kernel(enc, kernel)){
+            continue;
+         }
+
+         encoder_span(enc, cells + offset, length, own, others, number_others,
+            actual[0], actual[1], actual[2]);
+
+         for(gint k = 0; k < 3; k++){
+            if(memcmp(expected[k], actual[k], length)){
+               printf("%s span of %d cells differs in plane %d\n",
+                  encoder_kernel_name(kernel), length, k);
+               failures++;
+               break;
+            }
+         }
+      }
+   }
+
+   g_rand_free(rand);
+   encoder_free(enc);
+
+   return(failures);
+}
+
+gint check_games(gint storage){
+   encoder *reference = encoder_new();
+   encoder *enc = encoder_new();
+   gint failures = 0;
+
+   encoder_set_kernel(reference, ENCODE_KERNEL_SCALAR);
+
+   for(guint32 seed = 0; seed < CHECK_GAMES; seed++){
+      board *play_area = board_new_with_storage(NULL, CHECK_WIDTH,
+         CHECK_HEIGHT, 1, 1, board_cell_new_with_color(128, 128, 128),
+         storage);
+      snafu *game = snafu_new(play_area, number_players, 0);
+
+      snafu_set_seed(game, seed);
+      snafu_begin(game);
+
+      do{
+         board_forget_changes(play_area);
+
+         for(gint kernel = ENCODE_KERNEL_SSE2; kernel <= ENCODE_KERNEL_AVX2;
+            kernel++){
+            if(encoder_set_kernel(enc, kernel)){
+               failures += check_game(game, reference, enc);
+            }
+         }
+      }while(snafu_step(game));
+
+      snafu_free(game);
+      board_free(play_area);
+   }
+
+   encoder_free(reference);
+   encoder_free(enc);
+
+   return(failures);
+}
+
+gint check_game(snafu *game, encoder *reference, encoder *enc){
+   board *play_area = game->play_area;
+   gint side = (2 * crop_radius) + 1;
+   gsize board_size = ENCODE_PLANES * play_area->width * play_area->height;
+   gsize crop_size = ENCODE_PLANES * side * side;
+   guint8 *expected = g_new(guint8, MAX(board_size, crop_size));
+   guint8 *actual = g_new(guint8, MAX(board_size, crop_size));
+   gint failures = 0;
+
+   for(guint player = 0; player < game->number_players; player++){
+      encoder_encode(reference, game, player, expected);
+      encoder_encode(enc, game, player, actual);
+
+      if(memcmp(expected, actual, board_size)){
+         printf("%s board of player %u differs at tick %u\n",
+            encoder_kernel_name(enc->kernel), player, game->tick);
+         failures++;
+      }
+
+      for(gint rotate = 0; rotate < 2; rotate++){
+         encoder_encode_crop(reference, game, player, crop_radius, rotate,
+            expected);
+         encoder_encode_crop(enc, game, player, crop_radius, rotate, actual);
+
+         if(memcmp(expected, actual, crop_size)){
+            printf("%s crop of player %u differs at tick %u\n",
+               encoder_kernel_name(enc->kernel), player, game->tick);
+            failures++;
+         }
+      }
+   }
+
+   g_free(expected);
+   g_free(actual);
+
+   return(failures);
+}
+
+void bench_kernels(void){
+   gint width = MAX(bench_width, CHECK_WIDTH);
+   gint height = MAX(bench_height, CHECK_HEIGHT);
+   board *play_area = board_new(NULL, width, height, 1, 1,
+      board_cell_new_with_color(128, 128, 128));
+   snafu *game = snafu_new(play_area, number_players, 0);
+   GRand *rand = g_rand_new_with_seed(2);
+   gsize cells = (gsize) width * height;
+   guint8 *planes = g_new(guint8, ENCODE_PLANES * cells);
+
+   snafu_set_seed(game, 2);
+   snafu_begin(game);
+
+   //a board well filled with trails, so no kernel gets a branch for free
+   for(gint y = 0; y < height; y++){
+      for(gint x = 0; x < width; x++){
+         guint32 roll = g_rand_int_range(rand, 0, game->number_players + 2);
+
+         if(roll < game->number_players){
+            board_set_cell_dont_mark_changed(play_area, x, y,
+               (game->players + roll)->cell_value);
+         }
+      }
+   }
+
+   printf("%8s %12s %14s %10s\n", "kernel", "encodes", "cells/sec", "GB/sec");
+
+   encoder *enc = encoder_new();
+
+   for(gint kernel = ENCODE_KERNEL_SCALAR; kernel <= ENCODE_KERNEL_AVX2;
+      kernel++){
+      if(!encoder_set_kernel(enc, kernel)){
+         continue;
+      }
+
+      guint encodes = 0;
+      gint64 start = g_get_monotonic_time();
+      gdouble seconds;
+
+      do{
+         encoder_encode(enc, game, encodes % game->number_players, planes);
+         encodes++;
+      }while((seconds = (g_get_monotonic_time() - start) / 1e6) <
+         bench_seconds);
+
+      gdouble cells_per_second = encodes * cells / seconds;
+
+      printf("%8s %12u %14.0f %10.2f\n", encoder_kernel_name(kernel), encodes,
+         cells_per_second, cells_per_second * (sizeof(board_cell) +
+         ENCODE_PLANES) / 1e9);
+   }
+
+   encoder_free(enc);
+   g_rand_free(rand);
+   g_free(planes);
+
+   snafu_free(game);
+   board_free(play_area);
+}
@@ -0,0 +1,137 @@
+/******************************************************************************
+Title         : New SNAFU Environment Benchmark
+Description   : Measures how many game steps per second a snafu_env manages
+                for batches of 1 to --max-batch games, doubling the batch
+                each time.  Agents take random actions, so games run their
+                whole course and are reset as they end.
+Usage         : env-bench [--threads N] [--max-batch B] [--steps S]
+                   [--agents N] [--players N] [--max-length CELLS]
+                Every batch size is run for about S game steps in total.
+Build with    : gcc -o env-bench -std=c99 -Wall -g -DSNAFU_HEADLESS \
+   env_bench.c `pkg-config --cflags --libs glib-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "regions.h"
+#include "arena.h"
+#include "snafu.h"
+#include "snafu_env.h"
+
+#define MAX_BATCH 4096
+#define TOTAL_STEPS 400000
+#define MIN_STEPS 64
+
+//command line options
+static gint number_threads = 0;
+static gint max_batch = MAX_BATCH;
+static gint total_steps = TOTAL_STEPS;
+static gint number_agents = 1;
+static gint number_players = SNAFU_ENV_PLAYERS_MAX;
+static gint max_length = 0;
+
+static GOptionEntry options[] = {
+   {"threads", 0, 0, G_OPTION_ARG_INT, &number_threads,
+      "Threads stepping the batch, 0 for one per processor", "N"},
+   {"max-batch", 0, 0, G_OPTION_ARG_INT, &max_batch,
+      "Largest batch of games", "B"},
+   {"steps", 0, 0, G_OPTION_ARG_INT, &total_steps,
+      "Game steps run for every batch size", "S"},
+   {"agents", 0, 0, G_OPTION_ARG_INT, &number_agents,
+      "Players steered by actions in every game", "N"},
+   {"players", 0, 0, G_OPTION_ARG_INT, &number_players,
+      "Players in every game", "N"},
+   {"max-length", 0, 0, G_OPTION_ARG_INT, &max_length,
+      "Longest trail a player may leave, 0 for no limit", "CELLS"},
+   {NULL}
+};
+
+//runs steps steps of a batch of batch games, printing the steps per second
+void bench_batch(guint batch, guint steps);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "- measure snafu_env steps per second");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   printf("%8s %8s %10s %14s %10s\n", "batch", "steps", "seconds",
+      "steps/sec", "resets");
+
+   for(guint batch = 1; batch <= MAX(max_batch, 1); batch *= 2){
+      bench_batch(batch, MAX(total_steps / batch, MIN_STEPS));
+   }
+
+   return(0);
+}
+
+void bench_batch(guint batch, guint steps){
+   guint planes = SNAFU_ENV_PLANES(CLAMP(number_players, 2,
+      SNAFU_ENV_PLAYERS_MAX));
+   gsize cells = SNAFU_ENV_WIDTH_MIN * SNAFU_ENV_HEIGHT_MIN;
+
+   guint8 *observations = g_new(guint8, batch * planes * cells);
+   gfloat *rewards = g_new(gfloat, batch * SNAFU_ENV_PLAYERS_MAX);
+   guint8 *dones = g_new(guint8, batch);
+   guint8 *actions = g_new(guint8, batch * SNAFU_ENV_PLAYERS_MAX);
+   guint32 *seeds = g_new(guint32, batch);
+
+   snafu_env *env = snafu_env_new(batch, MAX(number_players, 0),
+      MAX(number_agents, 0), SNAFU_ENV_WIDTH_MIN, SNAFU_ENV_HEIGHT_MIN,
+      MAX(max_length, 0), observations, rewards, dones,
+      MAX(number_threads, 0));
+
+   for(guint b = 0; b < batch; b++){
+      *(seeds + b) = b;
+   }
+
+   snafu_env_reset(env, seeds);
+
+   GRand *rand = g_rand_new_with_seed(batch);
+   guint resets = 0;
+   gint64 start = g_get_monotonic_time();
+
+   for(guint step = 0; step < steps; step++){
+      //mostly keep going, sometimes turn
+      for(guint i = 0; i < batch * env->number_agents; i++){
+         guint32 roll = g_rand_int(rand);
+
+         *(actions + i) = roll & 0x30?0:1 << (roll & 3);
+      }
+
+      snafu_env_step(env, actions);
+
+      for(guint b = 0; b < batch; b++){
+         resets += *(dones + b);
+      }
+   }
+
+   gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+   printf("%8u %8u %10.3f %14.0f %10u\n", batch, steps, seconds,
+      (gdouble) batch * steps / seconds, resets);
+
+   g_rand_free(rand);
+
+   snafu_env_free(env);
+
+   g_free(observations);
+   g_free(rewards);
+   g_free(dones);
+   g_free(actions);
+   g_free(seeds);
+}
@@ -0,0 +1,810 @@
+/******************************************************************************
+Title         : New SNAFU League
+Description   : Rates ai controllers against each other.  Matches between
+                --players controllers drawn from the registered ones are
+                played headless on --threads workers, every worker reusing
+                one snafu and board for all of its matches.  Match N is
+                seeded with --seed plus N, so a league plays out the same
+                whatever the number of threads.  Results are rated in match
+                order with Elo and TrueSkill, and the standings are appended
+                to --standings every --report matches.
+Usage         : league [--matches N] [--players N] [--threads N] [--seed S]
+                   [--controllers NAME,NAME...] [--standings PATH]
+                   [--report N] [--max-ticks TICKS] [--width CELLS]
+                   [--height CELLS] [--max-length CELLS]
+                   [--solve-below CELLS] [--solve-nodes N]
+                   [--stats PATH] [--play-out]
+                The controllers are crude, the ai built into snafu, random,
+                reach, space and solver, which plays as space until its
+                region has --solve-below cells left and then solves the
+                endgame, searching --solve-nodes positions a move.
+                --stats writes a row for every player of every match to a
+                columnar stats file at PATH, see stats.h and stats-reader.
+                A match without a trail limit ends once no two players can
+                reach each other any more, the survivors ranking by the
+                space left around them, unless --play-out is given.
+Build with    : gcc -o league -std=c99 -Wall -g -DSNAFU_HEADLESS league.c \
+   `pkg-config --cflags --libs glib-2.0` -lm
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "board.h"
+#include "regions.h"
+#include "arena.h"
+#include "snafu.h"
+#include "solver.h"
+#include "stats.h"
+
+#define NUMBER_MATCHES 1000
+#define NUMBER_PLAYERS 4
+#define REPORT_MATCHES 100
+#define MAX_TICKS 5000
+
+//the cause column holds death_cause as it is
+G_STATIC_ASSERT(STATS_CAUSE_NONE == SNAFU_DEATH_NONE);
+G_STATIC_ASSERT(STATS_CAUSE_WALL == SNAFU_DEATH_WALL);
+G_STATIC_ASSERT(STATS_CAUSE_SELF == SNAFU_DEATH_SELF);
+G_STATIC_ASSERT(STATS_CAUSE_OTHER == SNAFU_DEATH_OTHER);
+
+//the solver controller solves regions of SOLVE_BELOW cells or fewer,
+//searching at most SOLVE_NODES positions a move
+#define SOLVE_BELOW 32
+#define SOLVE_NODES 100000
+
+//elo ratings start at ELO_START and move by at most ELO_K a game, shared
+//out over the opponents
+#define ELO_START 1500.0
+#define ELO_K 32.0
+
+//trueskill ratings start at mu TRUESKILL_MU with deviation TRUESKILL_SIGMA.
+//performances vary by TRUESKILL_BETA and skills drift by TRUESKILL_TAU a
+//game.  the draw margin is sqrt(2) * beta * inverse_cdf(0.55), for 10%
+//of games between equals being draws
+#define TRUESKILL_MU 25.0
+#define TRUESKILL_SIGMA (TRUESKILL_MU / 3.0)
+#define TRUESKILL_BETA (TRUESKILL_SIGMA / 2.0)
+#define TRUESKILL_TAU (TRUESKILL_SIGMA / 100.0)
+#define TRUESKILL_DRAW_MARGIN (1.4142135623730951 * TRUESKILL_BETA * \
+   0.12566134685507402)
+
+//typedefs
+
+//an ai controller and its ratings
+//
+//steer sets the direction of player for the next iteration of game, the
+//player being marked human so the engine follows it.  a NULL steer leaves
+//the player to the ai built into snafu
+typedef struct _controller{
+   const gchar *name;  //the name the controller is registered under
+   void (*steer)(snafu *game, snafu_player *player);
+   guint games;        //matches played
+   guint wins;         //matches ranked first, alone or shared
+   gdouble elo;        //elo rating
+   gdouble mu;         //trueskill mean
+   gdouble sigma;      //trueskill deviation
+} controller;
+
+//the result of a match
+//
+//seats holds the index of the controller playing each player and
+//death_ticks the tick each player died, G_MAXUINT for survivors, and spaces
+//the empty cells survivors could still reach at the end.  ticks is the
+//iterations the match lasted, cells the cells of every trail at the end and
+//causes the SNAFU_DEATH_* of every player.  done is set once the match has
+//been played
+typedef struct _match{
+   guint seats[NUMBER_PLAYERS]; //controllers of the players
+   guint death_ticks[NUMBER_PLAYERS]; //tick each player died
+   guint spaces[NUMBER_PLAYERS]; //space left around every survivor
+   guint ticks;          //iterations of the match
+   guint cells[NUMBER_PLAYERS]; //cells of every trail
+   guint8 causes[NUMBER_PLAYERS]; //what every player died of
+   gboolean done;        //whether the match was played
+} match;
+
+//a worker playing matches on its own game
+typedef struct _worker{
+   snafu *game;     //the game reused for every match
+   GThread *thread; //the thread
+} worker;
+
+//controllers
+void steer_random(snafu *game, snafu_player *player);
+void steer_reach(snafu *game, snafu_player *player);
+void steer_space(snafu *game, snafu_player *player);
+void steer_solver(snafu *game, snafu_player *player);
+
+//every controller which can be rated
+static controller registered[] = {
+   {"crude", NULL},
+   {"random", steer_random},
+   {"reach", steer_reach},
+   {"space", steer_space},
+   {"solver", steer_solver}
+};
+
+//command line options
+static gint number_matches = NUMBER_MATCHES;
+static gint number_players = NUMBER_PLAYERS;
+static gint number_threads = 0;
+static gint base_seed = 0;
+static gchar *controller_names = NULL;
+static gchar *standings_path = NULL;
+static gint report_matches = REPORT_MATCHES;
+static gint max_ticks = MAX_TICKS;
+static gint board_width = SNAFU_BOARD_WIDTH;
+static gint board_height = SNAFU_BOARD_HEIGHT;
+static gint max_length = 0;
+static gint solve_below = SOLVE_BELOW;
+static gint solve_nodes = SOLVE_NODES;
+static gchar *stats_path = NULL;
+static gboolean play_out = FALSE;
+
+static GOptionEntry options[] = {
+   {"matches", 0, 0, G_OPTION_ARG_INT, &number_matches,
+      "Matches to play", "N"},
+   {"players", 0, 0, G_OPTION_ARG_INT, &number_players,
+      "Controllers in every match, 2 to 4", "N"},
+   {"threads", 0, 0, G_OPTION_ARG_INT, &number_threads,
+      "Threads playing matches, 0 for one per processor", "N"},
+   {"seed", 0, 0, G_OPTION_ARG_INT, &base_seed,
+      "Seed of the first match", "S"},
+   {"controllers", 0, 0, G_OPTION_ARG_STRING, &controller_names,
+      "Comma separated controllers to rate, all by default", "NAMES"},
+   {"standings", 0, 0, G_OPTION_ARG_FILENAME, &standings_path,
+      "Append the standings to PATH as the league goes", "PATH"},
+   {"report", 0, 0, G_OPTION_ARG_INT, &report_matches,
+      "Matches between standings", "N"},
+   {"max-ticks", 0, 0, G_OPTION_ARG_INT, &max_ticks,
+      "Iterations after which the survivors share the match", "TICKS"},
+   {"width", 0, 0, G_OPTION_ARG_INT, &board_width,
+      "Width of the board in cells", "CELLS"},
+   {"height", 0, 0, G_OPTION_ARG_INT, &board_height,
+      "Height of the board in cells", "CELLS"},
+   {"max-length", 0, 0, G_OPTION_ARG_INT, &max_length,
+      "Longest trail a player may leave, 0 for no limit", "CELLS"},
+   {"solve-below", 0, 0, G_OPTION_ARG_INT, &solve_below,
+      "Region size from which the solver controller solves", "CELLS"},
+   {"solve-nodes", 0, 0, G_OPTION_ARG_INT, &solve_nodes,
+      "Positions the solver controller searches a move", "N"},
+   {"stats", 0, 0, G_OPTION_ARG_FILENAME, &stats_path,
+      "Write a row for every player of every match to PATH", "PATH"},
+   {"play-out", 0, 0, G_OPTION_ARG_NONE, &play_out,
+      "Play matches on after the players are walled apart", NULL},
+   {NULL}
+};
+
+//the controllers in the league, their number, the matches and the next
+//match to be played
+//global for convinience purposes
+static controller **league;
+static guint league_size;
+static match *matches;
+static volatile gint next_match = 0;
+
+//guards match->done, signalled whenever a match is done
+static GMutex matches_lock;
+static GCond match_done;
+
+//the solver of every worker, made by the first solver controller it plays
+static GPrivate worker_solver = G_PRIVATE_INIT((GDestroyNotify) solver_free);
+
+//returns the registered controller named name, NULL if there is none
+controller *controller_lookup(const gchar *name);
+
+//fills in the seats of match number, drawing distinct controllers when
+//there are enough of them
+void match_draw(guint number);
+
+//plays match number on game
+void match_play(snafu *game, guint number);
+
+//GThreadFunc of a worker, playing matches until there are none left
+gpointer worker_run(worker *work);
+
+//rates the controllers of a played match
+void match_rate(match *played);
+
+//returns -1, 0 or 1 as the player in seat a did worse than, as well as or
+//better than the one in seat b.  of two survivors the one with more space
+//did better
+gint match_compare(match *played, guint a, guint b);
+
+//adds the rows of the players of match number to st
+void match_stats(stats *st, guint number);
+
+//moves the trueskill ratings of winner and loser for one game between them,
+//or of both for a draw
+void trueskill_update(gdouble *winner_mu, gdouble *winner_sigma,
+   gdouble *loser_mu, gdouble *loser_sigma, gboolean draw);
+
+//density and cumulative distribution of the standard normal distribution
+gdouble normal_pdf(gdouble x);
+gdouble normal_cdf(gdouble x);
+
+//writes the standings after played matches to file
+void standings_print(FILE *file, guint played);
+
+//GCompareFunc sorting controllers by conservative trueskill, mu - 3 sigma
+gint standings_compare(gconstpointer a, gconstpointer b);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "- rate ai controllers in a league");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   number_matches = MAX(number_matches, 0);
+   number_players = CLAMP(number_players, 2, NUMBER_PLAYERS);
+   report_matches = MAX(report_matches, 1);
+   solve_below = CLAMP(solve_below, 0, SOLVER_MAX_DEPTH);
+   solve_nodes = MAX(solve_nodes, 1);
+
+   //the players start at fixed cells of the default board
+   board_width = MAX(board_width, SNAFU_BOARD_WIDTH);
+   board_height = MAX(board_height, SNAFU_BOARD_HEIGHT);
+
+   guint number_registered = sizeof(registered) / sizeof(controller);
+
+   league = g_new(controller *, number_registered);
+   league_size = 0;
+
+   if(controller_names == NULL){
+      for(guint i = 0; i < number_registered; i++){
+         *(league + league_size++) = registered + i;
+      }
+   }else{
+      gchar **names = g_strsplit(controller_names, ",", -1);
+
+      for(gint i = 0; *(names + i) != NULL; i++){
+         controller *entrant = controller_lookup(*(names + i));
+
+         if(entrant == NULL){
+            g_printerr("no controller named %s\n", *(names + i));
+            return(1);
+         }
+
+         //seats are rated by controller, so one controller is one entrant
+         for(guint j = 0; j < league_size; j++){
+            if(*(league + j) == entrant){
+               g_printerr("controller %s named twice\n", *(names + i));
+               return(1);
+            }
+         }
+
+         *(league + league_size++) = entrant;
+      }
+
+      g_strfreev(names);
+   }
+
+   if(league_size < 2){
+      g_printerr("a league needs at least 2 controllers\n");
+      return(1);
+   }
+
+   for(guint i = 0; i < league_size; i++){
+      controller *entrant = *(league + i);
+
+      entrant->games = 0;
+      entrant->wins = 0;
+      entrant->elo = ELO_START;
+      entrant->mu = TRUESKILL_MU;
+      entrant->sigma = TRUESKILL_SIGMA;
+   }
+
+   FILE *standings = NULL;
+
+   if(standings_path != NULL &&
+      (standings = fopen(standings_path, "a")) == NULL){
+      g_printerr("cannot open %s: %s\n", standings_path, g_strerror(errno));
+      return(1);
+   }
+
+   stats *match_rows = NULL;
+
+   if(stats_path != NULL){
+      gint fd = open(stats_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+         0644);
+
+      if(fd < 0){
+         g_printerr("cannot open %s: %s\n", stats_path, g_strerror(errno));
+         return(1);
+      }
+
+      match_rows = stats_new(fd);
+   }
+
+   matches = g_new0(match, MAX(number_matches, 1));
+
+   for(gint i = 0; i < number_matches; i++){
+      match_draw(i);
+   }
+
+   g_mutex_init(&matches_lock);
+   g_cond_init(&match_done);
+
+   guint number_workers = CLAMP(number_threads?number_threads:
+      g_get_num_processors(), 1, MAX(number_matches, 1));
+   worker *workers = g_new(worker, number_workers);
+
+   for(guint i = 0; i < number_workers; i++){
+      worker *work = workers + i;
+      board *play_area = board_new(NULL, board_width, board_height, 1, 1,
+         board_cell_new_with_color(128, 128, 128));
+
+      //the controllers ask for the rays and regions every iteration, and
+      //the solver for the hash
+      board_rays_alloc(play_area);
+      board_hash_alloc(play_area);
+
+      work->game = snafu_new(play_area, number_players, 0);
+
+      snafu_set_max_length(work->game, MAX(max_length, 0));
+      snafu_set_track_regions(work->game, TRUE);
+
+      work->thread = g_thread_new("league", (GThreadFunc) worker_run, work);
+   }
+
+   //rated in match order, whichever worker finishes first
+   gint64 start = g_get_monotonic_time();
+
+   for(gint i = 0; i < number_matches; i++){
+      match *played = matches + i;
+
+      g_mutex_lock(&matches_lock);
+
+      while(!played->done){
+         g_cond_wait(&match_done, &matches_lock);
+      }
+
+      g_mutex_unlock(&matches_lock);
+
+      match_rate(played);
+
+      if(match_rows != NULL){
+         match_stats(match_rows, i);
+      }
+
+      if(standings != NULL && ((i + 1) % report_matches == 0 ||
+         i + 1 == number_matches)){
+         standings_print(standings, i + 1);
+         fflush(standings);
+      }
+   }
+
+   gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+   for(guint i = 0; i < number_workers; i++){
+      worker *work = workers + i;
+      board *play_area = work->game->play_area;
+
+      g_thread_join(work->thread);
+
+      snafu_free(work->game);
+      board_free(play_area);
+   }
+
+   standings_print(stdout, number_matches);
+   printf("%d matches on %u threads in %.3f seconds\n", number_matches,
+      number_workers, seconds);
+
+   if(standings != NULL){
+      fclose(standings);
+   }
+
+   if(match_rows != NULL && !stats_free(match_rows)){
+      g_printerr("cannot write %s: %s\n", stats_path, g_strerror(errno));
+   }
+
+   g_mutex_clear(&matches_lock);
+   g_cond_clear(&match_done);
+
+   g_free(workers);
+   g_free(matches);
+   g_free(league);
+
+   return(0);
+}
+
+void steer_random(snafu *game, snafu_player *player){
+   //mostly keep going, sometimes turn either way
+   if(g_rand_int_range(game->rand, 0, 8)){
+      return;
+   }
+
+   gboolean vertical = player->direction & (SNAFU_UP | SNAFU_DOWN);
+
+   player->direction = snafu_player_direction_new(game->rand,
+      vertical?SNAFU_LEFT | SNAFU_RIGHT:SNAFU_UP | SNAFU_DOWN);
+}
+
+void steer_reach(snafu *game, snafu_player *player){
+   snafu_player_direction reverse =
+      player->direction == SNAFU_UP?SNAFU_DOWN:
+      player->direction == SNAFU_DOWN?SNAFU_UP:
+      player->direction == SNAFU_LEFT?SNAFU_RIGHT:SNAFU_LEFT;
+   snafu_player_direction best = player->direction;
+   guint best_reach = snafu_player_reach(game, player, best);
+
+   //the straightest way on, turning only for more room
+   for(snafu_player_direction direction = SNAFU_UP;
+      direction <= SNAFU_RIGHT; direction <<= 1){
+      guint reach = snafu_player_reach(game, player, direction);
+
+      if(direction != reverse && reach > best_reach){
+         best = direction;
+         best_reach = reach;
+      }
+   }
+
+   player->direction = best;
+}
+
+void steer_space(snafu *game, snafu_player *player){
+   snafu_player_direction reverse =
+      player->direction == SNAFU_UP?SNAFU_DOWN:
+      player->direction == SNAFU_DOWN?SNAFU_UP:
+      player->direction == SNAFU_LEFT?SNAFU_RIGHT:SNAFU_LEFT;
+   snafu_player_direction best = player->direction;
+   guint best_space = 0, best_reach = 0;
+
+   //the neighbouring cell in the largest region, then with the most reach
+   for(snafu_player_direction direction = SNAFU_UP;
+      direction <= SNAFU_RIGHT; direction <<= 1){
+      gint x = (gint) player->x + (direction == SNAFU_RIGHT) -
+         (direction == SNAFU_LEFT);
+      gint y = (gint) player->y + (direction == SNAFU_DOWN) -
+         (direction == SNAFU_UP);
+      guint space = regions_size(game->regions,
+         regions_label(game->regions, x, y));
+      guint reach = snafu_player_reach(game, player, direction);
+
+      if(direction == reverse || space == 0){
+         continue;
+      }
+
+      if(space > best_space || (space == best_space && reach > best_reach)){
+         best = direction;
+         best_space = space;
+         best_reach = reach;
+      }
+   }
+
+   player->direction = best;
+}
+
+void steer_solver(snafu *game, snafu_player *player){
+   solver *solve = g_private_get(&worker_solver);
+   snafu_player_direction direction = SNAFU_RANDOM;
+
+   if(snafu_player_space(game, player) <= (guint) solve_below){
+      if(solve == NULL){
+         g_private_set(&worker_solver, solve = solver_new());
+      }
+
+      direction = solver_move(solve, game, player, solve_nodes);
+   }
+
+   //too many opponents around or too much space left to solve
+   if(direction == SNAFU_RANDOM){
+      steer_space(game, player);
+   }else{
+      player->direction = direction;
+   }
+}
+
+controller *controller_lookup(const gchar *name){
+   for(guint i = 0; i < sizeof(registered) / sizeof(controller); i++){
+      if(!g_strcmp0(registered[i].name, name)){
+         return(registered + i);
+      }
+   }
+
+   return(NULL);
+}
+
+void match_draw(guint number){
+   match *drawn = matches + number;
+   GRand *rand = g_rand_new_with_seed(base_seed + number);
+   guint order[league_size];
+
+   for(guint i = 0; i < league_size; i++){
+      order[i] = i;
+   }
+
+   //a shuffle of the league, the first controllers take the seats
+   for(guint i = league_size - 1; i > 0; i--){
+      guint j = g_rand_int_range(rand, 0, i + 1);
+      guint swap = order[i];
+
+      order[i] = order[j];
+      order[j] = swap;
+   }
+
+   for(gint seat = 0; seat < number_players; seat++){
+      drawn->seats[seat] = order[seat % league_size];
+   }
+
+   g_rand_free(rand);
+}
+
+void match_play(snafu *game, guint number){
+   match *played = matches + number;
+   solver *solve = g_private_get(&worker_solver);
+
+   //solved positions of earlier matches of the worker would change the
+   //moves found within the budget
+   if(solve != NULL){
+      solver_reset(solve);
+   }
+
+   snafu_set_seed(game, base_seed + number);
+   snafu_end(game);
+   snafu_begin(game);
+
+   for(gint seat = 0; seat < number_players; seat++){
+      (game->players + seat)->human =
+         (*(league + played->seats[seat]))->steer != NULL;
+      played->death_ticks[seat] = G_MAXUINT;
+   }
+
+   while(game->active && game->tick < (guint) max_ticks){
+      for(gint seat = 0; seat < number_players; seat++){
+         snafu_player *player = game->players + seat;
+         controller *steering = *(league + played->seats[seat]);
+
+         if(player->alive && steering->steer != NULL){
+            steering->steer(game, player);
+         }
+      }
+
+      snafu_step(game);
+
+      board_forget_changes(game->play_area);
+
+      for(gint seat = 0; seat < number_players; seat++){
+         if(!(game->players + seat)->alive &&
+            played->death_ticks[seat] == G_MAXUINT){
+            played->death_ticks[seat] = game->tick;
+         }
+      }
+
+      //walled apart, every survivor can at best fill its own region, so 
+      //the one with the most space outlasts the others.  limited trails 
+      //empty cells again, so their regions may still join
+      if(!play_out && !game->max_length && snafu_players_separated(game)){
+         break;
+      }
+   }
+
+   played->ticks = game->tick;
+
+   //a trail grows a cell at the start and every iteration the player lives
+   for(gint seat = 0; seat < number_players; seat++){
+      snafu_player *player = game->players + seat;
+
+      played->cells[seat] = game->max_length?player->body_length:
+         MIN(played->death_ticks[seat], game->tick + 1);
+      played->causes[seat] = player->death_cause;
+      played->spaces[seat] = snafu_player_space(game, player);
+   }
+}
+
+gpointer worker_run(worker *work){
+   gint number;
+
+   while((number = g_atomic_int_add(&next_match, 1)) < number_matches){
+      match_play(work->game, number);
+
+      g_mutex_lock(&matches_lock);
+      (matches + number)->done = TRUE;
+      g_cond_broadcast(&match_done);
+      g_mutex_unlock(&matches_lock);
+   }
+
+   return(NULL);
+}
+
+void match_rate(match *played){
+   gdouble elo[NUMBER_PLAYERS], mu[NUMBER_PLAYERS], sigma[NUMBER_PLAYERS];
+   gdouble elo_change[NUMBER_PLAYERS], mu_change[NUMBER_PLAYERS];
+   gdouble sigma_scale[NUMBER_PLAYERS];
+
+   //every pair is rated against the ratings from before the match
+   for(gint seat = 0; seat < number_players; seat++){
+      controller *entrant = *(league + played->seats[seat]);
+
+      elo[seat] = entrant->elo;
+      mu[seat] = entrant->mu;
+      sigma[seat] = sqrt((entrant->sigma * entrant->sigma) +
+         (TRUESKILL_TAU * TRUESKILL_TAU));
+
+      elo_change[seat] = 0;
+      mu_change[seat] = 0;
+      sigma_scale[seat] = 1;
+   }
+
+   for(gint a = 0; a < number_players; a++){
+      for(gint b = a + 1; b < number_players; b++){
+         //a controller playing itself learns nothing
+         if(played->seats[a] == played->seats[b]){
+            continue;
+         }
+
+         gint outcome = match_compare(played, a, b);
+         gdouble expected = 1.0 / (1.0 + pow(10.0, (elo[b] - elo[a]) /
+            400.0));
+         gdouble change = (ELO_K / (number_players - 1)) *
+            (((outcome + 1) / 2.0) - expected);
+
+         elo_change[a] += change;
+         elo_change[b] -= change;
+
+         gint winner = outcome < 0?b:a, loser = outcome < 0?a:b;
+         gdouble winner_mu = mu[winner], winner_sigma = sigma[winner];
+         gdouble loser_mu = mu[loser], loser_sigma = sigma[loser];
+
+         trueskill_update(&winner_mu, &winner_sigma, &loser_mu, &loser_sigma,
+            outcome == 0);
+
+         //shared out over the opponents like elo
+         mu_change[winner] += (winner_mu - mu[winner]) / (number_players - 1);
+         mu_change[loser] += (loser_mu - mu[loser]) / (number_players - 1);
+         sigma_scale[winner] *= pow(winner_sigma / sigma[winner],
+            1.0 / (number_players - 1));
+         sigma_scale[loser] *= pow(loser_sigma / sigma[loser],
+            1.0 / (number_players - 1));
+      }
+   }
+
+   for(gint seat = 0; seat < number_players; seat++){
+      controller *entrant = *(league + played->seats[seat]);
+      gboolean first = TRUE;
+
+      for(gint other = 0; other < number_players; other++){
+         first &= match_compare(played, seat, other) >= 0;
+      }
+
+      entrant->games++;
+      entrant->wins += first;
+      entrant->elo += elo_change[seat];
+      entrant->mu += mu_change[seat];
+      entrant->sigma = sigma[seat] * sigma_scale[seat];
+   }
+}
+
+gint match_compare(match *played, guint a, guint b){
+   guint a_tick = played->death_ticks[a], b_tick = played->death_ticks[b];
+
+   if(a_tick == G_MAXUINT && b_tick == G_MAXUINT){
+      guint a_space = played->spaces[a], b_space = played->spaces[b];
+
+      return(a_space == b_space?0:a_space > b_space?1:-1);
+   }
+
+   return(a_tick == b_tick?0:a_tick > b_tick?1:-1);
+}
+
+void match_stats(stats *st, guint number){
+   match *played = matches + number;
+
+   for(gint seat = 0; seat < number_players; seat++){
+      stats_row row;
+
+      row.game = number;
+      row.seed = base_seed + number;
+      row.game_ticks = played->ticks;
+      row.players = number_players;
+      row.seat = seat;
+      row.controller = *(league + played->seats[seat]) - registered;
+      row.ticks = MIN(played->death_ticks[seat], played->ticks);
+      row.cells = played->cells[seat];
+      row.cause = played->causes[seat];
+      row.rank = 1;
+
+      for(gint other = 0; other < number_players; other++){
+         row.rank += match_compare(played, other, seat) > 0;
+      }
+
+      stats_add(st, &row);
+   }
+}
+
+void trueskill_update(gdouble *winner_mu, gdouble *winner_sigma,
+   gdouble *loser_mu, gdouble *loser_sigma, gboolean draw){
+   gdouble winner_variance = *winner_sigma * *winner_sigma;
+   gdouble loser_variance = *loser_sigma * *loser_sigma;
+   gdouble c = sqrt((2 * TRUESKILL_BETA * TRUESKILL_BETA) + winner_variance +
+      loser_variance);
+   gdouble t = (*winner_mu - *loser_mu) / c;
+   gdouble e = TRUESKILL_DRAW_MARGIN / c;
+   gdouble v, w;
+
+   if(draw){
+      gdouble p = normal_cdf(e - t) - normal_cdf(-e - t);
+
+      if(p < 1e-12){
+         //far apart, the one ahead only loses ground
+         v = t < 0?-t - e:-t + e;
+         w = 1;
+      }else{
+         v = (normal_pdf(-e - t) - normal_pdf(e - t)) / p;
+         w = (v * v) + (((e - t) * normal_pdf(e - t) +
+            (e + t) * normal_pdf(e + t)) / p);
+      }
+   }else{
+      gdouble p = normal_cdf(t - e);
+
+      if(p < 1e-12){
+         //a big upset, the tail of the gaussian is all that is left
+         v = -(t - e);
+         w = 1;
+      }else{
+         v = normal_pdf(t - e) / p;
+         w = v * (v + t - e);
+      }
+   }
+
+   *winner_mu += (winner_variance / c) * v;
+   *loser_mu -= (loser_variance / c) * v;
+
+   *winner_sigma = sqrt(winner_variance *
+      MAX(1 - ((winner_variance / (c * c)) * w), 1e-4));
+   *loser_sigma = sqrt(loser_variance *
+      MAX(1 - ((loser_variance / (c * c)) * w), 1e-4));
+}
+
+gdouble normal_pdf(gdouble x){
+   return(exp(-(x * x) / 2) / 2.5066282746310002);
+}
+
+gdouble normal_cdf(gdouble x){
+   return(erfc(-x / 1.4142135623730951) / 2);
+}
+
+void standings_print(FILE *file, guint played){
+   controller *sorted[league_size];
+
+   memcpy(sorted, league, sizeof(controller *) * league_size);
+   qsort(sorted, league_size, sizeof(controller *), standings_compare);
+
+   fprintf(file, "after %u matches\n", played);
+   fprintf(file, "%-10s %8s %8s %8s %8s %8s %10s\n", "controller", "games",
+      "wins", "elo", "mu", "sigma", "mu-3sigma");
+
+   for(guint i = 0; i < league_size; i++){
+      controller *entrant = sorted[i];
+
+      fprintf(file, "%-10s %8u %8u %8.1f %8.2f %8.2f %10.2f\n",
+         entrant->name, entrant->games, entrant->wins, entrant->elo,
+         entrant->mu, entrant->sigma, entrant->mu - (3 * entrant->sigma));
+   }
+
+   fprintf(file, "\n");
+}
+
+gint standings_compare(gconstpointer a, gconstpointer b){
+   const controller *first = *(controller * const *) a;
+   const controller *second = *(controller * const *) b;
+   gdouble first_rating = first->mu - (3 * first->sigma);
+   gdouble second_rating = second->mu - (3 * second->sigma);
+
+   return(first_rating < second_rating?1:first_rating > second_rating?-1:0);
+}
@@ -16,22 +16,67 @@ Usage         : Press play to start a game.  Control of Player 1 is determined
                 by the Up/Down/Left/Right keys on the keyboard.  Control of pl-
                 ayer 2 is determined by the W/S/A/D keys on the keyboard.  Bot-
                 h human controllable players will be controlled by ai until ap-
-                propriate input is detected
+                propriate input is detected.  Fast Forward plays the rest of a
+                game of ai players at full speed without drawing it, showing 
+                the board once the game ends
 Build with    : gcc -o snafu -std=c99 -Wall -g `pkg-config --cflags \
    --libs gtk+-2.0` main.c
+Options       : --width and --height set the size of the board in cells and 
+                --storage selects how it is stored (dense, palette8, palette16
+                or tiled).  --max-length limits the length of every player's 
+                trail, making the tail follow the head like a snake.  Boards 
+                larger than the window are viewed through a viewport:  drag 
+                with the mouse to pan, scroll to zoom and click the minimap to
+                jump.
+                --connect joins a game hosted by snafu-server at ADDRESS, the 
+                path of its unix socket or its loopback tcp port.  The arrow 
+                keys then steer the player the server hands out and the game 
+                is only drawn locally.  --watch follows a game at ADDRESS 
+                through the spectator frame stream without playing.  --shm 
+                publishes the board and players of a local game in shared 
+                memory as NAME, see shm_reader.c.
+                --wall shows N games of ai players at once, stepped on 
+                --threads worker threads, for watching tournaments.
+                --level loads static walls from FILE, a line of text to a
+                row of cells with '#' for walls.  The players start on the
+                same cells whatever the level, and levels walling over them
+                are refused.
+                --ponder lets the ai players of a local game think on 
+                threads of their own between ticks.  Once an ai player's 
+                region has --ponder-below cells or fewer, it solves the 
+                endgame and takes the best move found by the next tick.
+                --solve has the ai players solve regions of --ponder-below
+                cells or fewer on the main loop instead, searching a
+                bounded number of positions every move.
+                --book maps the opening book at FILE, written by book, and
+                the ai players of a local game play its moves while the
+                game is in it.
+                --record writes a replay of every local game to FILE on a
+                thread of its own, see writer.h, gzip if FILE ends in .gz.
 Modifications :
 ******************************************************************************/
-   
+
+#define _GNU_SOURCE
+
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 #include <cairo.h>
+#include <string.h>
 #include "board.h"
+#include "regions.h"
+#include "arena.h"
 #include "snafu.h"
+#include "solver.h"
+#include "ponder.h"
+#include "book.h"
+#include "protocol.h"
+#include "spectate.h"
+#include "shm.h"
+#include "wall.h"
+#include "writer.h"
 
 #define PADDING 25
 
-#define BOARD_WIDTH 45
-#define BOARD_HEIGHT 30
 #define BOARD_CELL_HEIGHT 15
 #define BOARD_CELL_WIDTH 15
 
@@ -40,6 +85,27 @@ Modifications :
 
 #define FREQUENCY_MAX 500
 #define FREQUENCY_MIN 2
+
+#define VIEW_WIDTH_MAX (SNAFU_BOARD_WIDTH * BOARD_CELL_WIDTH)
+#define VIEW_HEIGHT_MAX (SNAFU_BOARD_HEIGHT * BOARD_CELL_HEIGHT)
+
+#define MINIMAP_WIDTH 180
+#define MINIMAP_HEIGHT 120
+#define MINIMAP_PERIOD 250
+
+//iterations run by every idle call while fast forwarding
+#define FAST_FORWARD_TICKS 512
+
+//ai players ponder the endgame once their region has PONDER_BELOW cells
+#define PONDER_BELOW 64
+
+//ai players solving on the main loop search at most SOLVE_NODES positions
+//a move
+#define SOLVE_NODES 100000
+
+//the most pixels the games of --wall take up
+#define WALL_WIDTH_MAX 1280
+#define WALL_HEIGHT_MAX 800
  
 //the game of snafu
 //global for convinience purposes
@@ -49,6 +115,99 @@ static snafu *game;
 //global for convinience purposes
 static GtkWidget *speed_slider;
 
+//the minimap of the board, NULL if the whole board fits the window
+//global for convinience purposes
+static GtkWidget *minimap;
+
+//the idle source fast forwarding the game, 0 when the game runs at speed
+//global for convinience purposes
+static guint fast_forward_ref = 0;
+
+//the socket connected to the server, -1 when playing locally, the player 
+//the server handed out and the bytes received but not yet parsed.  
+//server_view reads the spectator frames when watching
+//global for convinience purposes
+static gint server_fd = -1;
+static guint8 server_player = SNAFU_PROTOCOL_SPECTATOR;
+static GByteArray *server_in;
+static spectate_view *server_view;
+
+//the ponder of every ai player, NULL unless the ai players ponder
+//global for convinience purposes
+static ponder *ponders[NUMBER_PLAYERS];
+
+//the opening book of the ai players, NULL without one
+//global for convinience purposes
+static book *opening_book = NULL;
+
+//the solver of the ai players solving on the main loop, NULL unless they do
+//global for convinience purposes
+static solver *endgame_solver = NULL;
+
+//the writer of the replay and whether every player was alive when last
+//recorded, NULL unless games are recorded
+//global for convinience purposes
+static writer *replay = NULL;
+static gboolean replay_alive[NUMBER_PLAYERS];
+
+//command line options
+static gchar *connect_address = NULL;
+static gchar *watch_address = NULL;
+static gchar *shm_name = NULL;
+static gint board_width = SNAFU_BOARD_WIDTH;
+static gint board_height = SNAFU_BOARD_HEIGHT;
+static gchar *board_storage = NULL;
+static gint max_length = 0;
+static gint wall_games = 0;
+static gint wall_threads = 0;
+static gchar *level_path = NULL;
+static gboolean ponder_ai = FALSE;
+static gboolean solve_ai = FALSE;
+static gint ponder_below = PONDER_BELOW;
+static gchar *book_path = NULL;
+static gchar *record_path = NULL;
+
+static GOptionEntry options[] = {
+   {"width", 0, 0, G_OPTION_ARG_INT, &board_width, 
+      "Width of the board in cells", "CELLS"},
+   {"height", 0, 0, G_OPTION_ARG_INT, &board_height, 
+      "Height of the board in cells", "CELLS"},
+   {"storage", 0, 0, G_OPTION_ARG_STRING, &board_storage, 
+      "Board storage: dense, palette8, palette16 or tiled", "STORAGE"},
+   {"max-length", 0, 0, G_OPTION_ARG_INT, &max_length, 
+      "Longest trail a player may leave, 0 for no limit", "CELLS"},
+   {"connect", 0, 0, G_OPTION_ARG_FILENAME, &connect_address, 
+      "Join the snafu-server at ADDRESS, a socket path or tcp port", 
+      "ADDRESS"},
+   {"watch", 0, 0, G_OPTION_ARG_FILENAME, &watch_address, 
+      "Watch a game of the snafu-server at ADDRESS", "ADDRESS"},
+   {"shm", 0, 0, G_OPTION_ARG_STRING, &shm_name, 
+      "Publish the game in shared memory as NAME", "NAME"},
+   {"wall", 0, 0, G_OPTION_ARG_INT, &wall_games, 
+      "Watch N games of ai players at once", "N"},
+   {"threads", 0, 0, G_OPTION_ARG_INT, &wall_threads, 
+      "Threads stepping the games of --wall, 0 for one per processor", "N"},
+   {"level", 0, 0, G_OPTION_ARG_FILENAME, &level_path, 
+      "Load static walls from the level at FILE", "FILE"},
+   {"ponder", 0, 0, G_OPTION_ARG_NONE, &ponder_ai, 
+      "Let the ai players think between ticks", NULL},
+   {"solve", 0, 0, G_OPTION_ARG_NONE, &solve_ai, 
+      "Let the ai players solve the endgame on the main loop", NULL},
+   {"ponder-below", 0, 0, G_OPTION_ARG_INT, &ponder_below, 
+      "Region size from which pondering or solving ai players solve", 
+      "CELLS"},
+   {"book", 0, 0, G_OPTION_ARG_FILENAME, &book_path, 
+      "Play the opening book at FILE for the ai players", "FILE"},
+   {"record", 0, 0, G_OPTION_ARG_FILENAME, &record_path, 
+      "Record a replay of every game to FILE, gzip if it ends in .gz", 
+      "FILE"},
+   {NULL}
+};
+
+//the cell grabbed by the mouse when panning the view
+static gint drag_x = -1;
+static gint drag_y = -1;
+
 //destroy signal handler
 static void destroy(GtkWidget*, gpointer);
 
@@ -62,6 +221,49 @@ GtkWidget *gtk_button_new_init(gchar *label, gboolean mnemonic);
 //will change the direction of player 1 or player 2 if input is detected
 static gboolean keyboard_press(GtkWidget *widget, GdkEventKey *event);
 
+//connects to the server at address and joins a game, or only watches it 
+//if watch is TRUE, filling in the size and background_color of its board 
+//and its number of players
+//returns FALSE if no game could be joined
+gboolean server_join(const gchar *address, gboolean watch, 
+   board_cell *background_color, guint *number_players);
+
+//io watch on the server socket
+//applies the changed cells, scores and messages sent by the server to brd 
+//and game
+static gboolean server_receive(GIOChannel *channel, GIOCondition condition, 
+   board *brd);
+
+//sends direction for the player handed out by the server
+void server_send_direction(snafu_player_direction direction);
+
+//drawing area button-press-event signal handler
+//grabs the cell under the mouse to pan the view
+static gboolean view_button_press(GtkWidget *widget, GdkEventButton *event, 
+   board *brd);
+
+//drawing area motion-notify-event signal handler
+//pans the view so the grabbed cell stays under the mouse
+static gboolean view_motion(GtkWidget *widget, GdkEventMotion *event, 
+   board *brd);
+
+//drawing area scroll-event signal handler
+//zooms the view around the mouse
+static gboolean view_scroll(GtkWidget *widget, GdkEventScroll *event, 
+   board *brd);
+
+//minimap expose-event signal handler
+static gboolean minimap_expose(GtkWidget *widget, GdkEventExpose *event, 
+   board *brd);
+
+//minimap button-press-event signal handler
+//centers the view on the clicked cell
+static gboolean minimap_button_press(GtkWidget *widget, GdkEventButton *event,
+   board *brd);
+
+//timeout which periodically redraws the minimap
+static gboolean minimap_refresh(GtkWidget *widget);
+
 //resets the score for all snafu_players of game
 void score_reset(snafu *game);
 
@@ -73,9 +275,67 @@ static void score_reset_button_press(GtkButton *button, snafu *game);
 //will reset score if the speed slider bares a new value
 static void start_button_press(GtkButton *button, snafu *game);
 
+//shows a window with a wall of wall_games games until it is closed
+//returns the exit status of the program
+gint wall_main(void);
+
+//fast_forward_button signal handler, plays the rest of an ai only game
+//without drawing it
+static void fast_forward_button_press(GtkButton *button, snafu *game);
+
+//idle function running the next FAST_FORWARD_TICKS iterations of a fast 
+//forwarded game, showing the tick reached.  once the game ends or a player 
+//is steered by hand the board is drawn and the game goes on at speed
+static gboolean fast_forward(snafu *game);
+
+//stops fast forwarding without drawing anything
+void fast_forward_cancel(void);
+
+//step_func of local games, publishing game to shm if it is not NULL, 
+//posting the new state to the ponders and recording it to the replay
+void game_step(snafu *game, gpointer shm);
+
+//pushes the records of the latest iteration of game to the replay, or of
+//its start when no iteration was played yet
+void game_record(snafu *game);
+
+//steer_func of local games with ponders, a book or a solver, steering
+//every ai player with its book move while the game is in the book, the move
+//its ponder found since the last iteration otherwise, and else the move the
+//solver finds once its region is small enough
+void game_steer(snafu *game, gpointer data);
+
 //main function
 int main (int argc, char *argv[]){
-   gtk_init(&argc, &argv);
+   GError *error = NULL;
+
+   if(!gtk_init_with_args(&argc, &argv, NULL, options, NULL, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   if(wall_games > 0){
+      return(wall_main());
+   }
+
+   board_cell background_color = board_cell_new_with_color(128, 128, 128);
+   guint number_players = NUMBER_PLAYERS;
+
+   if(connect_address != NULL || watch_address != NULL){
+      const gchar *address = watch_address != NULL?watch_address:
+         connect_address;
+
+      if(!server_join(address, watch_address != NULL, &background_color, 
+         &number_players)){
+         g_printerr("cannot join a game at %s\n", address);
+         return(1);
+      }
+   }else{
+      //the players start at fixed cells of the default board
+      board_width = MAX(board_width, SNAFU_BOARD_WIDTH);
+      board_height = MAX(board_height, SNAFU_BOARD_HEIGHT);
+   }
 
    //get window and initialize
    GtkWidget *window = gtk_window_new_init(GTK_WINDOW_TOPLEVEL,
@@ -95,14 +355,120 @@ int main (int argc, char *argv[]){
 
    //create board + play area widget + snafu
    GtkWidget *drawing_area = gtk_event_box_new();
-   gtk_widget_set_size_request(drawing_area, BOARD_WIDTH * BOARD_CELL_WIDTH, 
-      BOARD_HEIGHT * BOARD_CELL_HEIGHT);
+   gtk_widget_set_size_request(drawing_area, 
+      MIN(board_width * BOARD_CELL_WIDTH, VIEW_WIDTH_MAX), 
+      MIN(board_height * BOARD_CELL_HEIGHT, VIEW_HEIGHT_MAX));
+
+   board *brd = board_new_with_storage(drawing_area, board_width, board_height,
+      BOARD_CELL_WIDTH, BOARD_CELL_HEIGHT, background_color, 
+      board_storage_parse(board_storage));
+
+   //the server owns the cells of a joined game, walls included
+   if(level_path != NULL && server_fd < 0 && 
+      !board_walls_load(brd, level_path, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   //pan and zoom the view with the mouse
+   gtk_widget_add_events(drawing_area, GDK_BUTTON_PRESS_MASK | 
+      GDK_BUTTON1_MOTION_MASK | GDK_SCROLL_MASK);
 
-   board *brd = board_new(drawing_area, BOARD_WIDTH, BOARD_HEIGHT, 
-      BOARD_CELL_WIDTH, BOARD_CELL_HEIGHT, board_cell_new_with_color(128, 128, 
-      128));
+   g_signal_connect(drawing_area, "button-press-event", 
+      G_CALLBACK(view_button_press), brd);
+   g_signal_connect(drawing_area, "motion-notify-event", 
+      G_CALLBACK(view_motion), brd);
+   g_signal_connect(drawing_area, "scroll-event", G_CALLBACK(view_scroll), 
+      brd);
 
-   game = snafu_new(brd, NUMBER_PLAYERS, FREQUENCY);
+   //the minimap is only needed when the board does not fit the window
+   minimap = NULL;
+
+   if(board_width * BOARD_CELL_WIDTH > VIEW_WIDTH_MAX || 
+      board_height * BOARD_CELL_HEIGHT > VIEW_HEIGHT_MAX){
+      minimap = gtk_drawing_area_new();
+      gtk_widget_set_size_request(minimap, MINIMAP_WIDTH, MINIMAP_HEIGHT);
+      gtk_widget_add_events(minimap, GDK_BUTTON_PRESS_MASK);
+
+      g_signal_connect(minimap, "expose-event", G_CALLBACK(minimap_expose), 
+         brd);
+      g_signal_connect(minimap, "button-press-event", 
+         G_CALLBACK(minimap_button_press), brd);
+
+      g_timeout_add(MINIMAP_PERIOD, (GSourceFunc) minimap_refresh, minimap);
+   }
+
+   game = snafu_new(brd, number_players, FREQUENCY);
+
+   if(!snafu_walls_check(game, &error)){
+      g_printerr("%s: %s\n", level_path, error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   snafu_set_max_length(game, MAX(max_length, 0));
+
+   //only local games step, so only they are published
+   snafu_shm *shm = NULL;
+
+   if(shm_name != NULL && server_fd < 0){
+      shm = snafu_shm_new(shm_name, game);
+
+      if(shm == NULL){
+         g_printerr("cannot publish %s: %s\n", shm_name, g_strerror(errno));
+      }
+   }
+
+   //the ai players think on their own threads while the main loop waits
+   if(ponder_ai && server_fd < 0){
+      snafu_set_track_regions(game, TRUE);
+
+      for(guint i = 0; i < game->number_players; i++){
+         *(ponders + i) = ponder_new(brd);
+      }
+
+   }
+
+   if(solve_ai && server_fd < 0){
+      snafu_set_track_regions(game, TRUE);
+
+      endgame_solver = solver_new();
+   }
+
+   if(book_path != NULL && server_fd < 0){
+      opening_book = book_open(book_path, &error);
+
+      if(opening_book == NULL){
+         g_printerr("%s\n", error->message);
+         g_error_free(error);
+         return(1);
+      }
+   }
+
+   if(*ponders != NULL || opening_book != NULL || endgame_solver != NULL){
+      snafu_set_steer_func(game, game_steer, NULL);
+   }
+
+   if(record_path != NULL && server_fd < 0){
+      gint fd = open(record_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+         0644);
+
+      if(fd < 0){
+         g_printerr("cannot record to %s: %s\n", record_path, 
+            g_strerror(errno));
+         return(1);
+      }
+
+      //room for the records before the first iteration besides the rest
+      replay = writer_new(fd, sizeof(writer_replay), WRITER_CAPACITY + 
+         NUMBER_PLAYERS + 2 + (brd->wall_cells != NULL?
+         brd->wall_cells->len:0), g_str_has_suffix(record_path, ".gz"));
+   }
+
+   if(shm != NULL || *ponders != NULL || replay != NULL){
+      snafu_set_step_func(game, game_step, shm);
+   }
 
    //create score board
    GtkWidget *score_board = gtk_event_box_new();
@@ -136,6 +502,13 @@ int main (int argc, char *argv[]){
    gtk_scale_add_mark(GTK_SCALE(speed_slider), FREQUENCY, GTK_POS_BOTTOM, 
       "Default Speed");
 
+   //fast forward button
+   GtkWidget *fast_forward_button = gtk_button_new_init("Fast Forward", 
+      FALSE);
+
+   g_signal_connect(fast_forward_button, "clicked", 
+      G_CALLBACK(fast_forward_button_press), game);
+
    //score reset button
    GtkWidget *score_reset_button = gtk_button_new_init("Reset Score", FALSE);
  
@@ -144,11 +517,36 @@ int main (int argc, char *argv[]){
 
    //attach buttons_hbox
    gtk_box_pack_start(GTK_BOX(buttons_hbox), start_button, FALSE, FALSE, 0);
+   gtk_box_pack_start(GTK_BOX(buttons_hbox), fast_forward_button, FALSE, 
+      FALSE, 0);
    gtk_box_pack_start(GTK_BOX(buttons_hbox), message_label, TRUE, TRUE, PADDING);
 
    gtk_box_pack_start(GTK_BOX(buttons_hbox), score_reset_button, FALSE, FALSE,
       0);
 
+   if(minimap != NULL){
+      gtk_box_pack_start(GTK_BOX(buttons_hbox), minimap, FALSE, FALSE, 0);
+   }
+
+   //the server runs the game, only steering is left to this window
+   if(server_fd >= 0){
+      gtk_widget_set_sensitive(start_button, FALSE);
+      gtk_widget_set_sensitive(fast_forward_button, FALSE);
+      gtk_widget_set_sensitive(score_reset_button, FALSE);
+      gtk_widget_set_sensitive(speed_slider, FALSE);
+
+      gtk_label_set_markup(GTK_LABEL(message_label), 
+         server_player == SNAFU_PROTOCOL_SPECTATOR?"Watching":
+         "Use the arrow keys to steer");
+
+      GIOChannel *channel = g_io_channel_unix_new(server_fd);
+
+      g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, 
+         (GIOFunc) server_receive, brd);
+
+      g_io_channel_unref(channel);
+   }
+
    //accept user keyboard input
    g_signal_connect(window, "key-press-event", G_CALLBACK(keyboard_press), 
       NULL);
@@ -166,6 +564,39 @@ int main (int argc, char *argv[]){
 
    gtk_main();
 
+   if(shm != NULL){
+      snafu_shm_free(shm);
+   }
+
+   for(guint i = 0; i < NUMBER_PLAYERS && *(ponders + i) != NULL; i++){
+      ponder_free(*(ponders + i));
+   }
+
+   if(endgame_solver != NULL){
+      solver_free(endgame_solver);
+   }
+
+   if(opening_book != NULL){
+      book_close(opening_book);
+   }
+
+   if(replay != NULL){
+      //the drops at the end have no record after them to be marked in front of
+      writer_wait(replay, 1);
+      writer_mark_dropped(replay, game->tick);
+
+      guint pushed = replay->head, dropped = replay->dropped;
+      guint high_water = replay->high_water, capacity = replay->capacity;
+
+      if(!writer_free(replay)){
+         g_printerr("cannot record to %s: %s\n", record_path, 
+            g_strerror(errno));
+      }
+
+      g_printerr("recorded %u records to %s, %u dropped, at most %u of %u "
+         "queued\n", pushed, record_path, dropped, high_water, capacity);
+   }
+
    return(0);
 }
 
@@ -187,6 +618,36 @@ GtkWidget *gtk_button_new_init(gchar *label, gboolean mnemonic){
 }
 
 static gboolean keyboard_press(GtkWidget *widget, GdkEventKey *event){
+   if(server_fd >= 0){
+      if(event->type != GDK_KEY_PRESS){
+         return(TRUE);
+      }
+
+      switch(event->keyval){
+         case(GDK_KEY_Up):{
+            server_send_direction(SNAFU_UP);
+            break;
+         }
+         case(GDK_KEY_Down):{
+            server_send_direction(SNAFU_DOWN);
+            break;
+         }
+         case(GDK_KEY_Right):{
+            server_send_direction(SNAFU_RIGHT);
+            break;
+         }
+         case(GDK_KEY_Left):{
+            server_send_direction(SNAFU_LEFT);
+            break;
+         }
+         default:{
+
+         }
+      }
+
+      return(TRUE);
+   }
+
    if(!game->started){
       return(FALSE);
    }
@@ -256,10 +717,234 @@ static gboolean keyboard_press(GtkWidget *widget, GdkEventKey *event){
    return(TRUE);
 }
 
+gboolean server_join(const gchar *address, gboolean watch, 
+   board_cell *background_color, guint *number_players){
+   server_fd = snafu_protocol_connect(address);
+
+   if(server_fd < 0){
+      return(FALSE);
+   }
+
+   server_in = g_byte_array_new();
+
+   guint offset = snafu_protocol_begin(server_in, 
+      watch?SNAFU_MESSAGE_WATCH:SNAFU_MESSAGE_JOIN);
+   snafu_protocol_put_u32(server_in, SNAFU_PROTOCOL_ANY_SESSION);
+   snafu_protocol_end(server_in, offset);
+
+   guint8 type;
+   const guint8 *payload;
+   guint32 length;
+
+   if(!snafu_protocol_write_all(server_fd, server_in->data, server_in->len) ||
+      !snafu_protocol_read_message(server_fd, server_in, &type, &payload, 
+      &length) || type != SNAFU_MESSAGE_WELCOME || length < 18){
+      close(server_fd);
+      server_fd = -1;
+      return(FALSE);
+   }
+
+   server_player = *(payload + 4);
+   *number_players = *(payload + 5);
+   board_width = snafu_protocol_get_u32(payload + 6);
+   board_height = snafu_protocol_get_u32(payload + 10);
+   *background_color = snafu_protocol_get_u32(payload + 14);
+
+   g_byte_array_set_size(server_in, 0);
+
+   if(watch){
+      server_view = spectate_view_new();
+   }
+
+   //the rest arrives through server_receive
+   fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+
+   return(TRUE);
+}
+
+static gboolean server_receive(GIOChannel *channel, GIOCondition condition, 
+   board *brd){
+   guint8 buffer[4096];
+   gssize got;
+
+   while((got = recv(server_fd, buffer, sizeof(buffer), 0)) > 0){
+      g_byte_array_append(server_in, buffer, got);
+   }
+
+   guint offset = 0;
+   guint8 type;
+   const guint8 *payload;
+   guint32 length;
+   gboolean corrupt;
+
+   while(snafu_protocol_next(server_in, &offset, &type, &payload, &length, 
+      &corrupt)){
+      switch(type){
+         case(SNAFU_MESSAGE_CELLS):{
+            //the tick in front of the cells is only of use to spectators
+            for(guint32 i = 4; i + 8 <= length; i += 8){
+               guint32 cell_number = snafu_protocol_get_u32(payload + i);
+
+               if(cell_number < brd->width * brd->height){
+                  board_set_cell(brd, cell_number % brd->width, 
+                     cell_number / brd->width, 
+                     snafu_protocol_get_u32(payload + i + 4));
+               }
+            }
+
+            break;
+         }
+         case(SNAFU_MESSAGE_FRAME):{
+            gsize frame_offset = 0;
+            const guint8 *body;
+            guint32 body_length;
+
+            while(server_view != NULL && spectate_view_next(payload, length, 
+               &frame_offset, &body, &body_length)){
+               if(spectate_view_apply(server_view, brd, body, body_length)){
+                  continue;
+               }
+
+               //the frames until the next keyframe cannot be applied
+               spectate_view_free(server_view);
+               server_view = spectate_view_new();
+
+               guint8 message[SNAFU_PROTOCOL_HEADER_LENGTH] = 
+                  {SNAFU_MESSAGE_KEYFRAME, 0, 0, 0, 0};
+
+               snafu_protocol_write_all(server_fd, message, sizeof(message));
+            }
+
+            break;
+         }
+         case(SNAFU_MESSAGE_CLEAR):{
+            board_clear(brd, TRUE);
+            break;
+         }
+         case(SNAFU_MESSAGE_SCORE):{
+            if(length >= 5 && *payload < game->number_players){
+               snafu_player_set_score(game->players + *payload, 
+                  snafu_protocol_get_u32(payload + 1));
+            }
+
+            break;
+         }
+         case(SNAFU_MESSAGE_TEXT):{
+            gchar *message = g_strndup((const gchar *) payload, length);
+
+            snafu_display_message(game, message);
+
+            g_free(message);
+            break;
+         }
+         default:{
+
+         }
+      }
+   }
+
+   g_byte_array_remove_range(server_in, 0, offset);
+
+   board_incremental_draw(brd);
+   snafu_flush_display(game);
+
+   if(corrupt || got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && 
+      errno != EINTR)){
+      close(server_fd);
+      server_fd = -1;
+
+      snafu_display_message(game, "<b>Disconnected from the server</b>");
+      snafu_flush_display(game);
+
+      return(FALSE);
+   }
+
+   return(TRUE);
+}
+
+void server_send_direction(snafu_player_direction direction){
+   if(server_player == SNAFU_PROTOCOL_SPECTATOR){
+      return;
+   }
+
+   guint8 message[SNAFU_PROTOCOL_HEADER_LENGTH + 1] = 
+      {SNAFU_MESSAGE_DIRECTION, 1, 0, 0, 0, direction};
+
+   snafu_protocol_write_all(server_fd, message, sizeof(message));
+}
+
+static gboolean view_button_press(GtkWidget *widget, GdkEventButton *event, 
+   board *brd){
+   board_view_cell_at(brd, event->x, event->y, &drag_x, &drag_y);
+
+   return(TRUE);
+}
+
+static gboolean view_motion(GtkWidget *widget, GdkEventMotion *event, 
+   board *brd){
+   board_view_place(brd, drag_x, drag_y, event->x, event->y);
+
+   gtk_widget_queue_draw(widget);
+
+   if(minimap != NULL){
+      gtk_widget_queue_draw(minimap);
+   }
+
+   return(TRUE);
+}
+
+static gboolean view_scroll(GtkWidget *widget, GdkEventScroll *event, 
+   board *brd){
+   board_view_zoom(brd, event->direction == GDK_SCROLL_UP?1:-1, event->x, 
+      event->y);
+
+   gtk_widget_queue_draw(widget);
+
+   if(minimap != NULL){
+      gtk_widget_queue_draw(minimap);
+   }
+
+   return(TRUE);
+}
+
+static gboolean minimap_expose(GtkWidget *widget, GdkEventExpose *event, 
+   board *brd){
+   cairo_t *cr = gdk_cairo_create(widget->window);
+
+   board_draw_minimap(brd, cr, widget->allocation.width, 
+      widget->allocation.height);
+
+   cairo_destroy(cr);
+
+   return(TRUE);
+}
+
+static gboolean minimap_button_press(GtkWidget *widget, GdkEventButton *event,
+   board *brd){
+   gdouble scale = MIN((gdouble) widget->allocation.width / brd->width, 
+      (gdouble) widget->allocation.height / brd->height);
+
+   board_view_place(brd, event->x / scale, event->y / scale, 
+      brd->view_width / 2, brd->view_height / 2);
+
+   gtk_widget_queue_draw(brd->widget);
+   gtk_widget_queue_draw(widget);
+
+   return(TRUE);
+}
+
+static gboolean minimap_refresh(GtkWidget *widget){
+   gtk_widget_queue_draw(widget);
+
+   return(TRUE);
+}
+
 void score_reset(snafu *game){
    for(gint i = 0; i < game->number_players; i++){
       snafu_player_set_score(game->players + i, 0);
    }
+
+   snafu_flush_display(game);
 }
 
 static void score_reset_button_press(GtkButton *button, snafu *game){
@@ -269,6 +954,8 @@ static void score_reset_button_press(GtkButton *button, snafu *game){
 static void start_button_press(GtkButton *button, snafu *game){
    static guint last_speed = 0;
    guint _last_speed = 0;
+
+   fast_forward_cancel();
    
    if(game->started){
       snafu_end(game);
@@ -291,3 +978,185 @@ static void start_button_press(GtkButton *button, snafu *game){
    snafu_start(game);
 }
 
+gint wall_main(void){
+   GtkWidget *window = gtk_window_new_init(GTK_WINDOW_TOPLEVEL,
+      "New Snafu Wall");
+   gtk_window_set_resizable(GTK_WINDOW(window), FALSE);
+   gtk_container_set_border_width(GTK_CONTAINER(window), PADDING);
+
+   g_signal_connect(G_OBJECT(window), "destroy", G_CALLBACK(destroy), NULL);
+
+   //the players start at fixed cells of the default board
+   wall *games = wall_new(wall_games, MAX(board_width, SNAFU_BOARD_WIDTH),
+      MAX(board_height, SNAFU_BOARD_HEIGHT), NUMBER_PLAYERS, 
+      MAX(max_length, 0), FREQUENCY, MAX(wall_threads, 0), WALL_WIDTH_MAX, 
+      WALL_HEIGHT_MAX);
+
+   gtk_container_add(GTK_CONTAINER(window), games->widget);
+
+   gtk_widget_show_all(window);
+
+   gtk_main();
+
+   wall_free(games);
+
+   return(0);
+}
+
+static void fast_forward_button_press(GtkButton *button, snafu *game){
+   if(fast_forward_ref){
+      return;
+   }
+
+   if(!game->active){
+      start_button_press(button, game);
+   }
+
+   if(!snafu_ai_only(game)){
+      snafu_display_message(game, "Only games of ai players fast forward");
+      snafu_flush_display(game);
+      return;
+   }
+
+   //the game is stepped from the idle source instead of its timeout
+   if(game->timeout_func_ref){
+      g_source_remove(game->timeout_func_ref);
+      game->timeout_func_ref = 0;
+   }
+
+   fast_forward_ref = g_idle_add((GSourceFunc) fast_forward, game);
+}
+
+static gboolean fast_forward(snafu *game){
+   snafu_fast_forward(game, FAST_FORWARD_TICKS);
+
+   if(game->active && snafu_ai_only(game)){
+      snafu_display_message_printf(game, "Fast forwarding, tick %u", 
+         game->tick);
+      snafu_flush_display(game);
+
+      return(TRUE);
+   }
+
+   fast_forward_ref = 0;
+
+   snafu_redraw(game);
+
+   //a player took over, the rest of the game is played at speed
+   if(game->active){
+      game->timeout_func_ref = g_timeout_add(game->frequency, 
+         (GSourceFunc) snafu_next, game);
+   }
+
+   return(FALSE);
+}
+
+void fast_forward_cancel(void){
+   if(fast_forward_ref){
+      g_source_remove(fast_forward_ref);
+      fast_forward_ref = 0;
+   }
+}
+
+void game_step(snafu *game, gpointer shm){
+   if(shm != NULL){
+      snafu_shm_step(game, shm);
+   }
+
+   for(guint i = 0; i < NUMBER_PLAYERS && *(ponders + i) != NULL; i++){
+      snafu_player *player = game->players + i;
+
+      if(!player->human){
+         ponder_post(*(ponders + i), game, player, MAX(ponder_below, 0));
+      }
+   }
+
+   if(replay != NULL){
+      game_record(game);
+   }
+}
+
+void game_record(snafu *game){
+   board *brd = game->play_area;
+
+   if(!game->tick){
+      writer_push_replay(replay, 0, WRITER_REPLAY_GAME, game->number_players,
+         brd->width, brd->height, 0, game->max_length);
+
+      for(guint i = 0; i < game->number_players; i++){
+         snafu_player *player = game->players + i;
+
+         writer_push_replay(replay, 0, WRITER_REPLAY_PLAYER, i, player->x, 
+            player->y, player->direction, player->cell_value);
+
+         *(replay_alive + i) = TRUE;
+      }
+
+      for(guint i = 0; brd->wall_cells != NULL && i < brd->wall_cells->len; 
+         i++){
+         gint64 cell_number = g_array_index(brd->wall_cells, gint64, i);
+
+         writer_push_replay(replay, 0, WRITER_REPLAY_WALL, 0, 
+            BOARD_X(brd, cell_number), BOARD_Y(brd, cell_number), 0, 0);
+      }
+
+      return;
+   }
+
+   for(guint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+
+      if(player->alive){
+         writer_push_replay(replay, game->tick, WRITER_REPLAY_HEAD, i, 
+            player->x, player->y, player->direction, 0);
+      }else if(*(replay_alive + i)){
+         writer_push_replay(replay, game->tick, WRITER_REPLAY_DEATH, i, 
+            player->x, player->y, player->direction, 0);
+
+         *(replay_alive + i) = FALSE;
+      }
+   }
+
+   if(!game->active){
+      guint winner = G_MAXUINT8;
+
+      for(guint i = 0; i < game->number_players; i++){
+         if((game->players + i)->alive){
+            winner = i;
+         }
+      }
+
+      writer_push_replay(replay, game->tick, WRITER_REPLAY_END, winner, 0, 0,
+         0, 0);
+   }
+}
+
+void game_steer(snafu *game, gpointer data){
+   for(guint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+      snafu_player_direction direction = SNAFU_RANDOM;
+
+      if(!player->alive || player->human){
+         continue;
+      }
+
+      if(opening_book != NULL){
+         direction = book_lookup(opening_book, game, player);
+      }
+
+      if(direction == SNAFU_RANDOM && *(ponders + i) != NULL){
+         direction = ponder_take(*(ponders + i));
+      }
+
+      if(direction == SNAFU_RANDOM && endgame_solver != NULL &&
+         snafu_player_space(game, player) <= (guint) MAX(ponder_below, 0)){
+         direction = solver_move(endgame_solver, game, player, SOLVE_NODES);
+      }
+
+      //left to the crude ai until the book, the ponder or the solver has
+      //something
+      if(direction != SNAFU_RANDOM){
+         player->direction = direction;
+      }
+   }
+}
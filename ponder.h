@@ -0,0 +1,357 @@
+//symbolic constants used by ponder
+//
+//a ponder thinks about the moves of an ai player on a thread of its own
+//while the main loop waits for the next tick.  after every iteration the
+//game posts the state of the board to the ponder, which copies the
+//occupied cells and never touches the game itself.  the ponder solves the
+//endgame from that copy with a solver, deeper and deeper until the outcome
+//is known or the next state is posted, and publishes the best move of
+//every search it finishes.  before the next iteration the game picks up
+//the move published for the state it posted
+//
+//neither side ever waits for the other.  states are handed over through
+//three buffers:  the game fills one, the ponder reads another, and the
+//third holds the latest state posted, swapped in and out with compare and
+//exchange.  a swap only fails when the other side swapped in between, and
+//the ponder only swaps once a state was posted, so no swap fails twice in
+//a row.  moves come back as a single gint holding the serial number of 
+//the state they were found for and the direction
+
+//the number of state buffers
+#define PONDER_BUFFERS 3
+
+//set in the middle buffer index of a ponder when the state in it was
+//posted and not yet taken by the ponder
+#define PONDER_FRESH 4
+
+//the longest the thread of a ponder sleeps before looking for a new
+//state, in microseconds, in case the wake up was missed
+#define PONDER_IDLE_USEC 1000
+
+//the bits of a published move holding the direction, the serial number 
+//of its state being in the bits above
+#define PONDER_MOVE_SHIFT 4
+#define PONDER_MOVE_MASK 0xf
+
+//the bits of serial numbers kept in published moves
+#define PONDER_SERIAL_MASK (G_MAXUINT >> (PONDER_MOVE_SHIFT + 1))
+
+//typedefs
+
+//a state posted to a ponder
+//
+//filled holds a byte for every cell of the board, not 0 for occupied
+//cells.  head and other are the cells of the heads of the player and the
+//opponent sharing its region, other being -1 without an opponent, first
+//is TRUE when the player moves before the opponent and others_live when
+//players outside the region are alive.  serial counts
+//the states posted, so moves found for older states or games are never
+//taken for newer ones.  solve is FALSE
+//when there is nothing to solve, the rest of the state being left out
+typedef struct _ponder_state{
+   guint8 *filled;  //the occupied cells
+   gint head;       //the head of the player
+   gint other;      //the head of the opponent
+   gboolean first;  //whether the player moves first
+   gboolean others_live; //whether players outside the region are alive
+   guint serial;    //the number of the state
+   gboolean solve;  //whether there is anything to solve
+} ponder_state;
+
+//a ponder
+//
+//states are the buffers of the posted states.  back is the buffer the game
+//fills and front the one the thread reads.  middle is the index of the
+//third, with PONDER_FRESH set while it holds a state not yet taken
+//
+//mirror is a board kept by the thread alike to the state it reads, written
+//only where the state differs, so its hash is updated rather than
+//recomputed.  solve searches mirror and stops whenever cancel is set, which
+//posting a state does
+//
+//posted is the serial number of the latest state posted.  move is the 
+//latest move published, the serial number of its state shifted left by 
+//PONDER_MOVE_SHIFT and the direction in the bits below.  quit stops the
+//thread.  lock and wake let the thread sleep while there is nothing to do
+//
+//ponders must be freed with ponder_free
+typedef struct _ponder{
+   ponder_state states[PONDER_BUFFERS]; //the state buffers
+   gint back;             //the buffer of the game
+   volatile gint middle;  //the buffer in between, and PONDER_FRESH
+   gint front;            //the buffer of the thread
+   guint posted;          //the serial number of the latest state
+   board *mirror;         //the board as the thread sees it
+   solver *solve;         //the solver searching mirror
+   volatile gint move;    //the latest move published
+   volatile gint cancel;  //set when a newer state is posted
+   volatile gint quit;    //set to stop the thread
+   GMutex lock;           //guards sleeping on wake
+   GCond wake;            //signalled whenever a state is posted
+   GThread *thread;       //the thread pondering
+} ponder;
+
+
+/****
+ *ponder functions
+ ****/
+
+//returns a ponder for the players of boards the size of brd, its thread
+//already waiting for the first state
+ponder *ponder_new(board *brd);
+
+//stops the thread of pondering and frees it
+void ponder_free(ponder *pondering);
+
+//posts the state of game after its latest iteration for player to solve
+//once the region of player has solve_below cells or fewer and at most one
+//opponent.  called on the thread running game, never waits
+void ponder_post(ponder *pondering, snafu *game, snafu_player *player,
+   guint solve_below);
+
+//returns the direction published for the latest state posted, or 
+//SNAFU_RANDOM if none was published for it yet.  called on the thread 
+//running game, never waits
+snafu_player_direction ponder_take(ponder *pondering);
+
+//GThreadFunc of a ponder, solving every state taken until it quits
+gpointer ponder_run(ponder *pondering);
+
+//swaps the freshest posted state into the front buffer of pondering
+//returns FALSE if no state was posted since the last swap
+gboolean ponder_swap(ponder *pondering);
+
+//writes the cells of state which differ from mirror to mirror
+void ponder_load(ponder *pondering, ponder_state *state);
+
+/********/
+
+ponder *ponder_new(board *brd){
+   ponder *new_ponder = g_new(ponder, 1);
+   gint cells = brd->width * brd->height;
+
+   for(gint k = 0; k < PONDER_BUFFERS; k++){
+      ponder_state *state = new_ponder->states + k;
+
+      state->filled = g_new0(guint8, cells);
+      state->head = -1;
+      state->other = -1;
+      state->first = TRUE;
+      state->others_live = FALSE;
+      state->serial = 0;
+      state->solve = FALSE;
+   }
+
+   new_ponder->back = 0;
+   new_ponder->middle = 1;
+   new_ponder->front = 2;
+   new_ponder->posted = 0;
+
+   //the thread only reads the cells, so the mirror needs no widget
+   new_ponder->mirror = board_new(NULL, brd->width, brd->height, 1, 1,
+      brd->background_color);
+
+   board_hash_alloc(new_ponder->mirror);
+
+   new_ponder->solve = solver_new();
+   new_ponder->solve->cancel = &new_ponder->cancel;
+
+   new_ponder->move = SNAFU_RANDOM;
+   new_ponder->cancel = 0;
+   new_ponder->quit = 0;
+
+   g_mutex_init(&new_ponder->lock);
+   g_cond_init(&new_ponder->wake);
+
+   new_ponder->thread = g_thread_new("ponder", (GThreadFunc) ponder_run,
+      new_ponder);
+
+   return(new_ponder);
+}
+
+void ponder_free(ponder *pondering){
+   g_atomic_int_set(&pondering->quit, 1);
+   g_atomic_int_set(&pondering->cancel, 1);
+
+   g_mutex_lock(&pondering->lock);
+   g_cond_signal(&pondering->wake);
+   g_mutex_unlock(&pondering->lock);
+
+   g_thread_join(pondering->thread);
+
+   for(gint k = 0; k < PONDER_BUFFERS; k++){
+      g_free((pondering->states + k)->filled);
+   }
+
+   solver_free(pondering->solve);
+   board_free(pondering->mirror);
+
+   g_mutex_clear(&pondering->lock);
+   g_cond_clear(&pondering->wake);
+
+   g_free(pondering);
+}
+
+void ponder_post(ponder *pondering, snafu *game, snafu_player *player,
+   guint solve_below){
+   ponder_state *state = pondering->states + pondering->back;
+   board *brd = game->play_area;
+   gint opponent = -2;
+
+   state->serial = ++pondering->posted & PONDER_SERIAL_MASK;
+   state->solve = FALSE;
+
+   if(player->alive && snafu_player_space(game, player) <= solve_below){
+      opponent = solver_opponent(game, player);
+   }
+
+   if(opponent != -2){
+      state->solve = TRUE;
+      state->head = (brd->width * player->y) + player->x;
+      state->other = -1;
+      state->first = TRUE;
+      state->others_live = FALSE;
+
+      if(opponent >= 0){
+         snafu_player *other = game->players + opponent;
+
+         state->other = (brd->width * other->y) + other->x;
+         state->first = other > player;
+         state->others_live = solver_others_live(game, player, opponent);
+      }
+
+      for(gint i = 0; i < (brd->width * brd->height); i++){
+         *(state->filled + i) = board_read_cell_flags(brd, i) != 0;
+      }
+   }
+
+   gint middle;
+
+   do{
+      middle = g_atomic_int_get(&pondering->middle);
+   }while(!g_atomic_int_compare_and_exchange(&pondering->middle, middle,
+      pondering->back | PONDER_FRESH));
+
+   pondering->back = middle & (~PONDER_FRESH);
+
+   //whatever the thread is searching is out of date
+   g_atomic_int_set(&pondering->cancel, 1);
+   g_cond_signal(&pondering->wake);
+}
+
+snafu_player_direction ponder_take(ponder *pondering){
+   gint move = g_atomic_int_get(&pondering->move);
+
+   if((guint) move >> PONDER_MOVE_SHIFT != 
+      (pondering->posted & PONDER_SERIAL_MASK)){
+      return(SNAFU_RANDOM);
+   }
+
+   return(move & PONDER_MOVE_MASK);
+}
+
+gpointer ponder_run(ponder *pondering){
+   while(!g_atomic_int_get(&pondering->quit)){
+      if(!ponder_swap(pondering)){
+         g_mutex_lock(&pondering->lock);
+
+         if(!(g_atomic_int_get(&pondering->middle) & PONDER_FRESH) &&
+            !g_atomic_int_get(&pondering->quit)){
+            g_cond_wait_until(&pondering->wake, &pondering->lock,
+               g_get_monotonic_time() + PONDER_IDLE_USEC);
+         }
+
+         g_mutex_unlock(&pondering->lock);
+
+         continue;
+      }
+
+      //cleared after the swap.  a post sets cancel after swapping its state
+      //in, so a state posted before the clear is still fresh and taken
+      //first, and one posted after it cancels the search.  ponder_free
+      //sets quit before cancel in the same way
+      g_atomic_int_set(&pondering->cancel, 0);
+
+      if((g_atomic_int_get(&pondering->middle) & PONDER_FRESH) ||
+         g_atomic_int_get(&pondering->quit)){
+         continue;
+      }
+
+      ponder_state *state = pondering->states + pondering->front;
+      solver *solve = pondering->solve;
+      gint moves[SOLVER_MOVES], best;
+
+      if(!state->solve){
+         continue;
+      }
+
+      ponder_load(pondering, state);
+
+      //the positions of earlier states stay valid unless the order of the
+      //players changed
+      if(state->first != solve->first){
+         solver_reset(solve);
+      }
+
+      solver_prepare(solve, pondering->mirror, state->first, 
+         state->others_live, G_MAXUINT64);
+
+      //no way on, the player dies whichever way it goes
+      if(!solver_moves(solve, state->head, moves)){
+         continue;
+      }
+
+      gint depth_limit = MIN(solver_space(solve, state->head) + 1,
+         SOLVER_MAX_DEPTH);
+
+      for(gint depth = 1; depth <= depth_limit; depth++){
+         solve->horizon = FALSE;
+
+         solver_search(solve, state->head, state->other, depth,
+            -SOLVER_WIN, SOLVER_WIN, &best);
+
+         if(solve->out_of_budget){
+            break;
+         }
+
+         g_atomic_int_set(&pondering->move, (gint) 
+            ((state->serial << PONDER_MOVE_SHIFT) | (SNAFU_UP << best)));
+
+         if(!solve->horizon){
+            break;
+         }
+      }
+   }
+
+   return(NULL);
+}
+
+gboolean ponder_swap(ponder *pondering){
+   gint middle = g_atomic_int_get(&pondering->middle);
+
+   if(!(middle & PONDER_FRESH)){
+      return(FALSE);
+   }
+
+   //the game may have posted again in between, the state is fresh anyway
+   while(!g_atomic_int_compare_and_exchange(&pondering->middle, middle,
+      pondering->front)){
+      middle = g_atomic_int_get(&pondering->middle);
+   }
+
+   pondering->front = middle & (~PONDER_FRESH);
+
+   return(TRUE);
+}
+
+void ponder_load(ponder *pondering, ponder_state *state){
+   board *mirror = pondering->mirror;
+   board_cell occupied = board_cell_new_with_flags(1, 0, 0, 0);
+
+   for(gint i = 0; i < (mirror->width * mirror->height); i++){
+      if(*(state->filled + i) != (board_read_cell_flags(mirror, i) != 0)){
+         board_write_cell(mirror, i, *(state->filled + i)?occupied:
+            mirror->background_color);
+      }
+   }
+}
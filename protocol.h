@@ -0,0 +1,335 @@
+//symbolic constants used by the snafu network protocol
+//
+//every message is a header of SNAFU_PROTOCOL_HEADER_LENGTH bytes followed
+//by a payload.  the header is the guint8 message type followed by the
+//guint32 length of the payload.  all integers are little endian
+//
+//clients send SNAFU_MESSAGE_JOIN once, then SNAFU_MESSAGE_DIRECTION
+//whenever their player should turn.  the server answers the join with
+//SNAFU_MESSAGE_WELCOME and the whole board as SNAFU_MESSAGE_CELLS, then
+//sends the changed cells of every tick as SNAFU_MESSAGE_CELLS
+//
+//clients who only watch send SNAFU_MESSAGE_WATCH instead.  the server
+//answers with SNAFU_MESSAGE_WELCOME and the spectator frames since the last
+//keyframe, then sends the frame of every tick as SNAFU_MESSAGE_FRAME, see
+//spectate.h.  spectators who could not apply a frame send
+//SNAFU_MESSAGE_KEYFRAME and resync from the next keyframe
+//
+//addresses are either the path of a unix socket, which must contain a '/',
+//or a tcp port on the loopback interface
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define SNAFU_PROTOCOL_HEADER_LENGTH 5
+
+//messages with longer payloads are considered corrupt
+#define SNAFU_PROTOCOL_PAYLOAD_MAX (1 << 24)
+
+//the session number a client joins to be placed in any session
+#define SNAFU_PROTOCOL_ANY_SESSION 0xffffffff
+
+//the player number of clients who only watch
+#define SNAFU_PROTOCOL_SPECTATOR 0xff
+
+//client to server messages
+//SNAFU_MESSAGE_JOIN:  guint32 session number
+//SNAFU_MESSAGE_DIRECTION:  guint8 snafu_player_direction
+//SNAFU_MESSAGE_WATCH:  guint32 session number
+//SNAFU_MESSAGE_KEYFRAME:  no payload, the next frame should be a keyframe
+#define SNAFU_MESSAGE_JOIN 1
+#define SNAFU_MESSAGE_DIRECTION 2
+#define SNAFU_MESSAGE_WATCH 3
+#define SNAFU_MESSAGE_KEYFRAME 4
+
+//server to client messages
+//SNAFU_MESSAGE_WELCOME:  guint32 session number, guint8 player number,
+//   guint8 number of players, guint32 width, guint32 height,
+//   guint32 background_color
+//SNAFU_MESSAGE_CELLS:  guint32 tick, then for every changed cell the
+//   guint32 board index ((width * y) + x) and the guint32 board_cell, so
+//   boards served hold at most G_MAXUINT32 + 1 cells
+//SNAFU_MESSAGE_CLEAR:  no payload, the board was cleared for a new game
+//SNAFU_MESSAGE_SCORE:  guint8 player number, guint32 score
+//SNAFU_MESSAGE_TEXT:  markup of the game message, not nul terminated
+//SNAFU_MESSAGE_FRAME:  spectator stream frames, length prefixes included
+#define SNAFU_MESSAGE_WELCOME 16
+#define SNAFU_MESSAGE_CELLS 17
+#define SNAFU_MESSAGE_CLEAR 18
+#define SNAFU_MESSAGE_SCORE 19
+#define SNAFU_MESSAGE_TEXT 20
+#define SNAFU_MESSAGE_FRAME 21
+
+/****
+ *snafu_protocol functions
+ *preface:  messages are built into and parsed from GByteArrays
+ ****/
+
+//appends value to out
+void snafu_protocol_put_u8(GByteArray *out, guint8 value);
+void snafu_protocol_put_u32(GByteArray *out, guint32 value);
+
+//returns the guint32 stored at data
+guint32 snafu_protocol_get_u32(const guint8 *data);
+
+//appends the header of a message of type type to out and returns the
+//offset of the message, which must be passed to snafu_protocol_end once
+//the payload has been appended
+guint snafu_protocol_begin(GByteArray *out, guint8 type);
+
+//fills in the payload length of the message begun at offset
+void snafu_protocol_end(GByteArray *out, guint offset);
+
+//looks for a complete message at *offset of in
+//returns TRUE and sets type, payload and length if there is one, advancing
+//*offset past it.  returns FALSE if more bytes are needed
+//*corrupt is set if the message can never be completed
+gboolean snafu_protocol_next(GByteArray *in, guint *offset, guint8 *type,
+   const guint8 **payload, guint32 *length, gboolean *corrupt);
+
+//fills in storage with the socket address of address
+//returns the length of the socket address, or 0 if address is not valid
+socklen_t snafu_protocol_address(const gchar *address,
+   struct sockaddr_storage *storage);
+
+//returns a socket listening on address, or -1 with errno set
+gint snafu_protocol_listen(const gchar *address);
+
+//returns a socket connected to address, or -1 with errno set
+gint snafu_protocol_connect(const gchar *address);
+
+//writes all of length bytes of data to the blocking socket fd
+//returns FALSE if the connection failed
+gboolean snafu_protocol_write_all(gint fd, const guint8 *data, gsize length);
+
+//reads the next message from the blocking socket fd into in, which is
+//emptied first.  returns FALSE if the connection failed or the message is
+//corrupt
+gboolean snafu_protocol_read_message(gint fd, GByteArray *in, guint8 *type,
+   const guint8 **payload, guint32 *length);
+
+/********/
+
+void snafu_protocol_put_u8(GByteArray *out, guint8 value){
+   g_byte_array_append(out, &value, 1);
+}
+
+void snafu_protocol_put_u32(GByteArray *out, guint32 value){
+   guint8 bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+
+   g_byte_array_append(out, bytes, 4);
+}
+
+guint32 snafu_protocol_get_u32(const guint8 *data){
+   return(*data | (*(data + 1) << 8) | (*(data + 2) << 16) |
+      ((guint32) *(data + 3) << 24));
+}
+
+guint snafu_protocol_begin(GByteArray *out, guint8 type){
+   guint offset = out->len;
+
+   snafu_protocol_put_u8(out, type);
+   snafu_protocol_put_u32(out, 0);
+
+   return(offset);
+}
+
+void snafu_protocol_end(GByteArray *out, guint offset){
+   guint32 length = out->len - offset - SNAFU_PROTOCOL_HEADER_LENGTH;
+
+   for(gint i = 0; i < 4; i++){
+      *(out->data + offset + 1 + i) = length >> (i * 8);
+   }
+}
+
+gboolean snafu_protocol_next(GByteArray *in, guint *offset, guint8 *type,
+   const guint8 **payload, guint32 *length, gboolean *corrupt){
+   *corrupt = FALSE;
+
+   if(in->len - *offset < SNAFU_PROTOCOL_HEADER_LENGTH){
+      return(FALSE);
+   }
+
+   *length = snafu_protocol_get_u32(in->data + *offset + 1);
+
+   if(*length > SNAFU_PROTOCOL_PAYLOAD_MAX){
+      *corrupt = TRUE;
+      return(FALSE);
+   }
+
+   if(in->len - *offset - SNAFU_PROTOCOL_HEADER_LENGTH < *length){
+      return(FALSE);
+   }
+
+   *type = *(in->data + *offset);
+   *payload = in->data + *offset + SNAFU_PROTOCOL_HEADER_LENGTH;
+
+   *offset += SNAFU_PROTOCOL_HEADER_LENGTH + *length;
+
+   return(TRUE);
+}
+
+socklen_t snafu_protocol_address(const gchar *address,
+   struct sockaddr_storage *storage){
+   memset(storage, 0, sizeof(struct sockaddr_storage));
+
+   if(strchr(address, '/') != NULL){
+      struct sockaddr_un *unix_address = (struct sockaddr_un *) storage;
+
+      if(strlen(address) >= sizeof(unix_address->sun_path)){
+         return(0);
+      }
+
+      unix_address->sun_family = AF_UNIX;
+      g_strlcpy(unix_address->sun_path, address,
+         sizeof(unix_address->sun_path));
+
+      return(sizeof(struct sockaddr_un));
+   }
+
+   gchar *end = NULL;
+   guint64 port = g_ascii_strtoull(address, &end, 10);
+
+   if(end == address || *end != '\0' || port == 0 || port > 65535){
+      return(0);
+   }
+
+   struct sockaddr_in *inet_address = (struct sockaddr_in *) storage;
+
+   inet_address->sin_family = AF_INET;
+   inet_address->sin_port = htons(port);
+   inet_address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   return(sizeof(struct sockaddr_in));
+}
+
+gint snafu_protocol_listen(const gchar *address){
+   struct sockaddr_storage storage;
+   socklen_t length = snafu_protocol_address(address, &storage);
+
+   if(!length){
+      errno = EINVAL;
+      return(-1);
+   }
+
+   gint fd = socket(storage.ss_family, SOCK_STREAM, 0);
+
+   if(fd < 0){
+      return(-1);
+   }
+
+   if(storage.ss_family == AF_UNIX){
+      unlink(address);
+   }else{
+      gint reuse = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+   }
+
+   if(bind(fd, (struct sockaddr *) &storage, length) < 0 ||
+      listen(fd, SOMAXCONN) < 0){
+      gint bind_errno = errno;
+
+      close(fd);
+
+      errno = bind_errno;
+      return(-1);
+   }
+
+   return(fd);
+}
+
+gint snafu_protocol_connect(const gchar *address){
+   struct sockaddr_storage storage;
+   socklen_t length = snafu_protocol_address(address, &storage);
+
+   if(!length){
+      errno = EINVAL;
+      return(-1);
+   }
+
+   gint fd = socket(storage.ss_family, SOCK_STREAM, 0);
+
+   if(fd < 0){
+      return(-1);
+   }
+
+   if(connect(fd, (struct sockaddr *) &storage, length) < 0){
+      gint connect_errno = errno;
+
+      close(fd);
+
+      errno = connect_errno;
+      return(-1);
+   }
+
+   if(storage.ss_family == AF_INET){
+      gint nodelay = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+   }
+
+   return(fd);
+}
+
+gboolean snafu_protocol_write_all(gint fd, const guint8 *data, gsize length){
+   while(length){
+      gssize written = send(fd, data, length, MSG_NOSIGNAL);
+
+      if(written < 0 && errno == EINTR){
+         continue;
+      }
+
+      if(written <= 0){
+         return(FALSE);
+      }
+
+      data += written;
+      length -= written;
+   }
+
+   return(TRUE);
+}
+
+gboolean snafu_protocol_read_message(gint fd, GByteArray *in, guint8 *type,
+   const guint8 **payload, guint32 *length){
+   g_byte_array_set_size(in, 0);
+
+   for(;;){
+      guint offset = 0;
+      gboolean corrupt;
+
+      if(snafu_protocol_next(in, &offset, type, payload, length, &corrupt)){
+         return(TRUE);
+      }
+
+      if(corrupt){
+         return(FALSE);
+      }
+
+      //read only as far as the end of this message, leaving the rest queued
+      gsize wanted = SNAFU_PROTOCOL_HEADER_LENGTH;
+
+      if(in->len >= SNAFU_PROTOCOL_HEADER_LENGTH){
+         wanted += snafu_protocol_get_u32(in->data + 1);
+      }
+
+      guint old_length = in->len;
+
+      g_byte_array_set_size(in, wanted);
+
+      gssize got = recv(fd, in->data + old_length, wanted - old_length, 0);
+
+      if(got < 0 && errno == EINTR){
+         got = 0;
+      }else if(got <= 0){
+         return(FALSE);
+      }
+
+      g_byte_array_set_size(in, old_length + got);
+   }
+}
@@ -0,0 +1,483 @@
+//symbolic constants used by regions
+//
+//regions keeps the connected regions of empty cells of a board, cells being
+//connected to the cells above, below, left and right of them.  as cells are
+//filled the regions only split, which is found by searching from the sides
+//of the filled cell at the same time and stopping as soon as all but one of
+//the searches run out, so a split costs the size of the smaller parts.
+//emptied cells join the regions around them by relabelling the smaller ones
+//
+//the state of a cell is taken from the labels, never from the board, so the
+//changes of a board may be applied in any order and more than once
+
+//the label of filled cells and of cells off the board
+#define REGIONS_FILLED -1
+
+//the most searches a filled cell starts, one per side
+#define REGIONS_SEARCHES 4
+
+//the regions of a board
+//
+//labels holds the region label of each of the width * height cells, or
+//REGIONS_FILLED.  sizes holds the guint number of cells of each label, 0 for
+//labels not in use, which unused holds the gint numbers of for reuse
+//
+//searches, seen and stamp are scratch space for splitting regions:  cells a
+//search reaches are appended to its GArray and seen is set to stamp plus the
+//number of the search
+//
+//regions must be freed with regions_free
+typedef struct _regions{
+   gint width;       //width of the board
+   gint height;      //height of the board
+   gint *labels;     //the label of every cell
+   GArray *sizes;    //cells in each region
+   GArray *unused;   //labels free for reuse
+   guint number_regions; //labels in use
+   GArray *searches[REGIONS_SEARCHES]; //cells reached by each search
+   guint *seen;      //stamp of the last search reaching every cell
+   guint stamp;      //stamp of the current split
+} regions;
+
+
+/****
+ *regions functions
+ ****/
+
+//returns the regions of the empty cells of brd
+regions *regions_new(board *brd);
+
+//frees reg
+void regions_free(regions *reg);
+
+//labels every cell of reg again from the cells of brd, needed after brd is
+//cleared without marking its cells changed
+void regions_rebuild(regions *reg, board *brd);
+
+//applies the cells in brd->changed_cells to reg, so it must be called before
+//the changes are drawn or forgotten
+void regions_update(regions *reg, board *brd);
+
+//cell i of the board was filled, splitting its region if it held it together
+void regions_fill(regions *reg, gint i);
+
+//cell i of the board was emptied, joining the regions around it
+void regions_empty(regions *reg, gint i);
+
+//returns the label of cell (x, y), REGIONS_FILLED if it is filled or off the
+//board
+gint regions_label(regions *reg, gint x, gint y);
+
+//returns the number of cells labelled label
+guint regions_size(regions *reg, gint label);
+
+//writes the distinct labels of the empty cells beside cell (x, y) to labels,
+//which must have room for 4, and returns how many there are
+guint regions_around(regions *reg, gint x, gint y, gint *labels);
+
+//returns the number of cells in the regions beside cell (x, y), counting
+//every region once
+guint regions_space_around(regions *reg, gint x, gint y);
+
+//returns a label not in use with a size of 0
+gint regions_new_label(regions *reg);
+
+//returns label to the unused labels
+void regions_retire_label(regions *reg, gint label);
+
+//writes the indices of the empty cells beside cell i to neighbours, which
+//must have room for 4, and returns how many there are
+guint regions_neighbours(regions *reg, gint i, gint *neighbours);
+
+//labels every cell connected to cell i which is labelled from with to,
+//returning the number of cells relabelled
+guint regions_relabel(regions *reg, gint i, gint from, gint to);
+
+//returns TRUE if the empty cells of the ring of 8 cells around cell i join
+//every empty cell beside it, in which case filling i splits nothing
+gboolean regions_ring_connected(regions *reg, gint i);
+
+/********/
+
+regions *regions_new(board *brd){
+   regions *new_regions = g_new(regions, 1);
+   gint cells = brd->width * brd->height;
+
+   new_regions->width = brd->width;
+   new_regions->height = brd->height;
+   new_regions->labels = g_new(gint, cells);
+   new_regions->sizes = g_array_new(FALSE, FALSE, sizeof(guint));
+   new_regions->unused = g_array_new(FALSE, FALSE, sizeof(gint));
+   new_regions->number_regions = 0;
+   new_regions->seen = g_new0(guint, cells);
+   new_regions->stamp = 0;
+
+   for(gint k = 0; k < REGIONS_SEARCHES; k++){
+      new_regions->searches[k] = g_array_new(FALSE, FALSE, sizeof(gint));
+   }
+
+   regions_rebuild(new_regions, brd);
+
+   return(new_regions);
+}
+
+void regions_free(regions *reg){
+   for(gint k = 0; k < REGIONS_SEARCHES; k++){
+      g_array_free(reg->searches[k], TRUE);
+   }
+
+   g_array_free(reg->sizes, TRUE);
+   g_array_free(reg->unused, TRUE);
+
+   g_free(reg->labels);
+   g_free(reg->seen);
+
+   g_free(reg);
+}
+
+void regions_rebuild(regions *reg, board *brd){
+   gint cells = reg->width * reg->height;
+
+   g_array_set_size(reg->sizes, 0);
+   g_array_set_size(reg->unused, 0);
+   reg->number_regions = 0;
+
+   //every empty cell starts out in the same region until it is flooded
+   for(gint i = 0; i < cells; i++){
+      *(reg->labels + i) = board_read_cell_flags(brd, i)?REGIONS_FILLED:0;
+   }
+
+   gint unlabelled = regions_new_label(reg);
+
+   for(gint i = 0; i < cells; i++){
+      if(*(reg->labels + i) == unlabelled){
+         gint label = regions_new_label(reg);
+
+         g_array_index(reg->sizes, guint, label) = regions_relabel(reg, i,
+            unlabelled, label);
+      }
+   }
+
+   regions_retire_label(reg, unlabelled);
+}
+
+void regions_update(regions *reg, board *brd){
+   for(guint k = 0; k < brd->changed_cells->len; k++){
+      gint64 i = g_array_index(brd->changed_cells, gint64, k);
+
+      if(board_read_cell_flags(brd, i)){
+         regions_fill(reg, i);
+      }else{
+         regions_empty(reg, i);
+      }
+   }
+}
+
+void regions_fill(regions *reg, gint i){
+   gint label = *(reg->labels + i);
+
+   if(label == REGIONS_FILLED){
+      return;
+   }
+
+   *(reg->labels + i) = REGIONS_FILLED;
+
+   if(--g_array_index(reg->sizes, guint, label) == 0){
+      regions_retire_label(reg, label);
+      return;
+   }
+
+   if(regions_ring_connected(reg, i)){
+      return;
+   }
+
+   gint neighbours[4];
+   guint number_searches = regions_neighbours(reg, i, neighbours);
+   guint heads[REGIONS_SEARCHES];
+   gboolean running[REGIONS_SEARCHES];
+   guint number_running = number_searches;
+
+   //each search marks the cells it reaches with its own stamp
+   if(reg->stamp > G_MAXUINT - (2 * REGIONS_SEARCHES)){
+      memset(reg->seen, 0, sizeof(guint) * reg->width * reg->height);
+      reg->stamp = 0;
+   }
+
+   reg->stamp += REGIONS_SEARCHES;
+
+   for(guint k = 0; k < number_searches; k++){
+      g_array_set_size(reg->searches[k], 0);
+      heads[k] = 0;
+      running[k] = TRUE;
+   }
+
+   for(guint k = 0; k < number_searches; k++){
+      *(reg->seen + neighbours[k]) = reg->stamp + k;
+      g_array_append_val(reg->searches[k], neighbours[k]);
+   }
+
+   //one cell from each search in turn until only one search runs.  a search
+   //reaching a cell of another running search is in the same region and
+   //stops, the other one going on for both, and a search which runs out has
+   //found a whole region split off
+   while(number_running > 1){
+      for(guint k = 0; k < number_searches && number_running > 1; k++){
+         if(!running[k]){
+            continue;
+         }
+
+         GArray *search = reg->searches[k];
+
+         if(heads[k] == search->len){
+            gint split = regions_new_label(reg);
+
+            for(guint j = 0; j < search->len; j++){
+               *(reg->labels + g_array_index(search, gint, j)) = split;
+            }
+
+            g_array_index(reg->sizes, guint, split) = search->len;
+            g_array_index(reg->sizes, guint, label) -= search->len;
+
+            running[k] = FALSE;
+            number_running--;
+            continue;
+         }
+
+         gint cell = g_array_index(search, gint, heads[k]++);
+         gint around[4];
+         guint number_around = regions_neighbours(reg, cell, around);
+
+         for(guint j = 0; j < number_around; j++){
+            guint seen = *(reg->seen + around[j]);
+
+            if(seen >= reg->stamp && seen != reg->stamp + k &&
+               running[seen - reg->stamp]){
+               running[k] = FALSE;
+               number_running--;
+               break;
+            }
+
+            if(seen != reg->stamp + k){
+               *(reg->seen + around[j]) = reg->stamp + k;
+               g_array_append_val(search, around[j]);
+            }
+         }
+      }
+   }
+}
+
+void regions_empty(regions *reg, gint i){
+   if(*(reg->labels + i) != REGIONS_FILLED){
+      return;
+   }
+
+   gint labels[4];
+   guint number_labels = regions_around(reg, i % reg->width, i / reg->width,
+      labels);
+
+   if(number_labels == 0){
+      gint label = regions_new_label(reg);
+
+      *(reg->labels + i) = label;
+      g_array_index(reg->sizes, guint, label) = 1;
+      return;
+   }
+
+   //the largest region around keeps its label and takes in the others
+   gint largest = 0;
+
+   for(guint k = 1; k < number_labels; k++){
+      if(regions_size(reg, labels[k]) > regions_size(reg, labels[largest])){
+         largest = k;
+      }
+   }
+
+   gint label = labels[largest];
+   gint neighbours[4];
+   guint number_neighbours = regions_neighbours(reg, i, neighbours);
+
+   *(reg->labels + i) = label;
+   g_array_index(reg->sizes, guint, label)++;
+
+   for(guint k = 0; k < number_neighbours; k++){
+      gint joined = *(reg->labels + neighbours[k]);
+
+      if(joined != label){
+         g_array_index(reg->sizes, guint, label) += regions_relabel(reg,
+            neighbours[k], joined, label);
+
+         regions_retire_label(reg, joined);
+      }
+   }
+}
+
+gint regions_label(regions *reg, gint x, gint y){
+   if(x < 0 || y < 0 || x >= reg->width || y >= reg->height){
+      return(REGIONS_FILLED);
+   }
+
+   return(*(reg->labels + (reg->width * y) + x));
+}
+
+guint regions_size(regions *reg, gint label){
+   if(label == REGIONS_FILLED){
+      return(0);
+   }
+
+   return(g_array_index(reg->sizes, guint, label));
+}
+
+guint regions_around(regions *reg, gint x, gint y, gint *labels){
+   gint candidates[4] = {
+      regions_label(reg, x, y - 1), regions_label(reg, x, y + 1),
+      regions_label(reg, x - 1, y), regions_label(reg, x + 1, y)
+   };
+   guint number_labels = 0;
+
+   for(gint k = 0; k < 4; k++){
+      gboolean repeated = candidates[k] == REGIONS_FILLED;
+
+      for(guint j = 0; j < number_labels && !repeated; j++){
+         repeated = *(labels + j) == candidates[k];
+      }
+
+      if(!repeated){
+         *(labels + number_labels++) = candidates[k];
+      }
+   }
+
+   return(number_labels);
+}
+
+guint regions_space_around(regions *reg, gint x, gint y){
+   gint labels[4];
+   guint number_labels = regions_around(reg, x, y, labels);
+   guint space = 0;
+
+   for(guint k = 0; k < number_labels; k++){
+      space += regions_size(reg, labels[k]);
+   }
+
+   return(space);
+}
+
+gint regions_new_label(regions *reg){
+   gint label;
+   guint size = 0;
+
+   reg->number_regions++;
+
+   if(reg->unused->len){
+      label = g_array_index(reg->unused, gint, reg->unused->len - 1);
+      g_array_set_size(reg->unused, reg->unused->len - 1);
+
+      g_array_index(reg->sizes, guint, label) = 0;
+      return(label);
+   }
+
+   label = reg->sizes->len;
+   g_array_append_val(reg->sizes, size);
+
+   return(label);
+}
+
+void regions_retire_label(regions *reg, gint label){
+   reg->number_regions--;
+
+   g_array_index(reg->sizes, guint, label) = 0;
+   g_array_append_val(reg->unused, label);
+}
+
+guint regions_neighbours(regions *reg, gint i, gint *neighbours){
+   gint x = i % reg->width, y = i / reg->width;
+   guint number_neighbours = 0;
+
+   if(y > 0 && *(reg->labels + i - reg->width) != REGIONS_FILLED){
+      *(neighbours + number_neighbours++) = i - reg->width;
+   }
+
+   if(y < reg->height - 1 && *(reg->labels + i + reg->width) !=
+      REGIONS_FILLED){
+      *(neighbours + number_neighbours++) = i + reg->width;
+   }
+
+   if(x > 0 && *(reg->labels + i - 1) != REGIONS_FILLED){
+      *(neighbours + number_neighbours++) = i - 1;
+   }
+
+   if(x < reg->width - 1 && *(reg->labels + i + 1) != REGIONS_FILLED){
+      *(neighbours + number_neighbours++) = i + 1;
+   }
+
+   return(number_neighbours);
+}
+
+guint regions_relabel(regions *reg, gint i, gint from, gint to){
+   //the relabelled cells are the stack of cells still to visit
+   GArray *stack = reg->searches[0];
+   guint relabelled = 1;
+
+   g_array_set_size(stack, 0);
+   g_array_append_val(stack, i);
+   *(reg->labels + i) = to;
+
+   while(stack->len){
+      gint cell = g_array_index(stack, gint, stack->len - 1);
+      gint around[4];
+      guint number_around = regions_neighbours(reg, cell, around);
+
+      g_array_set_size(stack, stack->len - 1);
+
+      for(guint k = 0; k < number_around; k++){
+         if(*(reg->labels + around[k]) == from){
+            *(reg->labels + around[k]) = to;
+            g_array_append_val(stack, around[k]);
+            relabelled++;
+         }
+      }
+   }
+
+   return(relabelled);
+}
+
+gboolean regions_ring_connected(regions *reg, gint i){
+   gint x = i % reg->width, y = i / reg->width;
+
+   //the ring clockwise from the cell above, the sides at even positions
+   gint ring[8] = {
+      regions_label(reg, x, y - 1), regions_label(reg, x + 1, y - 1),
+      regions_label(reg, x + 1, y), regions_label(reg, x + 1, y + 1),
+      regions_label(reg, x, y + 1), regions_label(reg, x - 1, y + 1),
+      regions_label(reg, x - 1, y), regions_label(reg, x - 1, y - 1)
+   };
+   gint start = -1;
+
+   for(gint k = 0; k < 8 && start < 0; k++){
+      if(ring[k] == REGIONS_FILLED){
+         start = k;
+      }
+   }
+
+   //a ring of empty cells joins all four sides
+   if(start < 0){
+      return(TRUE);
+   }
+
+   //count the runs of empty cells around the ring holding a side
+   gint runs = 0;
+   gboolean in_run = FALSE, run_has_side = FALSE;
+
+   for(gint k = 1; k <= 8; k++){
+      gint position = (start + k) % 8;
+
+      if(ring[position] == REGIONS_FILLED){
+         runs += in_run && run_has_side;
+         in_run = run_has_side = FALSE;
+      }else{
+         in_run = TRUE;
+         run_has_side |= !(position & 1);
+      }
+   }
+
+   return(runs <= 1);
+}
@@ -0,0 +1,530 @@
+/******************************************************************************
+Title         : New SNAFU Replay Renderer
+Description   : Renders the games of replays recorded with snafu --record to
+                image sequences, without a display.  Every game is cut into
+                ranges of --chunk frames which --threads workers render at
+                once.  A worker replays its game onto a board of its own up
+                to the first frame of its range, draws the whole board to a
+                cairo image surface once, and from then on draws only the
+                cells changed since the frame before, with the drawing code
+                of the board.  A frame is taken every --stride iterations.
+                Frames are written to --output as game_NNNN_FFFFFF.png, or
+                with --raw to game_NNNN.bgra, every frame being width by
+                height BGRA pixels one after another, as ffmpeg reads with
+                -f rawvideo -pix_fmt bgra.
+Usage         : render [--output DIR] [--cell-size PIXELS] [--stride TICKS]
+                   [--chunk FRAMES] [--threads N] [--raw] FILE...
+                Games are numbered from 0 across the files in order.
+Build with    : gcc -o render -std=c99 -Wall -O2 render.c `pkg-config \
+   --cflags --libs gtk+-2.0` -lz
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <gtk/gtk.h>
+#include <cairo.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include "board.h"
+#include "writer.h"
+
+#define CELL_SIZE 8
+#define STRIDE 1
+#define CHUNK 256
+
+//bytes read from a replay at a time
+#define READ_SIZE (1 << 16)
+
+//typedefs
+
+//a game of a replay
+//
+//records points at the WRITER_REPLAY_GAME starting the game in the
+//records of its replay, count records long.  ticks is the last iteration
+//recorded and frames the frames rendered of it
+typedef struct _replay_game{
+   guint number;             //the number of the game
+   const writer_replay *records; //the records of the game
+   guint count;              //records of the game
+   gint width;               //width of the board
+   gint height;              //height of the board
+   guint number_players;     //players of the game
+   guint max_length;         //longest trail, 0 for no limit
+   guint ticks;              //the last iteration
+   guint frames;             //frames of the game
+} replay_game;
+
+//frames first to last of a game, rendered by one worker
+typedef struct _render_job{
+   replay_game *game;        //the game
+   guint first;              //the first frame
+   guint last;               //one past the last frame
+} render_job;
+
+//a game replayed onto a board
+//
+//next is the next record to replay.  trails holds the cells of the trail
+//of every player as a ring of max_length board indices when trails are
+//limited, like the body of a snafu_player
+typedef struct _replay_state{
+   replay_game *game;        //the game
+   board *brd;               //the board replayed onto
+   guint next;               //the next record
+   board_cell *colors;       //the board_cell of every player
+   guint *trails;            //the rings of the trails
+   guint *trail_start;       //the oldest cell of every ring
+   guint *trail_length;      //the cells of every ring
+} replay_state;
+
+//a worker rendering jobs
+typedef struct _worker{
+   guint frames;             //frames rendered
+   GThread *thread;          //the thread
+} worker;
+
+//command line options
+static gchar *output_dir = ".";
+static gint cell_size = CELL_SIZE;
+static gint stride = STRIDE;
+static gint chunk = CHUNK;
+static gint number_threads = 0;
+static gboolean raw_frames = FALSE;
+
+static GOptionEntry options[] = {
+   {"output", 0, 0, G_OPTION_ARG_FILENAME, &output_dir,
+      "Write the frames to DIR", "DIR"},
+   {"cell-size", 0, 0, G_OPTION_ARG_INT, &cell_size,
+      "Pixels to a side of a cell", "PIXELS"},
+   {"stride", 0, 0, G_OPTION_ARG_INT, &stride,
+      "Iterations between frames", "TICKS"},
+   {"chunk", 0, 0, G_OPTION_ARG_INT, &chunk,
+      "Frames of a game rendered by one worker at a time", "FRAMES"},
+   {"threads", 0, 0, G_OPTION_ARG_INT, &number_threads,
+      "Threads rendering, 0 for one per processor", "N"},
+   {"raw", 0, 0, G_OPTION_ARG_NONE, &raw_frames,
+      "Write raw BGRA frames, a file a game, instead of PNG images", NULL},
+   {NULL}
+};
+
+//the jobs and the next one to be rendered
+//global for convinience purposes
+static GArray *jobs;
+static volatile gint next_job = 0;
+
+//reads the replay at path, plain or gzip, and appends its games to games.
+//returns FALSE and sets error if it cannot be read.  the records stay in
+//contents, which must be kept while games are in use
+gboolean replay_load(const gchar *path, GArray *games, GByteArray *contents,
+   GError **error);
+
+//GThreadFunc of a worker, rendering jobs until there are none left
+gpointer worker_run(worker *work);
+
+//renders the frames of job, returning how many were written, none if no
+//surface the size of its board can be made
+guint render_job_run(render_job *job);
+
+//writes frame of the game of job drawn on surface to its file
+void render_frame(render_job *job, cairo_surface_t *surface, guint frame);
+
+//starts replaying game onto brd from its first record
+void replay_state_init(replay_state *state, replay_game *game, board *brd);
+
+//frees what state allocated, not its board
+void replay_state_clear(replay_state *state);
+
+//replays the records of state up to and including iteration tick
+void replay_state_advance(replay_state *state, guint tick);
+
+//puts the head of player of state on cell (x, y), clearing the oldest cell
+//of its trail when trails are limited and it is full
+void replay_state_grow(replay_state *state, guint player, gint x, gint y);
+
+//returns the path of the raw frames of game number
+gchar *raw_path(guint number);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "FILE... - render replays of snafu to images");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   if(argc < 2){
+      g_printerr("no replay given\n");
+      return(1);
+   }
+
+   cell_size = CLAMP(cell_size, 1, BOARD_VIEW_CELL_MAX);
+   stride = MAX(stride, 1);
+   chunk = MAX(chunk, 1);
+
+   GArray *games = g_array_new(FALSE, FALSE, sizeof(replay_game));
+   GByteArray **contents = g_new(GByteArray *, argc - 1);
+
+   for(gint i = 1; i < argc; i++){
+      *(contents + i - 1) = g_byte_array_new();
+
+      if(!replay_load(argv[i], games, *(contents + i - 1), &error)){
+         g_printerr("%s\n", error->message);
+         g_error_free(error);
+         return(1);
+      }
+   }
+
+   //every game in ranges of chunk frames
+   jobs = g_array_new(FALSE, FALSE, sizeof(render_job));
+
+   for(guint i = 0; i < games->len; i++){
+      replay_game *game = &g_array_index(games, replay_game, i);
+
+      for(guint first = 0; first < game->frames; first += chunk){
+         render_job job = {game, first, MIN(first + chunk, game->frames)};
+
+         g_array_append_val(jobs, job);
+      }
+
+      //the frames of every game go in one file, written range by range
+      if(raw_frames){
+         gchar *path = raw_path(game->number);
+         gint fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+
+         if(fd < 0){
+            g_printerr("cannot write %s: %s\n", path, g_strerror(errno));
+            return(1);
+         }
+
+         close(fd);
+         g_free(path);
+      }
+   }
+
+   guint number_workers = CLAMP(number_threads?number_threads:
+      g_get_num_processors(), 1, MAX(jobs->len, 1));
+   worker *workers = g_new0(worker, number_workers);
+   guint frames = 0;
+   gint64 start = g_get_monotonic_time();
+
+   for(guint i = 0; i < number_workers; i++){
+      (workers + i)->thread = g_thread_new("render",
+         (GThreadFunc) worker_run, workers + i);
+   }
+
+   for(guint i = 0; i < number_workers; i++){
+      g_thread_join((workers + i)->thread);
+
+      frames += (workers + i)->frames;
+   }
+
+   gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+   printf("%u frames of %u games on %u threads in %.3f seconds, %.1f frames "
+      "a second\n", frames, games->len, number_workers, seconds,
+      seconds > 0?frames / seconds:0);
+
+   for(gint i = 1; i < argc; i++){
+      g_byte_array_free(*(contents + i - 1), TRUE);
+   }
+
+   g_free(contents);
+   g_free(workers);
+   g_array_free(jobs, TRUE);
+   g_array_free(games, TRUE);
+
+   return(0);
+}
+
+gboolean replay_load(const gchar *path, GArray *games, GByteArray *contents,
+   GError **error){
+   //gzread reads plain files as they are
+   gzFile file = gzopen(path, "rb");
+   guint8 buffer[READ_SIZE];
+   gint got;
+
+   if(file == NULL){
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+         "cannot open %s: %s", path, g_strerror(errno));
+
+      return(FALSE);
+   }
+
+   while((got = gzread(file, buffer, READ_SIZE)) > 0){
+      g_byte_array_append(contents, buffer, got);
+   }
+
+   gzclose(file);
+
+   if(got < 0){
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO,
+         "cannot read %s", path);
+
+      return(FALSE);
+   }
+
+   writer_replay *records = (writer_replay *) contents->data;
+   guint count = contents->len / sizeof(writer_replay);
+   replay_game *game = NULL;
+
+   if(contents->len % sizeof(writer_replay) ||
+      (count && records->kind != WRITER_REPLAY_GAME)){
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+         "%s is not a replay", path);
+
+      return(FALSE);
+   }
+
+   //the records are read in place, once turned from little endian
+   for(guint i = 0; i < count; i++){
+      writer_replay *record = records + i;
+
+      record->tick = GUINT32_FROM_LE(record->tick);
+      record->x = GUINT16_FROM_LE(record->x);
+      record->y = GUINT16_FROM_LE(record->y);
+      record->value = GUINT32_FROM_LE(record->value);
+
+      if(record->kind == WRITER_REPLAY_DROPPED){
+         g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+            "%s is corrupt, %u records of game %u were dropped", path, 
+            record->value, games->len - 1);
+
+         return(FALSE);
+      }
+
+      if(record->kind == WRITER_REPLAY_GAME){
+         replay_game new_game;
+
+         new_game.number = games->len;
+         new_game.records = record;
+         new_game.count = 0;
+         new_game.width = MAX(record->x, 1);
+         new_game.height = MAX(record->y, 1);
+         new_game.number_players = record->player;
+         new_game.max_length = MIN(record->value,
+            (guint) new_game.width * new_game.height);
+         new_game.ticks = 0;
+
+         g_array_append_val(games, new_game);
+         game = &g_array_index(games, replay_game, games->len - 1);
+      }
+
+      game->count++;
+      game->ticks = MAX(game->ticks, record->tick);
+   }
+
+   for(guint i = 0; i < games->len; i++){
+      game = &g_array_index(games, replay_game, i);
+      game->frames = (game->ticks / stride) + 1;
+   }
+
+   return(TRUE);
+}
+
+gpointer worker_run(worker *work){
+   gint i;
+
+   while((i = g_atomic_int_add(&next_job, 1)) < (gint) jobs->len){
+      work->frames += render_job_run(&g_array_index(jobs, render_job, i));
+   }
+
+   return(NULL);
+}
+
+guint render_job_run(render_job *job){
+   replay_game *game = job->game;
+   cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+      game->width * cell_size, game->height * cell_size);
+
+   //such as when the board is too large for cairo at this cell size
+   if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS){
+      g_printerr("cannot render game %u: %s\n", game->number,
+         cairo_status_to_string(cairo_surface_status(surface)));
+      cairo_surface_destroy(surface);
+      return(0);
+   }
+
+   board *brd = board_new(NULL, game->width, game->height, cell_size,
+      cell_size, board_cell_new_with_color(128, 128, 128));
+   cairo_t *cr = cairo_create(surface);
+   replay_state state;
+
+   replay_state_init(&state, game, brd);
+
+   //up to the first frame without drawing, then the whole board once
+   replay_state_advance(&state, job->first * stride);
+   board_draw_with_cairo_t(brd, cr);
+   board_forget_changes(brd);
+
+   render_frame(job, surface, job->first);
+
+   for(guint frame = job->first + 1; frame < job->last; frame++){
+      replay_state_advance(&state, frame * stride);
+
+      board_draw_changed(brd, cr);
+      board_forget_changes(brd);
+
+      render_frame(job, surface, frame);
+   }
+
+   replay_state_clear(&state);
+
+   cairo_destroy(cr);
+   cairo_surface_destroy(surface);
+   board_free(brd);
+
+   return(job->last - job->first);
+}
+
+void render_frame(render_job *job, cairo_surface_t *surface, guint frame){
+   cairo_surface_flush(surface);
+
+   if(!raw_frames){
+      gchar *path = g_strdup_printf("%s/game_%04u_%06u.png", output_dir,
+         job->game->number, frame);
+
+      if(cairo_surface_write_to_png(surface, path) != CAIRO_STATUS_SUCCESS){
+         g_printerr("cannot write %s\n", path);
+      }
+
+      g_free(path);
+
+      return;
+   }
+
+   //ranges of the same game write to their own parts of one file
+   gchar *path = raw_path(job->game->number);
+   gint fd = open(path, O_WRONLY | O_CLOEXEC);
+   gint width = cairo_image_surface_get_width(surface);
+   gint height = cairo_image_surface_get_height(surface);
+   gint stride_bytes = cairo_image_surface_get_stride(surface);
+   const guint8 *data = cairo_image_surface_get_data(surface);
+   off_t offset = (off_t) frame * width * height * 4;
+   gboolean written = fd >= 0;
+
+   for(gint y = 0; written && y < height; y++){
+      written = pwrite(fd, data + ((gsize) y * stride_bytes), width * 4,
+         offset + ((off_t) y * width * 4)) == width * 4;
+   }
+
+   if(!written){
+      g_printerr("cannot write %s: %s\n", path, g_strerror(errno));
+   }
+
+   if(fd >= 0){
+      close(fd);
+   }
+
+   g_free(path);
+}
+
+void replay_state_init(replay_state *state, replay_game *game, board *brd){
+   state->game = game;
+   state->brd = brd;
+   state->next = 0;
+   state->colors = g_new0(board_cell, MAX(game->number_players, 1));
+   state->trails = NULL;
+   state->trail_start = g_new0(guint, MAX(game->number_players, 1));
+   state->trail_length = g_new0(guint, MAX(game->number_players, 1));
+
+   if(game->max_length){
+      state->trails = g_new(guint, game->number_players * game->max_length);
+   }
+
+   replay_state_advance(state, 0);
+}
+
+void replay_state_clear(replay_state *state){
+   g_free(state->colors);
+   g_free(state->trails);
+   g_free(state->trail_start);
+   g_free(state->trail_length);
+}
+
+void replay_state_advance(replay_state *state, guint tick){
+   replay_game *game = state->game;
+
+   while(state->next < game->count){
+      const writer_replay *record = game->records + state->next;
+
+      if(record->tick > tick){
+         break;
+      }
+
+      state->next++;
+
+      if(record->kind == WRITER_REPLAY_WALL &&
+         board_check_coords_in_bounds(state->brd, record->x, record->y)){
+         board_walls_add(state->brd,
+            (state->brd->width * record->y) + record->x);
+      }
+
+      if(record->player >= game->number_players){
+         continue;
+      }
+
+      if(record->kind == WRITER_REPLAY_PLAYER){
+         *(state->colors + record->player) = record->value;
+
+         replay_state_grow(state, record->player, record->x, record->y);
+      }else if(record->kind == WRITER_REPLAY_HEAD){
+         replay_state_grow(state, record->player, record->x, record->y);
+      }
+   }
+}
+
+void replay_state_grow(replay_state *state, guint player, gint x, gint y){
+   board *brd = state->brd;
+   guint max_length = state->game->max_length;
+
+   if(!board_check_coords_in_bounds(brd, x, y)){
+      return;
+   }
+
+   if(!max_length){
+      board_set_cell(brd, x, y, *(state->colors + player));
+      return;
+   }
+
+   guint *trail = state->trails + (player * max_length);
+   guint *trail_start = state->trail_start + player;
+   guint *trail_length = state->trail_length + player;
+
+   if(*trail_length == max_length){
+      guint tail = *(trail + *trail_start);
+
+      board_clear_cell(brd, tail % brd->width, tail / brd->width);
+
+      if(++*trail_start == max_length){
+         *trail_start = 0;
+      }
+
+      (*trail_length)--;
+   }
+
+   //set after the tail is cleared, which may be the cell moved into
+   board_set_cell(brd, x, y, *(state->colors + player));
+
+   guint head = *trail_start + *trail_length;
+
+   if(head >= max_length){
+      head -= max_length;
+   }
+
+   *(trail + head) = (brd->width * y) + x;
+
+   (*trail_length)++;
+}
+
+gchar *raw_path(guint number){
+   return(g_strdup_printf("%s/game_%04u.bgra", output_dir, number));
+}
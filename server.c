@@ -0,0 +1,929 @@
+/******************************************************************************
+Title         : New SNAFU Server
+Description   : Hosts many games of SNAFU at once without a display.  Every
+                session is a snafu advanced by its own timerfd, and all sess-
+                ions and clients share one epoll loop.  Clients join a sess-
+                ion over a unix socket or a loopback tcp port, take over one
+                of its players with direction messages, and receive the cha-
+                nged cells of every tick.  Players without a client, or who-
+                se client has not steered yet, are played by the ai.  Spect-
+                ators are sent a delta encoded frame stream instead, which 
+                --record also writes to a file or pipe.  --shm publishes the 
+                boards and players in shared memory for local readers.
+Usage         : snafu-server [--socket PATH] [--port PORT] [--games N]
+                   [--frequency MS] [--width CELLS] [--height CELLS]
+                   [--max-length CELLS] [--record PATH] [--keyframes TICKS]
+                   [--shm NAME]
+                Connect with snafu --connect PATH or snafu --connect PORT,
+                watch with snafu --watch PATH or snafu --watch PORT.  With 
+                --games above 1, game N is recorded to PATH.N and published 
+                as NAME.N.
+Build with    : gcc -o snafu-server -std=c99 -Wall -g -DSNAFU_HEADLESS \
+   server.c `pkg-config --cflags --libs glib-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "board.h"
+#include "regions.h"
+#include "arena.h"
+#include "snafu.h"
+#include "protocol.h"
+#include "spectate.h"
+#include "shm.h"
+
+#define FREQUENCY 85
+#define NUMBER_PLAYERS 4
+
+//ticks to wait after a game ends before the session starts the next one
+#define RESTART_TICKS 24
+
+//most timer expirations caught up in one go by a session which fell behind
+#define CATCH_UP_TICKS 4
+
+//clients whose unsent messages grow past this are disconnected
+#define CLIENT_BUFFER_MAX (4 << 20)
+
+#define EPOLL_EVENTS 256
+
+//kinds of things registered with epoll
+#define SOURCE_LISTENER 0
+#define SOURCE_SESSION 1
+#define SOURCE_CLIENT 2
+
+//a listening socket
+//type is SOURCE_LISTENER and must come first, as it does for sessions and
+//clients, so epoll events can be told apart.  tcp is set for loopback tcp
+//ports, whose connections are accepted with TCP_NODELAY
+typedef struct _listener{
+   gint type;
+   gint fd;
+   gboolean tcp;
+} listener;
+
+//a game hosted by the server
+//
+//timer_fd expires every game->frequency miliseconds.  clients holds the
+//clients following the session and controllers the client controlling each
+//player, NULL for players left to the ai.  watchers holds the spectators,
+//who are sent the frames of stream.  backlog holds the frame messages since
+//the last keyframe, the first thing sent to a new spectator.  record_fd is
+//the file the frames are recorded to, -1 if there is none.  shm is the 
+//shared memory the game is published to, NULL if there is none.  restart_ticks 
+//counts down the pause between the end of a game and the start of the next
+//one.  out and watch_out are scratch space for the messages broadcast to 
+//every client and every spectator
+typedef struct _session{
+   gint type;
+   guint number;
+   gint timer_fd;
+   snafu *game;
+   GPtrArray *clients;
+   struct _client **controllers;
+   GPtrArray *watchers;
+   spectate *stream;
+   GByteArray *backlog;
+   gint record_fd;
+   snafu_shm *shm;
+   guint restart_ticks;
+   GByteArray *out;
+   GByteArray *watch_out;
+} session;
+
+//a connection to a client
+//
+//in holds received bytes not yet parsed and out the bytes not yet sent.
+//player is the player the client controls or SNAFU_PROTOCOL_SPECTATOR, 
+//watching is set for spectators following the frame stream.
+//writing is set while epoll waits for the socket to take more of out.
+//fd is -1 once the client is closed, and the client is freed after the
+//epoll events being handled, which may still point at it
+typedef struct _client{
+   gint type;
+   gint fd;
+   session *joined;
+   guint8 player;
+   gboolean watching;
+   GByteArray *in;
+   GByteArray *out;
+   gboolean writing;
+} client;
+
+//the epoll instance, the hosted sessions and the clients closed since the
+//last epoll events were handled
+//global for convinience purposes
+static gint epoll_fd;
+static session **sessions;
+static GPtrArray *closed_clients;
+
+//command line options
+static gchar *socket_path = NULL;
+static gint port = 0;
+static gint number_sessions = 1;
+static gint frequency = FREQUENCY;
+static gint board_width = SNAFU_BOARD_WIDTH;
+static gint board_height = SNAFU_BOARD_HEIGHT;
+static gint max_length = 0;
+static gchar *record_path = NULL;
+static gint keyframe_interval = SPECTATE_KEYFRAME_INTERVAL;
+static gchar *shm_name = NULL;
+
+static GOptionEntry options[] = {
+   {"socket", 0, 0, G_OPTION_ARG_FILENAME, &socket_path,
+      "Listen on the unix socket PATH", "PATH"},
+   {"port", 0, 0, G_OPTION_ARG_INT, &port,
+      "Listen on loopback tcp PORT", "PORT"},
+   {"games", 0, 0, G_OPTION_ARG_INT, &number_sessions,
+      "Number of games to host", "N"},
+   {"frequency", 0, 0, G_OPTION_ARG_INT, &frequency,
+      "Miliseconds between ticks", "MS"},
+   {"width", 0, 0, G_OPTION_ARG_INT, &board_width,
+      "Width of the boards in cells", "CELLS"},
+   {"height", 0, 0, G_OPTION_ARG_INT, &board_height,
+      "Height of the boards in cells", "CELLS"},
+   {"max-length", 0, 0, G_OPTION_ARG_INT, &max_length,
+      "Longest trail a player may leave, 0 for no limit", "CELLS"},
+   {"record", 0, 0, G_OPTION_ARG_FILENAME, &record_path,
+      "Write the spectator frame stream to PATH", "PATH"},
+   {"keyframes", 0, 0, G_OPTION_ARG_INT, &keyframe_interval,
+      "Ticks between spectator keyframes", "TICKS"},
+   {"shm", 0, 0, G_OPTION_ARG_STRING, &shm_name,
+      "Publish the games in shared memory as NAME", "NAME"},
+   {NULL}
+};
+
+//registers fd with epoll for events, data pointing to source
+void epoll_watch(gint fd, guint32 events, gpointer source);
+
+//starts listening on address, exiting the server if that fails
+void listener_new(const gchar *address);
+
+//accepts every pending connection on the listening socket
+void listener_accept(listener *listening);
+
+//returns a session numbered number with a started game and a running timer
+session *session_new(guint number);
+
+//called when the timer of the session expires, advancing its game
+void session_tick(session *hosted);
+
+//appends the changed cells, scores and message of the session's game to
+//hosted->out and its frame, scores and message to hosted->watch_out, 
+//leaving them marked as sent.  the frame is also recorded and kept in the
+//backlog
+void session_append_changes(session *hosted);
+
+//appends the scores and message of the session's game to out
+void session_append_scores(session *hosted, GByteArray *out);
+
+//appends the whole board of the session's game to out
+void session_append_board(session *hosted, GByteArray *out);
+
+//sends hosted->out to every client and hosted->watch_out to every 
+//spectator of the session and empties them
+void session_broadcast(session *hosted);
+
+//returns the session a client asking for number should join, NULL if
+//there is none
+session *session_find(guint number);
+
+//places client in hosted, controlling the first player nobody controls
+void session_join(session *hosted, client *joining);
+
+//places client in hosted as a spectator of the frame stream
+void session_watch(session *hosted, client *watching);
+
+//returns a client for the connected socket fd
+client *client_new(gint fd);
+
+//called when the client's socket is readable, parsing its messages
+//returns FALSE if the client was closed
+gboolean client_read(client *connected);
+
+//handles one message from the client
+//returns FALSE if the message is invalid and the client should be closed
+gboolean client_handle(client *connected, guint8 type, const guint8 *payload,
+   guint32 length);
+
+//appends length bytes of data to the client's out and sends what the socket
+//takes.  returns FALSE if the client was closed
+gboolean client_send(client *connected, const guint8 *data, gsize length);
+
+//sends as much of the client's out as the socket takes, asking epoll to
+//report when more fits.  returns FALSE if the client was closed
+gboolean client_flush(client *connected);
+
+//closes the connection, returning its player to the ai.  the client is
+//only freed by clients_free_closed, closing it again does nothing
+void client_close(client *connected);
+
+//frees the clients closed since it was last called
+void clients_free_closed(void);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new("- host games of snafu");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   if(socket_path == NULL && !port){
+      g_printerr("nothing to listen on, give --socket or --port\n");
+      return(1);
+   }
+
+   //the players start at fixed cells of the default board
+   board_width = MAX(board_width, SNAFU_BOARD_WIDTH);
+   board_height = MAX(board_height, SNAFU_BOARD_HEIGHT);
+   number_sessions = MAX(number_sessions, 1);
+   frequency = MAX(frequency, 1);
+
+   //the cells of every session go out as guint32 board indices
+   if((gint64) board_width * board_height - 1 > G_MAXUINT32){
+      g_printerr("boards of more than %" G_GINT64_FORMAT " cells cannot be "
+         "served\n", (gint64) G_MAXUINT32 + 1);
+      return(1);
+   }
+
+   epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+   if(epoll_fd < 0){
+      g_printerr("epoll_create1: %s\n", g_strerror(errno));
+      return(1);
+   }
+
+   if(socket_path != NULL){
+      listener_new(socket_path);
+   }
+
+   if(port){
+      gchar *port_string = g_strdup_printf("%d", port);
+
+      listener_new(port_string);
+
+      g_free(port_string);
+   }
+
+   closed_clients = g_ptr_array_new();
+   sessions = g_new(session *, number_sessions);
+
+   for(gint i = 0; i < number_sessions; i++){
+      *(sessions + i) = session_new(i);
+   }
+
+   struct epoll_event events[EPOLL_EVENTS];
+
+   for(;;){
+      gint ready = epoll_wait(epoll_fd, events, EPOLL_EVENTS, -1);
+
+      if(ready < 0){
+         if(errno == EINTR){
+            continue;
+         }
+
+         g_printerr("epoll_wait: %s\n", g_strerror(errno));
+         return(1);
+      }
+
+      for(gint i = 0; i < ready; i++){
+         gint *source = events[i].data.ptr;
+
+         switch(*source){
+            case(SOURCE_LISTENER):{
+               listener_accept((listener *) source);
+               break;
+            }
+            case(SOURCE_SESSION):{
+               session_tick((session *) source);
+               break;
+            }
+            case(SOURCE_CLIENT):{
+               client *connected = (client *) source;
+
+               //closed by a session or client handled earlier in the batch
+               if(connected->fd < 0){
+                  break;
+               }
+
+               if(events[i].events & (EPOLLERR | EPOLLHUP)){
+                  client_close(connected);
+                  break;
+               }
+
+               if((events[i].events & EPOLLOUT) && !client_flush(connected)){
+                  break;
+               }
+
+               if(events[i].events & EPOLLIN){
+                  client_read(connected);
+               }
+
+               break;
+            }
+         }
+      }
+
+      clients_free_closed();
+   }
+
+   return(0);
+}
+
+void epoll_watch(gint fd, guint32 events, gpointer source){
+   struct epoll_event event;
+
+   event.events = events;
+   event.data.ptr = source;
+
+   epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+void listener_new(const gchar *address){
+   gint fd = snafu_protocol_listen(address);
+
+   if(fd < 0){
+      g_printerr("cannot listen on %s: %s\n", address, g_strerror(errno));
+      exit(1);
+   }
+
+   fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+   listener *listening = g_new(listener, 1);
+   struct sockaddr_storage storage;
+   socklen_t length = sizeof(storage);
+
+   listening->type = SOURCE_LISTENER;
+   listening->fd = fd;
+   listening->tcp = getsockname(fd, (struct sockaddr *) &storage, 
+      &length) == 0 && storage.ss_family == AF_INET;
+
+   epoll_watch(fd, EPOLLIN, listening);
+}
+
+void listener_accept(listener *listening){
+   gint fd;
+
+   while((fd = accept4(listening->fd, NULL, NULL,
+      SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+      //ticks are small messages that should not wait for more to send
+      if(listening->tcp){
+         gint nodelay = 1;
+         setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+      }
+
+      client_new(fd);
+   }
+}
+
+session *session_new(guint number){
+   session *hosted = g_new(session, 1);
+
+   hosted->type = SOURCE_SESSION;
+   hosted->number = number;
+
+   board *play_area = board_new(NULL, board_width, board_height, 1, 1,
+      board_cell_new_with_color(128, 128, 128));
+
+   hosted->game = snafu_new(play_area, NUMBER_PLAYERS, frequency);
+
+   snafu_set_max_length(hosted->game, MAX(max_length, 0));
+
+   hosted->clients = g_ptr_array_new();
+   hosted->controllers = g_new0(client *, NUMBER_PLAYERS);
+   hosted->watchers = g_ptr_array_new();
+   hosted->stream = spectate_new(MAX(keyframe_interval, 1));
+   hosted->backlog = g_byte_array_new();
+   hosted->record_fd = -1;
+   hosted->shm = NULL;
+   hosted->restart_ticks = 0;
+   hosted->out = g_byte_array_new();
+   hosted->watch_out = g_byte_array_new();
+
+   if(record_path != NULL){
+      gchar *path = number_sessions > 1?g_strdup_printf("%s.%u", 
+         record_path, number):g_strdup(record_path);
+
+      hosted->record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | 
+         O_CLOEXEC, 0644);
+
+      if(hosted->record_fd < 0){
+         g_printerr("cannot record to %s: %s\n", path, g_strerror(errno));
+      }
+
+      g_free(path);
+   }
+
+   if(shm_name != NULL){
+      gchar *name = number_sessions > 1?g_strdup_printf("%s.%u", shm_name,
+         number):g_strdup(shm_name);
+
+      hosted->shm = snafu_shm_new(name, hosted->game);
+
+      if(hosted->shm == NULL){
+         g_printerr("cannot publish %s: %s\n", name, g_strerror(errno));
+      }else{
+         snafu_set_step_func(hosted->game, snafu_shm_step, hosted->shm);
+      }
+
+      g_free(name);
+   }
+
+   snafu_begin(hosted->game);
+
+   hosted->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+      TFD_NONBLOCK | TFD_CLOEXEC);
+
+   struct itimerspec period;
+
+   period.it_interval.tv_sec = frequency / 1000;
+   period.it_interval.tv_nsec = (frequency % 1000) * 1000000;
+   period.it_value = period.it_interval;
+
+   timerfd_settime(hosted->timer_fd, 0, &period, NULL);
+
+   epoll_watch(hosted->timer_fd, EPOLLIN, hosted);
+
+   return(hosted);
+}
+
+void session_tick(session *hosted){
+   guint64 expirations = 0;
+
+   if(read(hosted->timer_fd, &expirations, sizeof(expirations)) !=
+      sizeof(expirations)){
+      return;
+   }
+
+   for(guint64 i = 0; i < MIN(expirations, CATCH_UP_TICKS); i++){
+      snafu *game = hosted->game;
+
+      if(!game->active){
+         if(hosted->restart_ticks && --hosted->restart_ticks){
+            continue;
+         }
+
+         snafu_end(game);
+
+         snafu_protocol_end(hosted->out,
+            snafu_protocol_begin(hosted->out, SNAFU_MESSAGE_CLEAR));
+
+         //snafu_end hands every player back to the ai, the clients take
+         //them back over when they next steer
+         snafu_begin(game);
+
+         //the board was cleared without marking the cells changed
+         spectate_request_keyframe(hosted->stream);
+      }else if(!snafu_step(game)){
+         hosted->restart_ticks = RESTART_TICKS;
+      }
+
+      session_append_changes(hosted);
+   }
+
+   session_broadcast(hosted);
+}
+
+void session_append_changes(session *hosted){
+   snafu *game = hosted->game;
+   board *play_area = game->play_area;
+   GByteArray *out = hosted->out;
+
+   //spectators get every tick as a frame, changed cells or not
+   guint offset = snafu_protocol_begin(hosted->watch_out, 
+      SNAFU_MESSAGE_FRAME);
+
+   gboolean keyframe = spectate_frame(hosted->stream, play_area, game->tick, 
+      hosted->watch_out);
+
+   snafu_protocol_end(hosted->watch_out, offset);
+
+   if(keyframe){
+      g_byte_array_set_size(hosted->backlog, 0);
+   }
+
+   g_byte_array_append(hosted->backlog, hosted->watch_out->data + offset, 
+      hosted->watch_out->len - offset);
+
+   if(hosted->record_fd >= 0 && !spectate_write(hosted->record_fd, 
+      hosted->watch_out->data + offset + SNAFU_PROTOCOL_HEADER_LENGTH, 
+      hosted->watch_out->len - offset - SNAFU_PROTOCOL_HEADER_LENGTH)){
+      g_printerr("stopped recording game %u: %s\n", hosted->number, 
+         g_strerror(errno));
+
+      close(hosted->record_fd);
+      hosted->record_fd = -1;
+   }
+
+   if(play_area->changed_cells->len){
+      offset = snafu_protocol_begin(out, SNAFU_MESSAGE_CELLS);
+
+      snafu_protocol_put_u32(out, game->tick);
+
+      for(guint i = 0; i < play_area->changed_cells->len; i++){
+         gint64 cell_number = g_array_index(play_area->changed_cells, gint64, 
+            i);
+
+         snafu_protocol_put_u32(out, cell_number);
+         snafu_protocol_put_u32(out, board_read_cell(play_area, cell_number));
+      }
+
+      snafu_protocol_end(out, offset);
+
+      board_forget_changes(play_area);
+   }
+
+   gboolean scores_changed = game->message_changed;
+
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+
+      if(player->score != player->score_shown){
+         scores_changed = TRUE;
+         player->score_shown = player->score;
+      }
+   }
+
+   //scores change a few times a game, so they are sent whole
+   if(scores_changed){
+      session_append_scores(hosted, out);
+      session_append_scores(hosted, hosted->watch_out);
+
+      game->message_changed = FALSE;
+   }
+}
+
+void session_append_scores(session *hosted, GByteArray *out){
+   snafu *game = hosted->game;
+
+   for(gint i = 0; i < game->number_players; i++){
+      guint offset = snafu_protocol_begin(out, SNAFU_MESSAGE_SCORE);
+
+      snafu_protocol_put_u8(out, i);
+      snafu_protocol_put_u32(out, (game->players + i)->score);
+
+      snafu_protocol_end(out, offset);
+   }
+
+   guint offset = snafu_protocol_begin(out, SNAFU_MESSAGE_TEXT);
+
+   g_byte_array_append(out, (guint8 *) game->message, strlen(game->message));
+
+   snafu_protocol_end(out, offset);
+}
+
+void session_append_board(session *hosted, GByteArray *out){
+   snafu *game = hosted->game;
+   board *play_area = game->play_area;
+
+   guint offset = snafu_protocol_begin(out, SNAFU_MESSAGE_CELLS);
+
+   snafu_protocol_put_u32(out, game->tick);
+
+   for(gint i = 0; i < play_area->width * play_area->height; i++){
+      board_cell cell = board_read_cell(play_area, i);
+
+      if(cell == play_area->background_color){
+         continue;
+      }
+
+      snafu_protocol_put_u32(out, i);
+      snafu_protocol_put_u32(out, cell);
+   }
+
+   snafu_protocol_end(out, offset);
+
+   session_append_scores(hosted, out);
+}
+
+void session_broadcast(session *hosted){
+   //closing a client removes it from hosted->clients, so walk backwards
+   if(hosted->out->len){
+      for(gint i = hosted->clients->len - 1; i >= 0; i--){
+         client_send(g_ptr_array_index(hosted->clients, i), hosted->out->data,
+            hosted->out->len);
+      }
+
+      g_byte_array_set_size(hosted->out, 0);
+   }
+
+   if(hosted->watch_out->len){
+      for(gint i = hosted->watchers->len - 1; i >= 0; i--){
+         client_send(g_ptr_array_index(hosted->watchers, i), 
+            hosted->watch_out->data, hosted->watch_out->len);
+      }
+
+      g_byte_array_set_size(hosted->watch_out, 0);
+   }
+}
+
+session *session_find(guint number){
+   if(number != SNAFU_PROTOCOL_ANY_SESSION){
+      return(number < number_sessions?*(sessions + number):NULL);
+   }
+
+   //the first session with a player nobody controls, or else the first
+   for(gint i = 0; i < number_sessions; i++){
+      for(gint j = 0; j < NUMBER_PLAYERS; j++){
+         if(*((*(sessions + i))->controllers + j) == NULL){
+            return(*(sessions + i));
+         }
+      }
+   }
+
+   return(*sessions);
+}
+
+void session_join(session *hosted, client *joining){
+   joining->joined = hosted;
+   joining->player = SNAFU_PROTOCOL_SPECTATOR;
+
+   for(gint i = 0; i < NUMBER_PLAYERS; i++){
+      if(*(hosted->controllers + i) == NULL){
+         *(hosted->controllers + i) = joining;
+         joining->player = i;
+         break;
+      }
+   }
+
+   g_ptr_array_add(hosted->clients, joining);
+}
+
+void session_watch(session *hosted, client *watching){
+   watching->joined = hosted;
+   watching->player = SNAFU_PROTOCOL_SPECTATOR;
+   watching->watching = TRUE;
+
+   g_ptr_array_add(hosted->watchers, watching);
+}
+
+client *client_new(gint fd){
+   client *connected = g_new(client, 1);
+
+   connected->type = SOURCE_CLIENT;
+   connected->fd = fd;
+   connected->joined = NULL;
+   connected->player = SNAFU_PROTOCOL_SPECTATOR;
+   connected->watching = FALSE;
+   connected->in = g_byte_array_new();
+   connected->out = g_byte_array_new();
+   connected->writing = FALSE;
+
+   epoll_watch(fd, EPOLLIN, connected);
+
+   return(connected);
+}
+
+gboolean client_read(client *connected){
+   guint8 buffer[4096];
+   gssize got;
+
+   while((got = recv(connected->fd, buffer, sizeof(buffer), 0)) > 0){
+      g_byte_array_append(connected->in, buffer, got);
+   }
+
+   if(got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+      errno != EINTR)){
+      client_close(connected);
+      return(FALSE);
+   }
+
+   guint offset = 0;
+   guint8 type;
+   const guint8 *payload;
+   guint32 length;
+   gboolean corrupt;
+
+   while(snafu_protocol_next(connected->in, &offset, &type, &payload,
+      &length, &corrupt)){
+      if(!client_handle(connected, type, payload, length)){
+         client_close(connected);
+         return(FALSE);
+      }
+   }
+
+   if(corrupt){
+      client_close(connected);
+      return(FALSE);
+   }
+
+   g_byte_array_remove_range(connected->in, 0, offset);
+
+   return(TRUE);
+}
+
+gboolean client_handle(client *connected, guint8 type, const guint8 *payload,
+   guint32 length){
+   switch(type){
+      case(SNAFU_MESSAGE_JOIN):
+      case(SNAFU_MESSAGE_WATCH):{
+         if(connected->joined != NULL || length < 4){
+            return(FALSE);
+         }
+
+         session *hosted = session_find(snafu_protocol_get_u32(payload));
+
+         if(hosted == NULL){
+            return(FALSE);
+         }
+
+         //changes already queued for this tick would be sent twice
+         session_broadcast(hosted);
+
+         if(type == SNAFU_MESSAGE_WATCH){
+            session_watch(hosted, connected);
+         }else{
+            session_join(hosted, connected);
+         }
+
+         GByteArray *out = g_byte_array_new();
+         guint offset = snafu_protocol_begin(out, SNAFU_MESSAGE_WELCOME);
+
+         snafu_protocol_put_u32(out, hosted->number);
+         snafu_protocol_put_u8(out, connected->player);
+         snafu_protocol_put_u8(out, hosted->game->number_players);
+         snafu_protocol_put_u32(out, hosted->game->play_area->width);
+         snafu_protocol_put_u32(out, hosted->game->play_area->height);
+         snafu_protocol_put_u32(out,
+            hosted->game->play_area->background_color);
+
+         snafu_protocol_end(out, offset);
+
+         //spectators sync from the last keyframe and the deltas after it
+         if(connected->watching){
+            g_byte_array_append(out, hosted->backlog->data, 
+               hosted->backlog->len);
+
+            session_append_scores(hosted, out);
+         }else{
+            session_append_board(hosted, out);
+         }
+
+         gboolean sent = client_send(connected, out->data, out->len);
+
+         g_byte_array_free(out, TRUE);
+
+         return(sent);
+      }
+      case(SNAFU_MESSAGE_DIRECTION):{
+         if(connected->joined == NULL || length < 1){
+            return(FALSE);
+         }
+
+         if(connected->player == SNAFU_PROTOCOL_SPECTATOR){
+            return(TRUE);
+         }
+
+         snafu_player *player = connected->joined->game->players +
+            connected->player;
+         snafu_player_direction direction = *payload;
+
+         //players may not turn back onto themselves
+         snafu_player_direction opposite =
+            direction == SNAFU_UP?SNAFU_DOWN:
+            direction == SNAFU_DOWN?SNAFU_UP:
+            direction == SNAFU_LEFT?SNAFU_RIGHT:
+            direction == SNAFU_RIGHT?SNAFU_LEFT:0;
+
+         if(!opposite){
+            return(FALSE);
+         }
+
+         player->human = TRUE;
+
+         if(player->direction != opposite){
+            player->direction = direction;
+         }
+
+         return(TRUE);
+      }
+      case(SNAFU_MESSAGE_KEYFRAME):{
+         if(connected->joined == NULL || !connected->watching){
+            return(FALSE);
+         }
+
+         spectate_request_keyframe(connected->joined->stream);
+
+         return(TRUE);
+      }
+      default:{
+         return(FALSE);
+      }
+   }
+}
+
+gboolean client_send(client *connected, const guint8 *data, gsize length){
+   if(connected->fd < 0){
+      return(FALSE);
+   }
+
+   g_byte_array_append(connected->out, data, length);
+
+   if(connected->out->len > CLIENT_BUFFER_MAX){
+      client_close(connected);
+      return(FALSE);
+   }
+
+   //while epoll watches for room, the socket is known to be full
+   if(connected->writing){
+      return(TRUE);
+   }
+
+   return(client_flush(connected));
+}
+
+gboolean client_flush(client *connected){
+   guint sent = 0;
+
+   if(connected->fd < 0){
+      return(FALSE);
+   }
+
+   while(sent < connected->out->len){
+      gssize written = send(connected->fd, connected->out->data + sent,
+         connected->out->len - sent, MSG_NOSIGNAL);
+
+      if(written < 0){
+         if(errno == EINTR){
+            continue;
+         }
+
+         if(errno == EAGAIN || errno == EWOULDBLOCK){
+            break;
+         }
+
+         client_close(connected);
+         return(FALSE);
+      }
+
+      sent += written;
+   }
+
+   g_byte_array_remove_range(connected->out, 0, sent);
+
+   gboolean writing = (connected->out->len != 0);
+
+   if(writing != connected->writing){
+      struct epoll_event event;
+
+      event.events = EPOLLIN | (writing?EPOLLOUT:0);
+      event.data.ptr = connected;
+
+      epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connected->fd, &event);
+
+      connected->writing = writing;
+   }
+
+   return(TRUE);
+}
+
+void client_close(client *connected){
+   session *hosted = connected->joined;
+
+   if(connected->fd < 0){
+      return;
+   }
+
+   if(hosted != NULL){
+      g_ptr_array_remove_fast(connected->watching?hosted->watchers:
+         hosted->clients, connected);
+
+      if(connected->player != SNAFU_PROTOCOL_SPECTATOR){
+         *(hosted->controllers + connected->player) = NULL;
+         (hosted->game->players + connected->player)->human = FALSE;
+      }
+   }
+
+   //closing the socket also removes it from epoll
+   close(connected->fd);
+
+   connected->fd = -1;
+   connected->joined = NULL;
+
+   g_ptr_array_add(closed_clients, connected);
+}
+
+void clients_free_closed(void){
+   for(guint i = 0; i < closed_clients->len; i++){
+      client *connected = g_ptr_array_index(closed_clients, i);
+
+      g_byte_array_free(connected->in, TRUE);
+      g_byte_array_free(connected->out, TRUE);
+
+      g_free(connected);
+   }
+
+   g_ptr_array_set_size(closed_clients, 0);
+}
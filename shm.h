@@ -0,0 +1,402 @@
+//symbolic constants used by snafu shared memory publication
+//
+//a publishing game keeps a copy of its board and players in a POSIX shared
+//memory segment which other processes map read only.  the segment starts
+//with a snafu_shm_header, followed by number_players snafu_shm_players at
+//players_offset and width * height guint32 board_cells at cells_offset
+//
+//the segment is guarded by a seqlock:  sequence is odd while the game is
+//writing and is advanced to the next even number once it is done.  readers
+//take sequence before reading and keep what they read only if sequence is
+//still the same even number afterwards, see snafu_shm_reader_begin and
+//snafu_shm_reader_validate.  the game never waits for readers
+//
+//programs which only read include this file with SNAFU_SHM_READER_ONLY
+//defined, needing glib alone.  publishing needs board.h and snafu.h first
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+//"SNAF" in the first bytes of the segment
+#define SNAFU_SHM_MAGIC 0x46414e53
+
+//changes whenever the layout of the segment does
+#define SNAFU_SHM_VERSION 1
+
+//the header of the segment
+//
+//tick is the iteration of the game and active whether it is still going
+//every field but sequence only changes while sequence is odd
+typedef struct _snafu_shm_header{
+   guint32 magic;          //SNAFU_SHM_MAGIC
+   guint32 version;        //SNAFU_SHM_VERSION
+   volatile gint sequence; //odd while the game is writing
+   guint32 tick;           //iteration of the game
+   guint32 active;         //whether the game is still going
+   guint32 width;          //width of the board
+   guint32 height;         //height of the board
+   guint32 background_color; //the board_cell of empty cells
+   guint32 number_players; //number of snafu_shm_players
+   guint32 players_offset; //bytes from the segment start to the players
+   guint32 cells_offset;   //bytes from the segment start to the cells
+   guint32 size;           //bytes in the segment
+} snafu_shm_header;
+
+//a snafu_player as published
+typedef struct _snafu_shm_player{
+   guint32 x;         //column of the head
+   guint32 y;         //row of the head
+   guint32 alive;     //whether the player is alive
+   guint32 human;     //whether the player is steered by a person
+   guint32 direction; //snafu_player_direction the player moves in
+   guint32 score;     //score of the player
+   guint32 length;    //cells in the trail when trails are limited
+   guint32 cell_value; //the board_cell of the player's trail
+} snafu_shm_player;
+
+//a mapped segment as seen by a reader
+//
+//width, height and number_players are those of the header when opened,
+//checked to fit the mapping, and used in place of the header from then on
+//
+//snafu_shm_readers must be freed with snafu_shm_reader_close
+typedef struct _snafu_shm_reader{
+   gint fd;     //the shared memory object
+   gsize size;  //bytes mapped
+   guint32 width;          //width of the board
+   guint32 height;         //height of the board
+   guint32 number_players; //number of snafu_shm_players
+   const snafu_shm_header *header;  //the mapped segment
+   const snafu_shm_player *players; //the players in the segment
+   const guint32 *cells;            //the board in the segment
+} snafu_shm_reader;
+
+
+/****
+ *snafu_shm_reader functions
+ ****/
+
+//returns the name of the shared memory object for name, which is name with
+//a leading '/' added if it has none.  the name needs to be freed with g_free
+gchar *snafu_shm_object_name(const gchar *name);
+
+//returns a reader of the segment published as name, NULL with errno set if
+//it cannot be mapped, is not a snafu segment of this version or its 
+//players and cells do not lie within it
+snafu_shm_reader *snafu_shm_reader_open(const gchar *name);
+
+//unmaps the segment and frees reader
+void snafu_shm_reader_close(snafu_shm_reader *reader);
+
+//returns the even sequence to pass to snafu_shm_reader_validate once the
+//segment has been read, yielding while the game is writing
+guint32 snafu_shm_reader_begin(snafu_shm_reader *reader);
+
+//returns TRUE if nothing was written since snafu_shm_reader_begin returned
+//sequence, so everything read in between is consistent
+gboolean snafu_shm_reader_validate(snafu_shm_reader *reader,
+   guint32 sequence);
+
+//copies a consistent header, players and cells out of the segment, retrying
+//until the game is not writing in between.  players must have room for
+//reader->number_players snafu_shm_players and cells for reader->width * 
+//reader->height guint32s, either may be NULL to be left out
+void snafu_shm_reader_copy(snafu_shm_reader *reader, snafu_shm_header *header,
+   snafu_shm_player *players, guint32 *cells);
+
+#ifndef SNAFU_SHM_READER_ONLY
+
+//a segment as seen by the game publishing it
+//
+//snafu_shms must be freed with snafu_shm_free, which also removes the
+//segment
+typedef struct _snafu_shm{
+   gchar *name; //the shared memory object
+   gint fd;     //the shared memory object
+   gsize size;  //bytes mapped
+   snafu_shm_header *header;  //the mapped segment
+   snafu_shm_player *players; //the players in the segment
+   guint32 *cells;            //the board in the segment
+} snafu_shm;
+
+
+/****
+ *snafu_shm functions
+ ****/
+
+//returns a segment named name sized for the board and players of game,
+//replacing any segment of that name.  NULL with errno set if it cannot be
+//created.  nothing is published until snafu_shm_publish is called
+snafu_shm *snafu_shm_new(const gchar *name, snafu *game);
+
+//removes the segment and frees shm
+//readers which still have it mapped keep the last published state
+void snafu_shm_free(snafu_shm *shm);
+
+//publishes the players of game and the cells of its board
+//if full is FALSE only play_area->changed_cells are copied, so it must be
+//called before the changes are drawn or forgotten
+void snafu_shm_publish(snafu_shm *shm, snafu *game, gboolean full);
+
+//step function for snafu_set_step_func with a snafu_shm as data,
+//publishing every iteration and the whole board when a game begins
+void snafu_shm_step(snafu *game, gpointer shm);
+
+#endif
+
+/********/
+
+gchar *snafu_shm_object_name(const gchar *name){
+   return(*name == '/'?g_strdup(name):g_strconcat("/", name, NULL));
+}
+
+snafu_shm_reader *snafu_shm_reader_open(const gchar *name){
+   gchar *object_name = snafu_shm_object_name(name);
+   gint fd = shm_open(object_name, O_RDONLY, 0);
+
+   g_free(object_name);
+
+   if(fd < 0){
+      return(NULL);
+   }
+
+   struct stat status;
+   const snafu_shm_header *header = MAP_FAILED;
+   snafu_shm_header layout = {0};
+
+   if(!fstat(fd, &status) && status.st_size >= sizeof(snafu_shm_header)){
+      header = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   }
+
+   //the layout is read once, so the checks hold whatever the segment says
+   //later.  the players and cells are guint32s and must lie in the segment
+   if(header != MAP_FAILED){
+      layout = *header;
+   }
+
+   guint64 players_end = layout.players_offset +
+      (guint64) sizeof(snafu_shm_player) * layout.number_players;
+   guint64 cells_end = layout.cells_offset +
+      (guint64) sizeof(guint32) * layout.width * layout.height;
+
+   if(header == MAP_FAILED || layout.magic != SNAFU_SHM_MAGIC ||
+      layout.version != SNAFU_SHM_VERSION || layout.size > status.st_size ||
+      layout.players_offset < sizeof(snafu_shm_header) || 
+      layout.players_offset % sizeof(guint32) || 
+      layout.cells_offset % sizeof(guint32) || 
+      players_end > layout.cells_offset || cells_end > layout.size){
+      if(header != MAP_FAILED){
+         munmap((gpointer) header, status.st_size);
+      }
+
+      close(fd);
+
+      errno = EINVAL;
+      return(NULL);
+   }
+
+   snafu_shm_reader *reader = g_new(snafu_shm_reader, 1);
+
+   reader->fd = fd;
+   reader->size = status.st_size;
+   reader->width = layout.width;
+   reader->height = layout.height;
+   reader->number_players = layout.number_players;
+   reader->header = header;
+   reader->players = (const snafu_shm_player *)
+      ((const guint8 *) header + layout.players_offset);
+   reader->cells = (const guint32 *)
+      ((const guint8 *) header + layout.cells_offset);
+
+   return(reader);
+}
+
+void snafu_shm_reader_close(snafu_shm_reader *reader){
+   munmap((gpointer) reader->header, reader->size);
+   close(reader->fd);
+
+   g_free(reader);
+}
+
+guint32 snafu_shm_reader_begin(snafu_shm_reader *reader){
+   guint32 sequence;
+
+   while((sequence = g_atomic_int_get(&reader->header->sequence)) & 1){
+      sched_yield();
+   }
+
+   //reads of the segment may not move above the sequence
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+   return(sequence);
+}
+
+gboolean snafu_shm_reader_validate(snafu_shm_reader *reader,
+   guint32 sequence){
+   //reads of the segment may not move below the sequence
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+   return(g_atomic_int_get(&reader->header->sequence) == sequence);
+}
+
+void snafu_shm_reader_copy(snafu_shm_reader *reader, snafu_shm_header *header,
+   snafu_shm_player *players, guint32 *cells){
+   guint32 sequence;
+
+   do{
+      sequence = snafu_shm_reader_begin(reader);
+
+      *header = *reader->header;
+
+      //only the layout checked when opening is trusted
+      header->width = reader->width;
+      header->height = reader->height;
+      header->number_players = reader->number_players;
+
+      if(players != NULL){
+         memcpy(players, reader->players,
+            sizeof(snafu_shm_player) * reader->number_players);
+      }
+
+      if(cells != NULL){
+         memcpy(cells, reader->cells,
+            sizeof(guint32) * reader->width * reader->height);
+      }
+   }while(!snafu_shm_reader_validate(reader, sequence));
+}
+
+#ifndef SNAFU_SHM_READER_ONLY
+
+snafu_shm *snafu_shm_new(const gchar *name, snafu *game){
+   board *play_area = game->play_area;
+
+   gsize players_offset = sizeof(snafu_shm_header);
+   gsize cells_offset = players_offset +
+      sizeof(snafu_shm_player) * game->number_players;
+   gsize size = cells_offset +
+      sizeof(guint32) * play_area->width * play_area->height;
+
+   //the header holds the size as a guint32
+   if(size > G_MAXUINT32){
+      errno = EFBIG;
+      return(NULL);
+   }
+
+   gchar *object_name = snafu_shm_object_name(name);
+
+   shm_unlink(object_name);
+
+   gint fd = shm_open(object_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+   if(fd < 0 || ftruncate(fd, size) < 0){
+      gint shm_errno = errno;
+
+      if(fd >= 0){
+         close(fd);
+         shm_unlink(object_name);
+      }
+
+      g_free(object_name);
+
+      errno = shm_errno;
+      return(NULL);
+   }
+
+   snafu_shm_header *header = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+
+   if(header == MAP_FAILED){
+      gint shm_errno = errno;
+
+      close(fd);
+      shm_unlink(object_name);
+      g_free(object_name);
+
+      errno = shm_errno;
+      return(NULL);
+   }
+
+   //ftruncate zeroed the segment, so it reads as an empty board at tick 0
+   header->magic = SNAFU_SHM_MAGIC;
+   header->version = SNAFU_SHM_VERSION;
+   header->width = play_area->width;
+   header->height = play_area->height;
+   header->background_color = play_area->background_color;
+   header->number_players = game->number_players;
+   header->players_offset = players_offset;
+   header->cells_offset = cells_offset;
+   header->size = size;
+
+   snafu_shm *new_shm = g_new(snafu_shm, 1);
+
+   new_shm->name = object_name;
+   new_shm->fd = fd;
+   new_shm->size = size;
+   new_shm->header = header;
+   new_shm->players = (snafu_shm_player *) ((guint8 *) header +
+      players_offset);
+   new_shm->cells = (guint32 *) ((guint8 *) header + cells_offset);
+
+   return(new_shm);
+}
+
+void snafu_shm_free(snafu_shm *shm){
+   munmap(shm->header, shm->size);
+   close(shm->fd);
+   shm_unlink(shm->name);
+
+   g_free(shm->name);
+   g_free(shm);
+}
+
+void snafu_shm_publish(snafu_shm *shm, snafu *game, gboolean full){
+   board *play_area = game->play_area;
+
+   //odd, the full barrier keeps the writes below from moving above it
+   g_atomic_int_inc(&shm->header->sequence);
+
+   shm->header->tick = game->tick;
+   shm->header->active = game->active;
+
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+      snafu_shm_player *published = shm->players + i;
+
+      published->x = player->x;
+      published->y = player->y;
+      published->alive = player->alive;
+      published->human = player->human;
+      published->direction = player->direction;
+      published->score = player->score;
+      published->length = player->body_length;
+      published->cell_value = player->cell_value;
+   }
+
+   if(full){
+      for(gint64 i = 0; i < (gint64)play_area->width * play_area->height; 
+         i++){
+         *(shm->cells + i) = board_read_cell(play_area, i);
+      }
+   }else{
+      for(guint i = 0; i < play_area->changed_cells->len; i++){
+         gint64 cell_number = g_array_index(play_area->changed_cells, gint64,
+            i);
+
+         *(shm->cells + cell_number) = board_read_cell(play_area,
+            cell_number);
+      }
+   }
+
+   //even again, the full barrier keeps the writes above from moving below
+   g_atomic_int_inc(&shm->header->sequence);
+}
+
+void snafu_shm_step(snafu *game, gpointer shm){
+   snafu_shm_publish(shm, game, game->tick == 0);
+}
+
+#endif
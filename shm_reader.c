@@ -0,0 +1,138 @@
+/******************************************************************************
+Title         : New SNAFU Shared Memory Reader
+Description   : An example reader of the board and players a game of SNAFU
+                publishes with --shm.  Every interval the segment is copied 
+                consistently and the tick, the players and, with --board, 
+                the board as text are printed.  The game is never slowed 
+                down by the reader.
+Usage         : shm-reader [--interval MS] [--board] [--count N] NAME
+                NAME is the one given to snafu --shm or snafu-server --shm.
+Build with    : gcc -o shm-reader -std=c99 -Wall -g shm_reader.c \
+   `pkg-config --cflags --libs glib-2.0` -lrt
+******************************************************************************/
+
+#define _GNU_SOURCE
+#define SNAFU_SHM_READER_ONLY
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "shm.h"
+
+#define INTERVAL 500
+
+//command line options
+static gint interval = INTERVAL;
+static gboolean print_board = FALSE;
+static gint count = 0;
+
+static GOptionEntry options[] = {
+   {"interval", 0, 0, G_OPTION_ARG_INT, &interval,
+      "Miliseconds between reads", "MS"},
+   {"board", 0, 0, G_OPTION_ARG_NONE, &print_board,
+      "Print the board as text", NULL},
+   {"count", 0, 0, G_OPTION_ARG_INT, &count,
+      "Reads before exiting, 0 to read forever", "N"},
+   {NULL}
+};
+
+//prints the header, players and, if print_board is set, the cells
+void print_state(const snafu_shm_header *header,
+   const snafu_shm_player *players, const guint32 *cells);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "NAME - read a published game of snafu");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   if(argc < 2){
+      g_printerr("no segment name given\n");
+      return(1);
+   }
+
+   snafu_shm_reader *reader = snafu_shm_reader_open(argv[1]);
+
+   if(reader == NULL){
+      g_printerr("cannot read %s: %s\n", argv[1], g_strerror(errno));
+      return(1);
+   }
+
+   //the layout never changes while the segment exists
+   snafu_shm_player *players = g_new(snafu_shm_player,
+      reader->number_players);
+   guint32 *cells = g_new(guint32, (gsize) reader->width * reader->height);
+   snafu_shm_header header;
+
+   for(gint i = 0; !count || i < count; i++){
+      snafu_shm_reader_copy(reader, &header, players,
+         print_board?cells:NULL);
+
+      print_state(&header, players, cells);
+
+      g_usleep(interval * 1000);
+   }
+
+   g_free(players);
+   g_free(cells);
+
+   snafu_shm_reader_close(reader);
+
+   return(0);
+}
+
+void print_state(const snafu_shm_header *header,
+   const snafu_shm_player *players, const guint32 *cells){
+   printf("tick %u%s\n", header->tick, header->active?"":" (over)");
+
+   for(guint i = 0; i < header->number_players; i++){
+      const snafu_shm_player *player = players + i;
+
+      printf("   player %u at (%u, %u) %s%s score %u\n", i + 1, player->x,
+         player->y, player->alive?"alive":"dead",
+         player->human?" human":"", player->score);
+   }
+
+   if(!print_board){
+      return;
+   }
+
+   gchar *row = g_new(gchar, header->width + 1);
+
+   *(row + header->width) = '\0';
+
+   for(guint y = 0; y < header->height; y++){
+      for(guint x = 0; x < header->width; x++){
+         guint32 cell = *(cells + (header->width * y) + x);
+
+         *(row + x) = '.';
+
+         if(cell == header->background_color){
+            continue;
+         }
+
+         *(row + x) = '#';
+
+         //trails are drawn with the number of their player
+         for(guint i = 0; i < header->number_players; i++){
+            if(((cell ^ (players + i)->cell_value) & 0x00ffffff) == 0){
+               *(row + x) = '1' + i;
+            }
+         }
+      }
+
+      printf("%s\n", row);
+   }
+
+   g_free(row);
+}
@@ -6,6 +6,17 @@
 #define SNAFU_LEFT 4
 #define SNAFU_RIGHT 8
 
+//what a snafu_player ran into, see death_cause
+#define SNAFU_DEATH_NONE 0
+#define SNAFU_DEATH_WALL 1
+#define SNAFU_DEATH_SELF 2
+#define SNAFU_DEATH_OTHER 3
+
+//sizes of the fixed buffers used to build label markup without allocating
+#define SNAFU_SCORE_MARKUP_LENGTH 64
+#define SNAFU_MESSAGE_LENGTH 160
+#define SNAFU_NAME_LENGTH 64
+
 //typedefs
 
 //the snafu_player_direction is an 8-bit integer representing 
@@ -27,16 +38,31 @@ typedef guint8 snafu_player_direction;
 // on the board
 //direction is the snafu_player_direction the snafu_player will 
 //attempt to move in
+//death_cause is SNAFU_DEATH_NONE while the snafu_player is alive, and what
+//was ahead of it when it died otherwise:  the edge of the board or a static
+//wall, its own trail or the trail of another snafu_player
 //
-//name is an allocated string representing what markup will should be 
-//used to depict the player's name on the user interface. it needs to be freed with g_free.
-//snafu_free will free snafu->players->name
+//name is a string representing what markup will should be 
+//used to depict the player's name on the user interface.  it is drawn from
+//the arena of the snafu and must not be freed
+//
+//body is a ring buffer of the board indices ((width * y) + x) of the cells 
+//the snafu_player occupies, oldest first.  it holds body_length indices 
+//starting at body_start and wraps around at the snafu's max_length.  body is
+//only drawn from the arena of the snafu when the snafu has a max_length, by
+//snafu_begin, and given back by snafu_end
 //
 //score is the snafu_player's score, and score_board is a GtkLabel 
 //which will be used to display the score.  
 //this is an optional feature, score_board may be set to NULL
+//score_board is not updated when score changes, only when the snafu is 
+//flushed with snafu_flush_display.  score_shown is the score last pushed to
+//score_board and score_markup caches the markup for it:  the colored prefix
+//is written once when the snafu_player is created and only the digits after 
+//score_markup_prefix_length are rewritten
 typedef struct _snafu_player{
    guint8 direction;
+   guint8 death_cause;
    board_cell cell_value;
    guint x;
    guint y;
@@ -44,8 +70,14 @@ typedef struct _snafu_player{
    guint _y;
    gboolean alive;
    gboolean human;
+   guint *body;
+   guint body_start;
+   guint body_length;
    guint score;
+   guint score_shown;
    GtkWidget *score_board;
+   gchar score_markup[SNAFU_SCORE_MARKUP_LENGTH];
+   gint score_markup_prefix_length;
    gchar *name;
 } snafu_player;
 
@@ -67,10 +99,46 @@ typedef struct _snafu_player{
 //
 //timeout_func_ref is a refference to the snafu timeout function.  the ref 
 //is used in the event that a timeout needs to be cancelled for whatever reason
+//it is 0 when no timeout is scheduled, such as for games stepped by hand 
+//with snafu_step
+//
+//tick counts the iterations of the current game
+//
+//max_length is the most cells a snafu_player's trail may have.  once a trail
+//is that long, its oldest cell is cleared for every cell it grows.  0 lets 
+//trails grow forever
+//
+//message is the markup last given to snafu_display_message, and 
+//message_changed is set until it is pushed to message_area by 
+//snafu_flush_display
+//
+//rand is the GRand every random choice of the game is drawn from, so games
+//seeded alike with snafu_set_seed play alike and games on different 
+//threads never share a generator
 //
-//snafu needs to be freed with snafu_free and players needs to be freed with 
-//g_free.  snafu_free frees players.  play_area needs to be freed with 
-//board_free
+//step_func is called with step_data after every iteration and when a game 
+//begins, while the changed cells are still in play_area->changed_cells.  a
+//game begins with tick 0 on a board which may have been cleared without 
+//marking the cells changed.  step_func may be NULL
+//
+//steer_func is called with steer_data before every iteration, while 
+//game->tick is still the tick of the iteration before, to set the 
+//directions the snafu_players take.  steer_func may be NULL
+//
+//regions are the connected regions of empty cells of play_area, kept up to
+//date after every iteration before step_func is called once they are turned
+//on with snafu_set_track_regions, NULL otherwise.  they are freed by 
+//snafu_free
+//
+//arena holds the snafu itself, players and their names, everything drawn 
+//before game_mark, and the bodies of the game in progress after it.  
+//snafu_end rewinds arena to game_mark, so a game gives back what it drew 
+//in one go and the next game draws from the same chunks.  arena is taken 
+//from the pool of arenas by snafu_new and given back by snafu_free, so 
+//games built and freed over and over reuse the memory
+//
+//snafu needs to be freed with snafu_free, which frees players.  play_area 
+//needs to be freed with board_free
 typedef struct _snafu{
    guint number_players;
    snafu_player *players;
@@ -79,8 +147,20 @@ typedef struct _snafu{
    gboolean active;
    guint frequency;
    guint death_count;
+   guint max_length;
+   guint tick;
    gint timeout_func_ref;
    GtkWidget *message_area;
+   gchar message[SNAFU_MESSAGE_LENGTH];
+   gboolean message_changed;
+   GRand *rand;
+   void (*step_func)(struct _snafu *game, gpointer data);
+   gpointer step_data;
+   void (*steer_func)(struct _snafu *game, gpointer data);
+   gpointer steer_data;
+   regions *regions;
+   arena *arena;
+   arena_mark game_mark;
 } snafu;
 
 /***
@@ -97,33 +177,66 @@ typedef struct _snafu{
 //   randomly selected
 //if more than two flags are set, it will return one of the outer-bit
 //   directions.  inner bits will never be returned
-snafu_player_direction snafu_player_direction_new(
+//random choices are drawn from rand
+snafu_player_direction snafu_player_direction_new(GRand *rand, 
    snafu_player_direction directions);
 
+//the size of the board the players of snafu_player_new start on, which
+//every board must at least have
+#define SNAFU_BOARD_WIDTH 45
+#define SNAFU_BOARD_HEIGHT 30
+
 //returns an allocated snafu_player whith properties determined by
 //the value of i
 snafu_player snafu_player_new(snafu *game, gint i);
 
 //this function is called at the end of a game, restoring a snafu_player
 //to play in a new game
-void snafu_player_end(snafu_player *player);
+void snafu_player_end(snafu *game, snafu_player *player);
 
-//returns an allocated string representing the value to be set to score_board
+//rewrites player->score_markup for the current score and returns it
 //the gchar* is a string to be used as markup to a GtkLabel
-//return value should be freed with g_free
-gchar *snafu_player_get_score_string(snafu_player *player);
+//return value points into player and must not be freed
+const gchar *snafu_player_get_score_string(snafu_player *player);
 
 //this function is called when a player's score is to be increased
 //'score' in this case is used a verb and is not intended to 
 //   refer to snafu_player->score
+//score_board is updated on the next snafu_flush_display
 void snafu_player_score(snafu_player *player);
 
 //sets the player's score to the value specified by score
+//score_board is updated on the next snafu_flush_display
 void snafu_player_set_score(snafu_player *player, guint score);
 
-//this function is called when a player dies
+//this function is called when a player dies, setting its death_cause from
+//the cell ahead of it
 void snafu_player_die(snafu *game, snafu_player *player);
 
+//this function is called when a player occupies cell (x, y)
+//the cell is set on the board and pushed onto player->body.  if the trail 
+//is already game->max_length long, its oldest cell is cleared first
+void snafu_player_grow(snafu *game, snafu_player *player, gint x, gint y);
+
+//returns the flags of cell (x, y) as an obstacle to player, which is 0 for 
+//the oldest cell of a trail already game->max_length long since 
+//snafu_player_grow clears it as the player moves this iteration
+board_cell snafu_player_blocked(snafu *game, snafu_player *player, gint x, 
+   gint y);
+
+//returns the number of empty cells player can still reach, which is the size
+//of the regions beside its head, or 0 if it is dead
+//game must track regions
+guint snafu_player_space(snafu *game, snafu_player *player);
+
+//returns the number of empty cells in a straight line from the head of 
+//player in direction, a single SNAFU_* direction flag, before the first 
+//occupied cell or the edge of the board
+//keeping the rays of game->play_area with board_rays_alloc makes this O(1)
+//for boards up to 4096 cells on a side
+guint snafu_player_reach(snafu *game, snafu_player *player, 
+   snafu_player_direction direction);
+
 //this function is called when the next iteration of a game in progress occurs
 //if human is set, the snafu_player will attempt to move in the direction
 //    of direction and die if that cell is occupied on the board
@@ -141,41 +254,115 @@ void snafu_player_next(snafu *game, snafu_player *player);
 //called to end a game in progress
 void snafu_end(snafu *game);
 
+//sets the most cells a snafu_player's trail may have, 0 for no limit
+//must not be called while a game is started
+void snafu_set_max_length(snafu *game, guint max_length);
+
+//turns tracking the connected regions of empty cells of game->play_area on
+//or off.  the changed cells of every iteration must reach play_area
+//->changed_cells, so cells must not be set without marking them changed 
+//while a game is in progress
+void snafu_set_track_regions(snafu *game, gboolean track);
+
+//returns TRUE if no two living players can reach the same empty cell any
+//more, so every player plays on alone and the player with the most space can
+//outlast the others.  game must track regions
+gboolean snafu_players_separated(snafu *game);
+
+//returns FALSE and sets error if a wall of game->play_area covers the first
+//cell of a player, which would die before its first move
+gboolean snafu_walls_check(snafu *game, GError **error);
+
+//reseeds the GRand of game, making the games after the next snafu_end 
+//play out the same for the same seed and the same input
+void snafu_set_seed(snafu *game, guint32 seed);
+
+//sets the function called with data after every iteration of game and when
+//a game begins, NULL for none
+void snafu_set_step_func(snafu *game, void (*step_func)(snafu *game, 
+   gpointer data), gpointer data);
+
+//sets the function called with data before every iteration of game, NULL
+//for none
+void snafu_set_steer_func(snafu *game, void (*steer_func)(snafu *game, 
+   gpointer data), gpointer data);
+
 //called to go through the next iteration of a game in progress
+//the iteration is drawn and the display flushed afterwards
 gboolean snafu_next(snafu *game);
 
+//same as snafu_next however nothing is drawn or flushed
+//the changed cells of the iteration are left in 
+//game->play_area->changed_cells for the caller
+//returns TRUE while the game is still active
+gboolean snafu_step(snafu *game);
+
+//returns TRUE if no living snafu_player is human, so the game plays out 
+//without any input
+gboolean snafu_ai_only(snafu *game);
+
+//runs up to max_ticks iterations of game, 0 for no limit, as fast as they 
+//go without drawing or flushing anything.  stops early once the game ends 
+//or a living snafu_player is human.  step_func is still called every 
+//iteration, after which the changed cells are forgotten, so the board needs
+//to be redrawn whole with snafu_redraw afterwards
+//returns the number of iterations run
+guint snafu_fast_forward(snafu *game, guint max_ticks);
+
+//draws the whole board of game and flushes the display
+void snafu_redraw(snafu *game);
+
 //accepts a gchar* which will be used on game->message_area, a GtkLabel, 
 //if the label is not NULL
+//the message is copied into game->message and shown on the next 
+//snafu_flush_display
 void snafu_display_message(snafu *game, gchar *message);
 
+//same as snafu_display_message however the message is built from a printf
+//style format directly into game->message
+void snafu_display_message_printf(snafu *game, const gchar *format, ...);
+
+//pushes changed scores and the changed message to their GtkLabels
+//called once per rendered frame, so any number of deaths in one iteration
+//cost at most one label update per label
+void snafu_flush_display(snafu *game);
+
+#ifndef SNAFU_HEADLESS
 //score_board, a GTKBox, will be initialized with labels for each 
 //snafu_player in players
 void snafu_score_board_init(snafu *game, GtkWidget *score_board);
+#endif
 
 //called to start a game of snafu
+//the game advances every game->frequency miliseconds from the glib main loop
 void snafu_start(snafu *game);
 
+//same as snafu_start however no timeout is scheduled, the game only 
+//advances when snafu_step or snafu_next is called
+void snafu_begin(snafu *game);
+
 //returns an allocated snafu pointer with number_players snafu_players and
 //frequency used as a timeout interval for the game
 snafu *snafu_new(board *play_area, guint number_players, guint frequency);
 
-//frees a snafu, including snafu_players and snafu_player->names
+//frees a snafu, including snafu_players and snafu_player->names, giving 
+//its arena back to the pool
 //snafu->play_area still needs to be freed with board_free
 void snafu_free(snafu *game);
 
 /********/
 
-snafu_player_direction snafu_player_direction_new(
+snafu_player_direction snafu_player_direction_new(GRand *rand, 
    snafu_player_direction directions){
    snafu_player_direction direction = 0;
 
    if(!directions){
       return(
-         (direction = g_random_int_range(1, 5)) && direction == 3?8:direction
+         (direction = g_rand_int_range(rand, 1, 5)) && direction == 3?8:direction
       );
    }
 
-   for(gint i = 0, j = g_random_int_range(0, 2);
+   for(gint i = 0, j = g_rand_int_range(rand, 0, 2);
       (j && ((direction = (directions & 1))) || 
          (direction = (directions & 128))) || TRUE;
       (i++, j?(directions >>= 1):(directions <<= 1))){
@@ -225,9 +412,14 @@ snafu_player snafu_player_new(snafu *game, gint i){
    new_snafu_player._x = new_snafu_player.x;
    new_snafu_player._y = new_snafu_player.y;
 
-   new_snafu_player.direction = snafu_player_direction_new(SNAFU_RANDOM);
+   new_snafu_player.direction = snafu_player_direction_new(game->rand, 
+      SNAFU_RANDOM);
    new_snafu_player.alive = TRUE;
+   new_snafu_player.death_cause = SNAFU_DEATH_NONE;
    new_snafu_player.human = FALSE;
+   new_snafu_player.body = NULL;
+   new_snafu_player.body_start = 0;
+   new_snafu_player.body_length = 0;
    new_snafu_player.score = 0;
 
    new_snafu_player.score_board = NULL;
@@ -238,26 +430,42 @@ snafu_player snafu_player_new(snafu *game, gint i){
 //players on the board with somewhat even distribution
 //   new_snafu_player.cell_value = board_cell_new_with_flags(1, ~(i * color_interval), (i * color_interval), ~(i * color_interval) >> 1);
 
-   new_snafu_player.name = g_strdup_printf(
+   new_snafu_player.name = arena_alloc(game->arena, SNAFU_NAME_LENGTH);
+
+   g_snprintf(new_snafu_player.name, SNAFU_NAME_LENGTH, 
       "<b><span color='#%006X'>Player %d</span></b>",
        new_snafu_player.cell_value & (~BOARD_CELL_FLAGS_MASK), i + 1);
 
+   new_snafu_player.score_markup_prefix_length = g_snprintf(
+      new_snafu_player.score_markup, SNAFU_SCORE_MARKUP_LENGTH, 
+      "<b><span color='#%006X'>", 
+      new_snafu_player.cell_value & (~BOARD_CELL_FLAGS_MASK));
+
+   new_snafu_player.score_shown = G_MAXUINT;
+
    return(new_snafu_player);
 }
 
-void snafu_player_end(snafu_player *player){
+void snafu_player_end(snafu *game, snafu_player *player){
    player->x = player->_x;
    player->y = player->_y;
 
-   player->direction = snafu_player_direction_new(SNAFU_RANDOM);
+   player->direction = snafu_player_direction_new(game->rand, SNAFU_RANDOM);
 
    player->alive = TRUE;
+   player->death_cause = SNAFU_DEATH_NONE;
    player->human = FALSE;
+
+   player->body_start = 0;
+   player->body_length = 0;
 }
 
-gchar *snafu_player_get_score_string(snafu_player *player){
-   return(g_strdup_printf("<b><span color='#%006X'>%d</span></b>",
-      player->cell_value & (~BOARD_CELL_FLAGS_MASK), player->score));
+const gchar *snafu_player_get_score_string(snafu_player *player){
+   g_snprintf(player->score_markup + player->score_markup_prefix_length, 
+      SNAFU_SCORE_MARKUP_LENGTH - player->score_markup_prefix_length,
+      "%u</span></b>", player->score);
+
+   return(player->score_markup);
 }
 
 void snafu_player_score(snafu_player *player){
@@ -266,49 +474,107 @@ void snafu_player_score(snafu_player *player){
    }
 
    player->score++;
+}
+
+void snafu_player_set_score(snafu_player *player, guint score){
+   player->score = score;
+}
 
-   if(player->score_board == NULL){
+void snafu_player_die(snafu *game, snafu_player *player){
+   if(!player->alive){
       return;
    }
 
-   gchar *score_string = snafu_player_get_score_string(player);
+   board *brd = game->play_area;
+   gint x = (gint) player->x + (player->direction == SNAFU_RIGHT) - 
+      (player->direction == SNAFU_LEFT);
+   gint y = (gint) player->y + (player->direction == SNAFU_DOWN) - 
+      (player->direction == SNAFU_UP);
+   board_cell ahead = board_get_cell_color(brd, x, y);
+
+   if(ahead == BOARD_CELL_OUT_OF_BOUNDS || 
+      board_walls_test(brd, (brd->width * y) + x)){
+      player->death_cause = SNAFU_DEATH_WALL;
+   }else if(ahead == (player->cell_value & (~BOARD_CELL_FLAGS_MASK))){
+      player->death_cause = SNAFU_DEATH_SELF;
+   }else{
+      player->death_cause = SNAFU_DEATH_OTHER;
+   }
 
-   gtk_label_set_markup(GTK_LABEL(player->score_board), score_string);
+   player->alive = FALSE;
+   game->death_count++;
 
-   g_free(score_string);
-}
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player_score(game->players + i);
+   }
 
-void snafu_player_set_score(snafu_player *player, guint score){
-   player->score = score;
+   snafu_display_message_printf(game, "%s Dies!", player->name);
+}
 
-   if(player->score_board == NULL){
+void snafu_player_grow(snafu *game, snafu_player *player, gint x, gint y){
+   if(player->body == NULL){
+      board_set_cell(game->play_area, x, y, player->cell_value);
       return;
-   }   
+   }
 
-   gchar *score_string = snafu_player_get_score_string(player);
+   if(player->body_length == game->max_length){
+      guint tail = *(player->body + player->body_start);
 
-   gtk_label_set_markup(GTK_LABEL(player->score_board), score_string);
+      board_clear_cell(game->play_area, tail % game->play_area->width, 
+         tail / game->play_area->width);
 
-   g_free(score_string);   
+      if(++player->body_start == game->max_length){
+         player->body_start = 0;
+      }
+
+      player->body_length--;
+   }
+
+   //set after the tail is cleared, which may be the cell moved into
+   board_set_cell(game->play_area, x, y, player->cell_value);
+
+   guint head = player->body_start + player->body_length;
+
+   if(head >= game->max_length){
+      head -= game->max_length;
+   }
+
+   *(player->body + head) = (game->play_area->width * y) + x;
+
+   player->body_length++;
 }
 
-void snafu_player_die(snafu *game, snafu_player *player){
-   if(!player->alive){
-      return;
+board_cell snafu_player_blocked(snafu *game, snafu_player *player, gint x, 
+   gint y){
+   if(player->body != NULL && player->body_length == game->max_length && 
+      board_check_coords_in_bounds(game->play_area, x, y) && 
+      *(player->body + player->body_start) == 
+      (game->play_area->width * y) + x){
+      return(0);
    }
 
-   player->alive = FALSE;
-   game->death_count++;
+   return(board_get_cell_flags(game->play_area, x, y));
+}
 
-   for(gint i = 0; i < game->number_players; i++){
-      snafu_player_score(game->players + i);
+guint snafu_player_space(snafu *game, snafu_player *player){
+   if(!player->alive){
+      return(0);
    }
 
-   gchar *message_string = g_strdup_printf("%s Dies!", player->name);
+   return(regions_space_around(game->regions, player->x, player->y));
+}
+
+guint snafu_player_reach(snafu *game, snafu_player *player, 
+   snafu_player_direction direction){
+   gint dx = direction == SNAFU_LEFT?-1:direction == SNAFU_RIGHT?1:0;
+   gint dy = direction == SNAFU_UP?-1:direction == SNAFU_DOWN?1:0;
 
-   snafu_display_message(game, message_string);
+   if(!dx && !dy){
+      return(0);
+   }
 
-   g_free(message_string);
+   return(board_ray_distance(game->play_area, player->x, player->y, dx, dy) - 
+      1);
 }
 
 void snafu_player_next(snafu *game, snafu_player *player){
@@ -320,7 +586,7 @@ void snafu_player_next(snafu *game, snafu_player *player){
 
    switch(player->direction){
       case(SNAFU_UP):{
-         board_cell advance_cell = board_get_cell_flags(game->play_area, 
+         board_cell advance_cell = snafu_player_blocked(game, player, 
             advance_x = player->x, advance_y = player->y - 1);
 
          if(advance_cell){
@@ -329,12 +595,12 @@ void snafu_player_next(snafu *game, snafu_player *player){
                break;
             }
 
-            gint random_direction = g_random_int_range(0, 2)?1:-1;
+            gint random_direction = g_rand_int_range(game->rand, 0, 2)?1:-1;
 
-            if(advance_cell = board_get_cell_flags(game->play_area, 
+            if(advance_cell = snafu_player_blocked(game, player, 
                advance_x = player->x + random_direction, 
                advance_y = player->y)){
-               if(advance_cell = board_get_cell_flags(game->play_area, 
+               if(advance_cell = snafu_player_blocked(game, player, 
                   advance_x = player->x - random_direction, 
                   advance_y = player->y)){
                   snafu_player_die(game, player);
@@ -350,7 +616,7 @@ void snafu_player_next(snafu *game, snafu_player *player){
          break;
       }
       case(SNAFU_DOWN):{
-         board_cell advance_cell = board_get_cell_flags(game->play_area, 
+         board_cell advance_cell = snafu_player_blocked(game, player, 
             advance_x = player->x, advance_y = player->y + 1);
 
          if(advance_cell){
@@ -359,12 +625,12 @@ void snafu_player_next(snafu *game, snafu_player *player){
                break;
             }
 
-            gint random_direction = g_random_int_range(0, 2)?1:-1;
+            gint random_direction = g_rand_int_range(game->rand, 0, 2)?1:-1;
 
-            if(advance_cell = board_get_cell_flags(game->play_area, 
+            if(advance_cell = snafu_player_blocked(game, player, 
                advance_x = player->x + random_direction, 
                advance_y = player->y)){
-               if(advance_cell = board_get_cell_flags(game->play_area, 
+               if(advance_cell = snafu_player_blocked(game, player, 
                   advance_x = player->x - random_direction, 
                   advance_y = player->y)){
                   snafu_player_die(game, player);
@@ -380,7 +646,7 @@ void snafu_player_next(snafu *game, snafu_player *player){
          break;
       }
       case(SNAFU_LEFT):{
-         board_cell advance_cell = board_get_cell_flags(game->play_area, 
+         board_cell advance_cell = snafu_player_blocked(game, player, 
             advance_x = player->x - 1, advance_y = player->y);
 
          if(advance_cell){
@@ -389,12 +655,12 @@ void snafu_player_next(snafu *game, snafu_player *player){
                break;
             }
 
-            gint random_direction = g_random_int_range(0, 2)?1:-1;
+            gint random_direction = g_rand_int_range(game->rand, 0, 2)?1:-1;
 
-            if(advance_cell = board_get_cell_flags(game->play_area, 
+            if(advance_cell = snafu_player_blocked(game, player, 
                advance_x = player->x, 
                advance_y = player->y + random_direction)){
-               if(advance_cell = board_get_cell_flags(game->play_area, 
+               if(advance_cell = snafu_player_blocked(game, player, 
                   advance_x = player->x, 
                   advance_y = player->y - random_direction)){
                   snafu_player_die(game, player);
@@ -409,7 +675,7 @@ void snafu_player_next(snafu *game, snafu_player *player){
          break;
       }
       case(SNAFU_RIGHT):{
-         board_cell advance_cell = board_get_cell_flags(game->play_area, 
+         board_cell advance_cell = snafu_player_blocked(game, player, 
             advance_x = player->x + 1, advance_y = player->y);
 
          if(advance_cell){
@@ -418,12 +684,12 @@ void snafu_player_next(snafu *game, snafu_player *player){
                break;
             }
 
-            gint random_direction = g_random_int_range(0, 2)?1:-1;
+            gint random_direction = g_rand_int_range(game->rand, 0, 2)?1:-1;
 
-            if(advance_cell = board_get_cell_flags(game->play_area, 
+            if(advance_cell = snafu_player_blocked(game, player, 
                advance_x = player->x, 
                advance_y = player->y + random_direction)){
-               if(advance_cell = board_get_cell_flags(game->play_area, 
+               if(advance_cell = snafu_player_blocked(game, player, 
                   advance_x = player->x, 
                   advance_y = player->y - random_direction)){
                   snafu_player_die(game, player);
@@ -438,7 +704,8 @@ void snafu_player_next(snafu *game, snafu_player *player){
          break;
       }
       default:{
-         player->direction = snafu_player_direction_new(SNAFU_RANDOM);
+         player->direction = snafu_player_direction_new(game->rand, 
+            SNAFU_RANDOM);
          snafu_player_next(game, player);
          return;
       }
@@ -451,7 +718,7 @@ void snafu_player_next(snafu *game, snafu_player *player){
    player->x = advance_x;
    player->y = advance_y;
 
-   board_set_cell(game->play_area, advance_x, advance_y, player->cell_value);
+   snafu_player_grow(game, player, advance_x, advance_y);
 }
 
 void snafu_end(snafu *game){
@@ -460,13 +727,21 @@ void snafu_end(snafu *game){
 
    game->death_count = 0;
 
-   g_source_remove(game->timeout_func_ref);
+   if(game->timeout_func_ref){
+      g_source_remove(game->timeout_func_ref);
+      game->timeout_func_ref = 0;
+   }
 
    board_clear(game->play_area, TRUE);
 
    for(gint i = 0; i < game->number_players; i++){
-      snafu_player_end(game->players + i);
+      snafu_player_end(game, game->players + i);
+
+      (game->players + i)->body = NULL;
    }
+
+   //the bodies of the game go back in one go
+   arena_rewind(game->arena, game->game_mark);
    
 }
 
@@ -475,10 +750,34 @@ gboolean snafu_next(snafu *game){
       return(FALSE);
    }
 
+   snafu_step(game);
+
+   board_incremental_draw(game->play_area);
+
+   snafu_flush_display(game);
+
+   return(game->active);
+}
+
+gboolean snafu_step(snafu *game){
+   if(!game->active){
+      return(FALSE);
+   }
+
+   if(game->steer_func != NULL){
+      game->steer_func(game, game->steer_data);
+   }
+
+   game->tick++;
+
    for(gint i = 0; i < game->number_players; i++){
       snafu_player_next(game, (game->players + i)); 
    }
 
+   if(game->regions != NULL){
+      regions_update(game->regions, game->play_area);
+   }
+
    if(game->death_count >= game->number_players - 1){
       game->active = FALSE;
 
@@ -487,43 +786,205 @@ gboolean snafu_next(snafu *game){
       }else{
          for(gint i = 0; i < game->number_players; i++){
             if((game->players + i)->alive){
-               gchar *message_string = g_strdup_printf("%s Wins!", 
+               snafu_display_message_printf(game, "%s Wins!", 
                   (game->players + i)->name);
+            }
+         }
+      }
+   }
+
+   if(game->step_func != NULL){
+      game->step_func(game, game->step_data);
+   }
 
-               snafu_display_message(game, message_string);
+   return(game->active);
+}
 
-               g_free(message_string);
+gboolean snafu_ai_only(snafu *game){
+   for(gint i = 0; i < game->number_players; i++){
+      if((game->players + i)->alive && (game->players + i)->human){
+         return(FALSE);
+      }
+   }
+
+   return(TRUE);
+}
+
+guint snafu_fast_forward(snafu *game, guint max_ticks){
+   guint ticks = 0;
+
+   while(game->active && (!max_ticks || ticks < max_ticks) && 
+      snafu_ai_only(game)){
+      snafu_step(game);
+      ticks++;
+
+      board_forget_changes(game->play_area);
+   }
+
+   return(ticks);
+}
+
+void snafu_redraw(snafu *game){
+   board_draw(game->play_area);
+
+   snafu_flush_display(game);
+}
+
+void snafu_set_seed(snafu *game, guint32 seed){
+   g_rand_set_seed(game->rand, seed);
+}
+
+void snafu_set_step_func(snafu *game, void (*step_func)(snafu *game, 
+   gpointer data), gpointer data){
+   game->step_func = step_func;
+   game->step_data = data;
+}
+
+void snafu_set_steer_func(snafu *game, void (*steer_func)(snafu *game, 
+   gpointer data), gpointer data){
+   game->steer_func = steer_func;
+   game->steer_data = data;
+}
+
+void snafu_set_track_regions(snafu *game, gboolean track){
+   if(!track && game->regions != NULL){
+      regions_free(game->regions);
+      game->regions = NULL;
+   }else if(track && game->regions == NULL){
+      game->regions = regions_new(game->play_area);
+   }
+}
+
+gboolean snafu_players_separated(snafu *game){
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+      gint labels[4];
+
+      if(!player->alive){
+         continue;
+      }
+
+      guint number_labels = regions_around(game->regions, player->x, 
+         player->y, labels);
+
+      for(gint j = i + 1; j < game->number_players; j++){
+         snafu_player *other = game->players + j;
+         gint other_labels[4];
+
+         if(!other->alive){
+            continue;
+         }
+
+         guint number_other_labels = regions_around(game->regions, other->x,
+            other->y, other_labels);
+
+         for(guint k = 0; k < number_labels; k++){
+            for(guint l = 0; l < number_other_labels; l++){
+               if(labels[k] == other_labels[l]){
+                  return(FALSE);
+               }
             }
          }
       }
    }
 
-   board_incremental_draw(game->play_area);
+   return(TRUE);
+}
 
-   return(game->active);
+gboolean snafu_walls_check(snafu *game, GError **error){
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+
+      if(board_walls_test(game->play_area, BOARD_INDEX(game->play_area, 
+         player->x, player->y))){
+         g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+            "a wall covers the first cell (%d, %d) of player %d", player->x,
+            player->y, i + 1);
+
+         return(FALSE);
+      }
+   }
+
+   return(TRUE);
+}
+
+void snafu_set_max_length(snafu *game, guint max_length){
+   game->max_length = max_length;
+
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+
+      //drawn by snafu_begin, the old ones go back with the game
+      player->body = NULL;
+      player->body_start = 0;
+      player->body_length = 0;
+   }
 }
 
+#ifndef SNAFU_HEADLESS
 void snafu_score_board_init(snafu *game, GtkWidget *score_board){
    for(gint i = 0; i< game->number_players; i++){
-      gchar *score_string = snafu_player_get_score_string(game->players + i);
-
       GtkWidget *score_label = gtk_label_new(NULL);
-      gtk_label_set_markup(GTK_LABEL(score_label), score_string);
-
-      g_free(score_string);
+      gtk_label_set_markup(GTK_LABEL(score_label), 
+         snafu_player_get_score_string(game->players + i));
 
+      (game->players + i)->score_shown = (game->players + i)->score;
       (game->players + i)->score_board = score_label;
 
       gtk_container_add(GTK_CONTAINER(score_board), score_label);
    }
 }
+#endif
 
 void snafu_display_message(snafu *game, gchar *message){
+   if(!g_strcmp0(game->message, message)){
+      return;
+   }
+
+   g_strlcpy(game->message, message, SNAFU_MESSAGE_LENGTH);
+
+   game->message_changed = TRUE;
+}
+
+void snafu_display_message_printf(snafu *game, const gchar *format, ...){
+   va_list args;
+
+   va_start(args, format);
+   g_vsnprintf(game->message, SNAFU_MESSAGE_LENGTH, format, args);
+   va_end(args);
+
+   game->message_changed = TRUE;
+}
+
+void snafu_flush_display(snafu *game){
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+
+      if(player->score_board == NULL || player->score == player->score_shown){
+         continue;
+      }
+
+#ifndef SNAFU_HEADLESS
+      gtk_label_set_markup(GTK_LABEL(player->score_board), 
+         snafu_player_get_score_string(player));
+#endif
+
+      player->score_shown = player->score;
+   }
+
+   if(!game->message_changed){
+      return;
+   }
+
+   game->message_changed = FALSE;
+
    if(game->message_area == NULL){
       return;
    }
 
-   gtk_label_set_markup(GTK_LABEL(game->message_area), message);
+#ifndef SNAFU_HEADLESS
+   gtk_label_set_markup(GTK_LABEL(game->message_area), game->message);
+#endif
 }
 
 void snafu_start(snafu *game){
@@ -531,22 +992,54 @@ void snafu_start(snafu *game){
       return;
    }
 
+   snafu_begin(game);
+
+   game->timeout_func_ref = g_timeout_add(game->frequency, 
+      (GSourceFunc) snafu_next, game);
+}
+
+void snafu_begin(snafu *game){
+   if(game->started){
+      return;
+   }
+
+   game->tick = 0;
+
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *player = game->players + i;
+
+      if(game->max_length && player->body == NULL){
+         player->body = arena_alloc(game->arena, 
+            sizeof(guint) * game->max_length);
+      }
+   }
+
    for(gint i = 0; i < game->number_players; i++){
-      board_set_cell(game->play_area, (game->players + i)->x, 
-         (game->players + i)->y, (game->players + i)->cell_value);
+      snafu_player_grow(game, game->players + i, (game->players + i)->x, 
+         (game->players + i)->y);
    }
 
    game->started = TRUE;
    game->active = TRUE;
 
+   if(game->regions != NULL){
+      regions_rebuild(game->regions, game->play_area);
+   }
+
+   if(game->step_func != NULL){
+      game->step_func(game, game->step_data);
+   }
+
    snafu_display_message(game, "<b>GO!</b>");
 
-   game->timeout_func_ref = g_timeout_add(game->frequency, 
-      (GSourceFunc) snafu_next, game);
+   snafu_flush_display(game);
 }
 
 snafu *snafu_new(board *play_area, guint number_players, guint frequency){
-   snafu *new_snafu = g_new(snafu, 1);
+   arena *game_arena = arena_take(ARENA_CHUNK_SIZE);
+   snafu *new_snafu = arena_alloc(game_arena, sizeof(snafu));
+
+   new_snafu->arena = game_arena;
 
    new_snafu->play_area = play_area;
    new_snafu->number_players = number_players;
@@ -556,8 +1049,18 @@ snafu *snafu_new(board *play_area, guint number_players, guint frequency){
    new_snafu->active = FALSE;
 
    new_snafu->death_count = 0;
-
-   new_snafu->players = g_new(snafu_player, number_players);
+   new_snafu->max_length = 0;
+   new_snafu->rand = g_rand_new();
+   new_snafu->step_func = NULL;
+   new_snafu->step_data = NULL;
+   new_snafu->steer_func = NULL;
+   new_snafu->steer_data = NULL;
+   new_snafu->regions = NULL;
+   new_snafu->tick = 0;
+   new_snafu->timeout_func_ref = 0;
+
+   new_snafu->players = arena_alloc(game_arena, 
+      sizeof(snafu_player) * number_players);
 
    board_clear(play_area, FALSE);
 
@@ -566,16 +1069,21 @@ snafu *snafu_new(board *play_area, guint number_players, guint frequency){
    }
 
    new_snafu->message_area = NULL;
+   *new_snafu->message = '\0';
+   new_snafu->message_changed = FALSE;
+
+   new_snafu->game_mark = arena_get_mark(game_arena);
 
    return(new_snafu);
 }
 
 void snafu_free(snafu *game){
-   for(gint i = 0; i < game->number_players; i++){
-      g_free((game->players + i)->name);
-   }
+   g_rand_free(game->rand);
 
-   g_free(game->players);
+   if(game->regions != NULL){
+      regions_free(game->regions);
+   }
 
-   g_free(game);
+   //game, players and names are drawn from the arena
+   arena_give(game->arena);
 }
@@ -0,0 +1,379 @@
+//symbolic constants used by snafu_env
+//
+//a snafu_env steps a batch of independent headless games in lockstep for
+//training agents.  in every game the first number_agents snafu_players are
+//steered by actions and die on collision like humans, the others are left
+//to the ai
+//
+//observations is a caller provided contiguous guint8 tensor of shape
+//[batch][SNAFU_ENV_PLANES(number_players)][height][width].  for game b and
+//player p, plane p is 1 where the trail of player p is and plane
+//number_players + p is 1 at the head of player p while it is alive.  it is
+//written in place as the games change, only the changed cells being touched
+//
+//actions are [batch][number_agents] snafu_player_directions, 0 to keep
+//going the same way.  turning back onto oneself is ignored.  rewards are
+//[batch][number_agents] gfloats:  the score gained in the step, every
+//other player dying scoring 1, less SNAFU_ENV_DEATH_PENALTY for dying.
+//dones are [batch] guint8s set for the games which ended in the step,
+//because they are over or every agent in them died.  games which end are
+//reset straight away, so their observation is already the start of the
+//next game
+#define SNAFU_ENV_PLANES(number_players) ((number_players) * 2)
+
+//reward for dying
+#define SNAFU_ENV_DEATH_PENALTY 1.0
+
+//games start at fixed cells of a board at least this large
+#define SNAFU_ENV_WIDTH_MIN 45
+#define SNAFU_ENV_HEIGHT_MIN 30
+
+//players have fixed starting cells and colors
+#define SNAFU_ENV_PLAYERS_MAX 4
+
+//the batch of games and the tensors bound to it
+//
+//games are number_threads chunks of consecutive games stepped on pool.
+//pending counts the chunks of the current step not yet done and is guarded
+//by lock, done signalling when it reaches 0.  heads holds the index of the
+//head of every player of every game when the observation was last written,
+//-1 for dead players.  seeds are the seeds of the next reset of every game
+//
+//snafu_envs must be freed with snafu_env_free, the tensors remain the
+//caller's
+typedef struct _snafu_env{
+   guint batch;          //number of games
+   guint number_players; //players in every game
+   guint number_agents;  //players steered by actions in every game
+   gint width;           //width of every board
+   gint height;          //height of every board
+
+   snafu **games; //the games
+   gint *heads;   //[batch][number_players] heads in the observation
+
+   guint8 *observations; //[batch][planes][height][width]
+   const guint8 *actions; //[batch][number_agents] actions of the step
+   gfloat *rewards;      //[batch][number_agents]
+   guint8 *dones;        //[batch]
+
+   guint number_threads; //chunks the batch is stepped in
+   GThreadPool *pool;    //runs the chunks, NULL for a single thread
+   GMutex lock;          //guards pending
+   GCond done;           //signalled when pending reaches 0
+   guint pending;        //chunks of the step not yet done
+} snafu_env;
+
+
+/****
+ *snafu_env functions
+ ****/
+
+//returns a batch of batch games of number_players players on width by
+//height boards, the first number_agents of them steered by actions
+//observations, rewards and dones are the tensors described above, written
+//by every snafu_env_reset and snafu_env_step.  the batch is stepped on
+//number_threads threads, 0 for one per processor
+//number_players is clamped to 2..SNAFU_ENV_PLAYERS_MAX and the board to
+//at least SNAFU_ENV_WIDTH_MIN by SNAFU_ENV_HEIGHT_MIN, see the fields
+//the games are not started until snafu_env_reset is called
+snafu_env *snafu_env_new(guint batch, guint number_players,
+   guint number_agents, gint width, gint height, guint max_length,
+   guint8 *observations, gfloat *rewards, guint8 *dones,
+   guint number_threads);
+
+//frees env and its games
+void snafu_env_free(snafu_env *env);
+
+//starts a new game in every game of the batch, seeding game b with
+//*(seeds + b), or from its own generator if seeds is NULL, and writes the
+//whole observation.  rewards and dones are zeroed
+void snafu_env_reset(snafu_env *env, const guint32 *seeds);
+
+//steps every game of the batch once with actions, writing rewards, dones
+//and the changes to the observation
+void snafu_env_step(snafu_env *env, const guint8 *actions);
+
+//returns the observation of game b
+guint8 *snafu_env_observation(snafu_env *env, guint b);
+
+//starts a new game in game b and writes its whole observation
+void snafu_env_reset_game(snafu_env *env, guint b);
+
+//steps game b once with its actions, writing its rewards, done flag and
+//observation, resetting it if it ended
+void snafu_env_step_game(snafu_env *env, guint b);
+
+//writes the whole observation of game b
+void snafu_env_observe(snafu_env *env, guint b);
+
+//writes the changed cells and the heads of game b to its observation and
+//forgets the changes
+void snafu_env_observe_changes(snafu_env *env, guint b);
+
+//GFunc of env->pool, steps the chunk numbered GPOINTER_TO_UINT(chunk) - 1
+void snafu_env_step_chunk(gpointer chunk, snafu_env *env);
+
+/********/
+
+snafu_env *snafu_env_new(guint batch, guint number_players,
+   guint number_agents, gint width, gint height, guint max_length,
+   guint8 *observations, gfloat *rewards, guint8 *dones,
+   guint number_threads){
+   snafu_env *new_env = g_new(snafu_env, 1);
+
+   new_env->batch = MAX(batch, 1);
+   new_env->number_players = CLAMP(number_players, 2, SNAFU_ENV_PLAYERS_MAX);
+   new_env->number_agents = MIN(number_agents, new_env->number_players);
+   new_env->width = MAX(width, SNAFU_ENV_WIDTH_MIN);
+   new_env->height = MAX(height, SNAFU_ENV_HEIGHT_MIN);
+
+   new_env->games = g_new(snafu *, new_env->batch);
+   new_env->heads = g_new(gint, new_env->batch * new_env->number_players);
+
+   for(guint b = 0; b < new_env->batch; b++){
+      board *play_area = board_new(NULL, new_env->width, new_env->height, 1,
+         1, board_cell_new_with_color(128, 128, 128));
+
+      *(new_env->games + b) = snafu_new(play_area, new_env->number_players,
+         0);
+
+      snafu_set_max_length(*(new_env->games + b), max_length);
+   }
+
+   new_env->observations = observations;
+   new_env->actions = NULL;
+   new_env->rewards = rewards;
+   new_env->dones = dones;
+
+   if(!number_threads){
+      number_threads = g_get_num_processors();
+   }
+
+   new_env->number_threads = MIN(number_threads, new_env->batch);
+   new_env->pool = NULL;
+
+   g_mutex_init(&new_env->lock);
+   g_cond_init(&new_env->done);
+   new_env->pending = 0;
+
+   if(new_env->number_threads > 1){
+      new_env->pool = g_thread_pool_new((GFunc) snafu_env_step_chunk,
+         new_env, new_env->number_threads, TRUE, NULL);
+   }
+
+   return(new_env);
+}
+
+void snafu_env_free(snafu_env *env){
+   if(env->pool != NULL){
+      g_thread_pool_free(env->pool, FALSE, TRUE);
+   }
+
+   for(guint b = 0; b < env->batch; b++){
+      board *play_area = (*(env->games + b))->play_area;
+
+      snafu_free(*(env->games + b));
+      board_free(play_area);
+   }
+
+   g_mutex_clear(&env->lock);
+   g_cond_clear(&env->done);
+
+   g_free(env->games);
+   g_free(env->heads);
+
+   g_free(env);
+}
+
+guint8 *snafu_env_observation(snafu_env *env, guint b){
+   return(env->observations + (gsize) b *
+      SNAFU_ENV_PLANES(env->number_players) * env->width * env->height);
+}
+
+void snafu_env_reset(snafu_env *env, const guint32 *seeds){
+   for(guint b = 0; b < env->batch; b++){
+      if(seeds != NULL){
+         snafu_set_seed(*(env->games + b), *(seeds + b));
+      }
+
+      snafu_env_reset_game(env, b);
+   }
+
+   memset(env->rewards, 0, sizeof(gfloat) * env->batch * env->number_agents);
+   memset(env->dones, 0, sizeof(guint8) * env->batch);
+}
+
+void snafu_env_reset_game(snafu_env *env, guint b){
+   snafu *game = *(env->games + b);
+
+   snafu_end(game);
+   snafu_begin(game);
+
+   for(guint p = 0; p < env->number_agents; p++){
+      (game->players + p)->human = TRUE;
+   }
+
+   snafu_env_observe(env, b);
+}
+
+void snafu_env_step(snafu_env *env, const guint8 *actions){
+   env->actions = actions;
+
+   if(env->pool == NULL){
+      for(guint b = 0; b < env->batch; b++){
+         snafu_env_step_game(env, b);
+      }
+
+      return;
+   }
+
+   env->pending = env->number_threads;
+
+   for(guint chunk = 1; chunk <= env->number_threads; chunk++){
+      g_thread_pool_push(env->pool, GUINT_TO_POINTER(chunk), NULL);
+   }
+
+   g_mutex_lock(&env->lock);
+
+   while(env->pending){
+      g_cond_wait(&env->done, &env->lock);
+   }
+
+   g_mutex_unlock(&env->lock);
+}
+
+void snafu_env_step_chunk(gpointer chunk, snafu_env *env){
+   guint number = GPOINTER_TO_UINT(chunk) - 1;
+   guint start = (gsize) env->batch * number / env->number_threads;
+   guint end = (gsize) env->batch * (number + 1) / env->number_threads;
+
+   for(guint b = start; b < end; b++){
+      snafu_env_step_game(env, b);
+   }
+
+   g_mutex_lock(&env->lock);
+
+   if(!--env->pending){
+      g_cond_signal(&env->done);
+   }
+
+   g_mutex_unlock(&env->lock);
+}
+
+void snafu_env_step_game(snafu_env *env, guint b){
+   snafu *game = *(env->games + b);
+   const guint8 *actions = env->actions + b * env->number_agents;
+   gfloat *rewards = env->rewards + b * env->number_agents;
+   guint agents_alive = 0;
+
+   for(guint p = 0; p < env->number_agents; p++){
+      snafu_player *player = game->players + p;
+      snafu_player_direction direction = *(actions + p);
+
+      //players may not turn back onto themselves
+      snafu_player_direction opposite =
+         direction == SNAFU_UP?SNAFU_DOWN:
+         direction == SNAFU_DOWN?SNAFU_UP:
+         direction == SNAFU_LEFT?SNAFU_RIGHT:
+         direction == SNAFU_RIGHT?SNAFU_LEFT:0;
+
+      if(opposite && player->direction != opposite){
+         player->direction = direction;
+      }
+
+      //the score before the step, made a reward below
+      *(rewards + p) = -(gfloat) player->score;
+   }
+
+   snafu_step(game);
+
+   for(guint p = 0; p < env->number_agents; p++){
+      snafu_player *player = game->players + p;
+
+      *(rewards + p) += player->score;
+
+      //the dead are left out of the heads, so -1 marks a death this step
+      if(!player->alive && *(env->heads + (b * env->number_players) + p) >= 0){
+         *(rewards + p) -= SNAFU_ENV_DEATH_PENALTY;
+      }
+
+      agents_alive += player->alive;
+   }
+
+   *(env->dones + b) = !game->active || (env->number_agents && !agents_alive);
+
+   if(*(env->dones + b)){
+      snafu_env_reset_game(env, b);
+   }else{
+      snafu_env_observe_changes(env, b);
+   }
+}
+
+void snafu_env_observe(snafu_env *env, guint b){
+   snafu *game = *(env->games + b);
+   board *play_area = game->play_area;
+   guint8 *observation = snafu_env_observation(env, b);
+   gint cells = env->width * env->height;
+
+   memset(observation, 0, (gsize) SNAFU_ENV_PLANES(env->number_players) *
+      cells);
+
+   for(gint i = 0; i < cells; i++){
+      board_cell value = board_read_cell(play_area, i);
+
+      for(guint p = 0; p < env->number_players; p++){
+         if(value == (game->players + p)->cell_value){
+            *(observation + (p * cells) + i) = 1;
+         }
+      }
+   }
+
+   for(guint p = 0; p < env->number_players; p++){
+      snafu_player *player = game->players + p;
+      gint head = player->alive?(env->width * player->y) + player->x:-1;
+
+      *(env->heads + (b * env->number_players) + p) = head;
+
+      if(head >= 0){
+         *(observation + ((env->number_players + p) * cells) + head) = 1;
+      }
+   }
+
+   board_forget_changes(play_area);
+}
+
+void snafu_env_observe_changes(snafu_env *env, guint b){
+   snafu *game = *(env->games + b);
+   board *play_area = game->play_area;
+   guint8 *observation = snafu_env_observation(env, b);
+   gint cells = env->width * env->height;
+
+   for(guint i = 0; i < play_area->changed_cells->len; i++){
+      gint64 cell_number = g_array_index(play_area->changed_cells, gint64,
+         i);
+      board_cell value = board_read_cell(play_area, cell_number);
+
+      for(guint p = 0; p < env->number_players; p++){
+         *(observation + (p * cells) + cell_number) =
+            (value == (game->players + p)->cell_value);
+      }
+   }
+
+   for(guint p = 0; p < env->number_players; p++){
+      snafu_player *player = game->players + p;
+      gint *head = env->heads + (b * env->number_players) + p;
+      guint8 *head_plane = observation + ((env->number_players + p) * cells);
+
+      if(*head >= 0){
+         *(head_plane + *head) = 0;
+      }
+
+      *head = player->alive?(env->width * player->y) + player->x:-1;
+
+      if(*head >= 0){
+         *(head_plane + *head) = 1;
+      }
+   }
+
+   board_forget_changes(play_area);
+}
@@ -0,0 +1,450 @@
+/******************************************************************************
+Title         : New SNAFU Soak Test
+Description   : Plays games of ai players back to back without a display for
+                --hours, freeing and building the game again every
+                --recreate games, and watches the memory it takes.  Every
+                malloc goes through a counting wrapper which charges its
+                allocations and bytes to the part of the game running at the
+                time:  building and freeing games, starting them, stepping
+                them or forgetting the changed cells.  After --warmup games
+                the heap in use and the resident set size are taken as the
+                baseline, and the soak fails as soon as either grows more
+                than --max-growth past it.  The allocations of every game go
+                to --log, one line a game.
+Usage         : soak [--hours H] [--games N] [--warmup N] [--recreate N]
+                   [--max-growth KB] [--log PATH] [--sample SECONDS]
+                   [--width CELLS] [--height CELLS] [--players N]
+                   [--max-length CELLS] [--max-ticks TICKS] [--storage NAME]
+                Exits with 1 when memory grew past --max-growth.
+Build with    : gcc -o soak -std=c99 -Wall -g -DSNAFU_HEADLESS soak.c \
+   `pkg-config --cflags --libs glib-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <malloc.h>
+#include "board.h"
+#include "regions.h"
+#include "arena.h"
+#include "snafu.h"
+
+#define WARMUP_GAMES 16
+#define RECREATE_GAMES 16
+#define MAX_GROWTH_KB 4096
+#define SAMPLE_SECONDS 10
+#define MAX_TICKS 100000
+
+//the parts of a game allocations are charged to
+#define SOAK_OTHER 0
+#define SOAK_BUILD 1
+#define SOAK_BEGIN 2
+#define SOAK_STEP 3
+#define SOAK_CHANGES 4
+#define SOAK_PARTS 5
+
+//typedefs
+
+//the allocations charged to a part of the game
+//
+//allocations and frees count calls, bytes the usable size of every block
+//allocated and live the usable size of the blocks allocated and not yet
+//freed, whichever part frees them
+typedef struct _soak_count{
+   guint64 allocations; //blocks allocated
+   guint64 frees;       //blocks freed
+   guint64 bytes;       //bytes allocated
+} soak_count;
+
+//the allocator of the c library, which the counting wrapper forwards to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t number, size_t size);
+extern void *__libc_realloc(void *block, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *block);
+
+//the part running, what every part allocated and the heap in use
+//the games are played on one thread so the counts are plain variables
+//global for convinience purposes
+static gint soak_part = SOAK_OTHER;
+static soak_count soak_counts[SOAK_PARTS];
+static gint64 soak_live = 0;
+
+static const gchar *soak_part_names[SOAK_PARTS] = {
+   "other", "build", "begin", "step", "changes"
+};
+
+//command line options
+static gdouble soak_hours = 1.0;
+static gint number_games = 0;
+static gint warmup_games = WARMUP_GAMES;
+static gint recreate_games = RECREATE_GAMES;
+static gint max_growth = MAX_GROWTH_KB;
+static gchar *log_path = NULL;
+static gint sample_seconds = SAMPLE_SECONDS;
+static gint board_width = SNAFU_BOARD_WIDTH;
+static gint board_height = SNAFU_BOARD_HEIGHT;
+static gint number_players = 4;
+static gint max_length = 0;
+static gint max_ticks = MAX_TICKS;
+static gchar *board_storage = NULL;
+
+static GOptionEntry options[] = {
+   {"hours", 0, 0, G_OPTION_ARG_DOUBLE, &soak_hours,
+      "Hours to play for", "H"},
+   {"games", 0, 0, G_OPTION_ARG_INT, &number_games,
+      "Stop after N games instead, 0 to go by --hours", "N"},
+   {"warmup", 0, 0, G_OPTION_ARG_INT, &warmup_games,
+      "Games played before the baseline is taken", "N"},
+   {"recreate", 0, 0, G_OPTION_ARG_INT, &recreate_games,
+      "Games between building the game again, 0 never to", "N"},
+   {"max-growth", 0, 0, G_OPTION_ARG_INT, &max_growth,
+      "Fail once the heap or resident set grew KB past the baseline", "KB"},
+   {"log", 0, 0, G_OPTION_ARG_FILENAME, &log_path,
+      "Write the allocations of every game to PATH", "PATH"},
+   {"sample", 0, 0, G_OPTION_ARG_INT, &sample_seconds,
+      "Seconds between memory samples", "SECONDS"},
+   {"width", 0, 0, G_OPTION_ARG_INT, &board_width,
+      "Width of the board in cells", "CELLS"},
+   {"height", 0, 0, G_OPTION_ARG_INT, &board_height,
+      "Height of the board in cells", "CELLS"},
+   {"players", 0, 0, G_OPTION_ARG_INT, &number_players,
+      "Players in every game, 2 to 4", "N"},
+   {"max-length", 0, 0, G_OPTION_ARG_INT, &max_length,
+      "Longest trail a player may leave, 0 for no limit", "CELLS"},
+   {"max-ticks", 0, 0, G_OPTION_ARG_INT, &max_ticks,
+      "Iterations after which a game is started over", "TICKS"},
+   {"storage", 0, 0, G_OPTION_ARG_STRING, &board_storage,
+      "Board storage: dense, palette8, palette16 or tiled", "STORAGE"},
+   {NULL}
+};
+
+//counting wrapper around the allocator of the c library
+void *malloc(size_t size);
+void *calloc(size_t number, size_t size);
+void *realloc(void *block, size_t size);
+void free(void *block);
+int posix_memalign(void **block, size_t alignment, size_t size);
+void *aligned_alloc(size_t alignment, size_t size);
+void *memalign(size_t alignment, size_t size);
+
+//charges the allocation of block to the part running
+void soak_count_allocation(void *block);
+
+//charges the free of block to the part running
+void soak_count_free(void *block);
+
+//returns the resident set size of the process in bytes, 0 if unknown
+gint64 soak_rss(void);
+
+//returns a game of number_players on a new board
+snafu *soak_game_new(void);
+
+//frees game and its board
+void soak_game_free(snafu *game);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "- play games back to back and watch the memory they take");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   number_players = CLAMP(number_players, 2, 4);
+   warmup_games = MAX(warmup_games, 0);
+   sample_seconds = MAX(sample_seconds, 1);
+   max_ticks = MAX(max_ticks, 1);
+
+   //the players start at fixed cells of the default board
+   board_width = MAX(board_width, SNAFU_BOARD_WIDTH);
+   board_height = MAX(board_height, SNAFU_BOARD_HEIGHT);
+
+   FILE *log = NULL;
+
+   if(log_path != NULL){
+      if((log = fopen(log_path, "w")) == NULL){
+         g_printerr("cannot open %s: %s\n", log_path, g_strerror(errno));
+         return(1);
+      }
+
+      fprintf(log, "game ticks allocations frees bytes");
+
+      for(gint part = SOAK_BUILD; part < SOAK_PARTS; part++){
+         fprintf(log, " %s_allocations %s_bytes", soak_part_names[part],
+            soak_part_names[part]);
+      }
+
+      fprintf(log, " live rss\n");
+   }
+
+   gint64 start = g_get_monotonic_time();
+   gint64 deadline = start + (gint64) (soak_hours * 3600 * 1e6);
+   gint64 next_sample = start + (sample_seconds * G_USEC_PER_SEC);
+   gint64 baseline_live = 0, baseline_rss = 0;
+   guint64 steady_allocations = 0, steady_bytes = 0;
+   guint64 steady_most_allocations = 0;
+   gint failed = 0;
+   gint played;
+
+   soak_part = SOAK_BUILD;
+   snafu *game = soak_game_new();
+
+   for(played = 0; number_games?played < number_games:
+      g_get_monotonic_time() < deadline; played++){
+      soak_count before[SOAK_PARTS];
+
+      memcpy(before, soak_counts, sizeof(soak_counts));
+
+      if(recreate_games && played && played % recreate_games == 0){
+         soak_part = SOAK_BUILD;
+         soak_game_free(game);
+         game = soak_game_new();
+      }
+
+      soak_part = SOAK_BEGIN;
+      snafu_set_seed(game, played);
+      snafu_end(game);
+      snafu_begin(game);
+
+      while(game->active && game->tick < (guint) max_ticks){
+         soak_part = SOAK_STEP;
+         snafu_step(game);
+
+         soak_part = SOAK_CHANGES;
+         board_forget_changes(game->play_area);
+      }
+
+      soak_part = SOAK_OTHER;
+
+      guint64 allocations = 0, frees = 0, bytes = 0;
+
+      for(gint part = SOAK_BUILD; part < SOAK_PARTS; part++){
+         allocations += soak_counts[part].allocations -
+            before[part].allocations;
+         frees += soak_counts[part].frees - before[part].frees;
+         bytes += soak_counts[part].bytes - before[part].bytes;
+      }
+
+      gint64 rss = soak_rss();
+
+      if(log != NULL){
+         fprintf(log, "%d %u %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+            " %" G_GUINT64_FORMAT, played, game->tick, allocations, frees,
+            bytes);
+
+         for(gint part = SOAK_BUILD; part < SOAK_PARTS; part++){
+            fprintf(log, " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+               soak_counts[part].allocations - before[part].allocations,
+               soak_counts[part].bytes - before[part].bytes);
+         }
+
+         fprintf(log, " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+            soak_live, rss);
+      }
+
+      if(played + 1 == warmup_games || (played == 0 && !warmup_games)){
+         baseline_live = soak_live;
+         baseline_rss = rss;
+      }
+
+      if(played + 1 > warmup_games){
+         steady_allocations += allocations;
+         steady_bytes += bytes;
+         steady_most_allocations = MAX(steady_most_allocations, allocations);
+
+         if(soak_live - baseline_live > max_growth * 1024LL){
+            printf("game %d: heap grew %" G_GINT64_FORMAT " bytes past the "
+               "baseline\n", played, soak_live - baseline_live);
+            failed = 1;
+         }
+
+         if(baseline_rss && rss - baseline_rss > max_growth * 1024LL){
+            printf("game %d: resident set grew %" G_GINT64_FORMAT " bytes "
+               "past the baseline\n", played, rss - baseline_rss);
+            failed = 1;
+         }
+
+         if(failed){
+            played++;
+            break;
+         }
+      }
+
+      if(g_get_monotonic_time() >= next_sample){
+         printf("%.0f s, %d games, heap %" G_GINT64_FORMAT " bytes, rss %"
+            G_GINT64_FORMAT " bytes\n",
+            (g_get_monotonic_time() - start) / 1e6, played + 1, soak_live,
+            rss);
+         fflush(stdout);
+
+         next_sample += sample_seconds * G_USEC_PER_SEC;
+      }
+   }
+
+   soak_part = SOAK_BUILD;
+   soak_game_free(game);
+   soak_part = SOAK_OTHER;
+
+   printf("%d games in %.0f seconds\n", played,
+      (g_get_monotonic_time() - start) / 1e6);
+   printf("%8s %14s %14s %16s\n", "part", "allocations", "frees", "bytes");
+
+   for(gint part = 0; part < SOAK_PARTS; part++){
+      printf("%8s %14" G_GUINT64_FORMAT " %14" G_GUINT64_FORMAT " %16"
+         G_GUINT64_FORMAT "\n", soak_part_names[part],
+         soak_counts[part].allocations, soak_counts[part].frees,
+         soak_counts[part].bytes);
+   }
+
+   if(played > warmup_games){
+      gint steady_games = played - warmup_games;
+
+      printf("after warmup:  %.1f allocations and %.0f bytes a game, at "
+         "most %" G_GUINT64_FORMAT " allocations\n",
+         (gdouble) steady_allocations / steady_games,
+         (gdouble) steady_bytes / steady_games, steady_most_allocations);
+   }
+
+   if(log != NULL){
+      fclose(log);
+   }
+
+   printf(failed?"FAILED\n":"ok\n");
+
+   return(failed);
+}
+
+void *malloc(size_t size){
+   void *block = __libc_malloc(size);
+
+   soak_count_allocation(block);
+
+   return(block);
+}
+
+void *calloc(size_t number, size_t size){
+   void *block = __libc_calloc(number, size);
+
+   soak_count_allocation(block);
+
+   return(block);
+}
+
+void *realloc(void *block, size_t size){
+   size_t freed = block != NULL?malloc_usable_size(block):0;
+   void *moved = __libc_realloc(block, size);
+
+   //a failed realloc leaves block allocated, so there is nothing to count
+   if(moved == NULL && size != 0){
+      return(NULL);
+   }
+
+   //counted as a free and an allocation, even when the block stays put
+   if(block != NULL){
+      soak_counts[soak_part].frees++;
+      soak_live -= freed;
+   }
+
+   soak_count_allocation(moved);
+
+   return(moved);
+}
+
+void free(void *block){
+   soak_count_free(block);
+
+   __libc_free(block);
+}
+
+int posix_memalign(void **block, size_t alignment, size_t size){
+   if((*block = __libc_memalign(alignment, size)) == NULL){
+      return(ENOMEM);
+   }
+
+   soak_count_allocation(*block);
+
+   return(0);
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+   return(memalign(alignment, size));
+}
+
+void *memalign(size_t alignment, size_t size){
+   void *block = __libc_memalign(alignment, size);
+
+   soak_count_allocation(block);
+
+   return(block);
+}
+
+void soak_count_allocation(void *block){
+   if(block == NULL){
+      return;
+   }
+
+   size_t size = malloc_usable_size(block);
+
+   soak_counts[soak_part].allocations++;
+   soak_counts[soak_part].bytes += size;
+   soak_live += size;
+}
+
+void soak_count_free(void *block){
+   if(block == NULL){
+      return;
+   }
+
+   soak_counts[soak_part].frees++;
+   soak_live -= malloc_usable_size(block);
+}
+
+gint64 soak_rss(void){
+   FILE *statm = fopen("/proc/self/statm", "r");
+   long long pages = 0;
+
+   if(statm == NULL){
+      return(0);
+   }
+
+   //the second field is the resident set in pages
+   if(fscanf(statm, "%*s %lld", &pages) != 1){
+      pages = 0;
+   }
+
+   fclose(statm);
+
+   return(pages * sysconf(_SC_PAGESIZE));
+}
+
+snafu *soak_game_new(void){
+   board *play_area = board_new_with_storage(NULL, board_width, board_height,
+      1, 1, board_cell_new_with_color(128, 128, 128),
+      board_storage_parse(board_storage));
+   snafu *game = snafu_new(play_area, number_players, 0);
+
+   snafu_set_max_length(game, MAX(max_length, 0));
+   snafu_set_track_regions(game, TRUE);
+
+   return(game);
+}
+
+void soak_game_free(snafu *game){
+   board *play_area = game->play_area;
+
+   snafu_free(game);
+   board_free(play_area);
+}
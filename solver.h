@@ -0,0 +1,631 @@
+//symbolic constants used by solver
+//
+//a solver plays the end of a game exactly.  once a player is walled into a
+//region it shares with at most one opponent, the moves of both are searched
+//with alpha-beta by iterative deepening until the outcome is known, the
+//player moving first and the opponent answering every move, so the move
+//found is the best against any reply.  a player alone in its region plays
+//for the longest survival instead.  positions are looked up in a
+//transposition table by the zobrist hash of the board, which the board
+//keeps up to date itself, with the heads of both players mixed in.  moves
+//made during the search fill the cells of the solver, never of the board,
+//and change the hash by the keys of those cells alone
+//
+//a tick is played as by snafu_step:  both players choose, then the player
+//earlier in game->players takes its cell first, so when both choose the
+//same cell the later one dies.  trails are taken to stay for good, which
+//only makes the solver careful on games with a max_length
+//
+//values are from the side of the player:  SOLVER_WIN for winning at once,
+//one less for every tick it takes, and the negation for losing.  dying
+//alone in a region loses and the longer the player lasts the better.
+//positions beyond the depth searched are valued by the difference of the
+//cells the players can reach, far from any win
+//
+//while other players live outside the region, outliving the opponent wins
+//nothing, so the player plays for its own survival throughout:  the death
+//of the opponent leaves it alone in the region, valued as if it had been
+//alone all along, and so are positions beyond the depth searched
+
+//the value of winning now
+#define SOLVER_WIN 30000
+
+//values further from 0 than SOLVER_WON are won or lost
+#define SOLVER_WON (SOLVER_WIN - 1024)
+
+//the deepest search, in ticks
+#define SOLVER_MAX_DEPTH 255
+
+//the transposition table has 1 << SOLVER_TABLE_BITS entries
+#define SOLVER_TABLE_BITS 18
+
+//the kinds of value a table entry holds:  the value itself, at least it or
+//at most it
+#define SOLVER_BOUND_EXACT 0
+#define SOLVER_BOUND_LOWER 1
+#define SOLVER_BOUND_UPPER 2
+
+//set in the bound_move of a table entry whose value depends on positions
+//valued without being played out
+#define SOLVER_ENTRY_HORIZON 16
+
+//mixed into the hash of positions searched for the player moving second,
+//whose values differ from those of the same cells searched for the player
+//moving first
+#define SOLVER_SECOND_KEY G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)
+
+//mixed into the hash of positions searched while other players live, 
+//whose values differ from those of the same cells searched for the last 
+//two players
+#define SOLVER_OTHERS_KEY G_GUINT64_CONSTANT(0xc2b2ae3d27d4eb4f)
+
+//the number of moves of a player, one per side
+#define SOLVER_MOVES 4
+
+//positions searched between looks at the cancel flag of a solver, a power
+//of 2
+#define SOLVER_CANCEL_NODES 1024
+
+//typedefs
+
+//an entry of the transposition table
+//
+//hash is the key of the position, generation the solver_reset it was found
+//after.  move is the index of the best move, 0 to SOLVER_MOVES - 1, in the
+//two bits above the bound, and SOLVER_ENTRY_HORIZON is set above them when
+//the value was not played out to the end
+typedef struct _solver_entry{
+   guint64 hash;       //the position
+   guint32 generation; //the solver_reset the entry belongs to
+   gint16 value;       //the value, or a bound on it
+   guint8 depth;       //the ticks searched below the position
+   guint8 bound_move;  //the SOLVER_BOUND_* and the best move
+} solver_entry;
+
+//a solver
+//
+//filled holds the cells filled by the moves being searched on brd, and
+//hash is the hash of brd with those cells.  first is TRUE when the player
+//searched for takes its cell before the opponent, and others_live when
+//players besides the two searched are alive
+//
+//nodes counts the positions searched by the current solver_move, which
+//gives up once it passes node_budget or once cancel, which another thread
+//may set, is not 0.  cancel is looked at every SOLVER_CANCEL_NODES
+//positions and is NULL when the search cannot be cancelled.  horizon is set whenever a position
+//is valued without being played out, so a search which never sets it is
+//exact.  seen, stamp and queue are scratch space for counting the cells a
+//player can reach
+//
+//solvers only serve one thread at a time and must be freed with solver_free
+typedef struct _solver{
+   board *brd;          //the board being solved
+   gint cells;          //cells of the scratch space
+   guint8 *filled;      //cells filled by the search
+   guint64 hash;        //hash of the position being searched
+   gboolean first;      //whether the player moves before the opponent
+   gboolean others_live; //whether players outside the search are alive
+   solver_entry *table; //the transposition table
+   guint32 generation;  //the current generation of the table
+   guint64 nodes;       //positions searched
+   guint64 node_budget; //most positions to search
+   volatile gint *cancel; //stops the search when set, NULL for never
+   gboolean out_of_budget; //set once nodes passes node_budget
+   gboolean horizon;    //set when a position is valued unfinished
+   guint32 *seen;       //stamp of the last count reaching every cell
+   guint32 stamp;       //stamp of the current count
+   gint *queue;         //cells waiting to be counted
+} solver;
+
+
+/****
+ *solver functions
+ ****/
+
+//returns a solver with an empty transposition table
+solver *solver_new(void);
+
+//frees solve
+void solver_free(solver *solve);
+
+//forgets every position in the transposition table of solve without
+//touching it, so the moves found afterwards do not depend on what was
+//solved before
+void solver_reset(solver *solve);
+
+//returns the index in game->players of the only opponent sharing a region
+//with player, -1 if player is alone in its region or -2 if more than one
+//opponent shares it.  game must track regions
+gint solver_opponent(snafu *game, snafu_player *player);
+
+//returns whether a player other than player and the player at index
+//opponent of game->players is alive, opponent being -1 for none
+gboolean solver_others_live(snafu *game, snafu_player *player, 
+   gint opponent);
+
+//returns the best move of player, searching at most node_budget positions
+//once player shares its region with one opponent at most.  returns
+//SNAFU_RANDOM if more opponents share the region.  when the budget runs out
+//the best move of the deepest search finished is returned, or the first
+//way on if none finished.  game must track regions and game->play_area
+//keeps its hash from the first call on
+snafu_player_direction solver_move(solver *solve, snafu *game,
+   snafu_player *player, guint64 node_budget);
+
+//readies solve to search brd, first being TRUE when the player moves
+//before the opponent and others_live when players outside the search are
+//alive, stopping after node_budget positions.  brd must keep its hash
+void solver_prepare(solver *solve, board *brd, gboolean first, 
+   gboolean others_live, guint64 node_budget);
+
+//returns the value of the position with the heads at cells head and other,
+//other being -1 without an opponent, searching depth ticks between alpha
+//and beta.  at the root, best is set to the index of the best move
+gint solver_search(solver *solve, gint head, gint other, gint depth,
+   gint alpha, gint beta, gint *best);
+
+//writes the empty cells beside cell i to moves, in the order of the
+//SNAFU_* directions, and returns how many there are
+guint solver_moves(solver *solve, gint i, gint *moves);
+
+//returns whether cell i is filled on the board or by the search
+gboolean solver_filled(solver *solve, gint i);
+
+//fills cell i for the search, or empties it again, updating the hash
+void solver_fill(solver *solve, gint i, gboolean filled);
+
+//returns the number of empty cells a player at cell i can reach, counting
+//at most SOLVER_MAX_DEPTH
+gint solver_space(solver *solve, gint i);
+
+//returns the key mixing a head at cell i into the hash, slot being 0 for
+//the player and 1 for the opponent
+guint64 solver_head_key(solver *solve, gint slot, gint i);
+
+//returns the entry of the table where the position hash is kept
+solver_entry *solver_entry_of(solver *solve, guint64 hash);
+
+//converts a value found one tick later to the value now, and a bound now
+//to the bound one tick later, wins and losses being one tick further away
+gint solver_from_child(gint value);
+gint solver_to_child(gint value);
+
+/********/
+
+solver *solver_new(void){
+   solver *new_solver = g_new(solver, 1);
+
+   new_solver->brd = NULL;
+   new_solver->cells = 0;
+   new_solver->filled = NULL;
+   new_solver->hash = 0;
+   new_solver->first = TRUE;
+   new_solver->others_live = FALSE;
+   new_solver->table = g_new0(solver_entry, 1 << SOLVER_TABLE_BITS);
+   new_solver->generation = 1;
+   new_solver->nodes = 0;
+   new_solver->node_budget = 0;
+   new_solver->cancel = NULL;
+   new_solver->out_of_budget = FALSE;
+   new_solver->horizon = FALSE;
+   new_solver->seen = NULL;
+   new_solver->stamp = 0;
+   new_solver->queue = NULL;
+
+   return(new_solver);
+}
+
+void solver_free(solver *solve){
+   g_free(solve->filled);
+   g_free(solve->seen);
+   g_free(solve->queue);
+   g_free(solve->table);
+
+   g_free(solve);
+}
+
+void solver_reset(solver *solve){
+   //entries of older generations never match
+   if(++solve->generation == 0){
+      memset(solve->table, 0, sizeof(solver_entry) << SOLVER_TABLE_BITS);
+      solve->generation = 1;
+   }
+}
+
+gint solver_opponent(snafu *game, snafu_player *player){
+   gint labels[4], opponent = -1;
+   guint number_labels = regions_around(game->regions, player->x, player->y,
+      labels);
+
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *other = game->players + i;
+      gint other_labels[4];
+      gboolean shared = FALSE;
+
+      if(other == player || !other->alive){
+         continue;
+      }
+
+      guint number_other_labels = regions_around(game->regions, other->x,
+         other->y, other_labels);
+
+      for(guint k = 0; k < number_labels; k++){
+         for(guint l = 0; l < number_other_labels; l++){
+            shared = shared || labels[k] == other_labels[l];
+         }
+      }
+
+      if(shared){
+         if(opponent != -1){
+            return(-2);
+         }
+
+         opponent = i;
+      }
+   }
+
+   return(opponent);
+}
+
+gboolean solver_others_live(snafu *game, snafu_player *player, 
+   gint opponent){
+   for(gint i = 0; i < game->number_players; i++){
+      snafu_player *other = game->players + i;
+
+      if(other != player && i != opponent && other->alive){
+         return(TRUE);
+      }
+   }
+
+   return(FALSE);
+}
+
+snafu_player_direction solver_move(solver *solve, snafu *game,
+   snafu_player *player, guint64 node_budget){
+   board *brd = game->play_area;
+   gint opponent = solver_opponent(game, player);
+
+   if(opponent == -2){
+      return(SNAFU_RANDOM);
+   }
+
+   if(brd->zobrist == NULL){
+      board_hash_alloc(brd);
+   }
+
+   solver_prepare(solve, brd, opponent < 0 || 
+      (game->players + opponent) > player, 
+      opponent >= 0 && solver_others_live(game, player, opponent), 
+      node_budget);
+
+   gint head = (brd->width * player->y) + player->x, other = -1;
+   gint moves[SOLVER_MOVES], best, move;
+
+   if(opponent >= 0){
+      other = (brd->width * (game->players + opponent)->y) +
+         (game->players + opponent)->x;
+   }
+
+   //no way on, the player dies whichever way it goes
+   if(!solver_moves(solve, head, moves)){
+      return(player->direction);
+   }
+
+   //the first way on, in case the budget runs out before any search ends
+   best = moves[0] == head - brd->width?0:moves[0] == head + brd->width?1:
+      moves[0] == head - 1?2:3;
+
+   //deeper until the outcome is known, every search beyond the space left
+   //being as deep as the game can go
+   gint depth_limit = MIN(solver_space(solve, head) + 1, SOLVER_MAX_DEPTH);
+
+   for(gint depth = 1; depth <= depth_limit; depth++){
+      solve->horizon = FALSE;
+
+      solver_search(solve, head, other, depth, -SOLVER_WIN, SOLVER_WIN,
+         &move);
+
+      if(solve->out_of_budget){
+         break;
+      }
+
+      best = move;
+
+      if(!solve->horizon){
+         break;
+      }
+   }
+
+   //the moves are indexed by the SNAFU_* directions, empty or not
+   return(SNAFU_UP << best);
+}
+
+void solver_prepare(solver *solve, board *brd, gboolean first, 
+   gboolean others_live, guint64 node_budget){
+   if(solve->cells != brd->width * brd->height){
+      solve->cells = brd->width * brd->height;
+      solve->filled = g_renew(guint8, solve->filled, solve->cells);
+      solve->seen = g_renew(guint32, solve->seen, solve->cells);
+      solve->queue = g_renew(gint, solve->queue, solve->cells);
+
+      memset(solve->filled, 0, solve->cells);
+      memset(solve->seen, 0, sizeof(guint32) * solve->cells);
+      solve->stamp = 0;
+   }
+
+   solve->brd = brd;
+   solve->hash = brd->hash;
+   solve->first = first;
+   solve->others_live = others_live;
+   solve->nodes = 0;
+   solve->node_budget = node_budget;
+   solve->out_of_budget = FALSE;
+}
+
+gint solver_search(solver *solve, gint head, gint other, gint depth,
+   gint alpha, gint beta, gint *best){
+   if(++solve->nodes > solve->node_budget || (solve->cancel != NULL && 
+      !(solve->nodes & (SOLVER_CANCEL_NODES - 1)) && 
+      g_atomic_int_get(solve->cancel))){
+      solve->out_of_budget = TRUE;
+      return(0);
+   }
+
+   guint64 hash = solve->hash ^ solver_head_key(solve, 0, head) ^
+      (other >= 0?solver_head_key(solve, 1, other):0) ^
+      (solve->first?0:SOLVER_SECOND_KEY) ^
+      (solve->others_live?SOLVER_OTHERS_KEY:0);
+   solver_entry *entry = solver_entry_of(solve, hash);
+   gint hint = -1;
+
+   if(entry->hash == hash && entry->generation == solve->generation){
+      gint bound = entry->bound_move & 3;
+
+      hint = (entry->bound_move >> 2) & 3;
+
+      //the root always searches, it has to name a move
+      if(best == NULL && entry->depth >= depth &&
+         (bound == SOLVER_BOUND_EXACT ||
+         (bound == SOLVER_BOUND_LOWER && entry->value >= beta) ||
+         (bound == SOLVER_BOUND_UPPER && entry->value <= alpha))){
+         //a value cut off at the depth of an earlier search is no more
+         //exact now
+         if(entry->bound_move & SOLVER_ENTRY_HORIZON){
+            solve->horizon = TRUE;
+         }
+
+         return(entry->value);
+      }
+   }
+
+   board *brd = solve->brd;
+   gint x = BOARD_X(brd, head), y = BOARD_Y(brd, head);
+   gint moves[SOLVER_MOVES], other_moves[SOLVER_MOVES];
+   gint number_moves = 0, number_other_moves = 0;
+   gint directions[SOLVER_MOVES], order[SOLVER_MOVES];
+
+   //the moves of the player by direction, -1 where the way is blocked
+   directions[0] = y > 0?head - brd->width:-1;
+   directions[1] = y < brd->height - 1?head + brd->width:-1;
+   directions[2] = x > 0?head - 1:-1;
+   directions[3] = x < brd->width - 1?head + 1:-1;
+
+   for(gint d = 0; d < SOLVER_MOVES; d++){
+      if(directions[d] >= 0 && solver_filled(solve, directions[d])){
+         directions[d] = -1;
+      }
+   }
+
+   //the move of the table first, the others in the order of the directions
+   if(hint >= 0 && directions[hint] >= 0){
+      order[number_moves] = hint;
+      moves[number_moves++] = directions[hint];
+   }
+
+   for(gint d = 0; d < SOLVER_MOVES; d++){
+      if(directions[d] >= 0 && d != hint){
+         order[number_moves] = d;
+         moves[number_moves++] = directions[d];
+      }
+   }
+
+   if(other >= 0){
+      number_other_moves = solver_moves(solve, other, other_moves);
+   }
+
+   //the game is decided this tick
+   if(!number_moves){
+      return(other >= 0 && !number_other_moves && !solve->others_live?0:
+         -SOLVER_WIN);
+   }
+
+   if(other >= 0 && !number_other_moves){
+      //the player plays on alone
+      if(solve->others_live){
+         return(solver_search(solve, head, -1, depth, alpha, beta, best));
+      }
+
+      return(SOLVER_WIN);
+   }
+
+   if(!depth){
+      solve->horizon = TRUE;
+
+      if(other < 0 || solve->others_live){
+         //the player lasts at most as long as the cells it can reach
+         return(-SOLVER_WIN + 1 + solver_space(solve, head));
+      }
+
+      return(solver_space(solve, head) - solver_space(solve, other));
+   }
+
+   gint original_alpha = alpha, value = -SOLVER_WIN - 1, best_move = 0;
+
+   //whether the positions below were played out is kept with this one, the
+   //flag of the positions searched before being put back afterwards
+   gboolean horizon = solve->horizon;
+
+   solve->horizon = FALSE;
+
+   for(gint k = 0; k < number_moves; k++){
+      gint worst = SOLVER_WIN + 1;
+
+      solver_fill(solve, moves[k], TRUE);
+
+      if(other < 0){
+         worst = solver_from_child(solver_search(solve, moves[k], -1,
+            depth - 1, solver_to_child(MAX(alpha, value)),
+            solver_to_child(beta), NULL));
+      }
+
+      for(gint l = 0; l < number_other_moves && other >= 0; l++){
+         gint reply;
+
+         //whoever moves first takes the cell, the other dies
+         if(other_moves[l] == moves[k] && !solve->first){
+            reply = -SOLVER_WIN;
+         }else if(other_moves[l] == moves[k] && !solve->others_live){
+            reply = SOLVER_WIN;
+         }else if(other_moves[l] == moves[k]){
+            //the player plays on alone
+            reply = solver_from_child(solver_search(solve, moves[k], -1,
+               depth - 1, solver_to_child(MAX(alpha, value)),
+               solver_to_child(beta), NULL));
+         }else{
+            solver_fill(solve, other_moves[l], TRUE);
+
+            reply = solver_from_child(solver_search(solve, moves[k],
+               other_moves[l], depth - 1, solver_to_child(MAX(alpha, value)),
+               solver_to_child(beta), NULL));
+
+            solver_fill(solve, other_moves[l], FALSE);
+         }
+
+         worst = MIN(worst, reply);
+
+         //the opponent already has an answer no better than another move
+         if(worst <= MAX(alpha, value) || solve->out_of_budget){
+            break;
+         }
+      }
+
+      solver_fill(solve, moves[k], FALSE);
+
+      if(solve->out_of_budget){
+         return(0);
+      }
+
+      if(worst > value){
+         value = worst;
+         best_move = order[k];
+      }
+
+      alpha = MAX(alpha, value);
+
+      if(alpha >= beta){
+         break;
+      }
+   }
+
+   if(best != NULL){
+      *best = best_move;
+   }
+
+   //replaced by anything at least as deep or from an older generation
+   if(entry->generation != solve->generation || depth >= entry->depth){
+      entry->hash = hash;
+      entry->generation = solve->generation;
+      entry->value = value;
+      entry->depth = depth;
+      entry->bound_move = (best_move << 2) |
+         (solve->horizon?SOLVER_ENTRY_HORIZON:0) |
+         (value <= original_alpha?SOLVER_BOUND_UPPER:
+         value >= beta?SOLVER_BOUND_LOWER:SOLVER_BOUND_EXACT);
+   }
+
+   solve->horizon = solve->horizon || horizon;
+
+   return(value);
+}
+
+guint solver_moves(solver *solve, gint i, gint *moves){
+   board *brd = solve->brd;
+   gint x = BOARD_X(brd, i), y = BOARD_Y(brd, i);
+   guint number_moves = 0;
+
+   if(y > 0 && !solver_filled(solve, i - brd->width)){
+      *(moves + number_moves++) = i - brd->width;
+   }
+
+   if(y < brd->height - 1 && !solver_filled(solve, i + brd->width)){
+      *(moves + number_moves++) = i + brd->width;
+   }
+
+   if(x > 0 && !solver_filled(solve, i - 1)){
+      *(moves + number_moves++) = i - 1;
+   }
+
+   if(x < brd->width - 1 && !solver_filled(solve, i + 1)){
+      *(moves + number_moves++) = i + 1;
+   }
+
+   return(number_moves);
+}
+
+gboolean solver_filled(solver *solve, gint i){
+   return(*(solve->filled + i) || board_read_cell_flags(solve->brd, i));
+}
+
+void solver_fill(solver *solve, gint i, gboolean filled){
+   *(solve->filled + i) = filled;
+
+   solve->hash ^= board_hash_key(solve->brd, i);
+}
+
+gint solver_space(solver *solve, gint i){
+   gint length = 0, space = 0;
+
+   if(++solve->stamp == 0){
+      memset(solve->seen, 0, sizeof(guint32) * solve->cells);
+      solve->stamp = 1;
+   }
+
+   *(solve->seen + i) = solve->stamp;
+   *(solve->queue + length++) = i;
+
+   for(gint next = 0; next < length && space < SOLVER_MAX_DEPTH; next++){
+      gint moves[SOLVER_MOVES];
+      guint number_moves = solver_moves(solve, *(solve->queue + next),
+         moves);
+
+      for(guint k = 0; k < number_moves; k++){
+         if(*(solve->seen + moves[k]) != solve->stamp){
+            *(solve->seen + moves[k]) = solve->stamp;
+            *(solve->queue + length++) = moves[k];
+            space++;
+         }
+      }
+   }
+
+   return(MIN(space, SOLVER_MAX_DEPTH));
+}
+
+guint64 solver_head_key(solver *solve, gint slot, gint i){
+   guint64 key = board_hash_key(solve->brd, i);
+   gint turn = slot?42:21;
+
+   //a rotation of the key of the cell, which is already in the hash
+   return((key << turn) | (key >> (64 - turn)));
+}
+
+solver_entry *solver_entry_of(solver *solve, guint64 hash){
+   return(solve->table + (hash >> (64 - SOLVER_TABLE_BITS)));
+}
+
+gint solver_from_child(gint value){
+   return(value > SOLVER_WON?value - 1:value < -SOLVER_WON?value + 1:value);
+}
+
+gint solver_to_child(gint value){
+   return(value > SOLVER_WON?value + 1:value < -SOLVER_WON?value - 1:value);
+}
@@ -0,0 +1,619 @@
+//symbolic constants used by the spectator frame stream
+//
+//a spectator stream is a sequence of frames, one per tick.  every frame is
+//its varint byte length followed by its body, so readers can skip frames
+//they do not want.  varints are unsigned little endian base 128:  seven
+//bits per byte, the high bit set on every byte but the last.  varints hold
+//at most 32 bits and varint64s, which count cells, at most 64
+//
+//the body of a frame is
+//   varint kind, SPECTATE_FRAME_KEY or SPECTATE_FRAME_DELTA
+//   varint tick
+//   keyframes only:  varint width, varint height
+//   varint number of new palette entries, then each board_cell as a varint
+//   varint number of runs, then for each run
+//      varint64 gap, varint64 length, varint palette index
+//
+//the palette maps the board_cells seen so far to small indices.  keyframes
+//start a new palette and deltas append to it.  a run sets length cells
+//starting gap cells past the end of the previous run (the first run counts
+//from index 0) to the board_cell at palette index.  keyframes cover the
+//whole board, deltas only the cells changed since the previous frame, so a
+//reader joining late syncs from the last keyframe and the deltas after it
+#define SPECTATE_FRAME_KEY 1
+#define SPECTATE_FRAME_DELTA 2
+
+//ticks between keyframes unless asked for otherwise
+#define SPECTATE_KEYFRAME_INTERVAL 256
+
+//a delta adding palette entries past this many forces a keyframe, which
+//drops the board_cells no longer on the board from the palette
+#define SPECTATE_PALETTE_MAX 256
+
+//longest varint of a guint32
+#define SPECTATE_VARINT_MAX 5
+
+//longest varint64 of a guint64
+#define SPECTATE_VARINT64_MAX 10
+
+//the writing end of a spectator stream
+//
+//frames are keyframes every keyframe_interval ticks, or sooner once
+//keyframe_wanted is set.  palette holds the board_cells of the current
+//palette and changed the sorted indices of the cells of a delta
+//
+//spectates must be freed with spectate_free
+typedef struct _spectate{
+   guint keyframe_interval;  //ticks between keyframes
+   guint since_keyframe;     //frames written since the last keyframe
+   gboolean keyframe_wanted; //whether the next frame must be a keyframe
+
+   GArray *palette; //the board_cells of the current palette
+   guint keyframe_palette_length; //length of palette after the keyframe
+
+   GArray *changed; //scratch space for the cells of a delta
+   GByteArray *runs; //scratch space for the runs of a frame
+} spectate;
+
+//the reading end of a spectator stream
+//
+//synced is set once a keyframe has been read, deltas before it are skipped
+//
+//spectate_views must be freed with spectate_view_free
+typedef struct _spectate_view{
+   gboolean synced; //whether a keyframe has been read
+   guint tick;      //tick of the last frame read
+   gint width;      //width of the board of the last keyframe
+   gint height;     //height of the board of the last keyframe
+
+   GArray *palette; //the board_cells of the current palette
+} spectate_view;
+
+
+/****
+ *varint functions
+ ****/
+
+//writes value as a varint64 to bytes, which must have room for it
+//returns the number of bytes written
+gint spectate_encode_varint(guint8 *bytes, guint64 value);
+
+//appends value to out as a varint
+void spectate_put_varint(GByteArray *out, guint32 value);
+
+//reads a varint from *data, advancing *data past it
+//returns FALSE if the varint does not end before end or is too long
+gboolean spectate_get_varint(const guint8 **data, const guint8 *end,
+   guint32 *value);
+
+//appends value to out as a varint64
+void spectate_put_varint64(GByteArray *out, guint64 value);
+
+//reads a varint64 from *data, advancing *data past it
+//returns FALSE if the varint64 does not end before end or is too long
+gboolean spectate_get_varint64(const guint8 **data, const guint8 *end,
+   guint64 *value);
+
+
+/****
+ *spectate functions
+ ****/
+
+//returns a spectate writing a keyframe every keyframe_interval ticks,
+//SPECTATE_KEYFRAME_INTERVAL if keyframe_interval is 0
+//the first frame is always a keyframe
+spectate *spectate_new(guint keyframe_interval);
+
+//frees stream
+void spectate_free(spectate *stream);
+
+//makes the next frame of stream a keyframe, for instance after the board
+//was cleared without marking the cells changed
+void spectate_request_keyframe(spectate *stream);
+
+//appends the frame of tick to out, a keyframe of the whole of brd or a
+//delta of brd->changed_cells.  changed_cells is left as it was, so this
+//must be called before the changes are drawn or forgotten
+//returns TRUE if the frame is a keyframe
+gboolean spectate_frame(spectate *stream, board *brd, guint tick,
+   GByteArray *out);
+
+//returns the palette index of value in stream, appending it if it is new
+guint spectate_palette_lookup(spectate *stream, board_cell value);
+
+//appends the run of length cells from start to stream->runs, *end being 
+//the index past the previous run
+void spectate_put_run(spectate *stream, gint64 *end, gint64 start, 
+   gint64 length, board_cell value);
+
+//appends the runs of the cells of row y of brd from x_start to before 
+//x_end which differ from the background_color, see spectate_put_run
+//returns the number of runs appended
+guint spectate_put_row(spectate *stream, board *brd, gint64 *end, gint y, 
+   gint x_start, gint x_end);
+
+//GCompareFunc ordering gint64 cell indices
+gint spectate_compare_cells(gconstpointer a, gconstpointer b);
+
+//writes all of length bytes of data to fd, a file, pipe or blocking socket
+//returns FALSE if the write failed
+gboolean spectate_write(gint fd, const guint8 *data, gsize length);
+
+
+/****
+ *spectate_view functions
+ ****/
+
+//returns a spectate_view which has not yet read a keyframe
+spectate_view *spectate_view_new(void);
+
+//frees view
+void spectate_view_free(spectate_view *view);
+
+//looks for a complete frame at *offset of the size bytes of data
+//returns TRUE and sets body and length if there is one, advancing *offset
+//past it.  returns FALSE if more bytes are needed or the length is corrupt
+gboolean spectate_view_next(const guint8 *data, gsize size, gsize *offset,
+   const guint8 **body, guint32 *length);
+
+//applies the frame body of length bytes to brd, marking the cells changed
+//brd must be as wide and high as the keyframes say, see
+//spectate_view_size to read them first
+//returns FALSE if the frame is corrupt or does not fit brd
+gboolean spectate_view_apply(spectate_view *view, board *brd,
+   const guint8 *body, guint32 length);
+
+//returns TRUE and sets width and height if the frame body of length bytes
+//is a keyframe
+gboolean spectate_view_size(const guint8 *body, guint32 length, gint *width,
+   gint *height);
+
+/********/
+
+gint spectate_encode_varint(guint8 *bytes, guint64 value){
+   gint length = 0;
+
+   while(value >= 0x80){
+      *(bytes + length++) = (value & 0x7f) | 0x80;
+      value >>= 7;
+   }
+
+   *(bytes + length++) = value;
+
+   return(length);
+}
+
+void spectate_put_varint(GByteArray *out, guint32 value){
+   guint8 bytes[SPECTATE_VARINT_MAX];
+
+   g_byte_array_append(out, bytes, spectate_encode_varint(bytes, value));
+}
+
+gboolean spectate_get_varint(const guint8 **data, const guint8 *end,
+   guint32 *value){
+   *value = 0;
+
+   for(gint i = 0; i < SPECTATE_VARINT_MAX && *data < end; i++){
+      guint8 byte = **data;
+
+      (*data)++;
+
+      *value |= (guint32) (byte & 0x7f) << (i * 7);
+
+      if(!(byte & 0x80)){
+         return(TRUE);
+      }
+   }
+
+   return(FALSE);
+}
+
+void spectate_put_varint64(GByteArray *out, guint64 value){
+   guint8 bytes[SPECTATE_VARINT64_MAX];
+
+   g_byte_array_append(out, bytes, spectate_encode_varint(bytes, value));
+}
+
+gboolean spectate_get_varint64(const guint8 **data, const guint8 *end,
+   guint64 *value){
+   *value = 0;
+
+   for(gint i = 0; i < SPECTATE_VARINT64_MAX && *data < end; i++){
+      guint8 byte = **data;
+
+      (*data)++;
+
+      *value |= (guint64) (byte & 0x7f) << (i * 7);
+
+      if(!(byte & 0x80)){
+         return(TRUE);
+      }
+   }
+
+   return(FALSE);
+}
+
+guint spectate_palette_lookup(spectate *stream, board_cell value){
+   for(guint i = 0; i < stream->palette->len; i++){
+      if(g_array_index(stream->palette, board_cell, i) == value){
+         return(i);
+      }
+   }
+
+   g_array_append_val(stream->palette, value);
+
+   return(stream->palette->len - 1);
+}
+
+void spectate_put_run(spectate *stream, gint64 *end, gint64 start,
+   gint64 length, board_cell value){
+   spectate_put_varint64(stream->runs, start - *end);
+   spectate_put_varint64(stream->runs, length);
+   spectate_put_varint(stream->runs, spectate_palette_lookup(stream, value));
+
+   *end = start + length;
+}
+
+guint spectate_put_row(spectate *stream, board *brd, gint64 *end, gint y,
+   gint x_start, gint x_end){
+   gint64 row = BOARD_INDEX(brd, 0, y);
+   guint number_runs = 0;
+
+   for(gint x = x_start; x < x_end;){
+      board_cell value = board_read_cell_xy(brd, row + x, x, y);
+      gint length = 1;
+
+      while(x + length < x_end && board_read_cell_xy(brd, row + x + length,
+         x + length, y) == value){
+         length++;
+      }
+
+      if(value != brd->background_color){
+         spectate_put_run(stream, end, row + x, length, value);
+         number_runs++;
+      }
+
+      x += length;
+   }
+
+   return(number_runs);
+}
+
+gint spectate_compare_cells(gconstpointer a, gconstpointer b){
+   gint64 left = *((const gint64 *) a), right = *((const gint64 *) b);
+
+   return((left > right) - (left < right));
+}
+
+spectate *spectate_new(guint keyframe_interval){
+   spectate *new_spectate = g_new(spectate, 1);
+
+   new_spectate->keyframe_interval = keyframe_interval?keyframe_interval:
+      SPECTATE_KEYFRAME_INTERVAL;
+   new_spectate->since_keyframe = 0;
+   new_spectate->keyframe_wanted = TRUE;
+
+   new_spectate->palette = g_array_new(FALSE, FALSE, sizeof(board_cell));
+   new_spectate->keyframe_palette_length = 0;
+
+   new_spectate->changed = g_array_new(FALSE, FALSE, sizeof(gint64));
+   new_spectate->runs = g_byte_array_new();
+
+   return(new_spectate);
+}
+
+void spectate_free(spectate *stream){
+   g_array_free(stream->palette, TRUE);
+   g_array_free(stream->changed, TRUE);
+   g_byte_array_free(stream->runs, TRUE);
+
+   g_free(stream);
+}
+
+void spectate_request_keyframe(spectate *stream){
+   stream->keyframe_wanted = TRUE;
+}
+
+gboolean spectate_frame(spectate *stream, board *brd, guint tick,
+   GByteArray *out){
+   gboolean keyframe = stream->keyframe_wanted ||
+      stream->since_keyframe >= stream->keyframe_interval ||
+      stream->palette->len > MAX(SPECTATE_PALETTE_MAX,
+      stream->keyframe_palette_length * 2);
+
+   guint palette_start = keyframe?0:stream->palette->len;
+   guint number_runs = 0;
+   gint64 end = 0;
+
+   if(keyframe){
+      g_array_set_size(stream->palette, 0);
+   }
+
+   g_byte_array_set_size(stream->runs, 0);
+
+   if(keyframe && brd->storage == BOARD_STORAGE_TILED){
+      //the tiles not allocated hold only the background_color, so only the
+      //rows of the allocated tiles are walked, sorted into board order in
+      //the scratch space of deltas
+      GArray *tiles = stream->changed;
+
+      g_array_set_size(tiles, 0);
+
+      for(guint i = 0; i < brd->tiles_used->len; i++){
+         gint64 tile_number = g_array_index(brd->tiles_used, gint, i);
+
+         g_array_append_val(tiles, tile_number);
+      }
+
+      g_array_sort(tiles, spectate_compare_cells);
+
+      for(guint first = 0, last; first < tiles->len; first = last){
+         gint tile_row = g_array_index(tiles, gint64, first) / 
+            brd->tiles_across;
+
+         for(last = first + 1; last < tiles->len && 
+            g_array_index(tiles, gint64, last) / brd->tiles_across == 
+            tile_row; last++);
+
+         gint y_end = MIN(brd->height, (tile_row + 1) << BOARD_TILE_SHIFT);
+
+         for(gint y = tile_row << BOARD_TILE_SHIFT; y < y_end; y++){
+            for(guint i = first; i < last; i++){
+               gint x = (g_array_index(tiles, gint64, i) % 
+                  brd->tiles_across) << BOARD_TILE_SHIFT;
+
+               number_runs += spectate_put_row(stream, brd, &end, y, x, 
+                  MIN(brd->width, x + BOARD_TILE_SIZE));
+            }
+         }
+      }
+   }else if(keyframe){
+      //the whole board as runs of equal cells, leaving out the runs of the
+      //background_color which every keyframe starts from
+      gint64 cells = (gint64)brd->width * brd->height;
+
+      for(gint64 i = 0; i < cells;){
+         board_cell value = board_read_cell(brd, i);
+         gint64 length = 1;
+
+         while(i + length < cells &&
+            board_read_cell(brd, i + length) == value){
+            length++;
+         }
+
+         if(value != brd->background_color){
+            spectate_put_run(stream, &end, i, length, value);
+            number_runs++;
+         }
+
+         i += length;
+      }
+   }else{
+      //the changed cells sorted and without repeats, as runs of equal cells
+      GArray *changed = stream->changed;
+
+      g_array_set_size(changed, 0);
+      g_array_append_vals(changed, brd->changed_cells->data,
+         brd->changed_cells->len);
+      g_array_sort(changed, spectate_compare_cells);
+
+      for(guint i = 0; i < changed->len;){
+         gint64 start = g_array_index(changed, gint64, i);
+         board_cell value = board_read_cell(brd, start);
+         gint64 length = 1;
+
+         for(i++; i < changed->len; i++){
+            gint64 next = g_array_index(changed, gint64, i);
+
+            if(next == start + length - 1){
+               continue;
+            }
+
+            if(next != start + length || board_read_cell(brd, next) != value){
+               break;
+            }
+
+            length++;
+         }
+
+         spectate_put_run(stream, &end, start, length, value);
+         number_runs++;
+      }
+   }
+
+   guint offset = out->len;
+
+   spectate_put_varint(out, keyframe?SPECTATE_FRAME_KEY:SPECTATE_FRAME_DELTA);
+   spectate_put_varint(out, tick);
+
+   if(keyframe){
+      spectate_put_varint(out, brd->width);
+      spectate_put_varint(out, brd->height);
+   }
+
+   spectate_put_varint(out, stream->palette->len - palette_start);
+
+   for(guint i = palette_start; i < stream->palette->len; i++){
+      spectate_put_varint(out, g_array_index(stream->palette, board_cell, i));
+   }
+
+   spectate_put_varint(out, number_runs);
+
+   g_byte_array_append(out, stream->runs->data, stream->runs->len);
+
+   //the length goes in front of the body, which is only known now
+   guint8 length[SPECTATE_VARINT_MAX];
+   gint length_length = spectate_encode_varint(length, out->len - offset);
+
+   g_byte_array_set_size(out, out->len + length_length);
+   memmove(out->data + offset + length_length, out->data + offset,
+      out->len - offset - length_length);
+   memcpy(out->data + offset, length, length_length);
+
+   if(keyframe){
+      stream->keyframe_wanted = FALSE;
+      stream->since_keyframe = 0;
+      stream->keyframe_palette_length = stream->palette->len;
+   }
+
+   stream->since_keyframe++;
+
+   return(keyframe);
+}
+
+gboolean spectate_write(gint fd, const guint8 *data, gsize length){
+   while(length){
+      gssize written = write(fd, data, length);
+
+      if(written < 0 && errno == EINTR){
+         continue;
+      }
+
+      if(written <= 0){
+         return(FALSE);
+      }
+
+      data += written;
+      length -= written;
+   }
+
+   return(TRUE);
+}
+
+spectate_view *spectate_view_new(void){
+   spectate_view *new_view = g_new(spectate_view, 1);
+
+   new_view->synced = FALSE;
+   new_view->tick = 0;
+   new_view->width = 0;
+   new_view->height = 0;
+
+   new_view->palette = g_array_new(FALSE, FALSE, sizeof(board_cell));
+
+   return(new_view);
+}
+
+void spectate_view_free(spectate_view *view){
+   g_array_free(view->palette, TRUE);
+
+   g_free(view);
+}
+
+gboolean spectate_view_next(const guint8 *data, gsize size, gsize *offset,
+   const guint8 **body, guint32 *length){
+   const guint8 *next = data + *offset;
+   const guint8 *end = data + size;
+
+   if(!spectate_get_varint(&next, end, length) ||
+      *length > (guint32) (end - next)){
+      return(FALSE);
+   }
+
+   *body = next;
+   *offset = (next - data) + *length;
+
+   return(TRUE);
+}
+
+gboolean spectate_view_size(const guint8 *body, guint32 length, gint *width,
+   gint *height){
+   const guint8 *end = body + length;
+   guint32 kind, tick, value;
+
+   if(!spectate_get_varint(&body, end, &kind) || kind != SPECTATE_FRAME_KEY ||
+      !spectate_get_varint(&body, end, &tick) ||
+      !spectate_get_varint(&body, end, &value)){
+      return(FALSE);
+   }
+
+   *width = value;
+
+   if(!spectate_get_varint(&body, end, &value)){
+      return(FALSE);
+   }
+
+   *height = value;
+
+   return(TRUE);
+}
+
+gboolean spectate_view_apply(spectate_view *view, board *brd,
+   const guint8 *body, guint32 length){
+   const guint8 *end = body + length;
+   guint32 kind, tick, count, value;
+
+   if(!spectate_get_varint(&body, end, &kind) ||
+      !spectate_get_varint(&body, end, &tick)){
+      return(FALSE);
+   }
+
+   if(kind == SPECTATE_FRAME_KEY){
+      guint32 read_width, read_height;
+
+      if(!spectate_get_varint(&body, end, &read_width) ||
+         !spectate_get_varint(&body, end, &read_height) ||
+         read_width != brd->width || read_height != brd->height){
+         return(FALSE);
+      }
+
+      view->synced = TRUE;
+      view->width = read_width;
+      view->height = read_height;
+
+      g_array_set_size(view->palette, 0);
+   }else if(kind != SPECTATE_FRAME_DELTA){
+      return(FALSE);
+   }else if(!view->synced){
+      return(TRUE);
+   }
+
+   view->tick = tick;
+
+   if(!spectate_get_varint(&body, end, &count)){
+      return(FALSE);
+   }
+
+   for(guint32 i = 0; i < count; i++){
+      if(!spectate_get_varint(&body, end, &value)){
+         return(FALSE);
+      }
+
+      g_array_append_val(view->palette, value);
+   }
+
+   if(!spectate_get_varint(&body, end, &count)){
+      return(FALSE);
+   }
+
+   gint64 cells = (gint64)brd->width * brd->height;
+   gint64 cell_number = 0;
+
+   //keyframes only hold the cells differing from the background_color
+   if(kind == SPECTATE_FRAME_KEY){
+      board_clear(brd, TRUE);
+   }
+
+   for(guint32 i = 0; i < count; i++){
+      guint64 gap, run;
+      guint32 index;
+
+      if(!spectate_get_varint64(&body, end, &gap) ||
+         !spectate_get_varint64(&body, end, &run) ||
+         !spectate_get_varint(&body, end, &index) ||
+         index >= view->palette->len || gap > cells - cell_number ||
+         run > cells - cell_number - gap){
+         return(FALSE);
+      }
+
+      cell_number += gap;
+
+      board_cell value = g_array_index(view->palette, board_cell, index);
+
+      for(guint64 j = 0; j < run; j++, cell_number++){
+         board_set_cell(brd, cell_number % brd->width,
+            cell_number / brd->width, value);
+      }
+   }
+
+   return(TRUE);
+}
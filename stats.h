@@ -0,0 +1,443 @@
+//symbolic constants used by stats
+//
+//a stats file holds a row for every player of every game of a batch run,
+//see league --stats, laid out by column so that tens of millions of games
+//are read back without parsing any text.  the file starts with a
+//stats_header, which names the STATS_COLUMNS columns and gives the bytes
+//every value of each takes, 1 or 4.  blocks of up to STATS_BLOCK_ROWS rows
+//follow, each a guint32 of its rows and one of padding, then the values of
+//every column in turn, each column padded to 8 bytes.  values are little
+//endian
+//
+//rows are gathered in memory and written a block at a time.  a game is the
+//rows sharing its game number, the winners being those ranked 1
+//
+//stats only needs glib, so readers of the files include it alone
+#include <glib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+//"SNAFSTAT" in the first bytes of the file
+#define STATS_MAGIC "SNAFSTAT"
+
+//changes whenever the layout of the file or its columns do
+#define STATS_VERSION 1
+
+//rows a block holds at most
+#define STATS_BLOCK_ROWS 4096
+
+//bytes of the name of a column, nul padded
+#define STATS_NAME_LENGTH 16
+
+//death causes in the cause column, equal to SNAFU_DEATH_* as league checks
+//when it is compiled
+#define STATS_CAUSE_NONE 0
+#define STATS_CAUSE_WALL 1
+#define STATS_CAUSE_SELF 2
+#define STATS_CAUSE_OTHER 3
+
+//the columns, in the order they are stored
+//
+//game is the number of the game in the run and seed the seed it was played
+//with, game_ticks the iterations it lasted and players the players in it.
+//seat is the index of the player and controller what steered it, which
+//the program writing the file numbers.  ticks is the iteration the player
+//died in, or game_ticks if it survived, cells the cells its trail held at
+//the end, cause one of STATS_CAUSE_* and rank 1 for the winners, 1 more
+//than the players doing better for the others
+typedef enum _stats_column{
+   STATS_GAME,
+   STATS_SEED,
+   STATS_GAME_TICKS,
+   STATS_PLAYERS,
+   STATS_SEAT,
+   STATS_CONTROLLER,
+   STATS_TICKS,
+   STATS_CELLS,
+   STATS_CAUSE,
+   STATS_RANK,
+   STATS_COLUMNS
+} stats_column;
+
+//typedefs
+
+//a row as added, one field to every column
+typedef struct _stats_row{
+   guint32 game;       //number of the game
+   guint32 seed;       //seed of the game
+   guint32 game_ticks; //iterations of the game
+   guint8 players;     //players in the game
+   guint8 seat;        //index of the player
+   guint8 controller;  //what steered the player
+   guint32 ticks;      //iterations the player lasted
+   guint32 cells;      //cells of its trail at the end
+   guint8 cause;       //STATS_CAUSE_*
+   guint8 rank;        //place of the player, 1 for the winners
+} stats_row;
+
+//the header of a stats file, little endian
+typedef struct _stats_header{
+   gchar magic[8];          //STATS_MAGIC
+   guint32 version;         //STATS_VERSION
+   guint32 columns;         //STATS_COLUMNS
+   gchar names[STATS_COLUMNS][STATS_NAME_LENGTH]; //the names of the columns
+   guint32 widths[STATS_COLUMNS]; //bytes a value of every column
+} stats_header;
+
+//a stats file being written
+//
+//columns holds the values of the rows of the block being gathered, a
+//buffer of STATS_BLOCK_ROWS values for every column.  error is the errno
+//of the first write to fail
+//
+//stats must be freed with stats_free
+typedef struct _stats{
+   gint fd;                //the file written
+   guint rows;             //rows gathered
+   guint8 *columns[STATS_COLUMNS]; //the values gathered
+   gint error;             //errno of the first failed write, 0 if none
+} stats;
+
+//a block of a stats file read back
+//
+//columns points at the values of every column in the mapping of the file,
+//see stats_block_get
+typedef struct _stats_block{
+   guint rows;                     //rows in the block
+   const guint8 *columns[STATS_COLUMNS]; //the values of the columns
+} stats_block;
+
+//a stats file mapped to be read
+//
+//offset is the byte of map the next block starts at
+//
+//readers must be closed with stats_reader_close
+typedef struct _stats_reader{
+   gpointer map;           //the mapping of the file
+   gsize length;           //bytes mapped
+   gsize offset;           //the next block
+} stats_reader;
+
+
+/****
+ *stats functions
+ ****/
+
+//returns the name of column
+const gchar *stats_column_name(stats_column column);
+
+//returns the bytes a value of column takes, 1 or 4
+guint stats_column_width(stats_column column);
+
+//returns the bytes the values of rows rows of column take, padding
+//included
+gsize stats_column_length(stats_column column, guint rows);
+
+//returns stats writing to fd, which it closes when freed, the header
+//already written
+stats *stats_new(gint fd);
+
+//writes the rows gathered, closes the file and frees st.  returns FALSE
+//and sets errno if any of the file could not be written
+gboolean stats_free(stats *st);
+
+//adds row to st, writing the block out once it is full
+void stats_add(stats *st, const stats_row *row);
+
+//writes the rows gathered in st as a block
+void stats_flush(stats *st);
+
+//writes length bytes at data to the file of st, keeping the errno of the
+//first failure
+void stats_write(stats *st, gconstpointer data, gsize length);
+
+//maps the stats file at path, returns NULL and sets error if it cannot be
+//read or holds other columns
+stats_reader *stats_reader_open(const gchar *path, GError **error);
+
+//unmaps reader and frees it
+void stats_reader_close(stats_reader *reader);
+
+//points block at the next block of reader, returning FALSE after the last
+//one or at a block cut short
+gboolean stats_reader_next(stats_reader *reader, stats_block *block);
+
+//returns the value of column in row of block
+guint32 stats_block_get(const stats_block *block, stats_column column,
+   guint row);
+
+/********/
+
+const gchar *stats_column_name(stats_column column){
+   switch(column){
+      case(STATS_GAME):
+         return("game");
+      case(STATS_SEED):
+         return("seed");
+      case(STATS_GAME_TICKS):
+         return("game_ticks");
+      case(STATS_PLAYERS):
+         return("players");
+      case(STATS_SEAT):
+         return("seat");
+      case(STATS_CONTROLLER):
+         return("controller");
+      case(STATS_TICKS):
+         return("ticks");
+      case(STATS_CELLS):
+         return("cells");
+      case(STATS_CAUSE):
+         return("cause");
+      case(STATS_RANK):
+         return("rank");
+      default:
+         return(NULL);
+   }
+}
+
+guint stats_column_width(stats_column column){
+   switch(column){
+      case(STATS_PLAYERS):
+      case(STATS_SEAT):
+      case(STATS_CONTROLLER):
+      case(STATS_CAUSE):
+      case(STATS_RANK):
+         return(1);
+      default:
+         return(4);
+   }
+}
+
+gsize stats_column_length(stats_column column, guint rows){
+   return((((gsize) rows * stats_column_width(column)) + 7) & (~(gsize) 7));
+}
+
+stats *stats_new(gint fd){
+   stats *new_stats = g_new0(stats, 1);
+   stats_header header;
+
+   new_stats->fd = fd;
+
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      new_stats->columns[column] = g_malloc0(stats_column_length(column,
+         STATS_BLOCK_ROWS));
+   }
+
+   memset(&header, 0, sizeof(stats_header));
+   memcpy(header.magic, STATS_MAGIC, sizeof(header.magic));
+   header.version = GUINT32_TO_LE(STATS_VERSION);
+   header.columns = GUINT32_TO_LE(STATS_COLUMNS);
+
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      strncpy(header.names[column], stats_column_name(column),
+         STATS_NAME_LENGTH);
+      header.widths[column] = GUINT32_TO_LE(stats_column_width(column));
+   }
+
+   stats_write(new_stats, &header, sizeof(stats_header));
+
+   return(new_stats);
+}
+
+gboolean stats_free(stats *st){
+   stats_flush(st);
+
+   gint error = st->error;
+
+   if(close(st->fd) < 0 && !error){
+      error = errno;
+   }
+
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      g_free(st->columns[column]);
+   }
+
+   g_free(st);
+
+   errno = error;
+
+   return(!error);
+}
+
+void stats_add(stats *st, const stats_row *row){
+   guint32 values[STATS_COLUMNS] = {
+      row->game, row->seed, row->game_ticks, row->players, row->seat,
+      row->controller, row->ticks, row->cells, row->cause, row->rank
+   };
+
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      if(stats_column_width(column) == 1){
+         *(st->columns[column] + st->rows) = values[column];
+      }else{
+         guint32 value = GUINT32_TO_LE(values[column]);
+
+         memcpy(st->columns[column] + (st->rows * 4), &value, 4);
+      }
+   }
+
+   if(++st->rows == STATS_BLOCK_ROWS){
+      stats_flush(st);
+   }
+}
+
+void stats_flush(stats *st){
+   guint32 rows[2] = {GUINT32_TO_LE(st->rows), 0};
+
+   if(!st->rows){
+      return;
+   }
+
+   stats_write(st, rows, sizeof(rows));
+
+   //values of bigger blocks may be left in the padding
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      gsize length = stats_column_length(column, st->rows);
+
+      memset(st->columns[column] + (st->rows * stats_column_width(column)),
+         0, length - (st->rows * stats_column_width(column)));
+
+      stats_write(st, st->columns[column], length);
+   }
+
+   st->rows = 0;
+}
+
+void stats_write(stats *st, gconstpointer data, gsize length){
+   const guint8 *bytes = data;
+
+   while(length && !st->error){
+      gssize done = write(st->fd, bytes, length);
+
+      if(done < 0 && errno == EINTR){
+         continue;
+      }
+
+      if(done < 0){
+         st->error = errno;
+
+         break;
+      }
+
+      bytes += done;
+      length -= done;
+   }
+}
+
+stats_reader *stats_reader_open(const gchar *path, GError **error){
+   gint fd = open(path, O_RDONLY);
+   struct stat status;
+
+   if(fd < 0 || fstat(fd, &status) < 0){
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+         "cannot open %s: %s", path, g_strerror(errno));
+
+      if(fd >= 0){
+         close(fd);
+      }
+
+      return(NULL);
+   }
+
+   if(status.st_size < sizeof(stats_header)){
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+         "%s is not a stats file", path);
+      close(fd);
+
+      return(NULL);
+   }
+
+   gpointer map = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+   //the mapping stays once the file is closed
+   close(fd);
+
+   if(map == MAP_FAILED){
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+         "cannot map %s: %s", path, g_strerror(errno));
+
+      return(NULL);
+   }
+
+   const stats_header *header = map;
+   gboolean matches = !memcmp(header->magic, STATS_MAGIC,
+      sizeof(header->magic)) && GUINT32_FROM_LE(header->version) ==
+      STATS_VERSION && GUINT32_FROM_LE(header->columns) == STATS_COLUMNS;
+
+   for(gint column = 0; matches && column < STATS_COLUMNS; column++){
+      matches = !strncmp(header->names[column], stats_column_name(column),
+         STATS_NAME_LENGTH) && GUINT32_FROM_LE(header->widths[column]) ==
+         stats_column_width(column);
+   }
+
+   if(!matches){
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+         "%s is not a stats file of this version", path);
+      munmap(map, status.st_size);
+
+      return(NULL);
+   }
+
+   stats_reader *reader = g_new(stats_reader, 1);
+
+   reader->map = map;
+   reader->length = status.st_size;
+   reader->offset = sizeof(stats_header);
+
+   return(reader);
+}
+
+void stats_reader_close(stats_reader *reader){
+   munmap(reader->map, reader->length);
+
+   g_free(reader);
+}
+
+gboolean stats_reader_next(stats_reader *reader, stats_block *block){
+   const guint8 *start = (const guint8 *) reader->map + reader->offset;
+   gsize left = reader->length - reader->offset, length = 8;
+   guint32 rows;
+
+   if(left < 8){
+      return(FALSE);
+   }
+
+   memcpy(&rows, start, sizeof(rows));
+   block->rows = GUINT32_FROM_LE(rows);
+
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      length += stats_column_length(column, block->rows);
+   }
+
+   //a run stopped while writing leaves its last block short
+   if(!block->rows || block->rows > STATS_BLOCK_ROWS || length > left){
+      return(FALSE);
+   }
+
+   length = 8;
+
+   for(gint column = 0; column < STATS_COLUMNS; column++){
+      block->columns[column] = start + length;
+      length += stats_column_length(column, block->rows);
+   }
+
+   reader->offset += length;
+
+   return(TRUE);
+}
+
+guint32 stats_block_get(const stats_block *block, stats_column column,
+   guint row){
+   guint32 value;
+
+   if(stats_column_width(column) == 1){
+      return(*(block->columns[column] + row));
+   }
+
+   memcpy(&value, block->columns[column] + (row * 4), 4);
+
+   return(GUINT32_FROM_LE(value));
+}
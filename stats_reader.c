@@ -0,0 +1,172 @@
+/******************************************************************************
+Title         : New SNAFU Stats Reader
+Description   : Reads the columnar stats files written by league --stats, a
+                block at a time straight from the mapped file.  Prints how
+                many games and players it holds and, for every controller,
+                the players it steered, their wins, mean ticks and rank and
+                what they died of.  --csv prints every row instead.
+Usage         : stats-reader [--csv] FILE
+                Controllers are numbered as league registers them:  crude,
+                random, reach, space and solver from 0.
+Build with    : gcc -o stats-reader -std=c99 -Wall -g stats_reader.c \
+   `pkg-config --cflags --libs glib-2.0`
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+//controllers told apart in the summary
+#define NUMBER_CONTROLLERS 256
+
+//death causes told apart in the summary
+#define NUMBER_CAUSES 4
+
+//typedefs
+
+//the summary of a controller
+typedef struct _summary{
+   guint64 players;    //players steered
+   guint64 wins;       //players ranked 1
+   guint64 ticks;      //ticks lasted, summed
+   guint64 ranks;      //ranks, summed
+   guint64 causes[NUMBER_CAUSES]; //players dying of every cause
+} summary;
+
+//command line options
+static gboolean print_csv = FALSE;
+
+static GOptionEntry options[] = {
+   {"csv", 0, 0, G_OPTION_ARG_NONE, &print_csv,
+      "Print every row as comma separated values", NULL},
+   {NULL}
+};
+
+//prints the rows of block as comma separated values
+void print_rows(const stats_block *block);
+
+//adds the rows of block to summaries
+void summarize(const stats_block *block, summary *summaries);
+
+//main function
+int main(int argc, char *argv[]){
+   GError *error = NULL;
+   GOptionContext *context = g_option_context_new(
+      "FILE - read the stats of a league");
+
+   g_option_context_add_main_entries(context, options, NULL);
+
+   if(!g_option_context_parse(context, &argc, &argv, &error)){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   g_option_context_free(context);
+
+   if(argc < 2){
+      g_printerr("no stats file given\n");
+      return(1);
+   }
+
+   stats_reader *reader = stats_reader_open(argv[1], &error);
+
+   if(reader == NULL){
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return(1);
+   }
+
+   summary *summaries = g_new0(summary, NUMBER_CONTROLLERS);
+   stats_block block;
+   guint64 rows = 0, games = 0;
+
+   if(print_csv){
+      for(gint column = 0; column < STATS_COLUMNS; column++){
+         printf("%s%c", stats_column_name(column),
+            column + 1 < STATS_COLUMNS?',':'\n');
+      }
+   }
+
+   while(stats_reader_next(reader, &block)){
+      if(print_csv){
+         print_rows(&block);
+      }
+
+      summarize(&block, summaries);
+
+      //every game has a row for its first seat
+      for(guint row = 0; row < block.rows; row++){
+         games += stats_block_get(&block, STATS_SEAT, row) == 0;
+      }
+
+      rows += block.rows;
+   }
+
+   if(reader->offset != reader->length){
+      g_printerr("%s ends in a block cut short\n", argv[1]);
+   }
+
+   stats_reader_close(reader);
+
+   if(!print_csv){
+      printf("%" G_GUINT64_FORMAT " games, %" G_GUINT64_FORMAT " players\n",
+         games, rows);
+      printf("controller  players     wins   ticks  rank    wall    self   "
+         "other\n");
+
+      for(guint i = 0; i < NUMBER_CONTROLLERS; i++){
+         summary *totals = summaries + i;
+
+         if(!totals->players){
+            continue;
+         }
+
+         printf("%10u %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+            " %7.1f %5.2f %7" G_GUINT64_FORMAT " %7" G_GUINT64_FORMAT " %7"
+            G_GUINT64_FORMAT "\n", i, totals->players, totals->wins,
+            (gdouble) totals->ticks / totals->players,
+            (gdouble) totals->ranks / totals->players,
+            totals->causes[STATS_CAUSE_WALL],
+            totals->causes[STATS_CAUSE_SELF],
+            totals->causes[STATS_CAUSE_OTHER]);
+      }
+   }
+
+   g_free(summaries);
+
+   return(0);
+}
+
+void print_rows(const stats_block *block){
+   for(guint row = 0; row < block->rows; row++){
+      for(gint column = 0; column < STATS_COLUMNS; column++){
+         printf("%u%c", stats_block_get(block, column, row),
+            column + 1 < STATS_COLUMNS?',':'\n');
+      }
+   }
+}
+
+void summarize(const stats_block *block, summary *summaries){
+   //a column at a time, the way the values lie in the file
+   const guint8 *controllers = block->columns[STATS_CONTROLLER];
+   const guint8 *ranks = block->columns[STATS_RANK];
+   const guint8 *causes = block->columns[STATS_CAUSE];
+
+   for(guint row = 0; row < block->rows; row++){
+      summary *totals = summaries + *(controllers + row);
+
+      totals->players++;
+      totals->wins += *(ranks + row) == 1;
+      totals->ranks += *(ranks + row);
+      totals->causes[*(causes + row) % NUMBER_CAUSES]++;
+   }
+
+   for(guint row = 0; row < block->rows; row++){
+      (summaries + *(controllers + row))->ticks +=
+         stats_block_get(block, STATS_TICKS, row);
+   }
+}
@@ -0,0 +1,327 @@
+//symbolic constants used by the spectator wall
+//
+//a wall shows a grid of games of ai players at once in one GtkDrawingArea.
+//the games are stepped on worker threads, every game behind its own lock,
+//and the main thread copies the cells each game changed straight into the
+//pixels of one shared cairo image surface, cell_size pixels to a cell side,
+//so an expose only paints that surface.  games start over a moment after
+//they end
+//
+//the wall needs board.h, regions.h, arena.h and snafu.h first and the GTK 
+//frontend
+
+//milliseconds between copies of the changed cells to the surface
+#define WALL_REFRESH 33
+
+//iterations a game which ended stays on the wall before starting over
+#define WALL_RESTART_TICKS 24
+
+//pixels between the games on the wall
+#define WALL_GAP 2
+
+//a game on the wall
+//
+//lock guards game and cleared.  cleared is set when the board of game was
+//cleared without marking its cells changed, so its whole tile needs to be
+//copied.  idle_ticks counts the iterations since game ended
+typedef struct _wall_game{
+   snafu *game;        //the game
+   GMutex lock;        //guards game and cleared
+   gboolean cleared;   //whether the whole tile needs copying
+   guint idle_ticks;   //iterations since the game ended
+} wall_game;
+
+struct _wall;
+
+//a thread stepping every number_workers-th game of a wall starting at
+//number
+typedef struct _wall_worker{
+   struct _wall *owner; //the wall of the games
+   guint number;        //the first game stepped
+   GThread *thread;     //the thread
+} wall_worker;
+
+//the wall
+//
+//the games are laid out columns across and rows down, every game taking a
+//tile of tile_width by tile_height pixels.  running is cleared to stop the
+//workers and refresh_ref is the timeout copying changed cells to surface
+//
+//walls must be freed with wall_free, which also stops the workers
+typedef struct _wall{
+   guint number_games;     //games on the wall
+   wall_game *games;       //the games
+   gint columns;           //games across
+   gint rows;              //games down
+   gint cell_size;         //pixels to a cell side
+   gint tile_width;        //pixels across a game
+   gint tile_height;       //pixels down a game
+   guint frequency;        //milliseconds between iterations of every game
+   cairo_surface_t *surface; //every game as drawn
+   GtkWidget *widget;      //the GtkDrawingArea showing surface
+   guint number_workers;   //threads stepping the games
+   wall_worker *workers;   //the threads
+   volatile gint running;  //cleared to stop the workers
+   guint refresh_ref;      //the timeout copying changed cells
+} wall;
+
+
+/****
+ *wall functions
+ ****/
+
+//returns a wall of number_games games of number_players ai players on
+//boards of width by height cells, trails limited to max_length cells, 0 for
+//no limit.  the games advance every frequency milliseconds on
+//number_workers threads, 0 for one per processor.  cells are made as large
+//as fits a wall of at most max_width by max_height pixels, at least 1 pixel
+//the games start right away, wall->widget is to be added to a window
+wall *wall_new(guint number_games, gint width, gint height,
+   guint number_players, guint max_length, guint frequency,
+   guint number_workers, gint max_width, gint max_height);
+
+//stops the workers and frees w and its games
+//wall->widget is left to its container
+void wall_free(wall *w);
+
+//GThreadFunc of a wall_worker, stepping its games until the wall stops
+gpointer wall_worker_run(wall_worker *worker);
+
+//steps game once, starting it over WALL_RESTART_TICKS iterations after it
+//ended.  the lock of game must be held
+void wall_game_step(wall_game *game);
+
+//GSourceFunc copying the cells changed in every game to w->surface and
+//queueing a redraw when any did
+gboolean wall_refresh(wall *w);
+
+//copies cell i of the game numbered number to w->surface
+void wall_draw_cell(wall *w, guint number, gint i);
+
+//expose-event handler of w->widget, painting w->surface
+gboolean wall_expose(GtkWidget *widget, GdkEventExpose *event, wall *w);
+
+/********/
+
+wall *wall_new(guint number_games, gint width, gint height,
+   guint number_players, guint max_length, guint frequency,
+   guint number_workers, gint max_width, gint max_height){
+   wall *new_wall = g_new(wall, 1);
+
+   new_wall->number_games = MAX(number_games, 1);
+   new_wall->frequency = MAX(frequency, 1);
+
+   //as square a grid as the games fill
+   new_wall->columns = 1;
+
+   while(new_wall->columns * new_wall->columns < new_wall->number_games){
+      new_wall->columns++;
+   }
+
+   new_wall->rows = (new_wall->number_games + new_wall->columns - 1) /
+      new_wall->columns;
+
+   new_wall->cell_size = MAX(MIN(
+      (max_width - (WALL_GAP * (new_wall->columns - 1))) /
+      (new_wall->columns * width),
+      (max_height - (WALL_GAP * (new_wall->rows - 1))) /
+      (new_wall->rows * height)), 1);
+
+   new_wall->tile_width = width * new_wall->cell_size;
+   new_wall->tile_height = height * new_wall->cell_size;
+
+   gint surface_width = (new_wall->columns * (new_wall->tile_width +
+      WALL_GAP)) - WALL_GAP;
+   gint surface_height = (new_wall->rows * (new_wall->tile_height +
+      WALL_GAP)) - WALL_GAP;
+
+   //the gaps stay black, new image surfaces being cleared
+   new_wall->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+      surface_width, surface_height);
+
+   new_wall->widget = gtk_drawing_area_new();
+   gtk_widget_set_size_request(new_wall->widget, surface_width,
+      surface_height);
+
+   g_signal_connect(new_wall->widget, "expose-event",
+      G_CALLBACK(wall_expose), new_wall);
+
+   new_wall->games = g_new(wall_game, new_wall->number_games);
+
+   for(guint k = 0; k < new_wall->number_games; k++){
+      wall_game *game = new_wall->games + k;
+      board *play_area = board_new(NULL, width, height, 1, 1,
+         board_cell_new_with_color(128, 128, 128));
+
+      game->game = snafu_new(play_area, number_players, frequency);
+      game->cleared = TRUE;
+      game->idle_ticks = 0;
+
+      g_mutex_init(&game->lock);
+
+      snafu_set_max_length(game->game, max_length);
+      snafu_set_seed(game->game, k);
+      snafu_begin(game->game);
+   }
+
+   new_wall->number_workers = MIN(number_workers?number_workers:
+      g_get_num_processors(), new_wall->number_games);
+   new_wall->workers = g_new(wall_worker, new_wall->number_workers);
+   new_wall->running = TRUE;
+
+   for(guint k = 0; k < new_wall->number_workers; k++){
+      wall_worker *worker = new_wall->workers + k;
+
+      worker->owner = new_wall;
+      worker->number = k;
+      worker->thread = g_thread_new("wall", (GThreadFunc) wall_worker_run,
+         worker);
+   }
+
+   new_wall->refresh_ref = g_timeout_add(WALL_REFRESH,
+      (GSourceFunc) wall_refresh, new_wall);
+
+   return(new_wall);
+}
+
+void wall_free(wall *w){
+   g_atomic_int_set(&w->running, FALSE);
+
+   for(guint k = 0; k < w->number_workers; k++){
+      g_thread_join((w->workers + k)->thread);
+   }
+
+   g_source_remove(w->refresh_ref);
+
+   for(guint k = 0; k < w->number_games; k++){
+      wall_game *game = w->games + k;
+      board *play_area = game->game->play_area;
+
+      snafu_free(game->game);
+      board_free(play_area);
+
+      g_mutex_clear(&game->lock);
+   }
+
+   cairo_surface_destroy(w->surface);
+
+   g_free(w->workers);
+   g_free(w->games);
+   g_free(w);
+}
+
+gpointer wall_worker_run(wall_worker *worker){
+   wall *w = worker->owner;
+
+   while(g_atomic_int_get(&w->running)){
+      gint64 start = g_get_monotonic_time();
+
+      for(guint k = worker->number; k < w->number_games;
+         k += w->number_workers){
+         wall_game *game = w->games + k;
+
+         g_mutex_lock(&game->lock);
+         wall_game_step(game);
+         g_mutex_unlock(&game->lock);
+      }
+
+      gint64 left = (w->frequency * 1000) - (g_get_monotonic_time() - start);
+
+      if(left > 0){
+         g_usleep(left);
+      }
+   }
+
+   return(NULL);
+}
+
+void wall_game_step(wall_game *game){
+   if(game->game->active){
+      snafu_step(game->game);
+      return;
+   }
+
+   if(++game->idle_ticks < WALL_RESTART_TICKS){
+      return;
+   }
+
+   //snafu_end clears the board without marking the cells changed
+   snafu_end(game->game);
+   snafu_begin(game->game);
+
+   game->cleared = TRUE;
+   game->idle_ticks = 0;
+}
+
+gboolean wall_refresh(wall *w){
+   gboolean changed = FALSE;
+
+   cairo_surface_flush(w->surface);
+
+   for(guint k = 0; k < w->number_games; k++){
+      wall_game *game = w->games + k;
+      board *play_area = game->game->play_area;
+
+      g_mutex_lock(&game->lock);
+
+      if(game->cleared){
+         for(gint i = 0; i < play_area->width * play_area->height; i++){
+            wall_draw_cell(w, k, i);
+         }
+
+         game->cleared = FALSE;
+         changed = TRUE;
+      }else{
+         for(guint j = 0; j < play_area->changed_cells->len; j++){
+            wall_draw_cell(w, k, g_array_index(play_area->changed_cells,
+               gint64, j));
+         }
+
+         changed |= play_area->changed_cells->len != 0;
+      }
+
+      board_forget_changes(play_area);
+
+      g_mutex_unlock(&game->lock);
+   }
+
+   if(changed){
+      cairo_surface_mark_dirty(w->surface);
+      gtk_widget_queue_draw(w->widget);
+   }
+
+   return(TRUE);
+}
+
+void wall_draw_cell(wall *w, guint number, gint i){
+   board *play_area = (w->games + number)->game->play_area;
+   gint stride = cairo_image_surface_get_stride(w->surface);
+
+   //RGB24 pixels hold the color in the same low 24 bits as board_cells
+   guint32 color = board_read_cell(play_area, i) & (~BOARD_CELL_FLAGS_MASK);
+   gint x = ((number % w->columns) * (w->tile_width + WALL_GAP)) +
+      ((i % play_area->width) * w->cell_size);
+   gint y = ((number / w->columns) * (w->tile_height + WALL_GAP)) +
+      ((i / play_area->width) * w->cell_size);
+   guint8 *row = cairo_image_surface_get_data(w->surface) + (stride * y) +
+      (sizeof(guint32) * x);
+
+   for(gint dy = 0; dy < w->cell_size; dy++){
+      guint32 *pixel = (guint32 *) (row + (stride * dy));
+
+      for(gint dx = 0; dx < w->cell_size; dx++){
+         *(pixel + dx) = color;
+      }
+   }
+}
+
+gboolean wall_expose(GtkWidget *widget, GdkEventExpose *event, wall *w){
+   cairo_t *cr = gdk_cairo_create(widget->window);
+
+   cairo_set_source_surface(cr, w->surface, 0, 0);
+   cairo_paint(cr);
+
+   cairo_destroy(cr);
+
+   return(TRUE);
+}
@@ -0,0 +1,408 @@
+//symbolic constants used by writers
+//
+//a writer puts the records of a game to a file on a thread of its own, so
+//the game never waits for the disk.  records all have the size the writer
+//was made with.  the game pushes them into a ring, which the thread drains
+//into a buffer written out WRITER_BATCH bytes at a time, deflated to gzip
+//when asked for
+//
+//the ring has one producer and one consumer and takes no lock.  the game
+//alone moves head and the thread alone moves tail, each reading the other
+//with an atomic load.  a push into a full ring drops the record rather
+//than wait, and the writer counts the records dropped and the most ever
+//waiting in the ring, so a recording slowing a game shows up as drops
+//rather than stalls
+//
+//replays are recorded as writer_replays, see snafu --record
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <zlib.h>
+
+//bytes gathered from the ring before they are written
+#define WRITER_BATCH (1 << 16)
+
+//the longest the thread sleeps before draining the ring, and the longest
+//records wait in the buffer before being written, in microseconds
+#define WRITER_IDLE_USEC 5000
+#define WRITER_FLUSH_USEC 1000000
+
+//records a ring of a writer holds by default
+#define WRITER_CAPACITY 4096
+
+//the kinds of writer_replays
+//
+//a replay starts with a WRITER_REPLAY_GAME holding the size of the board
+//in x and y, the players in player and the max_length of the game in
+//value.  a WRITER_REPLAY_PLAYER follows for every player, with its first
+//cell in x and y and the board_cell of its trail in value, and a
+//WRITER_REPLAY_WALL for every static wall cell.  then every iteration
+//records a WRITER_REPLAY_HEAD with the new cell and direction of every
+//living player and a WRITER_REPLAY_DEATH for every player dying in it.  a
+//WRITER_REPLAY_END with the winner in player, or G_MAXUINT8 for none,
+//closes the game
+//
+//the records before the first iteration are waited for rather than
+//dropped.  records dropped later are marked by a WRITER_REPLAY_DROPPED in
+//front of the next record kept, with the number dropped in value, so a
+//reader knows the game after it is missing cells
+typedef enum _writer_replay_kind{
+   WRITER_REPLAY_GAME = 1,
+   WRITER_REPLAY_PLAYER,
+   WRITER_REPLAY_WALL,
+   WRITER_REPLAY_HEAD,
+   WRITER_REPLAY_DEATH,
+   WRITER_REPLAY_END,
+   WRITER_REPLAY_DROPPED
+} writer_replay_kind;
+
+//typedefs
+
+//a record of a replay, little endian
+typedef struct _writer_replay{
+   guint32 tick;     //the iteration of the game
+   guint8 kind;      //writer_replay_kind
+   guint8 player;    //the index of the player
+   guint8 direction; //snafu_player_direction of the player
+   guint8 pad;       //0
+   guint16 x;        //column
+   guint16 y;        //row
+   guint32 value;    //depends on kind
+} writer_replay;
+
+//a writer
+//
+//records holds capacity records of record_size bytes, capacity being a
+//power of two.  head counts the records pushed and tail those taken by the
+//thread, each on a cache line of its own so the two sides do not slow each
+//other down.  dropped, dropped_marked and high_water are only written by
+//the game
+//
+//buffer holds used bytes waiting to be written to fd, through stream and
+//deflated when compress is set.  error is the errno of the first write to
+//fail, after which the thread takes records without writing them.  quit
+//stops the thread once the ring is empty
+//
+//writers must be freed with writer_free
+typedef struct _writer{
+   guint8 *records;        //the ring
+   guint record_size;      //bytes a record
+   guint capacity;         //records the ring holds
+   volatile gint head;     //records pushed
+   gchar head_pad[64 - sizeof(gint)];
+   volatile gint tail;     //records taken
+   gchar tail_pad[64 - sizeof(gint)];
+   guint dropped;          //records dropped with the ring full
+   guint dropped_marked;   //drops marked by a WRITER_REPLAY_DROPPED
+   guint high_water;       //most records ever waiting in the ring
+   gint fd;                //the file written
+   gboolean compress;      //whether the file is gzip
+   z_stream stream;        //the deflate stream when compress is set
+   guint8 *buffer;         //records gathered
+   gsize used;             //bytes in buffer
+   guint8 *deflated;       //output of stream
+   volatile gint error;    //errno of the first failed write, 0 if none
+   volatile gint quit;     //set to stop the thread
+   GMutex lock;            //guards sleeping on wake
+   GCond wake;             //signalled when the ring fills up
+   GThread *thread;        //the thread writing
+} writer;
+
+
+/****
+ *writer functions
+ ****/
+
+//returns a writer of records of record_size bytes to fd, which it closes
+//when freed, through a ring of capacity records rounded up to a power of
+//two.  the file is gzip if compress is TRUE
+writer *writer_new(gint fd, guint record_size, guint capacity,
+   gboolean compress);
+
+//writes what is left in the ring of writing, closes its file and frees it.
+//returns FALSE and sets errno if any of the file could not be written
+gboolean writer_free(writer *writing);
+
+//copies the record_size bytes at record into the ring of writing.  returns
+//FALSE, counting the record as dropped, if the ring is full.  called on
+//the one thread producing records, never waits
+gboolean writer_push(writer *writing, gconstpointer record);
+
+//waits until the ring of writing has room for room records, waking the
+//thread to drain it.  called on the one thread producing records
+void writer_wait(writer *writing, guint room);
+
+//pushes a WRITER_REPLAY_DROPPED at tick to writing if records were dropped
+//since the last one.  returns FALSE if it was dropped itself
+gboolean writer_mark_dropped(writer *writing, guint tick);
+
+//pushes a writer_replay of kind for player at tick, with x, y, direction
+//and value, to writing, marking the records dropped since the last one
+//kept.  waits for room for the records before the first iteration
+gboolean writer_push_replay(writer *writing, guint tick,
+   writer_replay_kind kind, guint player, guint x, guint y,
+   guint direction, guint32 value);
+
+//GThreadFunc of a writer, writing the records pushed until it quits
+gpointer writer_run(writer *writing);
+
+//writes the buffer of writing to its file, ending the gzip stream if
+//finish is TRUE
+void writer_flush(writer *writing, gboolean finish);
+
+//writes length bytes at data to the file of writing, keeping the errno of
+//the first failure
+void writer_write(writer *writing, const guint8 *data, gsize length);
+
+/********/
+
+writer *writer_new(gint fd, guint record_size, guint capacity,
+   gboolean compress){
+   writer *new_writer = g_new0(writer, 1);
+
+   new_writer->record_size = record_size;
+   new_writer->capacity = 1u << g_bit_storage(MAX(capacity, 2) - 1);
+   new_writer->records = g_malloc(new_writer->capacity * record_size);
+   new_writer->fd = fd;
+   new_writer->compress = compress;
+   new_writer->buffer = g_malloc(WRITER_BATCH);
+
+   //windowBits above 15 asks zlib for a gzip header and trailer
+   if(compress){
+      new_writer->deflated = g_malloc(WRITER_BATCH);
+
+      if(deflateInit2(&new_writer->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+         15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+         new_writer->error = ENOMEM;
+      }
+   }
+
+   g_mutex_init(&new_writer->lock);
+   g_cond_init(&new_writer->wake);
+
+   new_writer->thread = g_thread_new("writer", (GThreadFunc) writer_run,
+      new_writer);
+
+   return(new_writer);
+}
+
+gboolean writer_free(writer *writing){
+   g_atomic_int_set(&writing->quit, 1);
+
+   g_mutex_lock(&writing->lock);
+   g_cond_signal(&writing->wake);
+   g_mutex_unlock(&writing->lock);
+
+   g_thread_join(writing->thread);
+
+   if(writing->compress){
+      deflateEnd(&writing->stream);
+   }
+
+   gint error = writing->error;
+
+   if(close(writing->fd) < 0 && !error){
+      error = errno;
+   }
+
+   g_mutex_clear(&writing->lock);
+   g_cond_clear(&writing->wake);
+
+   g_free(writing->records);
+   g_free(writing->buffer);
+   g_free(writing->deflated);
+   g_free(writing);
+
+   errno = error;
+
+   return(!error);
+}
+
+gboolean writer_push(writer *writing, gconstpointer record){
+   guint head = writing->head;
+   guint waiting = head - (guint) g_atomic_int_get(&writing->tail);
+
+   if(waiting == writing->capacity){
+      writing->dropped++;
+
+      return(FALSE);
+   }
+
+   memcpy(writing->records + ((head & (writing->capacity - 1)) *
+      writing->record_size), record, writing->record_size);
+
+   //the record is in the ring before the thread can see head move past it
+   g_atomic_int_set(&writing->head, (gint) (head + 1));
+
+   writing->high_water = MAX(writing->high_water, waiting + 1);
+
+   //the thread would otherwise only find out once it wakes up by itself
+   if(waiting + 1 == writing->capacity / 2){
+      g_cond_signal(&writing->wake);
+   }
+
+   return(TRUE);
+}
+
+void writer_wait(writer *writing, guint room){
+   while(writing->capacity - (writing->head - 
+      (guint) g_atomic_int_get(&writing->tail)) < room){
+      g_mutex_lock(&writing->lock);
+      g_cond_signal(&writing->wake);
+      g_mutex_unlock(&writing->lock);
+
+      g_thread_yield();
+   }
+}
+
+gboolean writer_mark_dropped(writer *writing, guint tick){
+   guint dropped = writing->dropped;
+
+   if(dropped == writing->dropped_marked){
+      return(TRUE);
+   }
+
+   writer_replay mark = {GUINT32_TO_LE(tick), WRITER_REPLAY_DROPPED, 0, 0, 0,
+      0, 0, GUINT32_TO_LE(dropped - writing->dropped_marked)};
+
+   if(!writer_push(writing, &mark)){
+      return(FALSE);
+   }
+
+   writing->dropped_marked = dropped;
+
+   return(TRUE);
+}
+
+gboolean writer_push_replay(writer *writing, guint tick,
+   writer_replay_kind kind, guint player, guint x, guint y,
+   guint direction, guint32 value){
+   writer_replay record;
+
+   //room for the record and the mark in front of it
+   if(kind < WRITER_REPLAY_HEAD){
+      writer_wait(writing, 2);
+   }
+
+   //the mark failing counts as the drop of the record
+   if(!writer_mark_dropped(writing, tick)){
+      return(FALSE);
+   }
+
+   record.tick = GUINT32_TO_LE(tick);
+   record.kind = kind;
+   record.player = player;
+   record.direction = direction;
+   record.pad = 0;
+   record.x = GUINT16_TO_LE(x);
+   record.y = GUINT16_TO_LE(y);
+   record.value = GUINT32_TO_LE(value);
+
+   return(writer_push(writing, &record));
+}
+
+gpointer writer_run(writer *writing){
+   gint64 flushed = g_get_monotonic_time();
+
+   while(TRUE){
+      gboolean quit = g_atomic_int_get(&writing->quit);
+      guint tail = writing->tail;
+      guint head = g_atomic_int_get(&writing->head);
+
+      if(head == tail){
+         //quit was read before head, so nothing pushed before it is lost
+         if(quit){
+            break;
+         }
+
+         if(writing->used && g_get_monotonic_time() - flushed >=
+            WRITER_FLUSH_USEC){
+            writer_flush(writing, FALSE);
+            flushed = g_get_monotonic_time();
+         }
+
+         g_mutex_lock(&writing->lock);
+
+         if(!g_atomic_int_get(&writing->quit)){
+            g_cond_wait_until(&writing->wake, &writing->lock,
+               g_get_monotonic_time() + WRITER_IDLE_USEC);
+         }
+
+         g_mutex_unlock(&writing->lock);
+
+         continue;
+      }
+
+      //as many records as fit in the buffer, up to the end of the ring
+      guint start = tail & (writing->capacity - 1);
+      guint count = MIN(head - tail, writing->capacity - start);
+
+      count = MIN(count, (WRITER_BATCH - writing->used) /
+         writing->record_size);
+
+      memcpy(writing->buffer + writing->used, writing->records +
+         (start * writing->record_size), count * writing->record_size);
+
+      writing->used += count * writing->record_size;
+
+      //the records are copied out before the game can write over them
+      g_atomic_int_set(&writing->tail, (gint) (tail + count));
+
+      if(WRITER_BATCH - writing->used < writing->record_size){
+         writer_flush(writing, FALSE);
+         flushed = g_get_monotonic_time();
+      }
+   }
+
+   writer_flush(writing, TRUE);
+
+   return(NULL);
+}
+
+void writer_flush(writer *writing, gboolean finish){
+   if(!writing->compress){
+      writer_write(writing, writing->buffer, writing->used);
+      writing->used = 0;
+
+      return;
+   }
+
+   z_stream *stream = &writing->stream;
+
+   stream->next_in = writing->buffer;
+   stream->avail_in = writing->used;
+
+   //deflate until it takes all of the buffer, and its trailer is out
+   do{
+      stream->next_out = writing->deflated;
+      stream->avail_out = WRITER_BATCH;
+
+      if(!writing->error){
+         deflate(stream, finish?Z_FINISH:Z_NO_FLUSH);
+      }
+
+      writer_write(writing, writing->deflated, WRITER_BATCH -
+         stream->avail_out);
+   }while(!writing->error && (stream->avail_in || !stream->avail_out));
+
+   writing->used = 0;
+}
+
+void writer_write(writer *writing, const guint8 *data, gsize length){
+   while(length && !writing->error){
+      gssize done = write(writing->fd, data, length);
+
+      if(done < 0 && errno == EINTR){
+         continue;
+      }
+
+      if(done < 0){
+         g_atomic_int_set(&writing->error, errno);
+
+         break;
+      }
+
+      data += done;
+      length -= done;
+   }
+}